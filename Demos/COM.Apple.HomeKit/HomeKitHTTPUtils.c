@@ -29,6 +29,7 @@
 #include "platform_config.h"
 #include "SocketUtils.h"
 #include "MICOCrypto/crypto_aead_chacha20poly1305.h"
+#include "MICORTOS.h"
 
 #define min(a,b) ((a) < (b) ? (a) : (b))
 #define max(a,b) ((a) > (b) ? (a) : (b))
@@ -38,148 +39,274 @@
 
 #define kMIMEType_HAP_JSON   "application/hap+json"
 
+/* Smallest piece worth a frame of its own when the transmit buffer is almost full */
+#define HKFrameMinChunk      64
+
+/* A frame is held across the socket write of one message, one per session so a controller
+   that stops reading never holds up the others */
+#define HKTxFramePoolSize    HKMaxSessions
+#define HKTxFrameSize        (HKFrameLength + HKFrameOverhead)
+#define HKTxFrameWaitTime    10000
+
 extern bool verify_otp(void);
 
 #define hkhttp_utils_log(M, ...) custom_log("HKHTTPUtils", M, ##__VA_ARGS__)
 
 static volatile uint32_t flashStorageAddress = UPDATE_START_ADDRESS;
 
+static uint8_t          txFramePool[HKTxFramePoolSize][HKTxFrameSize];
+static bool             txFrameUsed[HKTxFramePoolSize];
+static mico_mutex_t     txFrameMutex = NULL;
+static mico_semaphore_t txFrameSem = NULL;
+
+void HKSecureInit(void)
+{
+  int i;
+
+  if(txFrameMutex) return;
+  mico_rtos_init_mutex(&txFrameMutex);
+  mico_rtos_init_semaphore(&txFrameSem, HKTxFramePoolSize);
+  for(i = 0; i < HKTxFramePoolSize; i++)
+    mico_rtos_set_semaphore(&txFrameSem);
+}
+
+static uint8_t *_HKTxFrameTake(void)
+{
+  uint8_t *frame = NULL;
+  int i;
+
+  require_quiet(txFrameMutex, exit);
+  require_quiet(mico_rtos_get_semaphore(&txFrameSem, HKTxFrameWaitTime) == kNoErr, exit);
+
+  mico_rtos_lock_mutex(&txFrameMutex);
+  for(i = 0; i < HKTxFramePoolSize; i++){
+    if(txFrameUsed[i] == false){
+      txFrameUsed[i] = true;
+      frame = txFramePool[i];
+      break;
+    }
+  }
+  mico_rtos_unlock_mutex(&txFrameMutex);
+
+exit:
+  return frame;
+}
+
+static void _HKTxFrameGive(uint8_t **frame)
+{
+  int i;
+
+  if(*frame == NULL) return;
+  mico_rtos_lock_mutex(&txFrameMutex);
+  for(i = 0; i < HKTxFramePoolSize; i++){
+    if(txFramePool[i] == *frame)
+      txFrameUsed[i] = false;
+  }
+  mico_rtos_unlock_mutex(&txFrameMutex);
+  mico_rtos_set_semaphore(&txFrameSem);
+  *frame = NULL;
+}
+
 security_session_t *HKSNewSecuritySession(void)
 {
   security_session_t *session;
   session = calloc(1, sizeof(security_session_t));
+  require( session, exit );
   session->established = false;
+
+exit:
   return session;
 }
 
 int HKSecureSocketSend( int sockfd, void *buf, size_t len, security_session_t *session)
 {
-  OSStatus       err = kNoErr;
-  uint8_t*       encryptedData = NULL;
-  uint64_t       encryptedDataLen;
+  socket_iovec_t iov;
 
-  if(session->established == false)
-    return SocketSend( sockfd, buf, len );
+  iov.iov_base = (const uint8_t *)buf;
+  iov.iov_len = len;
+  return HKSecureSocketSendv( sockfd, &iov, 1, session );
+}
 
-  encryptedData = malloc(len + crypto_aead_chacha20poly1305_ABYTES + sizeof(uint16_t));
-  require_action(encryptedData, exit, err = kNoMemoryErr);
-  *(uint16_t *)encryptedData = len;
-  err =  crypto_aead_chacha20poly1305_encrypt(encryptedData + sizeof(uint16_t), &encryptedDataLen, (uint8_t *)buf, len,
-                                              (const uint8_t *)encryptedData, sizeof(uint16_t), 
+static OSStatus _HKSecureFlush( int sockfd, security_session_t *session )
+{
+  OSStatus err = kNoErr;
+
+  require_quiet( session->txFrameLen, exit );
+  err = SocketSend( sockfd, session->txFrame, session->txFrameLen );
+  session->txFrameLen = 0;
+  require_noerr( err, exit );
+
+exit:
+  return err;
+}
+
+/* Seal chunk bytes of data into frame, data may already sit at frame + sizeof(uint16_t) */
+static OSStatus _HKSecureSeal( security_session_t *session, uint8_t *frame, const uint8_t *data, size_t chunk )
+{
+  OSStatus err;
+  unsigned long long encryptedDataLen;
+
+  frame[0] = (uint8_t)( chunk & 0xFF );  //Frames follow each other, so the length may be unaligned
+  frame[1] = (uint8_t)( chunk >> 8 );
+  err =  crypto_aead_chacha20poly1305_encrypt(frame + sizeof(uint16_t), &encryptedDataLen, data, chunk,
+                                              (const uint8_t *)frame, sizeof(uint16_t), 
                                               NULL, (uint8_t *)(&session->outputSeqNo),
                                               (const unsigned char *)session->OutputKey);
   session->outputSeqNo++;
   require_noerr_string(err, exit, "crypto_aead_chacha20poly1305_encrypt failed");
-  require_string(encryptedDataLen - crypto_aead_chacha20poly1305_ABYTES == len, exit, "encryptedDataLen is not properly set");
+  require_action_string(encryptedDataLen - crypto_aead_chacha20poly1305_ABYTES == chunk, exit, err = kSizeErr, "encryptedDataLen is not properly set");
+
+exit:
+  return err;
+}
+
+/* Pieces are cut into frames of at most HKFrameLength bytes and sealed into txFrame. Frames are
+   packed while they fit, so a response header and a short body still leave in one socket write */
+int HKSecureSocketSendv( int sockfd, const socket_iovec_t *iov, int iovCount, security_session_t *session)
+{
+  OSStatus       err = kNoErr;
+  const uint8_t* data;
+  size_t         remain, space, chunk;
+  int            i;
 
-  err = SocketSend( sockfd, encryptedData, encryptedDataLen + sizeof(uint16_t) );
+  if(session->established == false)
+    return SocketSendv( sockfd, iov, iovCount );
+
+  session->txFrame = _HKTxFrameTake();
+  require_action( session->txFrame, exit, err = kNoResourcesErr );
+
+  for(i = 0; i < iovCount; i++){
+    data = iov[i].iov_base;
+    remain = iov[i].iov_len;
+    while(remain){
+      space = HKTxFrameSize - session->txFrameLen;
+      /* Do not split into tiny frames, write out what is packed and start again */
+      if(space < HKFrameOverhead + min(remain, HKFrameMinChunk)){
+        err = _HKSecureFlush( sockfd, session );
+        require_noerr( err, exit );
+        continue;
+      }
+      chunk = min(remain, space - HKFrameOverhead);
+
+      err = _HKSecureSeal( session, session->txFrame + session->txFrameLen, data, chunk );
+      require_noerr( err, exit );
+
+      session->txFrameLen += chunk + HKFrameOverhead;
+      data += chunk;
+      remain -= chunk;
+    }
+  }
+
+  err = _HKSecureFlush( sockfd, session );
   require_noerr( err, exit );
 
-  exit:
-    if(encryptedData) free(encryptedData);
-    return err;
+exit:
+  if(err != kNoErr) session->txFrameLen = 0;
+  _HKTxFrameGive( &session->txFrame );
+  return err;
 }
 
-int HKSecureRead(security_session_t *session, int sockfd, void *buf, size_t len)
+/* Wait for data until session->readDeadline, or at most 20 seconds when no deadline is set */
+static OSStatus _HKSecureWaitReadable( security_session_t *session, int sockfd )
 {
   OSStatus    err = kNoErr;
-  uint16_t         packageLength;
-  ssize_t          length = 0;
-  size_t         recvLength = 0;
-  size_t         recvLengthTmp = 0;
-  uint8_t*       *encryptedData = NULL;
-
   fd_set      readfds;
-  int         returnLength = 0;
   int         selectResult;
+  int32_t     remain = 20*1000;
   struct      timeval_t t;
-  t.tv_sec  =  20;
-  t.tv_usec =  0;
-
-  if(session->established == true){
-    if(session->recvedDataLen){
-      returnLength += min(len, session->recvedDataLen);
-      memcpy(buf, session->recvedDataBuffer, returnLength);
-      session->recvedDataLen -= returnLength;
-      if(session->recvedDataLen)
-        memmove(session->recvedDataBuffer, session->recvedDataBuffer+returnLength, session->recvedDataLen);
-      else{
-        free(session->recvedDataBuffer);
-        session->recvedDataBuffer = NULL;
-      }
-      goto exit;
-    }else{
-      while( recvLengthTmp < sizeof(uint16_t)){
-        FD_ZERO( &readfds );
-        FD_SET( sockfd, &readfds );
-        selectResult = select( sockfd + 1, &readfds, NULL, NULL, &t );
-        require(selectResult >= 1, exit);
-        length = read( sockfd, (uint8_t *)&packageLength + recvLengthTmp, sizeof(uint16_t) - recvLengthTmp);
-        if( length > 0 ) recvLengthTmp += length;
-        else { err = kConnectionErr; goto exit; }
-      }
 
-      recvLength = packageLength + crypto_aead_chacha20poly1305_ABYTES;
-      recvLengthTmp = 0;
+  if( session->readDeadline ){
+    remain = (int32_t)( session->readDeadline - mico_get_time() );
+    require_action( remain > 0, exit, err = kTimeoutErr );
+  }
+  t.tv_sec  =  remain/1000;
+  t.tv_usec =  (remain%1000)*1000;
 
-      encryptedData = malloc(recvLength);
-      require(encryptedData, exit);
+  FD_ZERO( &readfds );
+  FD_SET( sockfd, &readfds );
+  selectResult = select( sockfd + 1, &readfds, NULL, NULL, &t );
+  require_action( selectResult >= 1, exit, err = kTimeoutErr );
 
-      while( recvLengthTmp < recvLength){
-        FD_ZERO( &readfds );
-        FD_SET( sockfd, &readfds );
-        selectResult = select( sockfd + 1, &readfds, NULL, NULL, &t );
-        require(selectResult >= 1, exit);
+exit:
+  return err;
+}
 
-        length = read( sockfd, encryptedData + recvLengthTmp, recvLength - recvLengthTmp );
-        if( length > 0 ) recvLengthTmp += length;
-        else { err = kConnectionErr; goto exit; }
-      }
+static OSStatus _HKSecureReadFull( security_session_t *session, int sockfd, uint8_t *buf, size_t len )
+{
+  OSStatus    err = kNoErr;
+  ssize_t     length;
+
+  while( len ){
+    err = _HKSecureWaitReadable( session, sockfd );
+    require_noerr_quiet( err, exit );
+    length = read( sockfd, buf, len );
+    require_action( length > 0, exit, err = kConnectionErr );
+    buf += length;
+    len -= length;
+  }
 
-      session->recvedDataBuffer = malloc(packageLength);
-      require(session->recvedDataBuffer, exit);
+exit:
+  return err;
+}
 
+/* Receive one frame into rxFrame and decrypt it where it is */
+static OSStatus _HKSecureReadFrame( security_session_t *session, int sockfd )
+{
+  OSStatus    err = kNoErr;
+  size_t      packageLength;
+  unsigned long long decryptedDataLen;
+
+  err = _HKSecureReadFull( session, sockfd, session->rxFrame, sizeof(uint16_t) );
+  require_noerr_quiet( err, exit );
+  packageLength = session->rxFrame[0] | ( session->rxFrame[1] << 8 );
+  require_action( packageLength <= HKFrameLength, exit, err = kSizeErr );
+
+  err = _HKSecureReadFull( session, sockfd, session->rxFrame + sizeof(uint16_t), packageLength + crypto_aead_chacha20poly1305_ABYTES );
+  require_noerr_quiet( err, exit );
+
+  err =  crypto_aead_chacha20poly1305_decrypt(session->rxFrame + sizeof(uint16_t), &decryptedDataLen, NULL, 
+                                              session->rxFrame + sizeof(uint16_t), packageLength + crypto_aead_chacha20poly1305_ABYTES,
+                                              session->rxFrame, sizeof(uint16_t),  
+                                              (uint8_t *)(&session->inputSeqNo), (const unsigned char *)session->InputKey);
+  session->inputSeqNo++;
+  require_noerr( err, exit );
+  require_action( decryptedDataLen == packageLength, exit, err = kSizeErr );
 
-      err =  crypto_aead_chacha20poly1305_decrypt(session->recvedDataBuffer, &session->recvedDataLen, NULL, 
-                                                     (const unsigned char *)encryptedData, recvLength, (uint8_t *)&packageLength, 2,  
-                                                     (uint8_t *)(&session->inputSeqNo), (const unsigned char *)session->InputKey);
+  session->recvedDataOffset = sizeof(uint16_t);
+  session->recvedDataLen = decryptedDataLen;
 
-      session->inputSeqNo++;
+exit:
+  return err;
+}
 
-      require_noerr(err, exit);
-      require(session->recvedDataLen == recvLength - crypto_aead_chacha20poly1305_ABYTES, exit);
-
-      free(encryptedData);
-      encryptedData = NULL;
-
-      returnLength += min(len, session->recvedDataLen);
-      memcpy(buf, session->recvedDataBuffer, returnLength);
-      session->recvedDataLen -= returnLength;
-      if(session->recvedDataLen)
-        memmove(session->recvedDataBuffer, session->recvedDataBuffer+returnLength, session->recvedDataLen);
-      else{
-        free(session->recvedDataBuffer);
-        session->recvedDataBuffer = NULL;
-      }
+int HKSecureRead(security_session_t *session, int sockfd, void *buf, size_t len)
+{
+  OSStatus    err = kNoErr;
+  size_t      returnLength = 0;
 
-      goto exit;
+  if(session->established == false){
+    if(session->readDeadline && _HKSecureWaitReadable( session, sockfd ) != kNoErr)
+      return 0;
+    return read( sockfd, buf, len);
+  }
 
-    }
+  if(session->recvedDataLen == 0){
+    err = _HKSecureReadFrame( session, sockfd );
+    require_noerr_quiet( err, exit );
+  }
 
-    exit:
-      if(err == kNoErr)
-        return returnLength;
-      else{
-        if(encryptedData) free(encryptedData);
-        if(session->recvedDataBuffer) {
-          free(session->recvedDataBuffer);
-          session->recvedDataBuffer = NULL;
-        }
-        return 0;
-      }
+  /* Small reads are served from the decrypted frame by offset */
+  returnLength = min(len, session->recvedDataLen);
+  memcpy(buf, session->rxFrame + session->recvedDataOffset, returnLength);
+  session->recvedDataOffset += returnLength;
+  session->recvedDataLen -= returnLength;
+
+exit:
+  if(err != kNoErr){
+    session->recvedDataLen = 0;
+    return 0;
   }
-  else
-    return read( sockfd, buf, len);
+  return returnLength;
 }
 
 
@@ -190,42 +317,34 @@ int HKSocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader, security_session
   char *          dst;
   char *          lim;
   char *          end;
-  ssize_t          len;
+  size_t          len;
   ssize_t         n;
-  const char *    value;
-  size_t          valueSize;
-  
+  uint32_t        start = mico_get_time();
   
   buf = inHeader->buf;
   dst = buf + inHeader->len;
-  lim = buf + sizeof( inHeader->buf );
+  lim = buf + kHTTPHeaderMaxLen;
+  // Frame reads below give up at the same time, not after a full timeout of their own
+  session->readDeadline = start + HKRequestReadTimeout;
+  if(session->readDeadline == 0) session->readDeadline = 1;
   for( ;; )
   {
-    // If there's data from a previous read, move it to the front to search it first.
-    len = inHeader->extraDataLen;
-    if( len > 0 )
-    {
-      require_action( len <= (size_t)( lim - dst ), exit, err = kParamErr );
-      memmove( dst, inHeader->extraDataPtr, len );
-      inHeader->extraDataLen = 0;
-    }
-    else
-    {
-      n = HKSecureRead( session, inSock, dst, (size_t)( lim - dst ) );
-      if(      n  > 0 ) len = (size_t) n;
-      else  { err = kConnectionErr; goto exit; }
-    }
+    // Bytes left from the previous message are parsed first, see HTTPHeaderClear
+    err = HTTPHeaderParseIncremental( inHeader, &end );
+    if( err == kNoErr ) break;
+    require( err == kInProgressErr, exit );
+    require_action( dst < lim, exit, err = kNoSpaceErr );
+    // The caller holds a pooled header, a client that trickles a header in must not keep it
+    require_action( mico_get_time() - start < HKRequestReadTimeout, exit, err = kTimeoutErr );
+    n = HKSecureRead( session, inSock, dst, (size_t)( lim - dst ) );
+    if(      n  > 0 ) len = (size_t) n;
+    else  { err = kConnectionErr; goto exit; }
     dst += len;
     inHeader->len += len;
-    
-    if(findHeader( inHeader,  &end ))
-      break ;
   }
   
   inHeader->len = (size_t)( end - buf );
-  err = HTTPHeaderParse( inHeader );
-  require_noerr( err, exit );
-  inHeader->extraDataLen = (size_t)( dst - end );
+  inHeader->extraDataLen = 0;
   if(inHeader->extraDataPtr) {
     free((uint8_t *)inHeader->extraDataPtr);
     inHeader->extraDataPtr = 0;
@@ -235,85 +354,57 @@ int HKSocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader, security_session
     free((uint8_t *)inHeader->otaDataPtr);
     inHeader->otaDataPtr = 0;
   }
-  
-  err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
-  
-  if(err == kNoErr && strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0){
-    hkhttp_utils_log("Receive OTA data!");        
-    err = MicoFlashInitialize(MICO_FLASH_FOR_UPDATE);
-    require_noerr(err, exit);
-    err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &flashStorageAddress, (uint8_t *)end, inHeader->extraDataLen);
-    require_noerr(err, exit);
-  }else{
-    inHeader->extraDataPtr = calloc(inHeader->contentLength, sizeof(uint8_t));
-    require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
-    memcpy((uint8_t *)inHeader->extraDataPtr, end, inHeader->extraDataLen);
-    err = kNoErr;
-  }
+  err = kNoErr;
   
 exit:   
+  session->readDeadline = 0;
   return err;
 }
 
-
+static int _HKSecureReadFunc( void *inContext, int inSock, void *inBuf, size_t inLen )
+{
+  return HKSecureRead( (security_session_t *)inContext, inSock, inBuf, inLen );
+}
 
 int HKSocketReadHTTPBody  ( int inSock, HTTPHeader_t *inHeader, security_session_t *session )
 {
   OSStatus err = kParamErr;
-  ssize_t readResult;
-  int selectResult;
-  fd_set readSet;
+  size_t          readLen;
   const char *    value;
   size_t          valueSize;
   
   require( inHeader, exit );
   
-  err = kNotReadableErr;
-  
-  
-  while ( inHeader->extraDataLen < inHeader->contentLength )
-  {
-    if(session->recvedDataLen == 0){
-      FD_ZERO( &readSet );
-      FD_SET( inSock, &readSet );
-      selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-      require( selectResult >= 1, exit );      
-    }
-    
-    err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
+  err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
+  if( err == kNoErr && strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0 ){
+    /* OTA image goes to flash one window at a time */
+    hkhttp_utils_log("Receive OTA data!");
+    inHeader->otaDataPtr = calloc(OTA_Data_Length_per_read, sizeof(uint8_t)); 
+    require_action(inHeader->otaDataPtr, exit, err = kNoMemoryErr);
+    err = MicoFlashInitialize(MICO_FLASH_FOR_UPDATE);
     require_noerr(err, exit);
-    if( strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0 ){
-      inHeader->otaDataPtr = calloc(OTA_Data_Length_per_read, sizeof(uint8_t)); 
-      require_action(inHeader->otaDataPtr, exit, err = kNoMemoryErr);
-      if((inHeader->contentLength - inHeader->extraDataLen)<OTA_Data_Length_per_read){
-        readResult = HKSecureRead(  session, inSock,
-                                    (uint8_t*)( inHeader->otaDataPtr ),
-                                    ( inHeader->contentLength - inHeader->extraDataLen ) );
-      }else{
-        readResult = HKSecureRead(  session, inSock,
-                                    (uint8_t*)( inHeader->otaDataPtr ),
-                                    OTA_Data_Length_per_read);
-      }
-      
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else  { err = kConnectionErr; goto exit; }
-      
-      err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &flashStorageAddress, (uint8_t *)inHeader->otaDataPtr, readResult);
+
+    while( HTTPHeaderBodyComplete( inHeader ) == false ){
+      err = HTTPReadBodyWindow( inSock, inHeader, _HKSecureReadFunc, session, 
+                                (uint8_t *)inHeader->otaDataPtr, OTA_Data_Length_per_read, &readLen );
+      require_noerr(err, exit);
+      err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &flashStorageAddress, (uint8_t *)inHeader->otaDataPtr, readLen);
       require_noerr(err, exit);
-      
-      free(inHeader->otaDataPtr);
-      inHeader->otaDataPtr = 0;
-    }else{
-      readResult = HKSecureRead( session, inSock,
-                                (uint8_t*)( inHeader->extraDataPtr + inHeader->extraDataLen ),
-                                ( inHeader->contentLength - inHeader->extraDataLen ) );
-      
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else if( readResult == 0 ) { err = kConnectionErr; goto exit; }
-      else goto exit;
     }
+  }else{
+    /* Pair protocol messages are parsed from one buffer, NUL terminated for string consumers */
+    require_action(inHeader->contentLength <= HKPairBodyMaxLen, exit, err = kSizeErr);
+    inHeader->extraDataPtr = calloc((size_t)inHeader->contentLength + 1, sizeof(uint8_t));
+    require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
+
+    while( inHeader->bodyReadLen < inHeader->contentLength ){
+      err = HTTPReadBodyWindow( inSock, inHeader, _HKSecureReadFunc, session, 
+                                (uint8_t *)inHeader->extraDataPtr + inHeader->bodyReadLen, 
+                                (size_t)( inHeader->contentLength - inHeader->bodyReadLen ), &readLen );
+      require_noerr(err, exit);
+    }
+    inHeader->extraDataLen = (size_t)inHeader->bodyReadLen;
   }
-  
   err = kNoErr;
   
 exit:
@@ -324,79 +415,236 @@ exit:
   return err;
 }
 
+OSStatus HKSocketReadHTTPJsonBody( int inSock, HTTPHeader_t *inHeader, security_session_t *session, json_object **outJson )
+{
+  OSStatus err = kNoMemoryErr;
+  struct json_tokener *tok = NULL;
+  uint8_t *window = NULL;
+  size_t readLen;
+
+  *outJson = NULL;
+  /* The request tree is built in one arena, and freed with a single put */
+  tok = json_tokener_new_arena( JSON_ARENA_DEF_BLOCK_SIZE );
+  require( tok, exit );
+  window = malloc( HTTP_Body_Window_Length );
+  require( window, exit );
+
+  /* Decrypted body is fed to the tokener directly, it is never copied into a content length buffer */
+  while( HTTPHeaderBodyComplete( inHeader ) == false ){
+    err = HTTPReadBodyWindow( inSock, inHeader, _HKSecureReadFunc, session, window, HTTP_Body_Window_Length, &readLen );
+    require_noerr( err, exit );
+    if( *outJson ) continue; // Drop trailing white spaces
+    *outJson = json_tokener_parse_ex( tok, (const char *)window, readLen );
+    require_action( *outJson || tok->err == json_tokener_continue, exit, err = kMalformedErr );
+  }
+  require_action( *outJson, exit, err = kMalformedErr );
+  err = kNoErr;
+
+exit:
+  if( err != kNoErr && *outJson ){
+    json_object_put( *outJson );
+    *outJson = NULL;
+  }
+  if(window)  free(window);
+  if(tok)     json_tokener_free(tok);
+  return err;
+}
+
 OSStatus HKSendResponseMessage(int sockfd, int status, uint8_t *payload, int payloadLen, security_session_t *session )
 {
   OSStatus err;
-  uint8_t *httpResponse = NULL;
+  char httpResponse[HKResponseHeaderMaxLen];
   size_t httpResponseLen = 0;
   const char *buffer = NULL;
   int bufferLen;
+  socket_iovec_t iov[2];
 
   buffer = (const char *)payload;
   bufferLen = payloadLen;
 
-  err = CreateHTTPRespondMessageNoCopy( status, kMIMEType_HAP_JSON, bufferLen, &httpResponse, &httpResponseLen );
-
+  err = CreateHTTPRespondHeader( status, kMIMEType_HAP_JSON, bufferLen, httpResponse, sizeof(httpResponse), &httpResponseLen );
   require_noerr( err, exit );
-  require( httpResponse, exit );
 
-  err = HKSecureSocketSend( sockfd, httpResponse, httpResponseLen, session );
+  iov[0].iov_base = (const uint8_t *)httpResponse;
+  iov[0].iov_len = httpResponseLen;
+  iov[1].iov_base = (const uint8_t *)buffer;
+  iov[1].iov_len = bufferLen;
+  err = HKSecureSocketSendv( sockfd, iov, bufferLen? 2 : 1, session );
   require_noerr( err, exit );
-  if(bufferLen){
-    err = HKSecureSocketSend( sockfd, (uint8_t *)buffer, bufferLen, session );
-    require_noerr( err, exit ); 
-  }
 
 exit:
-  if(httpResponse) free(httpResponse);
+  return err;
+}
+
+static OSStatus _HKCreateEventHeader( size_t contentLength, char *outHeader, size_t inHeaderSize, size_t *outHeaderSize )
+{
+  OSStatus err = kNoErr;
+  int len;
+
+  if(contentLength)
+    len = snprintf( outHeader, inHeaderSize, 
+            "%s %d %s%s%s %s%s%s %d%s",
+            "EVENT/1.0", 200, "OK", kCRLFNewLine, 
+            "Content-Type:", kMIMEType_HAP_JSON, kCRLFNewLine,
+            "Content-Length:", (int)contentLength, kCRLFLineEnding );
+  else
+    len = snprintf( outHeader, inHeaderSize, 
+        "%s %d %s%s",
+        "EVENT/1.0", 200, "OK", kCRLFLineEnding);
+  require_action( len > 0 && (size_t)len < inHeaderSize, exit, err = kSizeErr );
+
+  *outHeaderSize = (size_t)len;
+
+exit:
   return err;
 }
 
 OSStatus HKSendNotifyMessage( int sockfd, uint8_t *payload, int payloadLen, security_session_t *session )
 {
   OSStatus err;
-  uint8_t *httpResponse = NULL;
+  char httpResponse[HKResponseHeaderMaxLen];
   size_t httpResponseLen = 0;
   const char *buffer = NULL;
   int bufferLen;
+  socket_iovec_t iov[2];
   require_action( session->established == true, exit, err = kAuthenticationErr );
 
   buffer = (const char *)payload;
   bufferLen = payloadLen;
   
-  require( bufferLen >= 0, exit );
-  
-  err = kNoMemoryErr;
-  httpResponse = malloc( 200 );
-  require( httpResponse, exit );
+  require_action( bufferLen >= 0, exit, err = kParamErr );
   
   // Create HTTP Response
-  if(bufferLen)
-    snprintf( (char *)httpResponse, 200, 
-            "%s %d %s%s%s %s%s%s %d%s",
-            "EVENT/1.0", 200, "OK", kCRLFNewLine, 
-            "Content-Type:", kMIMEType_HAP_JSON, kCRLFNewLine,
-            "Content-Length:", (int)payloadLen, kCRLFLineEnding );
-  else
-    snprintf( (char *)httpResponse, 200, 
-        "%s %d %s%s",
-        "EVENT/1.0", 200, "OK", kCRLFLineEnding);
-  
-  httpResponseLen = strlen( (char*)httpResponse );
+  err = _HKCreateEventHeader( bufferLen, httpResponse, sizeof(httpResponse), &httpResponseLen );
+  require_noerr( err, exit );
 
-  err = HKSecureSocketSend( sockfd, httpResponse, httpResponseLen, session );
+  iov[0].iov_base = (const uint8_t *)httpResponse;
+  iov[0].iov_len = httpResponseLen;
+  iov[1].iov_base = (const uint8_t *)buffer;
+  iov[1].iov_len = bufferLen;
+  err = HKSecureSocketSendv( sockfd, iov, bufferLen? 2 : 1, session );
   require_noerr( err, exit );
-  if(bufferLen){
-    err = HKSecureSocketSend( sockfd, (uint8_t *)buffer, bufferLen, session );
-    require_noerr( err, exit ); 
+
+exit:
+  return err;
+}
+
+void HKStreamInit( HK_Stream_t *stream, int sockfd, security_session_t *session )
+{
+  stream->sockfd = sockfd;
+  stream->session = session;
+  stream->len = 0;
+  stream->frame = NULL;
+}
+
+OSStatus HKStreamWrite( HK_Stream_t *stream, const void *data, size_t len )
+{
+  OSStatus err = kNoErr;
+  const uint8_t *src = data;
+  size_t copyLen;
+
+  // Nothing to seal before pair verify, pieces go out as they come
+  if(stream->session->established == false)
+    return SocketSend( stream->sockfd, data, len );
+
+  if(stream->frame == NULL){
+    stream->frame = _HKTxFrameTake();
+    require_action( stream->frame, exit, err = kNoResourcesErr );
+  }
+
+  while(len){
+    copyLen = min(len, HKFrameLength - stream->len);
+    memcpy(stream->frame + sizeof(uint16_t) + stream->len, src, copyLen);
+    stream->len += copyLen;
+    src += copyLen;
+    len -= copyLen;
+    if(stream->len == HKFrameLength){
+      err = HKStreamFlush( stream );
+      require_noerr( err, exit );
+    }
   }
 
 exit:
-  if(httpResponse) free(httpResponse);
   return err;
 }
 
+OSStatus HKStreamWriteResponseHeader( HK_Stream_t *stream, int status, size_t contentLength )
+{
+  OSStatus err;
+  char httpResponse[HKResponseHeaderMaxLen];
+  size_t httpResponseLen = 0;
 
+  err = CreateHTTPRespondHeader( status, kMIMEType_HAP_JSON, contentLength, httpResponse, sizeof(httpResponse), &httpResponseLen );
+  require_noerr( err, exit );
 
+  err = HKStreamWrite( stream, httpResponse, httpResponseLen );
+  require_noerr( err, exit );
 
+exit:
+  return err;
+}
+
+OSStatus HKStreamWriteEventHeader( HK_Stream_t *stream, size_t contentLength )
+{
+  OSStatus err;
+  char httpResponse[HKResponseHeaderMaxLen];
+  size_t httpResponseLen = 0;
 
+  require_action( stream->session->established == true, exit, err = kAuthenticationErr );
+  err = _HKCreateEventHeader( contentLength, httpResponse, sizeof(httpResponse), &httpResponseLen );
+  require_noerr( err, exit );
+
+  err = HKStreamWrite( stream, httpResponse, httpResponseLen );
+  require_noerr( err, exit );
+
+exit:
+  return err;
+}
+
+OSStatus HKStreamFlush( HK_Stream_t *stream )
+{
+  OSStatus err = kNoErr;
+
+  require_quiet( stream->len, exit );
+  err = _HKSecureSeal( stream->session, stream->frame, stream->frame + sizeof(uint16_t), stream->len );
+  if( err == kNoErr )
+    err = SocketSend( stream->sockfd, stream->frame, stream->len + HKFrameOverhead );
+  stream->len = 0;
+  require_noerr( err, exit );
+
+exit:
+  return err;
+}
+
+void HKStreamDeinit( HK_Stream_t *stream )
+{
+  stream->len = 0;
+  _HKTxFrameGive( &stream->frame );
+}
+
+static int _HKStreamJsonSink( void *inContext, const char *inBuf, int inLen )
+{
+  return HKStreamWrite( (HK_Stream_t *)inContext, inBuf, inLen ) == kNoErr ? inLen : -1;
+}
+
+/* The json is rendered twice: once to learn the Content-Length, once straight into the
+   stream. The text is never held in a heap buffer of its own */
+OSStatus HKSendResponseJson( int sockfd, int status, json_object *json, security_session_t *session )
+{
+  OSStatus err;
+  HK_Stream_t stream;
+  int jsonLen;
+
+  HKStreamInit( &stream, sockfd, session );
+  jsonLen = json_object_to_json_buffer( json, NULL, 0 );
+
+  err = HKStreamWriteResponseHeader( &stream, status, jsonLen );
+  require_noerr( err, exit );
+  require_action( json_object_to_json_sink( json, NULL, 0, _HKStreamJsonSink, &stream ) == jsonLen, exit, err = kWriteErr );
+  err = HKStreamFlush( &stream );
+  require_noerr( err, exit );
+
+exit:
+  HKStreamDeinit( &stream );
+  return err;
+}
@@ -27,32 +27,80 @@
 #include "Common.h"
 
 #include "HTTPUtils.h"
+#include "SocketUtils.h"
+#include "JSON-C/json.h"
+#include "MICOCrypto/crypto_aead_chacha20poly1305.h"
+
+/* Largest plain text carried by one encrypted HAP frame */
+#define HKFrameLength           1024
+/* Length field and authentication tag around plain text */
+#define HKFrameOverhead         (sizeof(uint16_t) + crypto_aead_chacha20poly1305_ABYTES)
+/* Receive timeout of controller sockets, and the time a request header may take once it has started, in ms */
+#define HKRequestReadTimeout    2000
+/* Controller connections served at the same time */
+#define HKMaxSessions           8
+/* Longest pair protocol TLV body, read into one buffer */
+#define HKPairBodyMaxLen        1024
+/* Longest response or event header, formatted on the stack */
+#define HKResponseHeaderMaxLen  128
 
 typedef struct _security_session_t {
   bool          established;
   char          controllerIdentifier[64];
   uint8_t       OutputKey[32];
   uint8_t       InputKey[32];
-  uint64_t      recvedDataLen;
-  uint8_t*      recvedDataBuffer;
+  uint64_t      recvedDataLen;      //! Decrypted bytes not read yet, start at rxFrame + recvedDataOffset
+  size_t        recvedDataOffset;
   uint64_t      outputSeqNo;
   uint64_t      inputSeqNo;
+  uint32_t      readDeadline;       //! mico_get_time() a blocking read gives up at, 0 for no limit
+  size_t        txFrameLen;         //! Sealed frames in txFrame waiting for a socket write
+  uint8_t       *txFrame;           //! Taken from a pool shared by all sessions during one send
+  uint8_t       rxFrame[HKFrameLength + HKFrameOverhead];
 } security_session_t;
 
+/* Collects small writes in a pooled transmit frame and seals them where they are, one full frame at a time */
+typedef struct _HK_Stream_t {
+  int                 sockfd;
+  security_session_t *session;
+  size_t              len;            //! Plain text waiting in frame, after the length field
+  uint8_t            *frame;          //! Taken on the first write, given back by HKStreamDeinit
+} HK_Stream_t;
+
+void HKSecureInit(void);
+
 security_session_t *HKSNewSecuritySession(void);
 
 int HKSecureSocketSend( int sockfd, void *buf, size_t len, security_session_t *session);
 
+int HKSecureSocketSendv( int sockfd, const socket_iovec_t *iov, int iovCount, security_session_t *session);
+
 int HKSecureRead(security_session_t *session, int sockfd, void *buf, size_t len);
 
 int HKSocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader, security_session_t *session );
 
 int HKSocketReadHTTPBody  ( int inSock, HTTPHeader_t *inHeader, security_session_t *session );
 
+OSStatus HKSocketReadHTTPJsonBody( int inSock, HTTPHeader_t *inHeader, security_session_t *session, json_object **outJson );
+
 OSStatus HKSendResponseMessage(int sockfd, int status, uint8_t *payload, int payloadLen, security_session_t *session );
 
 OSStatus HKSendNotifyMessage( int sockfd, uint8_t *payload, int payloadLen, security_session_t *session );
 
+void HKStreamInit( HK_Stream_t *stream, int sockfd, security_session_t *session );
+
+OSStatus HKStreamWrite( HK_Stream_t *stream, const void *data, size_t len );
+
+OSStatus HKStreamWriteResponseHeader( HK_Stream_t *stream, int status, size_t contentLength );
+
+OSStatus HKStreamWriteEventHeader( HK_Stream_t *stream, size_t contentLength );
+
+OSStatus HKStreamFlush( HK_Stream_t *stream );
+
+void HKStreamDeinit( HK_Stream_t *stream );
+
+OSStatus HKSendResponseJson( int sockfd, int status, json_object *json, security_session_t *session );
+
 
 
 #endif // __HOMEKITHTTPUtils_h__
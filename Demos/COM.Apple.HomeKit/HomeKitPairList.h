@@ -23,8 +23,8 @@
 #include "platform_config.h"
 
 #define MaxControllerNameLen  64
-#define MAXPairNumber         (EX_PARA_FLASH_SIZE-64)/(MaxControllerNameLen+32+4)
-/*Pair Info flash content*/
+#define MAXPairNumber         16    //HAP requires at least 16 pairings, all kept in RAM
+/*Pair Info, the table is loaded to RAM once and kept in sync with the log in EX_PARA*/
 typedef struct _pair_t {
   char             controllerName[MaxControllerNameLen];
   uint8_t          controllerLTPK[32];
@@ -36,11 +36,12 @@ typedef struct _pair_list_in_flash_t {
 } pair_list_in_flash_t;
 
 
+OSStatus HMPairListInit(void);
 OSStatus HMClearPairList(void);
 OSStatus HMReadPairList(pair_list_in_flash_t *pPairList);
 OSStatus HMUpdatePairList(pair_list_in_flash_t *pPairList);
 OSStatus HKInsertPairInfo(char controllerIdentifier[64], uint8_t controllerLTPK[32], bool admin);
-uint8_t * HMFindLTPK(char * name);
+bool HMFindLTPK(char * name, uint8_t controllerLTPK[32]);
 bool HMFindAdmin(char * name);
 OSStatus HMRemoveLTPK(char * name);
 
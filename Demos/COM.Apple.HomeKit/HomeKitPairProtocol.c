@@ -43,9 +43,22 @@ typedef enum
   Pair_Verify,
   Pair_Add,
   Pair_Remove,
-  Pair_List
+  Pair_List,
+  Pair_Resume
 } HKPairMethold_t;
 
+#define HKResumeCacheSize     8                     //! Resumable sessions kept in RAM
+#define HKResumeLifetime      (8*60*60*1000)        //! A session can be resumed within 8 hours, in ms
+
+/* Keys of a verified session, kept so the controller can reconnect without Curve25519 and Ed25519 */
+typedef struct _resumeSession_t {
+  bool              valid;
+  uint32_t          lastUsed;
+  char              controllerIdentifier[64];
+  uint8_t           sessionID[HKResumeSessionIDLen];
+  uint8_t           sharedSecret[32];
+} resumeSession_t;
+
 const char * hkdfSetupSalt  =        "Pair-Setup-Encrypt-Salt";
 const char * hkdfSetupInfo =         "Pair-Setup-Encrypt-Info";
 
@@ -67,11 +80,19 @@ const char * hkdfC2AInfo =           "Control-Write-Encryption-Key";
 const char * hkdfA2CKeySalt =        "Control-Salt";
 const char * hkdfA2CInfo =           "Control-Read-Encryption-Key";
 
+const char * hkdfResumeSessionIDSalt =  "Pair-Verify-ResumeSessionID-Salt";
+const char * hkdfResumeSessionIDInfo =  "Pair-Verify-ResumeSessionID-Info";
+const char * hkdfResumeRequestInfo =    "Pair-Resume-Request-Info";
+const char * hkdfResumeResponseInfo =   "Pair-Resume-Response-Info";
+const char * hkdfResumeSecretInfo =     "Pair-Resume-Shared-Secret-Info";
+
 const char * AEAD_Nonce_Setup04 =   "PS-Msg04";
 const char * AEAD_Nonce_Setup05 =   "PS-Msg05";
 const char * AEAD_Nonce_Setup06 =   "PS-Msg06";
 const char * AEAD_Nonce_Verify02 =  "PV-Msg02";
 const char * AEAD_Nonce_Verify03 =  "PV-Msg03";
+const char * AEAD_Nonce_Resume01 =  "PR-Msg01";
+const char * AEAD_Nonce_Resume02 =  "PR-Msg02";
 
 const char *stateDescription[7] = {"", "kTLVType_State = M1", "kTLVType_State = M2", "kTLVType_State = M3",
                                    "kTLVType_State = M4", "kTLVType_State = M5", "kTLVType_State = M6"};
@@ -90,6 +111,13 @@ static size_t         _len_salt = 0;
 static HAPairSetupState_t haPairSetupState = eState_M1_SRPStartRequest;
 const char* hkSRPUser = "Pair-Setup";
 
+static resumeSession_t  resumeCache[HKResumeCacheSize];
+static mico_mutex_t     resumeCacheMutex = NULL;
+
+static srp_server_t     *preparedSRPServer = NULL;  //! Set up in background, B is ready for the next M2
+static mico_mutex_t     srpMutex = NULL;
+static mico_semaphore_t srpPrepareSem = NULL;
+
 OSStatus _HandleState_WaitingForSRPStartRequest( HTTPHeader_t* inHeader, pairInfo_t** inInfo, mico_Context_t * const inContext );
 OSStatus _HandleState_HandleSRPStartRespond(int inFd, pairInfo_t* inInfo, mico_Context_t * const inContext);
 OSStatus _HandleState_WaitingForSRPVerifyRequest(HTTPHeader_t* inHeader, pairInfo_t* inInfo, mico_Context_t * const inContext );
@@ -101,12 +129,24 @@ OSStatus _HandleState_WaitingForVerifyStartRequest( HTTPHeader_t* inHeader, pair
 OSStatus _HandleState_WaitingForVerifyStartRespond(int inFd, pairVerifyInfo_t* inInfo, mico_Context_t * const inContext);
 OSStatus _HandleState_WaitingForVerifyFinishRequest(HTTPHeader_t* inHeader, pairVerifyInfo_t* inInfo, mico_Context_t * const inContext );
 OSStatus _HandleState_WaitingForVerifyFinishRespond(int inFd, pairVerifyInfo_t* inInfo, mico_Context_t * const inContext);
+OSStatus _HandleState_WaitingForResumeRespond(int inFd, pairVerifyInfo_t* inInfo, mico_Context_t * const inContext);
+
 
+/* A prepared SRP server no longer matches the setup code, drop it and prepare again */
+static void _HKDropPreparedSRPServer(void)
+{
+  if(srpMutex == NULL) return;
+  mico_rtos_lock_mutex(&srpMutex);
+  if(preparedSRPServer) srp_server_delete(&preparedSRPServer);
+  mico_rtos_unlock_mutex(&srpMutex);
+  mico_rtos_set_semaphore(&srpPrepareSem);
+}
 
 void HKSetPassword (const uint8_t * password, const size_t passwordLen)
 {
   _password = password;
   _len_password = passwordLen;
+  _HKDropPreparedSRPServer();
 }
 
 void HKSetVerifier (const uint8_t * verifier, const size_t verifierLen, const uint8_t * salt, const size_t saltLen )
@@ -115,8 +155,188 @@ void HKSetVerifier (const uint8_t * verifier, const size_t verifierLen, const ui
   _len_verifier = verifierLen;
   _salt = salt;
   _len_salt = saltLen;
+  _HKDropPreparedSRPServer();
+}
+
+static srp_server_t *_HKSRPServerSetup(void)
+{
+  return srp_server_setup( SRP_SHA512, SRP_NG_3072, hkSRPUser, 
+                           _password, _len_password, 
+                           _verifier, _len_verifier,
+                           _salt, _len_salt,
+                           0, 0);
+}
+
+/* Use the SRP server prepared in background, or set one up now if it is not ready. 
+   Every server is used once, so B is never reused between two pair-setup attempts */
+static srp_server_t *_HKTakeSRPServer(void)
+{
+  srp_server_t *server = NULL;
+
+  if(srpMutex == NULL)
+    return _HKSRPServerSetup();
+
+  mico_rtos_lock_mutex(&srpMutex);
+  server = preparedSRPServer;
+  preparedSRPServer = NULL;
+  if(server == NULL)
+    server = _HKSRPServerSetup();
+  mico_rtos_unlock_mutex(&srpMutex);
+  mico_rtos_set_semaphore(&srpPrepareSem);
+  return server;
+}
+
+static bool _HKAccessoryLTSKValid(mico_Context_t * const inContext)
+{
+  int i;
+
+  for(i = 0; i < 64; i++){
+    if(inContext->flashContentInRam.appConfig.LTSK[i] != 0x0)
+      return true;
+  }
+  return false;
+}
+
+/* Low priority task that does the slow pair-setup math before a controller asks for it */
+static void _HKPairSetupPrepare_thread(void *inContext)
+{
+  mico_Context_t *context = inContext;
+  uint8_t LTPK[32];
+
+  /* Accessory's long-term keys are created once and kept until restored to default */
+  mico_rtos_lock_mutex(&context->flashContentInRam_mutex);
+  if(_HKAccessoryLTSKValid(context) == false){
+    if(crypto_sign_keypair(LTPK, context->flashContentInRam.appConfig.LTSK) == 0)
+      MICOUpdateConfiguration(context);
+  }
+  mico_rtos_unlock_mutex(&context->flashContentInRam_mutex);
+
+  while(1){
+    mico_rtos_lock_mutex(&srpMutex);
+    if(preparedSRPServer == NULL && (_verifier || _password)){
+      preparedSRPServer = _HKSRPServerSetup();
+      pair_log("SRP server prepared");
+    }
+    mico_rtos_unlock_mutex(&srpMutex);
+    mico_rtos_get_semaphore(&srpPrepareSem, MICO_WAIT_FOREVER);
+  }
+}
+
+OSStatus HKPairSetupPrepare(mico_Context_t * const inContext)
+{
+  OSStatus err = kNoErr;
+
+  err = mico_rtos_init_mutex(&srpMutex);
+  require_noerr(err, exit);
+  err = mico_rtos_init_semaphore(&srpPrepareSem, 1);
+  require_noerr(err, exit);
+  err = mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY+1, "HomeKit Prepare", _HKPairSetupPrepare_thread, 0x1000, (void*)inContext );
+  require_noerr(err, exit);
+
+exit:
+  return err;
+}
+
+
+void HKPairResumeInit(void)
+{
+#if HA_PAIR_RESUME_ENABLE
+  memset(resumeCache, 0x0, sizeof(resumeCache));
+  if(resumeCacheMutex == NULL)
+    mico_rtos_init_mutex(&resumeCacheMutex);
+#endif
+}
+
+/* Keep a verified session, an empty slot is used first, then the least recently used one */
+static void _resumeCacheStore(const char *controllerIdentifier, const uint8_t *sessionID, const uint8_t *sharedSecret)
+{
+  uint32_t now = mico_get_time();
+  int i, victim = 0;
+
+  if(resumeCacheMutex == NULL) return;
+  mico_rtos_lock_mutex(&resumeCacheMutex);
+
+  for(i = 0; i < HKResumeCacheSize; i++){
+    if(resumeCache[i].valid == false){
+      victim = i;
+      break;
+    }
+    if(now - resumeCache[i].lastUsed > now - resumeCache[victim].lastUsed)
+      victim = i;
+  }
+
+  resumeCache[victim].valid = true;
+  resumeCache[victim].lastUsed = now;
+  strncpy(resumeCache[victim].controllerIdentifier, controllerIdentifier, 64);
+  memcpy(resumeCache[victim].sessionID, sessionID, HKResumeSessionIDLen);
+  memcpy(resumeCache[victim].sharedSecret, sharedSecret, 32);
+
+  mico_rtos_unlock_mutex(&resumeCacheMutex);
 }
 
+/* Copy out a session that has not expired, expired sessions are dropped */
+static bool _resumeCacheFind(const uint8_t *sessionID, char controllerIdentifier[65], uint8_t sharedSecret[32])
+{
+  uint32_t now = mico_get_time();
+  bool found = false;
+  int i;
+
+  if(resumeCacheMutex == NULL) return false;
+  mico_rtos_lock_mutex(&resumeCacheMutex);
+
+  for(i = 0; i < HKResumeCacheSize; i++){
+    if(resumeCache[i].valid == false || memcmp(resumeCache[i].sessionID, sessionID, HKResumeSessionIDLen))
+      continue;
+    if(now - resumeCache[i].lastUsed > HKResumeLifetime){
+      memset(&resumeCache[i], 0x0, sizeof(resumeSession_t));
+      break;
+    }
+    memcpy(controllerIdentifier, resumeCache[i].controllerIdentifier, 64);
+    controllerIdentifier[64] = 0x0;
+    memcpy(sharedSecret, resumeCache[i].sharedSecret, 32);
+    found = true;
+    break;
+  }
+
+  mico_rtos_unlock_mutex(&resumeCacheMutex);
+  return found;
+}
+
+/* A session ID is only good for one resume, false if another connection took it first */
+static bool _resumeCacheConsume(const uint8_t *sessionID)
+{
+  bool found = false;
+  int i;
+
+  if(resumeCacheMutex == NULL) return false;
+  mico_rtos_lock_mutex(&resumeCacheMutex);
+
+  for(i = 0; i < HKResumeCacheSize; i++){
+    if(resumeCache[i].valid && memcmp(resumeCache[i].sessionID, sessionID, HKResumeSessionIDLen) == 0){
+      memset(&resumeCache[i], 0x0, sizeof(resumeSession_t));
+      found = true;
+      break;
+    }
+  }
+
+  mico_rtos_unlock_mutex(&resumeCacheMutex);
+  return found;
+}
+
+static void _resumeCacheRemoveController(const char *controllerIdentifier)
+{
+  int i;
+
+  if(resumeCacheMutex == NULL) return;
+  mico_rtos_lock_mutex(&resumeCacheMutex);
+
+  for(i = 0; i < HKResumeCacheSize; i++){
+    if(resumeCache[i].valid && strncmp(resumeCache[i].controllerIdentifier, controllerIdentifier, 64) == 0)
+      memset(&resumeCache[i], 0x0, sizeof(resumeSession_t));
+  }
+
+  mico_rtos_unlock_mutex(&resumeCacheMutex);
+}
 
 void HKCleanPairSetupInfo(pairInfo_t **info, mico_Context_t * const inContext){
   if(*info){
@@ -155,6 +375,7 @@ void HKCleanPairVerifyInfo(pairVerifyInfo_t **verifyInfo){
     if((*verifyInfo)->A2CKey) free((*verifyInfo)->A2CKey);
     if((*verifyInfo)->C2AKey) free((*verifyInfo)->C2AKey);
     if((*verifyInfo)->pControllerIdentifier) free((*verifyInfo)->pControllerIdentifier);
+    if((*verifyInfo)->pResumeAuthTag) free((*verifyInfo)->pResumeAuthTag);
     
     free((*verifyInfo));   
     *verifyInfo = 0; 
@@ -171,6 +392,7 @@ OSStatus HKPairSetupEngine( int inFd, HTTPHeader_t* inHeader, pairInfo_t** inInf
 
   uint8_t *httpResponse = NULL;
   size_t httpResponseLen = 0;
+  socket_iovec_t iov[2];
 
 
   if(pairErrorNum>=10){
@@ -197,9 +419,11 @@ OSStatus HKPairSetupEngine( int inFd, HTTPHeader_t* inHeader, pairInfo_t** inInf
 
     err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
     require_noerr( err, exit );
-    err = SocketSend( inFd, httpResponse, httpResponseLen );
-    require_noerr( err, exit );
-    err = SocketSend(inFd, outTLVResponse, outTLVResponseLen);
+    iov[0].iov_base = httpResponse;
+    iov[0].iov_len = httpResponseLen;
+    iov[1].iov_base = outTLVResponse;
+    iov[1].iov_len = outTLVResponseLen;
+    err = SocketSendv( inFd, iov, 2 );
     require_noerr( err, exit );
     goto exit;
   }
@@ -306,14 +530,12 @@ OSStatus _HandleState_HandleSRPStartRespond(int inFd, pairInfo_t* inInfo, mico_C
   char *tempString = NULL;
   uint8_t *httpResponse = NULL;
   size_t httpResponseLen = 0;
+  socket_iovec_t iov[2];
+  uint32_t startTime = mico_get_time();
 
   require_action(_verifier||_password, exit, err = kParamErr);
-  inInfo->SRPServer = srp_server_setup( SRP_SHA512, SRP_NG_3072, inInfo->SRPUser, 
-                                        _password, _len_password, 
-                                        _verifier, _len_verifier,
-                                        _salt, _len_salt,
-                                        0, 0);
-  require(inInfo->SRPServer, exit);
+  inInfo->SRPServer = _HKTakeSRPServer();
+  require_action(inInfo->SRPServer, exit, err = kNoMemoryErr);
 
 #ifdef DEBUG
   tempString = DataToHexString( inInfo->SRPServer->bytes_v, inInfo->SRPServer->len_v );
@@ -364,10 +586,13 @@ OSStatus _HandleState_HandleSRPStartRespond(int inFd, pairInfo_t* inInfo, mico_C
   /* Send */
   err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
   require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend( inFd, outTLVResponse, outTLVResponseLen );
+  iov[0].iov_base = httpResponse;
+  iov[0].iov_len = httpResponseLen;
+  iov[1].iov_base = outTLVResponse;
+  iov[1].iov_len = outTLVResponseLen;
+  err = SocketSendv( inFd, iov, 2 );
   require_noerr( err, exit );
+  pair_log("Pair setup M2 sent in %d ms", mico_get_time() - startTime);
 
   haPairSetupState = eState_M3_SRPVerifyRequest;
 
@@ -461,6 +686,7 @@ OSStatus _HandleState_HandleSRPVerifyRespond(int inFd, pairInfo_t* inInfo, mico_
 
   uint8_t *httpResponse = NULL;
   size_t httpResponseLen = 0;
+  socket_iovec_t iov[2];
 
   const uint8_t * bytes_HAMK = 0;
 
@@ -601,9 +827,11 @@ OSStatus _HandleState_HandleSRPVerifyRespond(int inFd, pairInfo_t* inInfo, mico_
 
   err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
   require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend(inFd, outTLVResponse, outTLVResponseLen);
+  iov[0].iov_base = httpResponse;
+  iov[0].iov_len = httpResponseLen;
+  iov[1].iov_base = outTLVResponse;
+  iov[1].iov_len = outTLVResponseLen;
+  err = SocketSendv( inFd, iov, 2 );
   require_noerr( err, exit );
 
 exit:
@@ -750,6 +978,7 @@ OSStatus _HandleState_HandleExchangeRespond(int inFd, pairInfo_t** inInfo, mico_
 
   uint8_t *httpResponse = NULL;
   size_t httpResponseLen = 0;
+  socket_iovec_t iov[2];
   uint8_t  signHKDF[32];
   uint8_t LTPK[32];
   unsigned char *       encryptedData = NULL;
@@ -774,7 +1003,7 @@ OSStatus _HandleState_HandleExchangeRespond(int inFd, pairInfo_t** inInfo, mico_
     pair_log("Send: kTLVType_Status: 0x%x", kTLVError_MaxPeers);
   }else{
 
-    if(inContext->flashContentInRam.appConfig.haPairSetupFinished){
+    if(inContext->flashContentInRam.appConfig.haPairSetupFinished || _HKAccessoryLTSKValid(inContext)){
       memcpy(LTPK, inContext->flashContentInRam.appConfig.LTSK + 32, 32);
     }else{
       err = crypto_sign_keypair(LTPK, inContext->flashContentInRam.appConfig.LTSK);
@@ -864,9 +1093,11 @@ OSStatus _HandleState_HandleExchangeRespond(int inFd, pairInfo_t** inInfo, mico_
 
   err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
   require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend(inFd, outTLVResponse, outTLVResponseLen);
+  iov[0].iov_base = httpResponse;
+  iov[0].iov_len = httpResponseLen;
+  iov[1].iov_base = outTLVResponse;
+  iov[1].iov_len = outTLVResponseLen;
+  err = SocketSendv( inFd, iov, 2 );
   require_noerr( err, exit );
 
   /*Save accessory's LPSK*/
@@ -900,6 +1131,14 @@ OSStatus HKPairVerifyEngine( int inFd, HTTPHeader_t* inHeader, pairVerifyInfo_t*
     case eState_M1_VerifyStartRequest:
       err = _HandleState_WaitingForVerifyStartRequest( inHeader, inInfo, inContext );
       require_noerr_action( err, exit, inInfo->haPairVerifyState = eState_M1_VerifyStartRequest);
+#if HA_PAIR_RESUME_ENABLE
+      if(inInfo->resumeRequested){
+        err = _HandleState_WaitingForResumeRespond( inFd, inInfo, inContext );
+        if(err == kNoErr) break;
+        require_action( err == kNotFoundErr, exit, inInfo->haPairVerifyState = eState_M1_VerifyStartRequest);
+        pair_log("Session cannot be resumed, continue with pair verify");
+      }
+#endif
       err =  _HandleState_WaitingForVerifyStartRespond( inFd , inInfo, inContext );
       require_noerr_action( err, exit, inInfo->haPairVerifyState = eState_M1_VerifyStartRequest);
       break;
@@ -947,6 +1186,24 @@ OSStatus _HandleState_WaitingForVerifyStartRequest( HTTPHeader_t* inHeader, pair
       case kTLVType_PublicKey:
         inInfo->pControllerCurve25519PK = (uint8_t *)tmp;
         break;
+      case kTLVType_Method:
+#if HA_PAIR_RESUME_ENABLE
+        if(len >= sizeof(uint8_t))
+          inInfo->resumeRequested = (*(uint8_t *)tmp == Pair_Resume);
+#endif
+        free(tmp);
+        break;
+      case kTLVType_SessionID:
+        if(len == HKResumeSessionIDLen)
+          memcpy(inInfo->resumeSessionID, tmp, HKResumeSessionIDLen);
+        free(tmp);
+        break;
+      case kTLVType_EncryptedData:
+        if(len == crypto_aead_chacha20poly1305_ABYTES)
+          inInfo->pResumeAuthTag = (uint8_t *)tmp;
+        else
+          free(tmp);
+        break;
       default:
         pair_log( "Warning: Ignoring unsupported pair setup EID 0x%02X", eid );
         break;
@@ -967,6 +1224,7 @@ OSStatus _HandleState_WaitingForVerifyStartRespond(int inFd, pairVerifyInfo_t* i
   uint8_t             *tlvPtr;
   uint8_t             *httpResponse = NULL;
   size_t              httpResponseLen = 0;
+  socket_iovec_t      iov[2];
   uint8_t             *ABC = NULL;
   size_t              ABCLen = 0;
   uint8_t             *signature = NULL;
@@ -1079,9 +1337,11 @@ OSStatus _HandleState_WaitingForVerifyStartRespond(int inFd, pairVerifyInfo_t* i
 
   err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
   require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend(inFd, outTLVResponse, outTLVResponseLen);
+  iov[0].iov_base = httpResponse;
+  iov[0].iov_len = httpResponseLen;
+  iov[1].iov_base = outTLVResponse;
+  iov[1].iov_len = outTLVResponseLen;
+  err = SocketSendv( inFd, iov, 2 );
   require_noerr( err, exit );
   inInfo->haPairVerifyState = eState_M3_VerifyFinishRequest;
 
@@ -1155,7 +1415,7 @@ OSStatus _HandleState_WaitingForVerifyFinishRequest(HTTPHeader_t* inHeader, pair
     {
       case kTLVType_Identifier:
         controllerIdentifier = tmp;
-        inInfo->pControllerLTPK = HMFindLTPK(controllerIdentifier);
+        inInfo->controllerLTPKFound = HMFindLTPK(controllerIdentifier, inInfo->controllerLTPK);
         inInfo->pControllerIdentifier = malloc(len+1);
         memcpy(inInfo->pControllerIdentifier, tmp, len+1);
         controllerIdentifierLen = len;
@@ -1175,7 +1435,8 @@ OSStatus _HandleState_WaitingForVerifyFinishRequest(HTTPHeader_t* inHeader, pair
   memcpy(signature+64+32,                         controllerIdentifier,             controllerIdentifierLen);
   memcpy(signature+64+32+controllerIdentifierLen, inInfo->pAccessoryCurve25519PK,   32);
 
-  err = crypto_sign_open(NULL, NULL, signature, 64 + 32 + controllerIdentifierLen + 32, inInfo->pControllerLTPK);
+  require_action(inInfo->controllerLTPKFound, exit, err = kNotFoundErr);
+  err = crypto_sign_open(NULL, NULL, signature, 64 + 32 + controllerIdentifierLen + 32, inInfo->controllerLTPK);
   require_noerr_string(err, exit, "Signature verify failed");
   pair_log("Signature verify success");
 
@@ -1187,6 +1448,32 @@ exit:
   return err;
 }
 
+/* Derive the control channel keys from the shared secret and keep the secret for a later resume */
+static OSStatus _HKPairVerifyComplete(pairVerifyInfo_t* inInfo, const uint8_t *sessionID)
+{
+  OSStatus err = kNoErr;
+
+  inInfo->A2CKey = malloc(32);
+  require_action(inInfo->A2CKey, exit, err = kNoMemoryErr);
+  err = hkdf(SHA512,  (const unsigned char *) hkdfA2CKeySalt, strlen(hkdfA2CKeySalt),
+                            inInfo->pSharedSecret, 32,
+                            (const unsigned char *)hkdfA2CInfo, strlen(hkdfA2CInfo), inInfo->A2CKey, 32);
+  require_noerr(err, exit);
+
+  inInfo->C2AKey = malloc(32);
+  require_action(inInfo->C2AKey, exit, err = kNoMemoryErr);
+  err = hkdf(SHA512,  (const unsigned char *) hkdfC2AKeySalt, strlen(hkdfC2AKeySalt),
+                            inInfo->pSharedSecret, 32,
+                            (const unsigned char *)hkdfC2AInfo, strlen(hkdfC2AInfo), inInfo->C2AKey, 32);
+  require_noerr(err, exit);
+
+  _resumeCacheStore(inInfo->pControllerIdentifier, sessionID, inInfo->pSharedSecret);
+  inInfo->verifySuccess = true;
+
+exit:
+  return err;
+}
+
 OSStatus _HandleState_WaitingForVerifyFinishRespond(int inFd, pairVerifyInfo_t* inInfo, mico_Context_t * const inContext)
 {
   pair_log_trace();
@@ -1198,6 +1485,8 @@ OSStatus _HandleState_WaitingForVerifyFinishRespond(int inFd, pairVerifyInfo_t*
 
   uint8_t *httpResponse = NULL;
   size_t httpResponseLen = 0;
+  socket_iovec_t iov[2];
+  uint8_t sessionID[HKResumeSessionIDLen];
 
   outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
 
@@ -1209,29 +1498,134 @@ OSStatus _HandleState_WaitingForVerifyFinishRespond(int inFd, pairVerifyInfo_t*
   *tlvPtr++ = sizeof(uint8_t);
   *tlvPtr++ = eState_M4_SRPVerifyRespond;
 
-  inInfo->verifySuccess = true;
-  inInfo->A2CKey = malloc(32);
-  require_action(inInfo->A2CKey, exit, err = kNoMemoryErr);
-  err = hkdf(SHA512,  (const unsigned char *) hkdfA2CKeySalt, strlen(hkdfA2CKeySalt),
+  /* Both sides derive the ID that resumes this session */
+  err = hkdf(SHA512,  (const unsigned char *) hkdfResumeSessionIDSalt, strlen(hkdfResumeSessionIDSalt),
                             inInfo->pSharedSecret, 32,
-                            (const unsigned char *)hkdfA2CInfo, strlen(hkdfA2CInfo), inInfo->A2CKey, 32);
+                            (const unsigned char *)hkdfResumeSessionIDInfo, strlen(hkdfResumeSessionIDInfo), sessionID, HKResumeSessionIDLen);
   require_noerr(err, exit);
 
-  inInfo->C2AKey = malloc(32);
-  require_action(inInfo->C2AKey, exit, err = kNoMemoryErr);
-  err = hkdf(SHA512,  (const unsigned char *) hkdfC2AKeySalt, strlen(hkdfC2AKeySalt),
-                            inInfo->pSharedSecret, 32,
-                            (const unsigned char *)hkdfC2AInfo, strlen(hkdfC2AInfo), inInfo->C2AKey, 32);
+  err = _HKPairVerifyComplete(inInfo, sessionID);
   require_noerr(err, exit);
 
   err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
   require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
+  iov[0].iov_base = httpResponse;
+  iov[0].iov_len = httpResponseLen;
+  iov[1].iov_base = outTLVResponse;
+  iov[1].iov_len = outTLVResponseLen;
+  err = SocketSendv( inFd, iov, 2 );
+  require_noerr( err, exit );
+
+exit:
+  if(outTLVResponse) free(outTLVResponse);
+  if(httpResponse) free(httpResponse);
+  return err;
+}
+
+/* Resume a session verified before: the request is authenticated with a key derived from the
+   cached shared secret, so no Curve25519 agreement or Ed25519 signature is needed. Returns 
+   kNotFoundErr when the session cannot be resumed and a full pair verify should follow */
+OSStatus _HandleState_WaitingForResumeRespond(int inFd, pairVerifyInfo_t* inInfo, mico_Context_t * const inContext)
+{
+  pair_log_trace();
+  OSStatus            err = kNoErr;
+  (void)              inContext;
+  char                controllerIdentifier[65];
+  uint8_t             sharedSecret[32];
+  uint8_t             salt[32+HKResumeSessionIDLen];
+  uint8_t             resumeKey[32];
+  uint8_t             sessionID[HKResumeSessionIDLen];
+  uint8_t             authTag[crypto_aead_chacha20poly1305_ABYTES];
+  unsigned long long  authTagLen = 0;
+  uint8_t             *outTLVResponse = NULL;
+  size_t              outTLVResponseLen = 0;
+  uint8_t             *tlvPtr;
+  uint8_t             *httpResponse = NULL;
+  size_t              httpResponseLen = 0;
+  socket_iovec_t      iov[2];
+
+  require_action(inInfo->pControllerCurve25519PK && inInfo->pResumeAuthTag, exit, err = kNotFoundErr);
+  require_action_quiet(_resumeCacheFind(inInfo->resumeSessionID, controllerIdentifier, sharedSecret), exit, err = kNotFoundErr);
+  require_action(HMFindLTPK(controllerIdentifier, NULL), exit, err = kNotFoundErr);
+
+  /* Request key is salted with the controller's new public key and the session ID */
+  memcpy(salt, inInfo->pControllerCurve25519PK, 32);
+  memcpy(salt+32, inInfo->resumeSessionID, HKResumeSessionIDLen);
+  err = hkdf(SHA512,  salt, sizeof(salt), sharedSecret, 32,
+                      (const unsigned char *)hkdfResumeRequestInfo, strlen(hkdfResumeRequestInfo), resumeKey, 32);
+  require_noerr(err, exit);
+
+  err =  crypto_aead_chacha20poly1305_decrypt(authTag, &authTagLen, NULL, 
+                                              inInfo->pResumeAuthTag, crypto_aead_chacha20poly1305_ABYTES, NULL, 0,  
+                                              (const unsigned char *)AEAD_Nonce_Resume01, resumeKey);
+  require_noerr_action(err, exit, err = kNotFoundErr; pair_log("Resume request auth failed"));
+  require_action(_resumeCacheConsume(inInfo->resumeSessionID), exit, err = kNotFoundErr);
+
+  /* New session ID, response key and shared secret */
+  err = PlatformRandomBytes( sessionID, HKResumeSessionIDLen );
+  require_noerr( err, exit );
+  memcpy(salt+32, sessionID, HKResumeSessionIDLen);
+
+  err = hkdf(SHA512,  salt, sizeof(salt), sharedSecret, 32,
+                      (const unsigned char *)hkdfResumeResponseInfo, strlen(hkdfResumeResponseInfo), resumeKey, 32);
+  require_noerr(err, exit);
+  err =  crypto_aead_chacha20poly1305_encrypt(authTag, &authTagLen, (const unsigned char *)"", 0, NULL, 0, NULL, 
+                                              (const unsigned char *)AEAD_Nonce_Resume02, resumeKey);
+  require_noerr_action(err, exit, pair_log("crypto_aead_chacha20poly1305_encrypt failed"));
+
+  inInfo->pSharedSecret = malloc(32);
+  require_action(inInfo->pSharedSecret, exit, err = kNoMemoryErr);
+  err = hkdf(SHA512,  salt, sizeof(salt), sharedSecret, 32,
+                      (const unsigned char *)hkdfResumeSecretInfo, strlen(hkdfResumeSecretInfo), inInfo->pSharedSecret, 32);
+  require_noerr(err, exit);
+
+  inInfo->pControllerIdentifier = malloc(strlen(controllerIdentifier)+1);
+  require_action(inInfo->pControllerIdentifier, exit, err = kNoMemoryErr);
+  strcpy(inInfo->pControllerIdentifier, controllerIdentifier);
+
+  err = _HKPairVerifyComplete(inInfo, sessionID);
+  require_noerr(err, exit);
+
+  /* Respond with TLV item */
+  outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
+  outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
+  outTLVResponseLen += HKResumeSessionIDLen + kHATLV_TypeLengthSize;
+  outTLVResponseLen += authTagLen + kHATLV_TypeLengthSize;
+
+  outTLVResponse = calloc( outTLVResponseLen, sizeof( uint8_t ) );
+  require_action( outTLVResponse, exit, err = kNoMemoryErr );
+
+  tlvPtr = outTLVResponse;
+  *tlvPtr++ = kTLVType_State;
+  *tlvPtr++ = sizeof(uint8_t);
+  *tlvPtr++ = eState_M2_VerifyStartRespond;
+
+  *tlvPtr++ = kTLVType_Method;
+  *tlvPtr++ = sizeof(uint8_t);
+  *tlvPtr++ = Pair_Resume;
+
+  *tlvPtr++ = kTLVType_SessionID;
+  *tlvPtr++ = HKResumeSessionIDLen;
+  memcpy( tlvPtr, sessionID, HKResumeSessionIDLen );
+  tlvPtr += HKResumeSessionIDLen;
+
+  *tlvPtr++ = kTLVType_EncryptedData;
+  *tlvPtr++ = authTagLen;
+  memcpy( tlvPtr, authTag, authTagLen );
+
+  err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
   require_noerr( err, exit );
-  err = SocketSend( inFd, outTLVResponse, outTLVResponseLen );
+  iov[0].iov_base = httpResponse;
+  iov[0].iov_len = httpResponseLen;
+  iov[1].iov_base = outTLVResponse;
+  iov[1].iov_len = outTLVResponseLen;
+  err = SocketSendv( inFd, iov, 2 );
   require_noerr( err, exit );
+  pair_log("Session resumed");
 
 exit:
+  memset(sharedSecret, 0x0, sizeof(sharedSecret));
+  memset(resumeKey, 0x0, sizeof(resumeKey));
   if(outTLVResponse) free(outTLVResponse);
   if(httpResponse) free(httpResponse);
   return err;
@@ -1240,28 +1634,26 @@ exit:
 OSStatus HKSendPairResponseMessage(int sockfd, int status, uint8_t *payload, int payloadLen, security_session_t *session )
 {
   OSStatus err;
-  uint8_t *httpResponse = NULL;
+  char httpResponse[HKResponseHeaderMaxLen];
   size_t httpResponseLen = 0;
   const char *buffer = NULL;
   int bufferLen;
+  socket_iovec_t iov[2];
 
   buffer = (const char *)payload;
   bufferLen = payloadLen;
 
-  err = CreateHTTPRespondMessageNoCopy( status, kMIMEType_Pairing_TLV8, bufferLen, &httpResponse, &httpResponseLen );
-
+  err = CreateHTTPRespondHeader( status, kMIMEType_Pairing_TLV8, bufferLen, httpResponse, sizeof(httpResponse), &httpResponseLen );
   require_noerr( err, exit );
-  require( httpResponse, exit );
 
-  err = HKSecureSocketSend( sockfd, httpResponse, httpResponseLen, session );
+  iov[0].iov_base = (const uint8_t *)httpResponse;
+  iov[0].iov_len = httpResponseLen;
+  iov[1].iov_base = (const uint8_t *)buffer;
+  iov[1].iov_len = bufferLen;
+  err = HKSecureSocketSendv( sockfd, iov, bufferLen? 2 : 1, session );
   require_noerr( err, exit );
-  if(bufferLen){
-    err = HKSecureSocketSend( sockfd, (uint8_t *)buffer, bufferLen, session );
-    require_noerr( err, exit ); 
-  }
 
 exit:
-  if(httpResponse) free(httpResponse);
   return err;
 }
 
@@ -1379,6 +1771,7 @@ OSStatus HKPairAddRemoveEngine( int inFd, HTTPHeader_t* inHeader, security_sessi
 
   }else if(methold == Pair_Remove){
     require_action(controllerIdentifier, exit, err = kParamErr);
+    _resumeCacheRemoveController(controllerIdentifier);
 
     if( HMRemoveLTPK(controllerIdentifier) != kNoErr ){ //Remove
       outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
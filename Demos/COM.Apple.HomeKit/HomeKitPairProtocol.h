@@ -7,6 +7,7 @@
 #include "MICOSRPServer.h"
 #include "HomeKitHTTPUtils.h"
 
+#define HKResumeSessionIDLen  8
 
 
 /*Pair setup info*/
@@ -26,7 +27,8 @@ typedef struct _pairInfo_t {
 typedef struct _pairVerifyInfo_t {
   bool                      verifySuccess;
   int                       haPairVerifyState;
-  uint8_t                   *pControllerLTPK;
+  bool                      controllerLTPKFound;
+  uint8_t                   controllerLTPK[32];
   char                      *pControllerIdentifier;
   uint8_t                   *pControllerCurve25519PK;
   uint8_t                   *pAccessoryCurve25519PK;
@@ -35,14 +37,21 @@ typedef struct _pairVerifyInfo_t {
   uint8_t                   *pHKDFKey;
   uint8_t                   *A2CKey;
   uint8_t                   *C2AKey;
+  bool                      resumeRequested;
+  uint8_t                   resumeSessionID[HKResumeSessionIDLen];
+  uint8_t                   *pResumeAuthTag;
 } pairVerifyInfo_t;
 
 void HKSetPassword (const uint8_t * password, const size_t passwordLen);
 
 void HKSetVerifier (const uint8_t * verifier, const size_t verifierLen, const uint8_t * salt, const size_t saltLen );
 
+OSStatus HKPairSetupPrepare(mico_Context_t * const inContext);
+
 void HKCleanPairSetupInfo(pairInfo_t **info, mico_Context_t * const inContext);
 
+void HKPairResumeInit(void);
+
 pairVerifyInfo_t* HKCreatePairVerifyInfo(void);
 
 void HKCleanPairVerifyInfo(pairVerifyInfo_t **verifyInfo);
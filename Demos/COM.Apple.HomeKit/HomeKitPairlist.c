@@ -22,44 +22,357 @@
 #include "HomeKitPairlist.h"
 #include "Debug.h"
 #include "MicoPlatform.h"
+#include "MICORTOS.h"
 #include "platform_config.h"
 
-/* Update seed number every time*/
+#define pair_log(M, ...) custom_log("HKPair", M, ##__VA_ARGS__)
+
+#define kPairRecordMagic      0x5AC3    //First byte 0xC3 can never start a controller name
+#define kPairRecordAdd        0x01
+#define kPairRecordRemove     0x02
+
+#define PairHashSize          32        //Power of 2, larger than MAXPairNumber
+#define MAXLegacyPairNumber   ((EX_PARA_FLASH_SIZE-64)/(MaxControllerNameLen+32+4))
+
+/* Every add and remove is appended to EX_PARA as a record, the magic is written
+   last so a record torn by a power loss never passes the check on replay */
+typedef struct _pair_record_t {
+  uint16_t         magic;
+  uint8_t          type;
+  uint8_t          permission;
+  char             controllerName[MaxControllerNameLen];
+  uint8_t          controllerLTPK[32];
+  uint16_t         reserved;
+  uint16_t         crc;
+} pair_record_t;
+
+#define MAXPairRecordNumber   (EX_PARA_FLASH_SIZE/sizeof(pair_record_t))
+
+static pair_list_in_flash_t pairTable;
+static uint8_t      pairHash[PairHashSize];   //! pairTable slot + 1, 0 is an empty bucket
+static uint32_t     pairRecordTail = 0;       //! Next free record in EX_PARA
+static bool         pairListLoaded = false;
+static bool         pairListLegacy = false;   //! EX_PARA still holds the fixed table of older firmware
+static mico_mutex_t pairListMutex = NULL;     //! Created by HMPairListInit
+
+static uint16_t _pairCRC16(const uint8_t *data, uint32_t len)
+{
+  uint16_t crc = 0xFFFF;
+  uint8_t i;
+
+  while(len--){
+    crc ^= (uint16_t)(*data++) << 8;
+    for(i = 0; i < 8; i++)
+      crc = (crc & 0x8000)? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static uint16_t _pairRecordCRC(const pair_record_t *record)
+{
+  return _pairCRC16(&record->type, (uint32_t)((const uint8_t *)&record->crc - &record->type));
+}
+
+static uint32_t _pairNameHash(const char *name)
+{
+  uint32_t hash = 2166136261UL;
+  uint32_t i;
+
+  for(i = 0; i < MaxControllerNameLen && name[i] != 0x0; i++)
+    hash = (hash ^ (uint8_t)name[i]) * 16777619UL;
+  return hash;
+}
+
+/* Return the pairTable slot that holds the controller, or -1 */
+static int _pairFind(const char *name)
+{
+  uint32_t bucket = _pairNameHash(name) & (PairHashSize - 1);
+  uint32_t probe;
+  int slot;
+
+  for(probe = 0; probe < PairHashSize; probe++){
+    slot = pairHash[bucket] - 1;
+    if(slot < 0)
+      break;
+    if(strncmp(pairTable.pairInfo[slot].controllerName, name, MaxControllerNameLen) == 0)
+      return slot;
+    bucket = (bucket + 1) & (PairHashSize - 1);
+  }
+  return -1;
+}
+
+static void _pairHashInsert(int slot)
+{
+  uint32_t bucket = _pairNameHash(pairTable.pairInfo[slot].controllerName) & (PairHashSize - 1);
+
+  while(pairHash[bucket] != 0)
+    bucket = (bucket + 1) & (PairHashSize - 1);
+  pairHash[bucket] = slot + 1;
+}
+
+static void _pairHashRebuild(void)
+{
+  int i;
+
+  memset(pairHash, 0x0, sizeof(pairHash));
+  for(i = 0; i < MAXPairNumber; i++){
+    if(pairTable.pairInfo[i].controllerName[0] != 0x0)
+      _pairHashInsert(i);
+  }
+}
+
+/* Apply an add or remove to the RAM table */
+static OSStatus _pairApply(uint8_t type, const char *name, const uint8_t *controllerLTPK, int permission)
+{
+  int slot = _pairFind(name);
+
+  if(type == kPairRecordRemove){
+    if(slot >= 0){
+      memset(&pairTable.pairInfo[slot], 0x0, sizeof(_pair_t));
+      _pairHashRebuild();
+    }
+    return kNoErr;
+  }
+
+  if(slot < 0){
+    for(slot = 0; slot < MAXPairNumber; slot++){
+      if(pairTable.pairInfo[slot].controllerName[0] == 0x0)
+        break;
+    }
+    if(slot == MAXPairNumber)
+      return kNoSpaceErr;
+    strncpy(pairTable.pairInfo[slot].controllerName, name, MaxControllerNameLen);
+    _pairHashInsert(slot);
+  }
+  memcpy(pairTable.pairInfo[slot].controllerLTPK, controllerLTPK, 32);
+  pairTable.pairInfo[slot].permission = permission;
+  return kNoErr;
+}
+
+static void _pairRecordFill(pair_record_t *record, uint8_t type, const char *name, const uint8_t *controllerLTPK, int permission)
+{
+  memset(record, 0x0, sizeof(pair_record_t));
+  record->type = type;
+  record->permission = (uint8_t)permission;
+  strncpy(record->controllerName, name, MaxControllerNameLen);
+  if(controllerLTPK)
+    memcpy(record->controllerLTPK, controllerLTPK, 32);
+}
+
+/* Program one record after the log tail and read it back, the slot is consumed even if it fails */
+static OSStatus _pairRecordAppend(pair_record_t *record)
+{
+  OSStatus err = kNoErr;
+  pair_record_t readback;
+  uint32_t recordAddress, address;
+
+  require_action(pairRecordTail < MAXPairRecordNumber, exit, err = kNoSpaceErr);
+
+  record->magic = kPairRecordMagic;
+  record->reserved = 0xFFFF;
+  record->crc = _pairRecordCRC(record);
+
+  recordAddress = EX_PARA_START_ADDRESS + pairRecordTail * sizeof(pair_record_t);
+  pairRecordTail++;
+
+  address = recordAddress + sizeof(record->magic);
+  err = MicoFlashWrite(MICO_FLASH_FOR_EX_PARA, &address, (uint8_t *)record + sizeof(record->magic), sizeof(pair_record_t) - sizeof(record->magic));
+  require_noerr(err, exit);
+  address = recordAddress;
+  err = MicoFlashWrite(MICO_FLASH_FOR_EX_PARA, &address, (uint8_t *)&record->magic, sizeof(record->magic));
+  require_noerr(err, exit);
+
+  address = recordAddress;
+  err = MicoFlashRead(MICO_FLASH_FOR_EX_PARA, &address, (uint8_t *)&readback, sizeof(pair_record_t));
+  require_noerr(err, exit);
+  require_action(memcmp(&readback, record, sizeof(pair_record_t)) == 0, exit, err = kWriteErr);
+
+exit:
+  return err;
+}
+
+/* Erase EX_PARA and write one add record for every pairing in RAM. EX_PARA is a single erase
+   unit on every board and there is no spare one, so the list only lives in RAM until the records
+   are written back: this is kept to a full log, HMUpdatePairList and the first change after a
+   legacy table was read, never done on boot */
+static OSStatus _pairListCompact(void)
+{
+  OSStatus err = kNoErr;
+  pair_record_t record;
+  int i;
+
+  err = MicoFlashErase(MICO_FLASH_FOR_EX_PARA, EX_PARA_START_ADDRESS, EX_PARA_END_ADDRESS);
+  require_noerr(err, exit);
+  pairRecordTail = 0;
+  pairListLegacy = false;
+
+  for(i = 0; i < MAXPairNumber; i++){
+    if(pairTable.pairInfo[i].controllerName[0] == 0x0)
+      continue;
+    _pairRecordFill(&record, kPairRecordAdd, pairTable.pairInfo[i].controllerName,
+                    pairTable.pairInfo[i].controllerLTPK, pairTable.pairInfo[i].permission);
+    err = _pairRecordAppend(&record);
+    require_noerr(err, exit);
+  }
+
+exit:
+  return err;
+}
+
+/* Rebuild the RAM table from EX_PARA. A pair list written as a fixed table by older firmware
+   is only read here, it is converted to log records by the first change */
+static OSStatus _pairListLoad(void)
+{
+  OSStatus err = kNoErr;
+  pair_record_t record;
+  _pair_t legacy;
+  uint32_t address = EX_PARA_START_ADDRESS;
+  uint32_t i;
+  uint8_t *p;
+
+  memset(&pairTable, 0x0, sizeof(pair_list_in_flash_t));
+  memset(pairHash, 0x0, sizeof(pairHash));
+  pairRecordTail = 0;
+  pairListLegacy = false;
+
+  err = MicoFlashRead(MICO_FLASH_FOR_EX_PARA, &address, (uint8_t *)&record, sizeof(pair_record_t));
+  require_noerr(err, exit);
+
+  if(*(uint8_t *)&record < 0x80){
+    address = EX_PARA_START_ADDRESS;
+    for(i = 0; i < MAXLegacyPairNumber; i++){
+      err = MicoFlashRead(MICO_FLASH_FOR_EX_PARA, &address, (uint8_t *)&legacy, sizeof(_pair_t));
+      require_noerr(err, exit);
+      if(legacy.controllerName[0] == 0x0)
+        continue;
+      if(_pairApply(kPairRecordAdd, legacy.controllerName, legacy.controllerLTPK, legacy.permission) != kNoErr)
+        pair_log("Pair list full, %s dropped", legacy.controllerName);
+    }
+    pairListLegacy = true;
+    goto exit;
+  }
+
+  address = EX_PARA_START_ADDRESS;
+  for(i = 0; i < MAXPairRecordNumber; i++){
+    err = MicoFlashRead(MICO_FLASH_FOR_EX_PARA, &address, (uint8_t *)&record, sizeof(pair_record_t));
+    require_noerr(err, exit);
+
+    for(p = (uint8_t *)&record; p < (uint8_t *)(&record + 1) && *p == 0xFF; p++);
+    if(p == (uint8_t *)(&record + 1))
+      continue;  //Erased, a failed write may still leave records after it
+    pairRecordTail = i + 1;
+
+    if(record.magic != kPairRecordMagic || record.crc != _pairRecordCRC(&record))
+      continue;  //Torn by a power loss, never committed
+    if(record.type != kPairRecordAdd && record.type != kPairRecordRemove)
+      continue;
+    _pairApply(record.type, record.controllerName, record.controllerLTPK, record.permission);
+  }
+
+exit:
+  return err;
+}
+
+/* Take the pair list lock, the table is read from flash on first use. Before HMPairListInit
+   there is no lock, only the boot path runs then (HMClearPairList on a restore default) */
+static void _pairListLock(void)
+{
+  if(pairListMutex)
+    mico_rtos_lock_mutex(&pairListMutex);
+
+  if(pairListLoaded == false && _pairListLoad() == kNoErr)
+    pairListLoaded = true;
+}
+
+static void _pairListUnlock(void)
+{
+  if(pairListMutex)
+    mico_rtos_unlock_mutex(&pairListMutex);
+}
+
+/* Persist one record, pairTable already holds the new state. Compact EX_PARA 
+   when the log is full or still holds a legacy table, and reload from flash if that fails too */
+static OSStatus _pairListCommit(pair_record_t *record)
+{
+  OSStatus err = kNoErr;
+
+  err = MicoFlashInitialize(MICO_FLASH_FOR_EX_PARA);
+  require_noerr(err, exit);
+
+  if(pairListLegacy){
+    pair_log("Convert pair list to log records");
+    err = _pairListCompact();
+    MicoFlashFinalize(MICO_FLASH_FOR_EX_PARA);
+    goto exit;
+  }
+
+  err = _pairRecordAppend(record);
+  if(err == kWriteErr)
+    err = _pairRecordAppend(record);
+  if(err != kNoErr){
+    pair_log("Compact pair list, err: %d", err);
+    err = _pairListCompact();
+  }
+  MicoFlashFinalize(MICO_FLASH_FOR_EX_PARA);
+
+exit:
+  if(err != kNoErr && _pairListLoad() != kNoErr)
+    pairListLoaded = false;
+  return err;
+}
+
+OSStatus HMPairListInit(void)
+{
+  OSStatus err = kNoErr;
+
+  if(pairListMutex == NULL)
+    err = mico_rtos_init_mutex(&pairListMutex);
+  require_noerr(err, exit);
+
+  _pairListLock();
+  if(pairListLoaded == false)
+    err = kReadErr;
+  _pairListUnlock();
+
+exit:
+  return err;
+}
 
 OSStatus HMClearPairList(void)
 { 
   OSStatus err = kNoErr;
-  uint32_t exParaStartAddress, exParaEndAddress;
- 
-  exParaStartAddress = EX_PARA_START_ADDRESS;
-  exParaEndAddress = EX_PARA_END_ADDRESS;
-  pair_list_in_flash_t *pairList = NULL;
-  pairList = calloc(1, sizeof(pair_list_in_flash_t));
-  require_action(pairList, exit, err = kNoMemoryErr);
+
+  _pairListLock();
 
   err = MicoFlashInitialize(MICO_FLASH_FOR_EX_PARA);
   require_noerr(err, exit);
-  err = MicoFlashErase(MICO_FLASH_FOR_EX_PARA, exParaStartAddress, exParaEndAddress);
-  require_noerr(err, exit);
-  err = MicoFlashWrite(MICO_FLASH_FOR_EX_PARA, &exParaStartAddress, (uint8_t *)pairList, sizeof(pair_list_in_flash_t));
+  err = MicoFlashErase(MICO_FLASH_FOR_EX_PARA, EX_PARA_START_ADDRESS, EX_PARA_END_ADDRESS);
   require_noerr(err, exit);
   err = MicoFlashFinalize(MICO_FLASH_FOR_EX_PARA);
   require_noerr(err, exit);
 
+  memset(&pairTable, 0x0, sizeof(pair_list_in_flash_t));
+  memset(pairHash, 0x0, sizeof(pairHash));
+  pairRecordTail = 0;
+  pairListLegacy = false;
+  pairListLoaded = true;
+
 exit:
-  if(pairList) free(pairList);
+  _pairListUnlock();
   return err;
 }
 
 OSStatus HMReadPairList(pair_list_in_flash_t *pPairList)
 {
-  uint32_t configInFlash;
   OSStatus err = kNoErr;
-  require(pPairList, exit);
+  require_action(pPairList, exit, err = kParamErr);
 
-  configInFlash = EX_PARA_START_ADDRESS;
-  err = MicoFlashRead(MICO_FLASH_FOR_EX_PARA, &configInFlash, (uint8_t *)pPairList, sizeof(pair_list_in_flash_t));
-  //memcpy(pPairList, (void *)configInFlash, sizeof(pair_list_in_flash_t));
+  _pairListLock();
+  if(pairListLoaded)
+    memcpy(pPairList, &pairTable, sizeof(pair_list_in_flash_t));
+  else
+    err = kReadErr;
+  _pairListUnlock();
 
 exit: 
   return err;
@@ -68,19 +381,21 @@ exit:
 OSStatus HMUpdatePairList(pair_list_in_flash_t *pPairList)
 {
   OSStatus err = kNoErr;
-  uint32_t exParaStartAddress, exParaEndAddress;
- 
-  exParaStartAddress = EX_PARA_START_ADDRESS;
-  exParaEndAddress = EX_PARA_END_ADDRESS;
+  require_action(pPairList, exit, err = kParamErr);
+
+  _pairListLock();
+
+  memcpy(&pairTable, pPairList, sizeof(pair_list_in_flash_t));
+  _pairHashRebuild();
 
   err = MicoFlashInitialize(MICO_FLASH_FOR_EX_PARA);
-  require_noerr(err, exit);
-  err = MicoFlashErase(MICO_FLASH_FOR_EX_PARA, exParaStartAddress, exParaEndAddress);
-  require_noerr(err, exit);
-  err = MicoFlashWrite(MICO_FLASH_FOR_EX_PARA, &exParaStartAddress, (uint8_t *)pPairList, sizeof(pair_list_in_flash_t));
-  require_noerr(err, exit);
-  err = MicoFlashFinalize(MICO_FLASH_FOR_EX_PARA);
-  require_noerr(err, exit);
+  if(err == kNoErr){
+    err = _pairListCompact();
+    MicoFlashFinalize(MICO_FLASH_FOR_EX_PARA);
+  }
+  pairListLoaded = (err == kNoErr || _pairListLoad() == kNoErr);
+
+  _pairListUnlock();
 
 exit:
   return err;
@@ -89,108 +404,81 @@ exit:
 OSStatus HKInsertPairInfo(char controllerIdentifier[64], uint8_t controllerLTPK[32], bool admin)
 {
   OSStatus err = kNoErr;
-  pair_list_in_flash_t        *pairList = NULL;
-  uint32_t i;
+  pair_record_t record;
+  int slot, permission = 0;
 
-  /* Pair storage */
-  pairList = calloc(1, sizeof(pair_list_in_flash_t));
-  require_action(pairList, exit, err = kNoMemoryErr);
-  err = HMReadPairList(pairList);
-  require_noerr(err, exit);
-  
-  /* Looking for controller pair record */
-  for(i=0; i<MAXPairNumber; i++){
-    if(strncmp(pairList->pairInfo[i].controllerName, controllerIdentifier, 64)==0)
-      break;
-  }
+  _pairListLock();
+  require_action(pairListLoaded, exit, err = kReadErr);
 
-  /* This is a new record */
-  if(i == MAXPairNumber){
-    for(i=0; i<MAXPairNumber; i++){
-      if(pairList->pairInfo[i].controllerName[0] == 0x0)
-      break;
-    }
-  }
-  
-  /* No space for new record */
-  require_action(i < MAXPairNumber, exit, err = kNoSpaceErr);
+  /* Looking for controller pair record */
+  slot = _pairFind(controllerIdentifier);
+  if(slot >= 0)
+    permission = pairTable.pairInfo[slot].permission;
 
-  /* Write pair info to flash */
-  strcpy(pairList->pairInfo[i].controllerName, controllerIdentifier);
-  memcpy(pairList->pairInfo[i].controllerLTPK, controllerLTPK, 32);
   if(admin)
-    pairList->pairInfo[i].permission = pairList->pairInfo[i].permission|0x00000001;
+    permission = permission|0x00000001;
   else
-    pairList->pairInfo[i].permission = pairList->pairInfo[i].permission&0xFFFFFFFE;
-  err = HMUpdatePairList(pairList);
+    permission = permission&0xFFFFFFFE;
+
+  /* No space for new record */
+  err = _pairApply(kPairRecordAdd, controllerIdentifier, controllerLTPK, permission);
+  require_noerr(err, exit);
+
+  _pairRecordFill(&record, kPairRecordAdd, controllerIdentifier, controllerLTPK, permission);
+  err = _pairListCommit(&record);
 
 exit: 
-  if(pairList) free(pairList);
+  _pairListUnlock();
   return err;
 }
 
-
-uint8_t foundControllerLTPK[32];
-
-uint8_t * HMFindLTPK(char * name)
+/* The key is copied to the caller's buffer while the list is locked, controllerLTPK may be NULL to only check 
+   that the controller is paired */
+bool HMFindLTPK(char * name, uint8_t controllerLTPK[32])
 {
-  uint8_t *controllerLTPK = NULL;
-  uint32_t i;
-
-  pair_list_in_flash_t *pairList = malloc(sizeof(pair_list_in_flash_t));
-  HMReadPairList(pairList);
+  bool ret = false;
+  int slot;
 
-  for(i=0; i<MAXPairNumber; i++){
-    if(strncmp(pairList->pairInfo[i].controllerName, name, 64) == 0){
-      memcpy(foundControllerLTPK, pairList->pairInfo[i].controllerLTPK, 32);
-      controllerLTPK = foundControllerLTPK;
-      break;
-    }
+  _pairListLock();
+  slot = _pairFind(name);
+  if(slot >= 0){
+    if(controllerLTPK) memcpy(controllerLTPK, pairTable.pairInfo[slot].controllerLTPK, 32);
+    ret = true;
   }
-  
-  free(pairList);
-  return controllerLTPK;
+  _pairListUnlock();
+
+  return ret;
 }
 
 bool HMFindAdmin(char * name)
 {
-  uint32_t i;
   bool ret = false;
+  int slot;
 
-  pair_list_in_flash_t *pairList = malloc(sizeof(pair_list_in_flash_t));
-  HMReadPairList(pairList);
+  _pairListLock();
+  slot = _pairFind(name);
+  if(slot >= 0)
+    ret = pairTable.pairInfo[slot].permission&0x1;
+  _pairListUnlock();
 
-  for(i=0; i<MAXPairNumber; i++){
-    if(strncmp(pairList->pairInfo[i].controllerName, name, 64) == 0){
-      ret = pairList->pairInfo[i].permission&0x1;
-      free(pairList);
-      return ret;
-    }
-  }
-  
-  free(pairList);
   return ret;
 }
 
 OSStatus HMRemoveLTPK(char * name)
 {
-  uint32_t i;
   OSStatus err = kNoErr;
+  pair_record_t record;
 
-  pair_list_in_flash_t *pairList = malloc(sizeof(pair_list_in_flash_t));
-  HMReadPairList(pairList);
+  _pairListLock();
+  require_action(pairListLoaded, exit, err = kReadErr);
+  require_quiet(_pairFind(name) >= 0, exit);
 
-  for(i=0; i<MAXPairNumber; i++){
-    if(strncmp(pairList->pairInfo[i].controllerName, name, 64) == 0){
-      pairList->pairInfo[i].controllerName[0] = 0x0; //Clear the controller name record
-      err = HMUpdatePairList(pairList);
-      break;
-    }
-  }
-  
-  free(pairList);
+  _pairApply(kPairRecordRemove, name, NULL, 0);
+  _pairRecordFill(&record, kPairRecordRemove, name, NULL, 0);
+  err = _pairListCommit(&record);
+
+exit:
+  _pairListUnlock();
   return err;  
 }
 
-
-
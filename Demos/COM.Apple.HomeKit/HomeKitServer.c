@@ -42,6 +42,7 @@
 #define kIdentity           "/identify"  
 
 #define min(a,b) ((a) < (b) ? (a) : (b))
+#define max(a,b) ((a) > (b) ? (a) : (b))
 
 /* Raw type password */
 static const char *password = "454-45-454";
@@ -90,24 +91,84 @@ typedef struct _HK_Char_ID_t {
   int          characteristicID;
 } HK_Char_ID_t;
 
+/* One characteristic of a /characteristics request or /accessories response */
+typedef struct _HK_Char_Request_t {
+  HK_Char_ID_t     id;
+  bool             dispatch;      //! Value is read from or written to the application
+  HK_Char_Value_t  charValue;
+} HK_Char_Request_t;
+
+/* One change of a characteristic, rendered once by HKCharacteristicDidChange and shared by
+   every subscribed session until each has sent it. refs is protected by sessionMutex */
+typedef struct _HK_Event{
+  int    refs;
+  size_t len;
+  char   text[1];           //! {"aid":..,"iid":..,"value":..}, not NUL terminated
+} HK_Event_t;
+
 typedef struct _HK_Notify{
   int aid;
   int iid;
-  value_union value;
+  int serviceID;
+  int characteristicID;
+  uint8_t valueType;      //! From the instance ID table, checked when the subscription was added
+  value_union value;      //! Latest value reported by HKCharacteristicDidChange
+  HK_Event_t *event;      //! Change not sent yet, NULL when there is none
   struct _HK_Notify *next;
 } HK_Notify_t;
 
+#define HKEventBatchSize      16              //! Changes sent in one EVENT message
+
+/* One controller connection, registered by the listener before its client thread starts.
+   The client thread blocks on an event fd made from eventQueue. HKCharacteristicDidChange
+   pushes one message when the first subscribed characteristic changes and later changes
+   are merged until it is sent. The listener pushes one when it sheds the session */
+typedef struct _HK_Session{
+  int          fd;
+  int          eventFd;
+  mico_queue_t eventQueue;
+  bool         signaled;
+  bool         verified;      //! Pair verify finished
+  bool         pairing;       //! Pair setup in progress, never shed or timed out
+  bool         shed;          //! Closed by admission control to make room for a new connection
+  uint32_t     lastActive;    //! mico_get_time() of the last request
+  HK_Notify_t *notifyList;
+  struct _HK_Session *next;
+} HK_Session_t;
+
+#define HKUnverifiedTimeout   (30*1000)       //! Unverified connections idle this long are closed, in ms
+#define HKIdleShedTime        (60*1000)       //! Verified sessions idle this long may be shed for a new one, in ms
+#define HKClientStackSize     0x1000
+#define HKHeapReserve         (8*1024)        //! Heap kept free for requests in progress
+#define HKHeaderPoolSize      3               //! HTTP headers shared by all sessions, held while one request is read
+#define HKHeaderWaitTime      5000
+/* Heap held by one connected session: stack, security session, this record, and about
+   256 bytes for the thread control block, queue and event fd */
+#define HKSessionMemory       (HKClientStackSize + sizeof(security_session_t) + sizeof(HK_Session_t) + 256)
+
 extern void HKCharacteristicInit(mico_Context_t * const inContext);
 extern HkStatus HKReadCharacteristicValue(int accessoryID, int serviceID, int characteristicID, value_union *value, mico_Context_t * const inContext);
 extern void HKWriteCharacteristicValue(int accessoryID, int serviceID, int characteristicID, value_union value, bool moreComing, mico_Context_t * const inContext);
 extern HkStatus HKReadCharacteristicStatus(int accessoryID, int serviceID, int characteristicID, mico_Context_t * const inContext);
+extern void HKReadCharacteristicValues(int accessoryID, HK_Char_Value_t values[], int count, mico_Context_t * const inContext);
+extern void HKWriteCharacteristicValues(int accessoryID, HK_Char_Value_t values[], int count, mico_Context_t * const inContext);
 extern HkStatus HKExcuteUnpairedIdentityRoutine( mico_Context_t * const inContext );
 
 
-static void homeKitClient_thread(void *inFd);
+static void homeKitClient_thread(void *arg);
+static void HKHeaderPoolInit(void);
+static OSStatus HKAccessoriesCacheInit(void);
+static OSStatus HKSessionAdmit(void);
+static HK_Session_t *HKSessionNew(int fd);
+static void HKSessionFree(HK_Session_t *hkSession);
 static mico_Context_t *Context;
+static mico_mutex_t sessionMutex = NULL;   //! Protects hkSessions, every notify list and the header pool
+static HK_Session_t *hkSessions = NULL;
+static HTTPHeader_t headerPool[HKHeaderPoolSize];
+static bool headerPoolUsed[HKHeaderPoolSize];
+static mico_semaphore_t headerPoolSem = NULL;
 static OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notify_t** notifyList, HK_Context_t *inHkContext, mico_Context_t * const inContext);
-static OSStatus HKCreateHAPAttriDataBase( struct _hapAccessory_t *inHapObject,  HK_Notify_t* notifyList, json_object **OutHapObjectJson,  mico_Context_t * const inContext);
+static void HKPrintbufAddValue(printbuf *buffer, valueType type, value_union value);
 static OSStatus HKCreateHAPReadRespond( struct _hapAccessory_t inHapObject[],  json_object **OutHapObjectJson, 
                                                 int accessoryID, int serviceID, int characteristicID, mico_Context_t * const inContext);
 static OSStatus HKCreateHAPWriteRespond( struct _hapAccessory_t inHapObject[],  json_object *inputHapObjectJson, json_object **OutHapObjectJson,
@@ -130,10 +191,21 @@ void homeKitListener_thread(void *inContext)
   char ip_address[16];
   
   int homeKitlistener_fd = -1;
+  HK_Session_t *hkSession;
   //HKSetPassword (password, strlen(password));
   HKSetVerifier(verifier, sizeof(verifier), salt, sizeof(salt));
+  HKPairSetupPrepare(inContext);
 
   Context->appStatus.haPairSetupRunning = false;
+  err = mico_rtos_init_mutex(&sessionMutex);
+  require_noerr(err, exit);
+  HKHeaderPoolInit();
+  HKSecureInit();
+  HKIIDTableInit();
+  err = HKAccessoriesCacheInit();
+  require_noerr(err, exit);
+  HMPairListInit();
+  HKPairResumeInit();
   HKCharacteristicInit(inContext);
   /*Establish a TCP server fd that accept the tcp clients connections*/ 
   homeKitlistener_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
@@ -151,7 +223,7 @@ void homeKitListener_thread(void *inContext)
   while(1){
     FD_ZERO(&readfds);
     FD_SET(homeKitlistener_fd, &readfds);
-    select(1, &readfds, NULL, NULL, NULL);
+    select(homeKitlistener_fd + 1, &readfds, NULL, NULL, NULL);
 
     /*Check tcp connection requests */
     if(FD_ISSET(homeKitlistener_fd, &readfds)){
@@ -160,11 +232,18 @@ void homeKitListener_thread(void *inContext)
       if (j > 0) {
         inet_ntoa(ip_address, addr.s_ip );
         ha_log("HomeKit Client %s:%d connected, fd: %d", ip_address, addr.s_port, j);
-        ha_log("memory>>>>>>>>: %d", mico_memory_info()->free_memory);
-        err = mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "HomeKit Client", homeKitClient_thread, 0x1000, &j);  
+        hkSession = NULL;
+        if(HKSessionAdmit() == kNoErr)
+          hkSession = HKSessionNew(j);
+        if(hkSession == NULL){
+          ha_log("HomeKit Client for fd %d rejected, free memory: %d", j, mico_memory_info()->free_memory);
+          SocketClose(&j);
+          continue;
+        }
+        err = mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "HomeKit Client", homeKitClient_thread, HKClientStackSize, hkSession);  
         if(err != kNoErr){
           ha_log("HomeKit Client for fd %d create failed", j);
-          SocketClose(&j);
+          HKSessionFree(hkSession);
         }
       }
     }
@@ -178,57 +257,50 @@ exit:
 
 void FindCharacteristicByIID(struct _hapAccessory_t inHapObject[], int aid, int iid, int *serviceID, int *characteristicID)
 {
-  int serviceIndex, characteristicIndex, tmpIID;
-  tmpIID = 1;
-  *serviceID = 0;
-  *characteristicID = 0;
-
-  for(serviceIndex = 0; serviceIndex < MAXServicePerAccessory; serviceIndex++){
-    if(inHapObject[aid-1].services[serviceIndex].type == 0 || tmpIID > iid)
-      return;
-    if(tmpIID == iid){
-      *serviceID = serviceIndex + 1;
-      return;
-    }
-    tmpIID ++;
+  const hapIID_t *entry = HKIIDTableLookup(aid, iid);
+  (void)inHapObject;
 
-    for(characteristicIndex = 0; characteristicIndex < MAXCharacteristicPerService; characteristicIndex++){
-      if(inHapObject[aid-1].services[serviceIndex].characteristic[characteristicIndex].type == 0 )
-        break;
-      if(tmpIID > iid)
-        return;
-      if(tmpIID == iid){
-        *serviceID = serviceIndex + 1;
-        *characteristicID = characteristicIndex + 1;;
-        return;
-      }
-      tmpIID ++;
-    }
-  }
+  *serviceID = entry? entry->serviceID : 0;
+  *characteristicID = entry? entry->characteristicID : 0;
+}
+
+static void HKEventRelease(HK_Event_t **event)
+{
+  if(*event == NULL) return;
+  if(--(*event)->refs == 0)
+    free(*event);
+  *event = NULL;
 }
 
-OSStatus HKNotificationAdd( int aid, int iid, value_union value, HK_Notify_t** notifyList )
+/* IDs are checked against the instance ID table here, so a stored subscription always names an
+   existing characteristic that supports events */
+OSStatus HKNotificationAdd( HK_Char_ID_t id, HK_Notify_t** notifyList )
 {
   OSStatus err = kNoErr;
-  HK_Notify_t *notify = (HK_Notify_t *)malloc(sizeof(HK_Notify_t));
+  const hapIID_t *entry = HKIIDTableLookup(id.aid, id.iid);
+  HK_Notify_t *notify = NULL;
   HK_Notify_t *tmp = * notifyList;
+  require_action(entry && entry->serviceID == id.serviceID && entry->characteristicID == id.characteristicID
+                 && id.characteristicID != 0 && (entry->perms & kHAPPermEvents), exit, err = kParamErr);
+  notify = (HK_Notify_t *)malloc(sizeof(HK_Notify_t));
   require_action(notify, exit, err = kNoMemoryErr);
-  notify->aid = aid;
-  notify->iid = iid;
-  notify->value = value;
+  notify->aid = id.aid;
+  notify->iid = id.iid;
+  notify->serviceID = id.serviceID;
+  notify->characteristicID = id.characteristicID;
+  notify->valueType = entry->valueType;
+  notify->event = NULL;
   notify->next = NULL;
   if(* notifyList == NULL){
     * notifyList = notify;
   }else{
-    if(tmp->aid == aid && tmp->iid == iid){
+    if(tmp->aid == id.aid && tmp->iid == id.iid){
       free(notify);
-      memcpy(&tmp->value, &value, sizeof(value_union));
       return kNoErr;   //Nodify already exist
     }
     while(tmp->next!=NULL){
       tmp = tmp->next;
-      if(tmp->aid == aid && tmp->iid == iid){
-        memcpy(&tmp->value, &value, sizeof(value_union));
+      if(tmp->aid == id.aid && tmp->iid == id.iid){
         free(notify);
         return kNoErr;   //Nodify already exist
       }
@@ -249,11 +321,11 @@ OSStatus HKNotificationRemove( int aid, int iid, HK_Notify_t** notifyList )
     if(temp->aid == aid && temp->iid == iid){
       if(temp == *notifyList){  //first element
         * notifyList = temp->next;
-        free(temp);
       }else{
         temp2->next = temp->next;
-        free(temp);
       }
+      HKEventRelease(&temp->event);
+      free(temp);
        break;
     }
     require_action(temp->next!=NULL, exit, err = kNotFoundErr);
@@ -301,6 +373,7 @@ OSStatus HKNotificationClean( HK_Notify_t** notifyList )
   if(*notifyList == NULL) return kNoErr;
   do{
     temp2 = temp->next;
+    HKEventRelease(&temp->event);
     free(temp);
     temp = temp2;
   }while(temp!=NULL);    
@@ -310,146 +383,364 @@ exit:
   return kNoErr;
 }
 
-void homeKitClient_thread(void *inFd)
+static HK_Event_t *HKEventNew(int aid, int iid, uint8_t valueType, value_union value)
+{
+  HK_Event_t *event = NULL;
+  printbuf *buffer = printbuf_new();
+  require(buffer, exit);
+
+  sprintbuf(buffer, "{\"aid\":%d,\"iid\":%d,\"value\":", aid, iid);
+  HKPrintbufAddValue(buffer, valueType, value);
+  sprintbuf(buffer, "}");
+
+  event = malloc(sizeof(HK_Event_t) + buffer->bpos);
+  require(event, exit);
+  event->refs = 1;
+  event->len = buffer->bpos;
+  memcpy(event->text, buffer->buf, buffer->bpos);
+
+exit:
+  if(buffer) printbuf_free(buffer);
+  return event;
+}
+
+/* The change is rendered once and handed to every subscribed session, a later change replaces 
+   one that has not been sent yet */
+void HKCharacteristicDidChange(int accessoryID, int serviceID, int characteristicID, value_union value)
+{
+  HK_Session_t *hkSession;
+  HK_Notify_t *notify;
+  HK_Event_t *event = NULL;
+  uint32_t msg = 0;
+  bool subscribed;
+
+  if(sessionMutex == NULL) return;
+
+  mico_rtos_lock_mutex(&sessionMutex);
+  for(hkSession = hkSessions; hkSession != NULL; hkSession = hkSession->next){
+    subscribed = false;
+    for(notify = hkSession->notifyList; notify != NULL; notify = notify->next){
+      if(notify->aid == accessoryID && notify->serviceID == serviceID && notify->characteristicID == characteristicID){
+        if(event == NULL)
+          event = HKEventNew(notify->aid, notify->iid, notify->valueType, value);
+        if(event == NULL)
+          continue;
+        HKEventRelease(&notify->event);
+        notify->event = event;
+        event->refs++;
+        notify->value = value;
+        subscribed = true;
+      }
+    }
+    if(subscribed && hkSession->signaled == false){
+      hkSession->signaled = true;
+      mico_rtos_push_to_queue(&hkSession->eventQueue, &msg, MICO_NO_WAIT);
+    }
+  }
+  HKEventRelease(&event);
+  mico_rtos_unlock_mutex(&sessionMutex);
+}
+
+/* Send every changed characteristic of this session, up to HKEventBatchSize in one event. The 
+   rendered changes are taken off the list under the lock and written out without it */
+static OSStatus HKSendPendingNotifications(int sockfd, HK_Session_t *hkSession, security_session_t *session)
+{
+  OSStatus err = kNoErr;
+  HK_Notify_t *notify;
+  HK_Event_t *events[HKEventBatchSize];
+  HK_Stream_t stream;
+  size_t contentLength;
+  int count, idx;
+  bool more = true;
+
+  HKStreamInit(&stream, sockfd, session);
+
+  while(more){
+    count = 0;
+    more = false;
+    contentLength = strlen("{\"characteristics\":[]}");
+
+    mico_rtos_lock_mutex(&sessionMutex);
+    hkSession->signaled = false;
+    for(notify = hkSession->notifyList; notify != NULL; notify = notify->next){
+      if(notify->event == NULL)
+        continue;
+      if(count == HKEventBatchSize){
+        more = true;
+        break;
+      }
+      contentLength += notify->event->len + (count? 1 : 0);
+      events[count++] = notify->event;
+      notify->event = NULL;
+    }
+    mico_rtos_unlock_mutex(&sessionMutex);
+    require_quiet(count, exit);
+
+    err = HKStreamWriteEventHeader(&stream, contentLength);
+    if(err == kNoErr)
+      err = HKStreamWrite(&stream, "{\"characteristics\":[", strlen("{\"characteristics\":["));
+    for(idx = 0; idx < count && err == kNoErr; idx++){
+      if(idx) err = HKStreamWrite(&stream, ",", 1);
+      if(err == kNoErr) err = HKStreamWrite(&stream, events[idx]->text, events[idx]->len);
+    }
+    if(err == kNoErr)
+      err = HKStreamWrite(&stream, "]}", 2);
+    if(err == kNoErr)
+      err = HKStreamFlush(&stream);
+
+    mico_rtos_lock_mutex(&sessionMutex);
+    for(idx = 0; idx < count; idx++)
+      HKEventRelease(&events[idx]);
+    mico_rtos_unlock_mutex(&sessionMutex);
+    require_noerr(err, exit);
+  }
+
+exit:
+  HKStreamDeinit(&stream);
+  return err;
+}
+
+/* Pool of HTTP headers, a session only holds one while it reads and handles a request. Reads are bounded by 
+   HKRequestReadTimeout, so a session that stops sending gives its header back */
+static void HKHeaderPoolInit(void)
+{
+  int i;
+
+  mico_rtos_init_semaphore(&headerPoolSem, HKHeaderPoolSize);
+  for(i = 0; i < HKHeaderPoolSize; i++)
+    mico_rtos_set_semaphore(&headerPoolSem);
+}
+
+static HTTPHeader_t *HKHeaderTake(void)
+{
+  HTTPHeader_t *header = NULL;
+  int i;
+
+  require_quiet(mico_rtos_get_semaphore(&headerPoolSem, HKHeaderWaitTime) == kNoErr, exit);
+
+  mico_rtos_lock_mutex(&sessionMutex);
+  for(i = 0; i < HKHeaderPoolSize; i++){
+    if(headerPoolUsed[i] == false){
+      headerPoolUsed[i] = true;
+      header = &headerPool[i];
+      break;
+    }
+  }
+  mico_rtos_unlock_mutex(&sessionMutex);
+
+exit:
+  return header;
+}
+
+/* A header holding the start of a pipelined request stays with its session */
+static void HKHeaderGive(HTTPHeader_t **header)
+{
+  if(*header == NULL || (*header)->len != 0) return;
+
+  mico_rtos_lock_mutex(&sessionMutex);
+  headerPoolUsed[*header - headerPool] = false;
+  mico_rtos_unlock_mutex(&sessionMutex);
+  mico_rtos_set_semaphore(&headerPoolSem);
+  *header = NULL;
+}
+
+static void HKSessionFree(HK_Session_t *hkSession)
+{
+  HK_Session_t **pSession;
+
+  mico_rtos_lock_mutex(&sessionMutex);
+  for(pSession = &hkSessions; *pSession != NULL; pSession = &(*pSession)->next){
+    if(*pSession == hkSession){
+      *pSession = hkSession->next;
+      break;
+    }
+  }
+  mico_rtos_unlock_mutex(&sessionMutex);
+
+  if(hkSession->eventFd >= 0) SocketCloseForOSEvent(&hkSession->eventFd);
+  if(hkSession->eventQueue) mico_rtos_deinit_queue(&hkSession->eventQueue);
+  SocketClose(&hkSession->fd);
+  mico_rtos_lock_mutex(&sessionMutex);   //Events are shared with other sessions
+  HKNotificationClean( &hkSession->notifyList );
+  mico_rtos_unlock_mutex(&sessionMutex);
+  free(hkSession);
+}
+
+static HK_Session_t *HKSessionNew(int fd)
+{
+  OSStatus err = kNoErr;
+  HK_Session_t *hkSession = calloc(1, sizeof(HK_Session_t));
+  int readTimeout = HKRequestReadTimeout;
+  require_action(hkSession, exit, err = kNoMemoryErr);
+
+  hkSession->fd = -1;
+  hkSession->eventFd = -1;
+  hkSession->lastActive = mico_get_time();
+
+  /* Requests are read with blocking reads, a stalled client must not keep a pooled header or a shed session alive */
+  err = setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &readTimeout, sizeof(readTimeout));
+  require_noerr(err, exit);
+
+  /* One slot for a notification and one for shedding */
+  err = mico_rtos_init_queue(&hkSession->eventQueue, "HK Session", sizeof(uint32_t), 2);
+  require_noerr(err, exit);
+  hkSession->eventFd = mico_create_event_fd(hkSession->eventQueue);
+  require_action(hkSession->eventFd >= 0, exit, err = kNoResourcesErr);
+  hkSession->fd = fd;
+
+  mico_rtos_lock_mutex(&sessionMutex);
+  hkSession->next = hkSessions;
+  hkSessions = hkSession;
+  mico_rtos_unlock_mutex(&sessionMutex);
+
+exit:
+  if(err != kNoErr && hkSession){
+    HKSessionFree(hkSession);
+    hkSession = NULL;
+  }
+  return hkSession;
+}
+
+/* Decide on one more session without blocking the listener. When the session count or the heap
+   is at its limit, the newcomer is refused and one session is shed so the controller's next
+   connect succeeds: an unverified session first, then the verified session idle the longest if
+   it has been idle for HKIdleShedTime. Sessions in pair setup are never shed */
+static OSStatus HKSessionAdmit(void)
+{
+  HK_Session_t *hkSession, *victim = NULL;
+  uint32_t now = mico_get_time(), idle, victimIdle = 0;
+  int count = 0;
+  bool shedding = false;
+  uint32_t msg = 0;
+
+  mico_rtos_lock_mutex(&sessionMutex);
+  for(hkSession = hkSessions; hkSession != NULL; hkSession = hkSession->next){
+    count++;
+    if(hkSession->shed) shedding = true;
+    if(hkSession->shed || hkSession->pairing) continue;
+
+    idle = now - hkSession->lastActive;
+    if(hkSession->verified == false) idle += HKIdleShedTime;   //Unverified ones go first
+    if(idle >= HKIdleShedTime && idle >= victimIdle){
+      victim = hkSession;
+      victimIdle = idle;
+    }
+  }
+
+  if(count < HKMaxSessions && mico_memory_info()->free_memory >= (int)(HKSessionMemory + HKHeapReserve)){
+    mico_rtos_unlock_mutex(&sessionMutex);
+    ha_log("Session admitted, %d running, %d bytes each, free memory: %d", 
+           count, HKSessionMemory, mico_memory_info()->free_memory);
+    return kNoErr;
+  }
+
+  /* One shed at a time, the slot is free once that session's thread has exited */
+  if(shedding == false && victim != NULL){
+    ha_log("Shed session fd: %d, idle %d ms", victim->fd, now - victim->lastActive);
+    victim->shed = true;
+    mico_rtos_push_to_queue(&victim->eventQueue, &msg, MICO_NO_WAIT);
+  }
+  mico_rtos_unlock_mutex(&sessionMutex);
+  return kNoResourcesErr;
+}
+
+static OSStatus HKSessionHandleRequest(HK_Session_t *hkSession, HTTPHeader_t **httpHeader, HK_Context_t *hkContext)
+{
+  OSStatus err = kNoErr;
+
+  if(*httpHeader == NULL){
+    *httpHeader = HKHeaderTake();
+    require_action(*httpHeader, exit, err = kNoResourcesErr);
+  }
+
+  err = HKhandleIncomeingMessage(hkSession->fd, *httpHeader, &hkSession->notifyList, hkContext, Context);
+
+  mico_rtos_lock_mutex(&sessionMutex);
+  hkSession->lastActive = mico_get_time();
+  hkSession->verified = hkContext->session->established;
+  hkSession->pairing = (hkContext->pairInfo != NULL);
+  mico_rtos_unlock_mutex(&sessionMutex);
+
+  HKHeaderGive(httpHeader);
+
+exit:
+  return err;
+}
+
+void homeKitClient_thread(void *arg)
 {
   ha_log_trace();
   OSStatus err;
-  int clientFd = *(int *)inFd;
-  struct timeval_t t;
+  HK_Session_t *hkSession = arg;
+  int clientFd = hkSession->fd;
   HTTPHeader_t *httpHeader = NULL;
   int selectResult;
   fd_set      readfds;
+  struct timeval_t t, *timeout;
   HK_Context_t hkContext;
-  int aid, iid, serviceID, characteristicID;
-  value_union value, newValue;
-  struct _hapCharacteristic_t pCharacteristic;
-  json_object *outEventJsonObject = NULL, *outCharacteristics, *outCharacteristic;
-  const char *buffer = NULL;
+  uint32_t msg, idle;
+  bool shed;
 
   memset(&hkContext, 0x0, sizeof(HK_Context_t));
   hkContext.session = HKSNewSecuritySession();
   require_action(hkContext.session, exit, err = kNoMemoryErr);
 
-  httpHeader = calloc(1, sizeof( HTTPHeader_t ) );
-  require_action( httpHeader, exit, err = kNoMemoryErr );
-
-  HK_Notify_t *notifyList = NULL, *temp;
-
-  bool isChanged;
-
-  t.tv_sec = 1;
-  t.tv_usec = 0;  //Check for notify every 1 second
   ha_log("Free memory1: %d", mico_memory_info()->free_memory);
 
   while(1){
-    if(hkContext.session->established == true && hkContext.session->recvedDataLen > 0){
-       err = HKhandleIncomeingMessage(clientFd, httpHeader, &notifyList, &hkContext, Context);
-    }else{
-      FD_ZERO(&readfds);
-      FD_SET(clientFd, &readfds);
-      selectResult = select(clientFd + 1, &readfds, NULL, NULL, &t);
-      require( selectResult >= 0, exit );
-      if(FD_ISSET(clientFd, &readfds)){
-        err = HKhandleIncomeingMessage(clientFd, httpHeader, &notifyList, &hkContext, Context);
-        require_noerr(err, exit);
-      }
+    /* A header is only kept between requests when it holds the start of a pipelined one, read the rest now 
+       instead of idling with it */
+    if(httpHeader != NULL || (hkContext.session->established == true && hkContext.session->recvedDataLen > 0)){
+      err = HKSessionHandleRequest(hkSession, &httpHeader, &hkContext);
+      require_noerr(err, exit);
+      continue;
+    }
 
-      if(hkContext.session->established == false) // No nofification in no paired session
-        continue;
+    /* Unverified connections are closed when idle, unless pair setup is running */
+    timeout = NULL;
+    if(hkContext.session->established == false && hkContext.pairInfo == NULL){
+      idle = mico_get_time() - hkSession->lastActive;
+      require_action(idle < HKUnverifiedTimeout, exit, ha_log("Unverified session idle, fd: %d", clientFd));
+      t.tv_sec = (HKUnverifiedTimeout - idle)/1000;
+      t.tv_usec = ((HKUnverifiedTimeout - idle)%1000)*1000;
+      timeout = &t;
+    }
 
-      outEventJsonObject = json_object_new_object();
-      require_action(outEventJsonObject, exit, err = kNoMemoryErr);
-      outCharacteristics = json_object_new_array();
-      require_action(outCharacteristics, exit, err = kNoMemoryErr);
-      json_object_object_add( outEventJsonObject, "characteristics", outCharacteristics);
-      temp = notifyList;
-
-      while(HKNotifyGetNext( temp, &aid, &iid, &value, &temp) == kNoErr){
-        FindCharacteristicByIID(hapObjects, aid, iid, &serviceID, &characteristicID);   
-        if(HKReadCharacteristicValue(aid, serviceID, characteristicID, &newValue, Context)==kHKNoErr){
-          pCharacteristic = ((hapObjects[aid-1]).services[serviceID-1]).characteristic[characteristicID-1];
-
-          switch(pCharacteristic.valueType){
-            case ValueType_bool:
-              if( value.boolValue != newValue.boolValue ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_boolean(newValue.boolValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            case ValueType_int:
-              if( value.intValue != newValue.intValue ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_int(newValue.intValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            case ValueType_float:
-              if( value.floatValue != newValue.floatValue ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_double(newValue.floatValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            case ValueType_string:
-              if( !strcmp(value.stringValue, newValue.stringValue) ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_string(newValue.stringValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            case ValueType_date:
-              if( !strcmp(value.dateValue, newValue.dateValue) ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_string(newValue.dateValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            default:
-              break;
-          }
-        }
-      }
-            
-      if(json_object_array_length(outCharacteristics)){
-        buffer = json_object_to_json_string(outEventJsonObject);
-        ha_log("Notification json cstring generated, memory remains %d, %s", mico_memory_info()->free_memory, buffer);  
-        err = HKSendNotifyMessage( clientFd, (uint8_t *)buffer, strlen(buffer), hkContext.session );
+    FD_ZERO(&readfds);
+    FD_SET(clientFd, &readfds);
+    FD_SET(hkSession->eventFd, &readfds);
+    /* Idle until controller sends a request or a subscribed characteristic changes */
+    selectResult = select(max(clientFd, hkSession->eventFd) + 1, &readfds, NULL, NULL, timeout);
+    require( selectResult >= 0, exit );
+
+    if(FD_ISSET(hkSession->eventFd, &readfds)){
+      while(mico_rtos_pop_from_queue(&hkSession->eventQueue, &msg, MICO_NO_WAIT) == kNoErr);
+      mico_rtos_lock_mutex(&sessionMutex);
+      shed = hkSession->shed;
+      mico_rtos_unlock_mutex(&sessionMutex);
+      require_action_quiet(shed == false, exit, ha_log("Session shed, fd: %d", clientFd));
+      if(hkContext.session->established == true){ // No nofification in no paired session
+        err = HKSendPendingNotifications(clientFd, hkSession, hkContext.session);
         require_noerr(err, exit);
-
       }
-      
-      json_object_put(outEventJsonObject);
-      outEventJsonObject = NULL;
-          //err = HKSendResponseMessage(sockfd, status, (uint8_t *)buffer->buf, strlen(buffer->buf), inHkContext);
-          //require_noerr(err, exit);
+    }
+
+    if(FD_ISSET(clientFd, &readfds)){
+      err = HKSessionHandleRequest(hkSession, &httpHeader, &hkContext);
+      require_noerr(err, exit);
     }
   }
 
 exit:
-  SocketClose(&clientFd);
-  HTTPHeaderClear( httpHeader );
-  if(httpHeader)    free(httpHeader);
-  HKNotificationClean( &notifyList );
-  if(outEventJsonObject) json_object_put(outEventJsonObject);
+  if(httpHeader){
+    HTTPHeaderClear( httpHeader );
+    httpHeader->len = 0;
+    HKHeaderGive( &httpHeader );
+  }
   HKCleanPairSetupInfo(&hkContext.pairInfo, Context);
   HKCleanPairVerifyInfo(&hkContext.pairVerifyInfo);
-  free(hkContext.session);
+  if(hkContext.session) free(hkContext.session);
+  HKSessionFree(hkSession);
   ha_log("Last Free memory1: %d", mico_memory_info()->free_memory);
   mico_rtos_delete_thread(NULL);
   return;
@@ -459,164 +750,349 @@ exit:
 
 
 
-static HkStatus HKCreateHAPAttriDataBase( struct _hapAccessory_t inHapObject[], HK_Notify_t* notifyList, json_object **OutHapObjectJson, mico_Context_t * const inContext)
+/* Accessory database cache
+ *
+ * Everything in /accessories except live values and "ev" flags comes from hapObjects, so it
+ * is rendered once into a buffer. Holes mark where the per request parts are inserted.
+ */
+#define kHKHoleValue          0
+#define kHKHoleEvent          1
+
+typedef struct _HK_Acc_Hole_t {
+  uint32_t  offset;       //! Position in cached bytes
+  uint8_t   type;         //! kHKHoleValue or kHKHoleEvent
+  uint8_t   aid;
+  uint8_t   serviceID;
+  uint8_t   characteristicID;
+  int       iid;
+} HK_Acc_Hole_t;
+
+typedef struct _HK_Acc_Cache_t {
+  char          *buf;
+  size_t        len;
+  HK_Acc_Hole_t *holes;
+  int           holeCount;
+} HK_Acc_Cache_t;
+
+static HK_Acc_Cache_t accessoriesCache = {NULL, 0, NULL, 0};
+
+/* Quote and escape string straight into buffer, with the same escapes as json-c writes */
+static void HKPrintbufAddString(printbuf *buffer, const char *string)
 {
-  HkStatus err = kNoErr;
-  uint32_t accessoryIndex, serviceIndex, characteristicIndex;
-  uint32_t aid = 1;
-  uint32_t iid = 1;
-  struct _hapCharacteristic_t             pCharacteristic;
-  bool hasConstraint = false;
-  value_union value;
-  bool event;
+  static const char hex[] = "0123456789abcdef";
+  const char *start;
+  unsigned char c;
+  char esc[6];
+  int len;
+
+  if(string == NULL){
+    sprintbuf(buffer, "null");
+    return;
+  }
 
-  json_object *hapJsonObject, *accessories, *accessory, *services, *service, *characteristics, *characteristic, *properties;
-  json_object *constraints, *metaData;
+  printbuf_memappend_fast(buffer, "\"", 1);
+  for(start = string; (c = (unsigned char)*string) != 0x0; string++){
+    if(c >= ' ' && c != '"' && c != '\\' && c != '/')
+      continue;
+    len = (int)(string - start);
+    if(len)
+      printbuf_memappend_fast(buffer, start, len);
+    esc[0] = '\\';
+    switch(c){
+      case '\b': esc[1] = 'b'; break;
+      case '\n': esc[1] = 'n'; break;
+      case '\r': esc[1] = 'r'; break;
+      case '\t': esc[1] = 't'; break;
+      case '"':
+      case '\\':
+      case '/':  esc[1] = c; break;
+      default:
+        esc[1] = 'u'; esc[2] = '0'; esc[3] = '0';
+        esc[4] = hex[c >> 4];
+        esc[5] = hex[c & 0xf];
+    }
+    len = (esc[1] == 'u')? 6 : 2;
+    printbuf_memappend_fast(buffer, esc, len);
+    start = string + 1;
+  }
+  len = (int)(string - start);
+  if(len)
+    printbuf_memappend_fast(buffer, start, len);
+  printbuf_memappend_fast(buffer, "\"", 1);
+}
 
-  hapJsonObject = json_object_new_object();
-  accessories = json_object_new_array();
-  json_object_object_add( hapJsonObject, "accessories", accessories ); 
+static void HKPrintbufAddValue(printbuf *buffer, valueType type, value_union value)
+{
+  switch(type){
+    case ValueType_bool:
+      sprintbuf(buffer, value.boolValue? "true":"false");
+      break;
+    case ValueType_int:
+      sprintbuf(buffer, "%d", value.intValue);
+      break;
+    case ValueType_float:
+      sprintbuf(buffer, "%g", value.floatValue);
+      break;
+    case ValueType_string:
+    case ValueType_date:
+      HKPrintbufAddString(buffer, value.stringValue);
+      break;
+    default:
+      sprintbuf(buffer, "null");
+      break;
+  }
+}
 
-  for(accessoryIndex = 0; accessoryIndex < NumberofAccessories; accessoryIndex++){
+static void HKPrintbufAddNumber(printbuf *buffer, const char *key, valueType type, int intValue, float floatValue)
+{
+  if(type == ValueType_int)
+    sprintbuf(buffer, ",\"%s\":%d", key, intValue);
+  else if(type == ValueType_float)
+    sprintbuf(buffer, ",\"%s\":%g", key, floatValue);
+}
+
+/* Render hapObjects once, in the key order the json-c serializer used before */
+static OSStatus HKCreateHAPAttriDataBaseCache( struct _hapAccessory_t inHapObject[], HK_Acc_Cache_t *cache )
+{
+  OSStatus err = kNoErr;
+  uint32_t accessoryIndex, serviceIndex, characteristicIndex;
+  int iid, holeCount = 0;
+  const struct _hapService_t *pService;
+  const struct _hapCharacteristic_t *pCharacteristic;
+  printbuf *buffer = NULL;
+  HK_Acc_Hole_t *hole;
+
+  /* Count holes first so they fit in one allocation */
+  for(accessoryIndex = 0; accessoryIndex < NumberofAccessories; accessoryIndex++)
+    for(serviceIndex = 0; serviceIndex < MAXServicePerAccessory && inHapObject[accessoryIndex].services[serviceIndex].type; serviceIndex++)
+      for(characteristicIndex = 0; characteristicIndex < MAXCharacteristicPerService; characteristicIndex++){
+        pCharacteristic = &inHapObject[accessoryIndex].services[serviceIndex].characteristic[characteristicIndex];
+        if(pCharacteristic->type == 0) break;
+        if(pCharacteristic->secureRead && !pCharacteristic->hasStaticValue) holeCount++;
+        if(pCharacteristic->hasEvents) holeCount++;
+      }
 
-    accessory = json_object_new_object();
-    json_object_array_add (accessories, accessory);
+  cache->holes = calloc(holeCount? holeCount : 1, sizeof(HK_Acc_Hole_t));
+  require_action(cache->holes, exit, err = kNoMemoryErr);
+  buffer = printbuf_new();
+  require_action(buffer, exit, err = kNoMemoryErr);
+  hole = cache->holes;
 
-    json_object_object_add( accessory, "aid", json_object_new_int(aid++) );   
-    services = json_object_new_array();
-    json_object_object_add( accessory, "services", services);
+  sprintbuf(buffer, "{\"accessories\":[");
+  for(accessoryIndex = 0; accessoryIndex < NumberofAccessories; accessoryIndex++){
+    sprintbuf(buffer, "%s{\"aid\":%d,\"services\":[", accessoryIndex? ",":"", accessoryIndex + 1);
 
     for(serviceIndex = 0, iid = 1; serviceIndex < MAXServicePerAccessory; serviceIndex++){
-      if(inHapObject[accessoryIndex].services[serviceIndex].type == 0)
+      pService = &inHapObject[accessoryIndex].services[serviceIndex];
+      if(pService->type == 0)
         break;
-      service = json_object_new_object();
+      sprintbuf(buffer, "%s{\"type\":", serviceIndex? ",":"");
+      HKPrintbufAddString(buffer, pService->type);
+      sprintbuf(buffer, ",\"iid\":%d,\"characteristics\":[", iid++);
 
-      json_object_object_add( service, "type", json_object_new_string(inHapObject[0].services[serviceIndex].type));
-      json_object_object_add( service, "iid",  json_object_new_int(iid++));
-
-      characteristics = json_object_new_array();
+      for(characteristicIndex = 0; characteristicIndex < MAXCharacteristicPerService; characteristicIndex++){
+        pCharacteristic = &pService->characteristic[characteristicIndex];
+        if(pCharacteristic->type == 0)
+          break;
 
-      json_object_object_add( service, "characteristics",  characteristics);
+        sprintbuf(buffer, "%s{\"type\":", characteristicIndex? ",":"");
+        HKPrintbufAddString(buffer, pCharacteristic->type);
+        sprintbuf(buffer, ",\"iid\":%d", iid);
 
-      for(characteristicIndex = 0; characteristicIndex < MAXCharacteristicPerService; characteristicIndex++){
-        pCharacteristic = inHapObject[accessoryIndex].services[serviceIndex].characteristic[characteristicIndex];
-        if(pCharacteristic.type){
-          characteristic = json_object_new_object();
-          json_object_array_add( characteristics, characteristic ); 
-          /*Type*/
-          json_object_object_add( characteristic, "type", json_object_new_string(pCharacteristic.type));
-
-          /*Instance ID*/
-          json_object_object_add( characteristic, "iid", json_object_new_int(iid++));
-
-          HKReadCharacteristicValue(accessoryIndex+1, serviceIndex+1, characteristicIndex+1, &value, inContext);
-          /*Value*/
-          if( pCharacteristic.secureRead == true ){
-            if(pCharacteristic.hasStaticValue)
-              value = pCharacteristic.value;
-
-            switch(pCharacteristic.valueType){
-              case ValueType_bool:
-                json_object_object_add( characteristic, "value", json_object_new_boolean(value.boolValue));
-                break;
-              case ValueType_int:
-                json_object_object_add( characteristic, "value", json_object_new_int(value.intValue));
-                break;
-              case ValueType_float:
-                json_object_object_add( characteristic, "value", json_object_new_double(value.floatValue));
-                break;
-              case ValueType_string:
-                json_object_object_add( characteristic, "value", json_object_new_string(value.stringValue));
-                break;
-              case ValueType_date:
-                json_object_object_add( characteristic, "value", json_object_new_string(value.dateValue));
-                break;
-              case ValueType_null:
-                json_object_object_add( characteristic, "value", NULL);
-                break;
-              default:
-                break;
-            }
+        if(pCharacteristic->secureRead){
+          sprintbuf(buffer, ",\"value\":");
+          if(pCharacteristic->hasStaticValue)
+            HKPrintbufAddValue(buffer, pCharacteristic->valueType, pCharacteristic->value);
+          else{
+            hole->offset = buffer->bpos;
+            hole->type = kHKHoleValue;
+            hole->aid = accessoryIndex + 1;
+            hole->serviceID = serviceIndex + 1;
+            hole->characteristicID = characteristicIndex + 1;
+            hole->iid = iid;
+            hole++;
           }
+        }
 
-          properties = json_object_new_array();
-          if(pCharacteristic.secureRead)
-            json_object_array_add( properties, json_object_new_string("pr") );
-          if(pCharacteristic.secureWrite)
-            json_object_array_add( properties, json_object_new_string("pw") );
-          json_object_object_add( characteristic, "perms", properties);
+        sprintbuf(buffer, ",\"perms\":[");
+        if(pCharacteristic->secureRead)
+          sprintbuf(buffer, "\"pr\"%s", pCharacteristic->secureWrite? ",":"");
+        if(pCharacteristic->secureWrite)
+          sprintbuf(buffer, "\"pw\"");
+        sprintbuf(buffer, "]");
+
+        if(pCharacteristic->hasEvents){
+          sprintbuf(buffer, ",\"ev\":");
+          hole->offset = buffer->bpos;
+          hole->type = kHKHoleEvent;
+          hole->aid = accessoryIndex + 1;
+          hole->serviceID = serviceIndex + 1;
+          hole->characteristicID = characteristicIndex + 1;
+          hole->iid = iid;
+          hole++;
+        }
 
-          if(pCharacteristic.hasEvents){
-            if(HKNotificationFind(aid, iid, notifyList)==kNoErr)
-              json_object_object_add( characteristic, "ev", json_object_new_boolean(true));
-            else
-              json_object_object_add( characteristic, "ev", json_object_new_boolean(false));
-          }
+        if(pCharacteristic->hasMinimumValue)
+          HKPrintbufAddNumber(buffer, "minValue", pCharacteristic->valueType, pCharacteristic->minimumValue.intValue, pCharacteristic->minimumValue.floatValue);
+        if(pCharacteristic->hasMaximumValue)
+          HKPrintbufAddNumber(buffer, "maxValue", pCharacteristic->valueType, pCharacteristic->maximumValue.intValue, pCharacteristic->maximumValue.floatValue);
+        if(pCharacteristic->hasMinimumStep)
+          HKPrintbufAddNumber(buffer, "minStep", pCharacteristic->valueType, pCharacteristic->minimumStep.intValue, pCharacteristic->minimumStep.floatValue);
+        if(pCharacteristic->hasMaxLength)
+          sprintbuf(buffer, ",\"maxLen\":%d", pCharacteristic->maxLength);
+        if(pCharacteristic->hasMaxDataLength)
+          sprintbuf(buffer, ",\"maxDataLen\":%d", pCharacteristic->maxDataLength);
+        if(pCharacteristic->description){
+          sprintbuf(buffer, ",\"description\":");
+          HKPrintbufAddString(buffer, pCharacteristic->description);
+        }
+        if(pCharacteristic->format){
+          sprintbuf(buffer, ",\"format\":");
+          HKPrintbufAddString(buffer, pCharacteristic->format);
+        }
+        if(pCharacteristic->unit){
+          sprintbuf(buffer, ",\"unit\":");
+          HKPrintbufAddString(buffer, pCharacteristic->unit);
+        }
+        sprintbuf(buffer, "}");
+        iid++;
+      }
+      sprintbuf(buffer, "]}");
+    }
+    sprintbuf(buffer, "]}");
+  }
+  sprintbuf(buffer, "]}");
 
-          if(pCharacteristic.hasMinimumValue){
-            switch(pCharacteristic.valueType){
-              case ValueType_int:
-                json_object_object_add( characteristic, "minValue",  json_object_new_int(pCharacteristic.minimumValue.intValue) );
-                break;
-              case ValueType_float:
-                json_object_object_add( characteristic, "minValue",  json_object_new_double(pCharacteristic.minimumValue.floatValue) );
-                break;
-              default:
-                break;
-            }
-          }
+  /* Keep the rendered bytes, drop the printbuf wrapper */
+  cache->buf = buffer->buf;
+  cache->len = buffer->bpos;
+  cache->holeCount = holeCount;
+  free(buffer);
+  buffer = NULL;
 
-          if(pCharacteristic.hasMaximumValue){
-            switch(pCharacteristic.valueType){
-              case ValueType_int:
-                json_object_object_add( characteristic, "maxValue",  json_object_new_int(pCharacteristic.maximumValue.intValue) );
-                break;
-              case ValueType_float:
-                json_object_object_add( characteristic, "maxValue",  json_object_new_double(pCharacteristic.maximumValue.floatValue) );
-                break;
-              default:
-                break;
-            }
-          }
+exit:
+  if(err != kNoErr && cache->holes){
+    free(cache->holes);
+    cache->holes = NULL;
+  }
+  if(buffer) printbuf_free(buffer);
+  return err;
+}
 
-          if(pCharacteristic.hasMinimumStep){
-            switch(pCharacteristic.valueType){
-              case ValueType_int:
-                json_object_object_add( characteristic, "minStep",  json_object_new_int(pCharacteristic.minimumStep.intValue) );
-                break;
-              case ValueType_float:
-                json_object_object_add( characteristic, "minStep",  json_object_new_double(pCharacteristic.minimumStep.floatValue) );
-                break;
-              default:
-                break;
-            }
-          }
-               
-          if(pCharacteristic.hasMaxLength)
-            json_object_object_add( characteristic, "maxLen",     json_object_new_int(pCharacteristic.maxLength));
+/* Built by the listener before any client is accepted, client threads only read it afterwards */
+static OSStatus HKAccessoriesCacheInit(void)
+{
+  return HKCreateHAPAttriDataBaseCache(hapObjects, &accessoriesCache);
+}
 
-          if(pCharacteristic.hasMaxDataLength)
-            json_object_object_add( characteristic, "maxDataLen",     json_object_new_int(pCharacteristic.maxDataLength));
+/* Hand the requests marked for dispatch to the application, one call per accessory, so a
+   scene that touches many characteristics reaches a slow backend in a single round trip */
+static void _HKDispatchPerAccessory(HK_Char_Request_t requests[], uint32_t count, bool write, mico_Context_t * const inContext)
+{
+  HK_Char_Value_t *batch;
+  uint32_t *slot;
+  uint32_t idx, batchLen;
+  int aid;
 
-          if(pCharacteristic.description)
-            json_object_object_add( characteristic, "description", json_object_new_string(pCharacteristic.description));
+  if(count == 0)
+    return;
 
-          if(pCharacteristic.format)
-            json_object_object_add( characteristic, "format", json_object_new_string(pCharacteristic.format));
+  batch = malloc(count * (sizeof(HK_Char_Value_t) + sizeof(uint32_t)));
+  if(batch == NULL){
+    for(idx = 0; idx < count; idx++)
+      if(requests[idx].dispatch) requests[idx].charValue.status = kHKResourceErr;
+    return;
+  }
+  slot = (uint32_t *)(batch + count);
 
-          if(pCharacteristic.unit)
-            json_object_object_add( characteristic, "unit", json_object_new_string(pCharacteristic.unit));
-        }
+  for(aid = 1; aid <= NumberofAccessories; aid++){
+    for(idx = 0, batchLen = 0; idx < count; idx++){
+      if(requests[idx].dispatch && requests[idx].id.aid == aid){
+        batch[batchLen] = requests[idx].charValue;
+        slot[batchLen++] = idx;
       }
-      
-      json_object_array_add( services, service ); 
-    }    
+    }
+    if(batchLen == 0)
+      continue;
+
+    if(write)
+      HKWriteCharacteristicValues(aid, batch, batchLen, inContext);
+    else
+      HKReadCharacteristicValues(aid, batch, batchLen, inContext);
+
+    for(idx = 0; idx < batchLen; idx++)
+      requests[slot[idx]].charValue = batch[idx];
   }
-  
-  *OutHapObjectJson = hapJsonObject;
+  free(batch);
+}
 
-  return err;
+/* Send /accessories: cached bytes with live values and event flags filled in, one HAP frame at a time */
+static OSStatus HKSendHAPAttriDataBase( int sockfd, HK_Notify_t* notifyList, security_session_t *session, mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+  printbuf *values = NULL;
+  HK_Stream_t stream;
+  HK_Char_Request_t *requests = NULL;
+  HK_Acc_Hole_t *hole;
+  const struct _hapCharacteristic_t *pCharacteristic;
+  const char *value;
+  size_t offset = 0, valueLen;
+  int idx;
+
+  HKStreamInit(&stream, sockfd, session);
+  require_action(accessoriesCache.buf, exit, err = kNotPreparedErr);
+
+  /* Read every live value with one batched call per accessory */
+  requests = calloc(accessoriesCache.holeCount + 1, sizeof(HK_Char_Request_t));
+  require_action(requests, exit, err = kNoMemoryErr);
+  for(idx = 0; idx < accessoriesCache.holeCount; idx++){
+    hole = &accessoriesCache.holes[idx];
+    if(hole->type != kHKHoleValue)
+      continue;
+    requests[idx].id.aid = hole->aid;
+    requests[idx].dispatch = true;
+    requests[idx].charValue.serviceID = hole->serviceID;
+    requests[idx].charValue.characteristicID = hole->characteristicID;
+  }
+  _HKDispatchPerAccessory(requests, accessoriesCache.holeCount, false, inContext);
+
+  /* Render per request parts first, the response header needs the total length */
+  values = printbuf_new();
+  require_action(values, exit, err = kNoMemoryErr);
+  for(idx = 0; idx < accessoriesCache.holeCount; idx++){
+    hole = &accessoriesCache.holes[idx];
+    if(hole->type == kHKHoleValue){
+      pCharacteristic = &hapObjects[hole->aid-1].services[hole->serviceID-1].characteristic[hole->characteristicID-1];
+      HKPrintbufAddValue(values, pCharacteristic->valueType, requests[idx].charValue.value);
+    }else
+      sprintbuf(values, HKNotificationFind(hole->aid, hole->iid, notifyList) == kNoErr? "true":"false");
+    printbuf_memappend(values, "", 1); //Every part is NUL terminated
+  }
+
+  err = HKStreamWriteResponseHeader(&stream, kStatusOK, accessoriesCache.len + values->bpos - accessoriesCache.holeCount);
+  require_noerr(err, exit);
+
+  value = values->buf;
+  for(idx = 0; idx < accessoriesCache.holeCount; idx++){
+    hole = &accessoriesCache.holes[idx];
+    err = HKStreamWrite(&stream, accessoriesCache.buf + offset, hole->offset - offset);
+    require_noerr(err, exit);
+    offset = hole->offset;
+    valueLen = strlen(value);
+    err = HKStreamWrite(&stream, value, valueLen);
+    require_noerr(err, exit);
+    value += valueLen + 1;
+  }
+  err = HKStreamWrite(&stream, accessoriesCache.buf + offset, accessoriesCache.len - offset);
+  require_noerr(err, exit);
+  err = HKStreamFlush(&stream);
+  require_noerr(err, exit);
 
+exit:
+  HKStreamDeinit(&stream);
+  if(values) printbuf_free(values);
+  if(requests) free(requests);
+  return err;
 }
 
 
@@ -640,38 +1116,115 @@ OSStatus IDGetNext(
   return kNoErr;
 }
 
+/* Characteristic of a resolved instance ID, NULL when the IDs are out of range */
+static const struct _hapCharacteristic_t *_HKCharacteristicGet(struct _hapAccessory_t inHapObject[], HK_Char_ID_t id)
+{
+  if(id.aid < 1 || id.aid > NumberofAccessories)
+    return NULL;
+  if(id.serviceID < 1 || id.serviceID > MAXServicePerAccessory)
+    return NULL;
+  if(id.characteristicID < 1 || id.characteristicID > MAXCharacteristicPerService)
+    return NULL;
+  return &inHapObject[id.aid-1].services[id.serviceID-1].characteristic[id.characteristicID-1];
+}
+
+/* Mark a characteristic to be read, static values and errors are resolved without the application */
+static void _HKPrepareRead(struct _hapAccessory_t inHapObject[], HK_Char_Request_t *request)
+{
+  const struct _hapCharacteristic_t *pCharacteristic;
+
+  request->dispatch = false;
+  request->charValue.serviceID = request->id.serviceID;
+  request->charValue.characteristicID = request->id.characteristicID;
+  request->charValue.status = kHKNoErr;
+
+  pCharacteristic = _HKCharacteristicGet(inHapObject, request->id);
+  if(pCharacteristic == NULL){
+    request->charValue.status = kHKNotExistErr;
+    return;
+  }
+
+  if(pCharacteristic->secureRead == false)
+    request->charValue.status = kHKReadFromWOErr;
+  else if(pCharacteristic->hasStaticValue)
+    request->charValue.value = pCharacteristic->value;
+  else
+    request->dispatch = true;
+}
+
+/* Expand the id list of a read request, an instance ID of a service stands for all of its
+   characteristics. Returns a request array for every characteristic, free it after use */
+static OSStatus _HKCollectReadRequests(struct _hapAccessory_t inHapObject[], const uint8_t *src, const uint8_t *end,
+                                       HK_Char_Request_t **outRequests, uint32_t *outCount)
+{
+  OSStatus err = kNoErr;
+  HK_Char_Request_t *requests = NULL;
+  const struct _hapCharacteristic_t *pCharacteristic;
+  HK_Char_ID_t id;
+  const uint8_t *next;
+  uint32_t count = 0, pass, idx;
+
+  /* First pass counts, second pass fills */
+  for(pass = 0; pass < 2; pass++){
+    next = src;
+    idx = 0;
+    while( IDGetNext( next, end, &id.aid, &id.iid, &next ) == kNoErr ){
+      FindCharacteristicByIID(inHapObject, id.aid, id.iid, &id.serviceID, &id.characteristicID);
+      if(id.serviceID && id.characteristicID == 0){ //Read every characteristic in one service
+        for(id.characteristicID = 1; id.characteristicID <= MAXCharacteristicPerService; id.characteristicID++){
+          pCharacteristic = _HKCharacteristicGet(inHapObject, id);
+          if(pCharacteristic == NULL || pCharacteristic->type == 0)
+            break;
+          if(requests){
+            requests[idx].id = id;
+            requests[idx].id.iid = id.iid + id.characteristicID; //Characteristics follow their service
+          }
+          idx++;
+        }
+      }else{ //Read single characteristic
+        if(requests) requests[idx].id = id;
+        idx++;
+      }
+    }
+    if(pass == 0){
+      count = idx;
+      requests = calloc(count + 1, sizeof(HK_Char_Request_t));
+      require_action(requests, exit, err = kNoMemoryErr);
+    }
+  }
+
+  for(idx = 0; idx < count; idx++)
+    _HKPrepareRead(inHapObject, &requests[idx]);
+
+  *outRequests = requests;
+  *outCount = count;
 
+exit:
+  return err;
+}
 
-HkStatus _HKCreateReadResponsePerCharacteristic(struct _hapAccessory_t inHapObject[], HK_Char_ID_t id, 
+HkStatus _HKCreateReadResponsePerCharacteristic(struct _hapAccessory_t inHapObject[], const HK_Char_Request_t *request, 
                                                 bool needMeta, bool needperms, bool needType, bool needEv, HK_Notify_t* notifyList,
                                                 json_object *inHapReadRespondJson, mico_Context_t * const inContext)
 {
-  HkStatus hkErr = kNoErr;
-  value_union value;
-  bool event;
+  HkStatus hkErr = request->charValue.status;
+  HK_Char_ID_t id = request->id;
+  value_union value = request->charValue.value;
   static json_object *characteristic;
-  struct _hapCharacteristic_t pCharacteristic = ((inHapObject[id.aid-1]).services[id.serviceID-1]).characteristic[id.characteristicID-1];
+  const struct _hapCharacteristic_t *pCharacteristic;
   
   characteristic = json_object_new_object();
   json_object_array_add(inHapReadRespondJson, characteristic);
   json_object_object_add( characteristic, "aid", json_object_new_int(id.aid));
   json_object_object_add( characteristic, "iid", json_object_new_int(id.iid));
-
-  if(pCharacteristic.secureRead == false){
-    hkErr = kHKReadFromWOErr;
-  }else if(id.serviceID == 0)
-    hkErr = kHKNotExistErr;
-  else{
-    if(pCharacteristic.hasStaticValue)
-      value = pCharacteristic.value;
-    else
-      hkErr = HKReadCharacteristicValue(id.aid, id.serviceID, id.characteristicID, &value, inContext);    
-  }
-
   json_object_object_add( characteristic, "status", json_object_new_int(hkErr)); //If no err occure, remove this key before send the respond
 
+  pCharacteristic = _HKCharacteristicGet(inHapObject, id);
+  if(pCharacteristic == NULL)
+    return hkErr;
+
   if(hkErr == kNoErr){
-    switch(pCharacteristic.valueType ){
+    switch(pCharacteristic->valueType ){
       case ValueType_bool:
         json_object_object_add( characteristic, "value", json_object_new_boolean(value.boolValue));
         break;
@@ -695,76 +1248,76 @@ HkStatus _HKCreateReadResponsePerCharacteristic(struct _hapAccessory_t inHapObje
   }
 
   if(needMeta){
-     if(pCharacteristic.hasMinimumValue){
-      switch(pCharacteristic.valueType){
+     if(pCharacteristic->hasMinimumValue){
+      switch(pCharacteristic->valueType){
         case ValueType_int:
-          json_object_object_add( characteristic, "minValue",  json_object_new_int(pCharacteristic.minimumValue.intValue) );
+          json_object_object_add( characteristic, "minValue",  json_object_new_int(pCharacteristic->minimumValue.intValue) );
           break;
         case ValueType_float:
-          json_object_object_add( characteristic, "minValue",  json_object_new_double(pCharacteristic.minimumValue.floatValue) );
+          json_object_object_add( characteristic, "minValue",  json_object_new_double(pCharacteristic->minimumValue.floatValue) );
           break;
         default:
           break;
       }
     }
 
-    if(pCharacteristic.hasMaximumValue){
-      switch(pCharacteristic.valueType){
+    if(pCharacteristic->hasMaximumValue){
+      switch(pCharacteristic->valueType){
         case ValueType_int:
-          json_object_object_add( characteristic, "maxValue",  json_object_new_int(pCharacteristic.maximumValue.intValue) );
+          json_object_object_add( characteristic, "maxValue",  json_object_new_int(pCharacteristic->maximumValue.intValue) );
           break;
         case ValueType_float:
-          json_object_object_add( characteristic, "maxValue",  json_object_new_double(pCharacteristic.maximumValue.floatValue) );
+          json_object_object_add( characteristic, "maxValue",  json_object_new_double(pCharacteristic->maximumValue.floatValue) );
           break;
         default:
           break;
       }
     }
 
-    if(pCharacteristic.hasMinimumStep){
-      switch(pCharacteristic.valueType){
+    if(pCharacteristic->hasMinimumStep){
+      switch(pCharacteristic->valueType){
         case ValueType_int:
-          json_object_object_add( characteristic, "minStep",  json_object_new_int(pCharacteristic.minimumStep.intValue) );
+          json_object_object_add( characteristic, "minStep",  json_object_new_int(pCharacteristic->minimumStep.intValue) );
           break;
         case ValueType_float:
-          json_object_object_add( characteristic, "minStep",  json_object_new_double(pCharacteristic.minimumStep.floatValue) );
+          json_object_object_add( characteristic, "minStep",  json_object_new_double(pCharacteristic->minimumStep.floatValue) );
           break;
         default:
           break;
       }
     }
          
-    if(pCharacteristic.hasMaxLength)
-      json_object_object_add( characteristic, "maxLen",     json_object_new_int(pCharacteristic.maxLength));
+    if(pCharacteristic->hasMaxLength)
+      json_object_object_add( characteristic, "maxLen",     json_object_new_int(pCharacteristic->maxLength));
 
-    if(pCharacteristic.hasMaxDataLength)
-      json_object_object_add( characteristic, "maxDataLen",     json_object_new_int(pCharacteristic.maxDataLength));
+    if(pCharacteristic->hasMaxDataLength)
+      json_object_object_add( characteristic, "maxDataLen",     json_object_new_int(pCharacteristic->maxDataLength));
 
-    if(pCharacteristic.description)
-      json_object_object_add( characteristic, "description", json_object_new_string(pCharacteristic.description));
+    if(pCharacteristic->description)
+      json_object_object_add( characteristic, "description", json_object_new_string(pCharacteristic->description));
 
-    if(pCharacteristic.format)
-      json_object_object_add( characteristic, "format", json_object_new_string(pCharacteristic.format));
+    if(pCharacteristic->format)
+      json_object_object_add( characteristic, "format", json_object_new_string(pCharacteristic->format));
 
-    if(pCharacteristic.unit)
-      json_object_object_add( characteristic, "unit", json_object_new_string(pCharacteristic.unit));   
+    if(pCharacteristic->unit)
+      json_object_object_add( characteristic, "unit", json_object_new_string(pCharacteristic->unit));   
   }
 
   if(needperms){
     json_object *properties = json_object_new_array();
-    if(pCharacteristic.secureRead)
+    if(pCharacteristic->secureRead)
       json_object_array_add( properties, json_object_new_string("pr") );
-    if(pCharacteristic.secureWrite)
+    if(pCharacteristic->secureWrite)
       json_object_array_add( properties, json_object_new_string("pw") );
     json_object_object_add( characteristic, "perms", properties);
   }
 
   if(needType){
-    json_object_object_add( characteristic, "type", json_object_new_string(pCharacteristic.type));
+    json_object_object_add( characteristic, "type", json_object_new_string(pCharacteristic->type));
   }
 
   if(needEv){
-    if(pCharacteristic.hasEvents){
+    if(pCharacteristic->hasEvents){
       if(HKNotificationFind(id.aid, id.iid, notifyList)==kNoErr)
         json_object_object_add( characteristic, "ev", json_object_new_boolean(true));
       else
@@ -775,18 +1328,21 @@ HkStatus _HKCreateReadResponsePerCharacteristic(struct _hapAccessory_t inHapObje
   return hkErr;
 }
 
-void _HKCreateWritePerCharacteristic(struct _hapAccessory_t inHapObject[], HK_Char_ID_t id, json_object *value_obj, bool moreComing, mico_Context_t * const inContext)
+/* Convert the new value of a writable characteristic and mark it to be written */
+void _HKCreateWritePerCharacteristic(struct _hapAccessory_t inHapObject[], HK_Char_Request_t *request, json_object *value_obj)
 {
-  struct _hapCharacteristic_t pCharacteristic;
+  const struct _hapCharacteristic_t *pCharacteristic;
+  HK_Char_ID_t id = request->id;
   value_union value;
 
-  if(id.serviceID == 0 || id.characteristicID == 0)
+  request->charValue.serviceID = id.serviceID;
+  request->charValue.characteristicID = id.characteristicID;
+  pCharacteristic = _HKCharacteristicGet(inHapObject, id);
+  if(pCharacteristic == NULL)
     return;
   
-  pCharacteristic = ((inHapObject[id.aid-1]).services[id.serviceID-1]).characteristic[id.characteristicID-1];
-  
-  if( pCharacteristic.secureWrite == true && id.serviceID && id.characteristicID ){
-    switch(pCharacteristic.valueType ){
+  if( pCharacteristic->secureWrite == true && id.serviceID && id.characteristicID ){
+    switch(pCharacteristic->valueType ){
       case ValueType_bool:
         value.boolValue = json_object_get_boolean(value_obj);
         break;
@@ -807,60 +1363,57 @@ void _HKCreateWritePerCharacteristic(struct _hapAccessory_t inHapObject[], HK_Ch
       default:
         break;
     }      
-    HKWriteCharacteristicValue(id.aid, id.serviceID, id.characteristicID, value, moreComing, inContext);    
+    request->charValue.value = value;
+    request->dispatch = true;
   }
 }
 
 void _HKCreateWriteEVPerCharacteristic(struct _hapAccessory_t inHapObject[], HK_Char_ID_t id, json_object *value_obj, HK_Notify_t** notifyList, mico_Context_t * const inContext)
 {
-  struct _hapCharacteristic_t pCharacteristic;
+  const struct _hapCharacteristic_t *pCharacteristic;
   bool enableNotify = json_object_get_boolean(value_obj);
-  value_union value;
 
-  if(id.serviceID == 0 || id.characteristicID == 0)
+  pCharacteristic = _HKCharacteristicGet(inHapObject, id);
+  if(pCharacteristic == NULL)
     return;
-
-  pCharacteristic = ((inHapObject[id.aid-1]).services[id.serviceID-1]).characteristic[id.characteristicID-1];
   
-  if( pCharacteristic.hasEvents == true && id.serviceID && id.characteristicID ){
+  if( pCharacteristic->hasEvents == true && id.serviceID && id.characteristicID ){
+    mico_rtos_lock_mutex(&sessionMutex);
     if(enableNotify){
-      FindCharacteristicByIID(hapObjects, id.aid, id.iid, &id.serviceID, &id.characteristicID);
-      HKReadCharacteristicValue(id.aid, id.serviceID, id.characteristicID, &value, inContext);
-      HKNotificationAdd(id.aid, id.iid, value, notifyList);
+      HKNotificationAdd(id, notifyList);
     }else{
       HKNotificationRemove(id.aid, id.iid, notifyList);
     }
+    mico_rtos_unlock_mutex(&sessionMutex);
   }
 }
 
 
-HkStatus _HKCreateWriteResponsePerCharacteristic(struct _hapAccessory_t inHapObject[], HK_Char_ID_t id, json_object *inHapReadRespondJson, bool check_value, bool check_event, mico_Context_t * const inContext)
+HkStatus _HKCreateWriteResponsePerCharacteristic(struct _hapAccessory_t inHapObject[], const HK_Char_Request_t *request, json_object *inHapReadRespondJson, bool check_value, bool check_event)
 {
   HkStatus hkErr = kNoErr;
-  value_union value;
-  bool event;
-  int httpStatus = kStatusOK;
+  HK_Char_ID_t id = request->id;
   static json_object *characteristic;
-  struct _hapCharacteristic_t pCharacteristic = ((inHapObject[id.aid-1]).services[id.serviceID-1]).characteristic[id.characteristicID-1];
+  const struct _hapCharacteristic_t *pCharacteristic = _HKCharacteristicGet(inHapObject, id);
   
   characteristic = json_object_new_object();
   json_object_array_add(inHapReadRespondJson, characteristic);
   json_object_object_add( characteristic, "aid", json_object_new_int(id.aid));
   json_object_object_add( characteristic, "iid", json_object_new_int(id.iid));
 
-  if(id.serviceID == 0 || id.characteristicID == 0)
+  if(pCharacteristic == NULL)
     return kHKNotExistErr;
 
   if(check_value){
-    if(pCharacteristic.secureWrite == false){
+    if(pCharacteristic->secureWrite == false){
       hkErr = kHKWriteToROErr;
     }else{
-      hkErr = HKReadCharacteristicStatus(id.aid, id.serviceID, id.characteristicID, inContext);    
+      hkErr = request->charValue.status;
     }    
   }
   
   if(check_event){
-    if(!pCharacteristic.hasEvents && hkErr == kHKNoErr){
+    if(!pCharacteristic->hasEvents && hkErr == kHKNoErr){
       hkErr = kHKNotifyUnsupportErr;
     }
   }
@@ -876,7 +1429,6 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
 {
   OSStatus err = kNoErr;
   HkStatus hkErr = kNoErr;
-  printbuf *buffer = NULL;
   uint32_t idx;
   size_t arrayLen;
   err = HKSocketReadHTTPHeader( sockfd, httpHeader, inHkContext->session );
@@ -889,12 +1441,17 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
   int status = kStatusOK;
   int aid, iid;
   HK_Char_ID_t id;
+  HK_Char_Request_t *requests = NULL;
+  uint32_t requestCount;
 
   switch ( err )
   {
     case kNoErr:
-        err = HKSocketReadHTTPBody( sockfd, httpHeader, inHkContext->session );
-        require_noerr(err, exit);
+        /* Characteristic writes are streamed into the json tokener later */
+        if(HTTPHeaderMatchMethod( httpHeader, "PUT") == kNotFoundErr){
+          err = HKSocketReadHTTPBody( sockfd, httpHeader, inHkContext->session );
+          require_noerr(err, exit);
+        }
         /*Pair set engine*/
         if(HTTPHeaderMatchURL( httpHeader, kPAIRSETUP ) == kNoErr) {
           err = HTTPHeaderMatchMethod( httpHeader, "POST");
@@ -952,14 +1509,8 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
 
           require_action( inHkContext->session->established == true, exit, err = kAuthenticationErr; status = kStatusAuthenticationErr );
 
-          err = HKCreateHAPAttriDataBase(hapObjects, *notifyList, &outhapJsonObject, inContext);
+          err = HKSendHAPAttriDataBase(sockfd, *notifyList, inHkContext->session, inContext);
           require_noerr( err, exit );
-          buffer = json_object_to_json_string_ex(outhapJsonObject);
-          ha_log("Json cstring generated, memory remains %d, %s", mico_memory_info()->free_memory, buffer->buf);
-          json_object_put(outhapJsonObject);
-          outhapJsonObject = NULL;
-          err = HKSendResponseMessage(sockfd, status, (uint8_t *)buffer->buf, strlen(buffer->buf), inHkContext->session);
-          require_noerr(err, exit);
         }
         /*Read or write characteristics*/
         else if (HTTPHeaderMatchPartialURL( httpHeader, kRWCharacter ) != NULL){
@@ -991,27 +1542,20 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
             const uint8_t *         src = (const uint8_t *) idPtr + strlen("id=");
             const uint8_t * const   end = idPtrEnd;
 
-            while( IDGetNext( src, end, &id.aid, &id.iid, &src ) == kNoErr ) //Not support ev, perm...
-            {
-              FindCharacteristicByIID(hapObjects, id.aid, id.iid, &id.serviceID, &id.characteristicID);
-              if(id.characteristicID == 0){ //Read every haracteristic in one service
-                for(id.characteristicID = 1; id.characteristicID <= MAXCharacteristicPerService; id.characteristicID++){
-                  if(hapObjects[id.aid-1].services[id.serviceID-1].characteristic[id.characteristicID-1].type == 0 )
-                    break;
-
-                  if(_HKCreateReadResponsePerCharacteristic(hapObjects, id, 
-                                                            needMeta, needPerms, needType, needEv, *notifyList,
-                                                            outCharacteristics, inContext)!=kHKNoErr)
-                    status = kStatusPartialContent;
-                  id.characteristicID ++;
-                }
-              }else{ //Read single haracteristic
-                if(_HKCreateReadResponsePerCharacteristic(hapObjects, id, 
-                                                          needMeta, needPerms, needType, needEv, *notifyList,
-                                                          outCharacteristics, inContext)!=kHKNoErr)
-                  status = kStatusPartialContent;
-              }
+            err = _HKCollectReadRequests(hapObjects, src, end, &requests, &requestCount);
+            require_noerr(err, exit);
+
+            /* Every value of one accessory is read in a single call */
+            _HKDispatchPerAccessory(requests, requestCount, false, inContext);
+
+            for(idx = 0; idx < requestCount; idx++){
+              if(_HKCreateReadResponsePerCharacteristic(hapObjects, &requests[idx], 
+                                                        needMeta, needPerms, needType, needEv, *notifyList,
+                                                        outCharacteristics, inContext)!=kHKNoErr)
+                status = kStatusPartialContent;
             }
+            free(requests);
+            requests = NULL;
             
             /* Remove status object if no error occured */
             if(status != kStatusPartialContent){
@@ -1023,17 +1567,16 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
             }
 
             /* Send the respond */
-            buffer = json_object_to_json_string_ex(outhapJsonObject);
-            ha_log("Json cstring generated, memory remains %d, %s", mico_memory_info()->free_memory, buffer->buf);
+            ha_log("Json response generated, memory remains %d", mico_memory_info()->free_memory);
+            err = HKSendResponseJson(sockfd, status, outhapJsonObject, inHkContext->session);
             json_object_put(outhapJsonObject);
             outhapJsonObject = NULL;
-            err = HKSendResponseMessage(sockfd, status, (uint8_t *)buffer->buf, strlen(buffer->buf), inHkContext->session);
             require_noerr(err, exit);
           }
         /* Write characteristic */
         else if(HTTPHeaderMatchMethod( httpHeader, "PUT")!=kNotFoundErr){
-          inhapJsonObject = json_tokener_parse(httpHeader->extraDataPtr);
-          require_action(inhapJsonObject, exit, err = kMalformedErr);
+          err = HKSocketReadHTTPJsonBody( sockfd, httpHeader, inHkContext->session, &inhapJsonObject );
+          require_noerr(err, exit);
           characteristics = json_object_object_get(inhapJsonObject, "characteristics");
           require_action(characteristics, exit, err = kMalformedErr);
           require_action(json_object_is_type(characteristics, json_type_array), exit, err = kMalformedErr);
@@ -1044,20 +1587,23 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
           outCharacteristics = json_object_new_array();
           json_object_object_add( outhapJsonObject, "characteristics", outCharacteristics);
 
-          /* Parse every value and write*/
+          /* Parse every value, subscriptions are changed right away */
           arrayLen = json_object_array_length(characteristics);
+          requests = calloc(arrayLen + 1, sizeof(HK_Char_Request_t));
+          require_action(requests, exit, err = kNoMemoryErr);
           for(idx = 0; idx < arrayLen; idx++){
 
             characteristic = json_object_array_get_idx(characteristics, idx);
             id.aid = json_object_get_int(json_object_object_get(characteristic, "aid"));
             id.iid = json_object_get_int(json_object_object_get(characteristic, "iid"));
             FindCharacteristicByIID(hapObjects, id.aid, id.iid, &id.serviceID, &id.characteristicID);      
+            requests[idx].id = id;
 
             value_obj = json_object_object_get(characteristic, "value");
             event_obj = json_object_object_get(characteristic, "ev");
 
             if(value_obj){
-              _HKCreateWritePerCharacteristic(hapObjects, id, value_obj, idx < arrayLen-1, inContext);
+              _HKCreateWritePerCharacteristic(hapObjects, &requests[idx], value_obj);
           }
             if(event_obj){
               require_action(json_object_is_type(event_obj, json_type_boolean), exit, err = kMalformedErr);
@@ -1065,36 +1611,36 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
             }
           }
 
+          /* Every new value of one accessory is written in a single call */
+          _HKDispatchPerAccessory(requests, arrayLen, true, inContext);
+
           /* Read the write respond */
           for(idx = 0; idx < arrayLen; idx++){
             characteristic = json_object_array_get_idx(characteristics, idx);
-            id.aid = json_object_get_int(json_object_object_get(characteristic, "aid"));
-            id.iid = json_object_get_int(json_object_object_get(characteristic, "iid"));
-            FindCharacteristicByIID(hapObjects, id.aid, id.iid, &id.serviceID, &id.characteristicID);
-
             value_obj = json_object_object_get(characteristic, "value");
             event_obj = json_object_object_get(characteristic, "ev");
 
-            if(_HKCreateWriteResponsePerCharacteristic(hapObjects, id, outCharacteristics, value_obj, event_obj, inContext)!=kHKNoErr)
+            if(_HKCreateWriteResponsePerCharacteristic(hapObjects, &requests[idx], outCharacteristics, value_obj, event_obj)!=kHKNoErr)
               status = kStatusPartialContent;               
           }
+          free(requests);
+          requests = NULL;
 
-          /* Create response json string */
-          buffer = json_object_to_json_string_ex(outhapJsonObject);
-          ha_log("Json cstring generated, memory remains %d, %s", mico_memory_info()->free_memory, buffer->buf);
-          json_object_put(outhapJsonObject);
-          outhapJsonObject = NULL;
           json_object_put(inhapJsonObject);
           inhapJsonObject = NULL;
 
+          /* Response json is rendered straight into the session frames */
+          ha_log("Json response generated, memory remains %d", mico_memory_info()->free_memory);
           if(status == kStatusNoConetnt)
             HKSendResponseMessage(sockfd, status, NULL, 0, inHkContext->session);
           else{
             if(arrayLen == 1)
-              HKSendResponseMessage(sockfd, kStatusBadRequest, (uint8_t *)buffer->buf, strlen(buffer->buf), inHkContext->session);
+              HKSendResponseJson(sockfd, kStatusBadRequest, outhapJsonObject, inHkContext->session);
             else
-              HKSendResponseMessage(sockfd, status, (uint8_t *)buffer->buf, strlen(buffer->buf), inHkContext->session);
+              HKSendResponseJson(sockfd, status, outhapJsonObject, inHkContext->session);
           }
+          json_object_put(outhapJsonObject);
+          outhapJsonObject = NULL;
 
         }else
         /*Unkown Methold*/
@@ -1135,16 +1681,15 @@ exit:
   if( err != kNoErr && status != kStatusOK ){
     outhapJsonObject = json_object_new_object();
     json_object_object_add( outhapJsonObject, "status", json_object_new_int(hkErr));
-    buffer = json_object_to_json_string_ex(outhapJsonObject);
-    ha_log("Json cstring generated, memory remains %d, %s", mico_memory_info()->free_memory, buffer->buf);
-    HKSendResponseMessage(sockfd, status, (uint8_t *)buffer->buf, strlen(buffer->buf), inHkContext->session);
+    ha_log("Json response generated, memory remains %d", mico_memory_info()->free_memory);
+    HKSendResponseJson(sockfd, status, outhapJsonObject, inHkContext->session);
     msleep(100);
   }
 
   HTTPHeaderClear( httpHeader );
   if(outhapJsonObject) json_object_put(outhapJsonObject);
   if(inhapJsonObject) json_object_put(inhapJsonObject);
-  if(buffer) printbuf_free(buffer);
+  if(requests) free(requests);
   return err;
 
 }
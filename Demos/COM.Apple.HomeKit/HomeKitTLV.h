@@ -49,6 +49,9 @@
 // [bytes] Last fragment of data
 #define kTLVType_FragmentLast           0x0D
 
+// [bytes] Identifier of a verified session that the controller wants to resume.
+#define kTLVType_SessionID              0x0E
+
 // [null] Zero-length TLV that separates different TLVs in a list.
 #define kTLVType_Separator              0xFF
 
@@ -228,24 +228,33 @@ void HKWriteCharacteristicValue(int accessoryID, int serviceID, int characterist
     /*Control lightbulb*/
     /*.................*/
 
+    /*Report every new value to controllers that subscribed to its events*/
     if(inContext->appStatus.service.on_status == kHKBusyErr){
       inContext->appStatus.service.on = inContext->appStatus.service.on_new;
       inContext->appStatus.service.on_status = kNoErr;      
+      value.boolValue = inContext->appStatus.service.on;
+      HKCharacteristicDidChange(accessoryID, 2, 1, value);
     }
 
     if(inContext->appStatus.service.brightness_status == kHKBusyErr){
       inContext->appStatus.service.brightness = inContext->appStatus.service.brightness_new;
       inContext->appStatus.service.brightness_status = kNoErr;
+      value.intValue = inContext->appStatus.service.brightness;
+      HKCharacteristicDidChange(accessoryID, 2, 2, value);
     }
 
     if(inContext->appStatus.service.hue_status == kHKBusyErr){
       inContext->appStatus.service.hue = inContext->appStatus.service.hue_new; 
       inContext->appStatus.service.hue_status = kNoErr;
+      value.floatValue = inContext->appStatus.service.hue;
+      HKCharacteristicDidChange(accessoryID, 2, 3, value);
     }
 
     if(inContext->appStatus.service.saturation_status == kHKBusyErr){
       inContext->appStatus.service.saturation = inContext->appStatus.service.saturation_new;
       inContext->appStatus.service.saturation_status = kNoErr;
+      value.floatValue = inContext->appStatus.service.saturation;
+      HKCharacteristicDidChange(accessoryID, 2, 4, value);
     }
     
     if( inContext->appStatus.service.on == false)
@@ -294,6 +303,29 @@ void HKWriteCharacteristicValue(int accessoryID, int serviceID, int characterist
   return;
 }
 
+/*The HAP server reads and writes every characteristic of one accessory in a request with a 
+  single call, replace these to talk to a slow backend once per scene. The defaults below
+  use the per characteristic routines above*/
+void HKReadCharacteristicValues(int accessoryID, HK_Char_Value_t values[], int count, mico_Context_t * const inContext)
+{
+  int idx;
+
+  for(idx = 0; idx < count; idx++)
+    values[idx].status = HKReadCharacteristicValue(accessoryID, values[idx].serviceID, values[idx].characteristicID, &values[idx].value, inContext);
+}
+
+void HKWriteCharacteristicValues(int accessoryID, HK_Char_Value_t values[], int count, mico_Context_t * const inContext)
+{
+  int idx;
+
+  for(idx = 0; idx < count; idx++)
+    HKWriteCharacteristicValue(accessoryID, values[idx].serviceID, values[idx].characteristicID, values[idx].value, idx < count-1, inContext);
+
+  /*Status after the last write has been operated*/
+  for(idx = 0; idx < count; idx++)
+    values[idx].status = HKReadCharacteristicStatus(accessoryID, values[idx].serviceID, values[idx].characteristicID, inContext);
+}
+
 
 void HKCharacteristicInit(mico_Context_t * const inContext)
 {
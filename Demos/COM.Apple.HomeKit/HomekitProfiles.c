@@ -4,6 +4,8 @@
 #include "MICODefine.h"
 #include "platform_config.h"
 
+static hapIID_t hapIIDTable[NumberofAccessories][MAXIIDPerAccessory + 1];
+
 const struct _hapAccessory_t hapObjects[NumberofAccessories] = 
 {
   {
@@ -225,3 +227,44 @@ const struct _hapAccessory_t hapObjects[NumberofAccessories] =
     }
   }
 };
+
+/* Number instance IDs in the same order as the accessory database is serialized:
+   every service takes one iid, followed by its characteristics */
+void HKIIDTableInit(void)
+{
+  int accessoryIndex, serviceIndex, characteristicIndex, iid;
+  const struct _hapCharacteristic_t *pCharacteristic;
+  hapIID_t *entry;
+
+  memset(hapIIDTable, 0x0, sizeof(hapIIDTable));
+
+  for(accessoryIndex = 0; accessoryIndex < NumberofAccessories; accessoryIndex++){
+    for(serviceIndex = 0, iid = 1; serviceIndex < MAXServicePerAccessory; serviceIndex++){
+      if(hapObjects[accessoryIndex].services[serviceIndex].type == 0)
+        break;
+      entry = &hapIIDTable[accessoryIndex][iid++];
+      entry->serviceID = serviceIndex + 1;
+
+      for(characteristicIndex = 0; characteristicIndex < MAXCharacteristicPerService; characteristicIndex++){
+        pCharacteristic = &hapObjects[accessoryIndex].services[serviceIndex].characteristic[characteristicIndex];
+        if(pCharacteristic->type == 0)
+          break;
+        entry = &hapIIDTable[accessoryIndex][iid++];
+        entry->serviceID = serviceIndex + 1;
+        entry->characteristicID = characteristicIndex + 1;
+        entry->valueType = pCharacteristic->valueType;
+        entry->perms = (pCharacteristic->secureRead? kHAPPermRead:0) | (pCharacteristic->secureWrite? kHAPPermWrite:0)
+                     | (pCharacteristic->hasEvents? kHAPPermEvents:0);
+      }
+    }
+  }
+}
+
+const hapIID_t *HKIIDTableLookup(int aid, int iid)
+{
+  if(aid < 1 || aid > NumberofAccessories || iid < 1 || iid > MAXIIDPerAccessory)
+    return NULL;
+  if(hapIIDTable[aid-1][iid].serviceID == 0)
+    return NULL;
+  return &hapIIDTable[aid-1][iid];
+}
@@ -64,6 +64,15 @@ typedef union {
     json_object *object;
   } value_union;
 
+/* One characteristic in a batched read or write, every characteristic of an accessory
+   touched by one request is passed to the application in a single call */
+typedef struct _HK_Char_Value_t {
+  int          serviceID;
+  int          characteristicID;
+  value_union  value;
+  HkStatus     status;        //! Set by the application, kHKNoErr or a kHKxxxErr code
+} HK_Char_Value_t;
+
 
 struct _hapCharacteristic_t {
   char   *type;
@@ -116,6 +125,23 @@ struct _hapAccessory_t {
   struct _hapService_t  services[MAXServicePerAccessory];
 };
 
+/* Instance ID index, built once from hapObjects by HKIIDTableInit */
+#define MAXIIDPerAccessory                (MAXServicePerAccessory * (MAXCharacteristicPerService + 1))
+
+#define kHAPPermRead                      0x01
+#define kHAPPermWrite                     0x02
+#define kHAPPermEvents                    0x04
+
+typedef struct _hapIID_t {
+  uint8_t   serviceID;                    //! Start from 1, 0 if instance ID does not exist
+  uint8_t   characteristicID;             //! Start from 1, 0 if instance ID is a service
+  uint8_t   valueType;
+  uint8_t   perms;                        //! kHAPPermRead, kHAPPermWrite and kHAPPermEvents
+} hapIID_t;
+
+void HKIIDTableInit(void);
+const hapIID_t *HKIIDTableLookup(int aid, int iid);
+
 
 #endif
 
@@ -47,6 +47,10 @@
 #define BONJOUR_SERVICE         "_hap._tcp.local."
 #define CATEGORY_IDENTIFIER     CI_LIGHTBULB
 
+/* Pair resume is not sent by iOS controllers over IP, and it answers a controller
+   before any signature is checked. Leave it off unless a controller really uses it */
+#define HA_PAIR_RESUME_ENABLE   0
+
 typedef enum
 {
     eState_M1_SRPStartRequest      = 1,
@@ -151,5 +155,9 @@ typedef struct _current_app_status_t {
 
 void homeKitListener_thread(void *inContext);
 
+/* Call when a characteristic value is changed, events are sent to every controller that
+   subscribed to it. String values should stay valid as the ones from HKReadCharacteristicValue */
+void HKCharacteristicDidChange(int accessoryID, int serviceID, int characteristicID, value_union value);
+
 #endif
 
@@ -119,6 +119,7 @@ json_object* ConfigCreateReportJsonMessage( mico_Context_t * const inContext )
   OTA_Versions_t versions;
   char rfVersion[50];
   json_object *sectors, *sector, *subMenuSectors, *subMenuSector, *mainObject = NULL;
+  struct json_arena *arena;
 
   MicoGetRfVer( rfVersion, 50 );
 
@@ -137,14 +138,18 @@ json_object* ConfigCreateReportJsonMessage( mico_Context_t * const inContext )
   versions.protocol =  PROTOCOL;
   versions.rfVersion = NULL;
 
-  sectors = json_object_new_array();
-  require( sectors, exit );
+  /* The whole report lives in one arena. sectors is its first object and so
+     its root: the arena is freed when sectors is released, by mainObject once
+     the top menu holds it, or here if the top menu cannot be built */
+  arena = json_arena_new(JSON_ARENA_DEF_BLOCK_SIZE);
+  sectors = json_arena_new_array(arena);
+  require_action( sectors, exit, json_arena_free(arena); err = kNoMemoryErr );
 
   err = MICOAddTopMenu(&mainObject, name, sectors, versions);
-  require_noerr(err, exit);
+  require_noerr_action(err, exit, json_object_put(sectors));
 
   /*Sector 1*/
-  sector = json_object_new_array();
+  sector = json_arena_new_array(arena);
   require( sector, exit );
   err = MICOAddSector(sectors, "MICO SYSTEM",    sector);
   require_noerr(err, exit);
@@ -166,12 +171,12 @@ json_object* ConfigCreateReportJsonMessage( mico_Context_t * const inContext )
     require_noerr(err, exit);
 
     /*sub menu*/
-    subMenuSectors = json_object_new_array();
+    subMenuSectors = json_arena_new_array(arena);
     require( subMenuSectors, exit );
     err = MICOAddMenuCellToSector(sector, "Detail", subMenuSectors);
     require_noerr(err, exit);
       
-      subMenuSector = json_object_new_array();
+      subMenuSector = json_arena_new_array(arena);
       require( subMenuSector, exit );
       err = MICOAddSector(subMenuSectors,  "",    subMenuSector);
       require_noerr(err, exit);
@@ -191,7 +196,7 @@ json_object* ConfigCreateReportJsonMessage( mico_Context_t * const inContext )
         err = MICOAddStringCellToSector(subMenuSector, "Protocol",       PROTOCOL,          "RO", NULL);
         require_noerr(err, exit);
 
-      subMenuSector = json_object_new_array();
+      subMenuSector = json_arena_new_array(arena);
       err = MICOAddSector(subMenuSectors,  "WLAN",    subMenuSector);
       require_noerr(err, exit);
       
@@ -245,7 +250,7 @@ json_object* ConfigCreateReportJsonMessage( mico_Context_t * const inContext )
         }
 
   /*Sector 3*/
-  sector = json_object_new_array();
+  sector = json_arena_new_array(arena);
   require( sector, exit );
   err = MICOAddSector(sectors, "WLAN",           sector);
   require_noerr(err, exit);
@@ -281,52 +286,52 @@ exit:
   return mainObject;
 }
 
+OSStatus ConfigIncommingJsonValue( const char *key, json_object *val, void *ctx )
+{
+  flash_content_t * const config = ctx;
+
+  config_delegate_log("Recv config %s", key);
+  if(!strcmp(key, "Device Name")){
+    strncpy(config->micoSystemConfig.name, json_object_get_string(val), maxNameLen);
+  }else if(!strcmp(key, "RF power save")){
+    config->micoSystemConfig.rfPowerSaveEnable = json_object_get_boolean(val);
+  }else if(!strcmp(key, "MCU power save")){
+    config->micoSystemConfig.mcuPowerSaveEnable = json_object_get_boolean(val);
+  }else if(!strcmp(key, "Bonjour")){
+    config->micoSystemConfig.bonjourEnable = json_object_get_boolean(val);
+  }else if(!strcmp(key, "Wi-Fi")){
+    strncpy(config->micoSystemConfig.ssid, json_object_get_string(val), maxSsidLen);
+    config->micoSystemConfig.channel = 0;
+    memset(config->micoSystemConfig.bssid, 0x0, 6);
+    config->micoSystemConfig.security = SECURITY_TYPE_AUTO;
+    memcpy(config->micoSystemConfig.key, config->micoSystemConfig.user_key, maxKeyLen);
+    config->micoSystemConfig.keyLength = config->micoSystemConfig.user_keyLength;
+  }else if(!strcmp(key, "Password")){
+    config->micoSystemConfig.security = SECURITY_TYPE_AUTO;
+    strncpy(config->micoSystemConfig.key, json_object_get_string(val), maxKeyLen);
+    strncpy(config->micoSystemConfig.user_key, json_object_get_string(val), maxKeyLen);
+    config->micoSystemConfig.keyLength = strlen(config->micoSystemConfig.key);
+    config->micoSystemConfig.user_keyLength = strlen(config->micoSystemConfig.key);
+  }else if(!strcmp(key, "DHCP")){
+    config->micoSystemConfig.dhcpEnable   = json_object_get_boolean(val);
+  }else if(!strcmp(key, "IP address")){
+    strncpy(config->micoSystemConfig.localIp, json_object_get_string(val), maxIpLen);
+  }else if(!strcmp(key, "Net Mask")){
+    strncpy(config->micoSystemConfig.netMask, json_object_get_string(val), maxIpLen);
+  }else if(!strcmp(key, "Gateway")){
+    strncpy(config->micoSystemConfig.gateWay, json_object_get_string(val), maxIpLen);
+  }else if(!strcmp(key, "DNS Server")){
+    strncpy(config->micoSystemConfig.dnsServer, json_object_get_string(val), maxIpLen);
+  }
+  return kNoErr;
+}
+
 OSStatus ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext )
 {
   OSStatus err = kNoErr;
-  json_object *new_obj;
-  config_delegate_log_trace();
 
-  new_obj = json_tokener_parse(input);
-  require_action(new_obj, exit, err = kUnknownErr);
-  config_delegate_log("Recv config object=%s", json_object_to_json_string(new_obj));
-  mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
-  json_object_object_foreach(new_obj, key, val) {
-    if(!strcmp(key, "Device Name")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.name, json_object_get_string(val), maxNameLen);
-    }else if(!strcmp(key, "RF power save")){
-      inContext->flashContentInRam.micoSystemConfig.rfPowerSaveEnable = json_object_get_boolean(val);
-    }else if(!strcmp(key, "MCU power save")){
-      inContext->flashContentInRam.micoSystemConfig.mcuPowerSaveEnable = json_object_get_boolean(val);
-    }else if(!strcmp(key, "Bonjour")){
-      inContext->flashContentInRam.micoSystemConfig.bonjourEnable = json_object_get_boolean(val);
-    }else if(!strcmp(key, "Wi-Fi")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.ssid, json_object_get_string(val), maxSsidLen);
-      inContext->flashContentInRam.micoSystemConfig.channel = 0;
-      memset(inContext->flashContentInRam.micoSystemConfig.bssid, 0x0, 6);
-      inContext->flashContentInRam.micoSystemConfig.security = SECURITY_TYPE_AUTO;
-      memcpy(inContext->flashContentInRam.micoSystemConfig.key, inContext->flashContentInRam.micoSystemConfig.user_key, maxKeyLen);
-      inContext->flashContentInRam.micoSystemConfig.keyLength = inContext->flashContentInRam.micoSystemConfig.user_keyLength;
-    }else if(!strcmp(key, "Password")){
-      inContext->flashContentInRam.micoSystemConfig.security = SECURITY_TYPE_AUTO;
-      strncpy(inContext->flashContentInRam.micoSystemConfig.key, json_object_get_string(val), maxKeyLen);
-      strncpy(inContext->flashContentInRam.micoSystemConfig.user_key, json_object_get_string(val), maxKeyLen);
-      inContext->flashContentInRam.micoSystemConfig.keyLength = strlen(inContext->flashContentInRam.micoSystemConfig.key);
-      inContext->flashContentInRam.micoSystemConfig.user_keyLength = strlen(inContext->flashContentInRam.micoSystemConfig.key);
-    }else if(!strcmp(key, "DHCP")){
-      inContext->flashContentInRam.micoSystemConfig.dhcpEnable   = json_object_get_boolean(val);
-    }else if(!strcmp(key, "IP address")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.localIp, json_object_get_string(val), maxIpLen);
-    }else if(!strcmp(key, "Net Mask")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.netMask, json_object_get_string(val), maxIpLen);
-    }else if(!strcmp(key, "Gateway")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.gateWay, json_object_get_string(val), maxIpLen);
-    }else if(!strcmp(key, "DNS Server")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.dnsServer, json_object_get_string(val), maxIpLen);
-    }
-  }
-  json_object_put(new_obj);
-  mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
+  err = MICOConfigJsonApply( input, ConfigIncommingJsonValue, inContext );
+  require_noerr( err, exit );
 
 exit:
   return err; 
@@ -373,61 +373,61 @@ exit:
   return mainObject;
 }
 
+OSStatus ConfigIncommingJsonValue( const char *key, json_object *val, void *ctx )
+{
+  flash_content_t * const config = ctx;
+
+  config_delegate_log("Recv config %s", key);
+  if(!strcmp(key, "Device Name")){
+    strncpy(config->micoSystemConfig.name, json_object_get_string(val), maxNameLen);
+  }else if(!strcmp(key, "RF power save")){
+    config->micoSystemConfig.rfPowerSaveEnable = json_object_get_boolean(val);
+  }else if(!strcmp(key, "MCU power save")){
+    config->micoSystemConfig.mcuPowerSaveEnable = json_object_get_boolean(val);
+  }else if(!strcmp(key, "Bonjour")){
+    config->micoSystemConfig.bonjourEnable = json_object_get_boolean(val);
+  }else if(!strcmp(key, "Wi-Fi")){
+    strncpy(config->micoSystemConfig.ssid, json_object_get_string(val), maxSsidLen);
+    config->micoSystemConfig.channel = 0;
+    memset(config->micoSystemConfig.bssid, 0x0, 6);
+    config->micoSystemConfig.security = SECURITY_TYPE_AUTO;
+    memcpy(config->micoSystemConfig.key, config->micoSystemConfig.user_key, maxKeyLen);
+    config->micoSystemConfig.keyLength = config->micoSystemConfig.user_keyLength;
+  }else if(!strcmp(key, "Password")){
+    config->micoSystemConfig.security = SECURITY_TYPE_AUTO;
+    strncpy(config->micoSystemConfig.key, json_object_get_string(val), maxKeyLen);
+    strncpy(config->micoSystemConfig.user_key, json_object_get_string(val), maxKeyLen);
+    config->micoSystemConfig.keyLength = strlen(config->micoSystemConfig.key);
+    config->micoSystemConfig.user_keyLength = strlen(config->micoSystemConfig.key);
+  }else if(!strcmp(key, "DHCP")){
+    config->micoSystemConfig.dhcpEnable   = json_object_get_boolean(val);
+  }else if(!strcmp(key, "IP address")){
+    strncpy(config->micoSystemConfig.localIp, json_object_get_string(val), maxIpLen);
+  }else if(!strcmp(key, "Net Mask")){
+    strncpy(config->micoSystemConfig.netMask, json_object_get_string(val), maxIpLen);
+  }else if(!strcmp(key, "Gateway")){
+    strncpy(config->micoSystemConfig.gateWay, json_object_get_string(val), maxIpLen);
+  }else if(!strcmp(key, "DNS Server")){
+    strncpy(config->micoSystemConfig.dnsServer, json_object_get_string(val), maxIpLen);   
+  }else if(!strcmp(key, "Baurdrate")){
+    config->appConfig.virtualDevConfig.USART_BaudRate = json_object_get_int(val);
+  }else if(!strcmp(key, "login_id")){
+    strncpy(config->appConfig.virtualDevConfig.loginId, json_object_get_string(val), MAX_SIZE_LOGIN_ID); 
+  } else if(!strcmp(key, "devPasswd")){
+    strncpy(config->appConfig.virtualDevConfig.devPasswd, json_object_get_string(val), MAX_SIZE_DEV_PASSWD); 
+  }/*else if(!strcmp(key, "user_token")){
+    strncpy(config->appConfig.virtualDevConfig.userToken, json_object_get_string(val), MAX_SIZE_USER_TOKEN); 
+  }*/else{
+  }
+  return kNoErr;
+}
+
 OSStatus ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext )
 {
   OSStatus err = kNoErr;
-  json_object *new_obj;
-  config_delegate_log_trace();
 
-  new_obj = json_tokener_parse(input);
-  require_action(new_obj, exit, err = kUnknownErr);
-  config_delegate_log("Recv config object=%s", json_object_to_json_string(new_obj));
-  mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
-  json_object_object_foreach(new_obj, key, val) {
-    if(!strcmp(key, "Device Name")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.name, json_object_get_string(val), maxNameLen);
-    }else if(!strcmp(key, "RF power save")){
-      inContext->flashContentInRam.micoSystemConfig.rfPowerSaveEnable = json_object_get_boolean(val);
-    }else if(!strcmp(key, "MCU power save")){
-      inContext->flashContentInRam.micoSystemConfig.mcuPowerSaveEnable = json_object_get_boolean(val);
-    }else if(!strcmp(key, "Bonjour")){
-      inContext->flashContentInRam.micoSystemConfig.bonjourEnable = json_object_get_boolean(val);
-    }else if(!strcmp(key, "Wi-Fi")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.ssid, json_object_get_string(val), maxSsidLen);
-      inContext->flashContentInRam.micoSystemConfig.channel = 0;
-      memset(inContext->flashContentInRam.micoSystemConfig.bssid, 0x0, 6);
-      inContext->flashContentInRam.micoSystemConfig.security = SECURITY_TYPE_AUTO;
-      memcpy(inContext->flashContentInRam.micoSystemConfig.key, inContext->flashContentInRam.micoSystemConfig.user_key, maxKeyLen);
-      inContext->flashContentInRam.micoSystemConfig.keyLength = inContext->flashContentInRam.micoSystemConfig.user_keyLength;
-    }else if(!strcmp(key, "Password")){
-      inContext->flashContentInRam.micoSystemConfig.security = SECURITY_TYPE_AUTO;
-      strncpy(inContext->flashContentInRam.micoSystemConfig.key, json_object_get_string(val), maxKeyLen);
-      strncpy(inContext->flashContentInRam.micoSystemConfig.user_key, json_object_get_string(val), maxKeyLen);
-      inContext->flashContentInRam.micoSystemConfig.keyLength = strlen(inContext->flashContentInRam.micoSystemConfig.key);
-      inContext->flashContentInRam.micoSystemConfig.user_keyLength = strlen(inContext->flashContentInRam.micoSystemConfig.key);
-    }else if(!strcmp(key, "DHCP")){
-      inContext->flashContentInRam.micoSystemConfig.dhcpEnable   = json_object_get_boolean(val);
-    }else if(!strcmp(key, "IP address")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.localIp, json_object_get_string(val), maxIpLen);
-    }else if(!strcmp(key, "Net Mask")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.netMask, json_object_get_string(val), maxIpLen);
-    }else if(!strcmp(key, "Gateway")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.gateWay, json_object_get_string(val), maxIpLen);
-    }else if(!strcmp(key, "DNS Server")){
-      strncpy(inContext->flashContentInRam.micoSystemConfig.dnsServer, json_object_get_string(val), maxIpLen);   
-    }else if(!strcmp(key, "Baurdrate")){
-      inContext->flashContentInRam.appConfig.virtualDevConfig.USART_BaudRate = json_object_get_int(val);
-    }else if(!strcmp(key, "login_id")){
-      strncpy(inContext->flashContentInRam.appConfig.virtualDevConfig.loginId, json_object_get_string(val), MAX_SIZE_LOGIN_ID); 
-    } else if(!strcmp(key, "devPasswd")){
-      strncpy(inContext->flashContentInRam.appConfig.virtualDevConfig.devPasswd, json_object_get_string(val), MAX_SIZE_DEV_PASSWD); 
-    }/*else if(!strcmp(key, "user_token")){
-      strncpy(inContext->flashContentInRam.appConfig.virtualDevConfig.userToken, json_object_get_string(val), MAX_SIZE_USER_TOKEN); 
-    }*/else{
-    }
-  }
-  json_object_put(new_obj);
-  mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
+  err = MICOConfigJsonApply( input, ConfigIncommingJsonValue, inContext );
+  require_noerr( err, exit );
 
   inContext->flashContentInRam.micoSystemConfig.configured = allConfigured;
   MICOUpdateConfiguration(inContext);
@@ -436,31 +436,42 @@ exit:
   return err; 
 }
 
+/* Cloud requests carry the same credentials, they are picked out as the body is parsed */
+typedef struct {
+  char *loginId;
+  char *devPasswd;
+  char *userToken;  /* NULL if the request takes no token */
+} _MVDRequestFields_t;
+
+static OSStatus _MVDRequestValue( const char *key, json_object *val, void *inFields )
+{
+  _MVDRequestFields_t *fields = inFields;
+
+  if(!strcmp(key, "login_id")){
+    strncpy(fields->loginId, json_object_get_string(val), MAX_SIZE_LOGIN_ID);
+  }
+  else if(!strcmp(key, "dev_passwd")){
+    strncpy(fields->devPasswd, json_object_get_string(val), MAX_SIZE_DEV_PASSWD);
+  }
+  else if(!strcmp(key, "user_token") && fields->userToken){
+    strncpy(fields->userToken, json_object_get_string(val), MAX_SIZE_USER_TOKEN);
+  }
+  return kNoErr;
+}
+
 OSStatus getMVDActivateRequestData(const char *input, MVDActivateRequestData_t *activateData)
 {
   OSStatus err = kUnknownErr;
-  json_object *new_obj;
+  _MVDRequestFields_t fields;
   config_delegate_log_trace();
-  
-  new_obj = json_tokener_parse(input);
-  require_action(new_obj, exit, err = kUnknownErr);
-  
-  config_delegate_log("Recv activate object=%s", json_object_to_json_string(new_obj));
-  
-  json_object_object_foreach(new_obj, key, val) {
-    if(!strcmp(key, "login_id")){
-      strncpy(activateData->loginId, json_object_get_string(val), MAX_SIZE_LOGIN_ID);
-    }
-    else if(!strcmp(key, "dev_passwd")){
-      strncpy(activateData->devPasswd, json_object_get_string(val), MAX_SIZE_DEV_PASSWD);
-    }
-    else if(!strcmp(key, "user_token")){
-      strncpy(activateData->user_token, json_object_get_string(val), MAX_SIZE_USER_TOKEN);
-    }
-  }
-  json_object_put(new_obj);
-  err = kNoErr;
-  
+
+  fields.loginId = activateData->loginId;
+  fields.devPasswd = activateData->devPasswd;
+  fields.userToken = activateData->user_token;
+  err = MICOConfigJsonParse( input, _MVDRequestValue, &fields );
+  require_noerr( err, exit );
+  config_delegate_log("Recv activate request, login_id=%s", activateData->loginId);
+
 exit:  
   return err;
 }
@@ -468,28 +479,16 @@ exit:
 OSStatus getMVDAuthorizeRequestData(const char *input, MVDAuthorizeRequestData_t *authorizeData)
 {
   OSStatus err = kUnknownErr;
-  json_object *new_obj;
+  _MVDRequestFields_t fields;
   config_delegate_log_trace();
-  
-  new_obj = json_tokener_parse(input);
-  require_action(new_obj, exit, err = kUnknownErr);
-  
-  config_delegate_log("Recv activate object=%s", json_object_to_json_string(new_obj));
-  
-  json_object_object_foreach(new_obj, key, val) {
-    if(!strcmp(key, "login_id")){
-      strncpy(authorizeData->loginId, json_object_get_string(val), MAX_SIZE_LOGIN_ID);
-    }
-    else if(!strcmp(key, "dev_passwd")){
-      strncpy(authorizeData->devPasswd, json_object_get_string(val), MAX_SIZE_DEV_PASSWD);
-    }
-    else if(!strcmp(key, "user_token")){
-      strncpy(authorizeData->user_token, json_object_get_string(val), MAX_SIZE_USER_TOKEN);
-    }
-  }
-  json_object_put(new_obj);
-  err = kNoErr;
-  
+
+  fields.loginId = authorizeData->loginId;
+  fields.devPasswd = authorizeData->devPasswd;
+  fields.userToken = authorizeData->user_token;
+  err = MICOConfigJsonParse( input, _MVDRequestValue, &fields );
+  require_noerr( err, exit );
+  config_delegate_log("Recv authorize request, login_id=%s", authorizeData->loginId);
+
 exit:  
   return err;
 }
@@ -497,27 +496,16 @@ exit:
 OSStatus getMVDResetRequestData(const char *input, MVDResetRequestData_t *devResetData)
 {
   OSStatus err = kUnknownErr;
-  json_object *new_obj;
+  _MVDRequestFields_t fields;
   config_delegate_log_trace();
-  
-  new_obj = json_tokener_parse(input);
-  require_action(new_obj, exit, err = kUnknownErr);
-  
-  config_delegate_log("Recv devReset object=%s", json_object_to_json_string(new_obj));
-  
-  json_object_object_foreach(new_obj, key, val) {
-    if(!strcmp(key, "login_id")){
-      strncpy(devResetData->loginId, json_object_get_string(val), MAX_SIZE_LOGIN_ID);
-    }
-    else if(!strcmp(key, "dev_passwd")){
-      strncpy(devResetData->devPasswd, json_object_get_string(val), MAX_SIZE_DEV_PASSWD);
-    }
-    else {
-    }
-  }
-  json_object_put(new_obj);
-  err = kNoErr;
-  
+
+  fields.loginId = devResetData->loginId;
+  fields.devPasswd = devResetData->devPasswd;
+  fields.userToken = NULL;
+  err = MICOConfigJsonParse( input, _MVDRequestValue, &fields );
+  require_noerr( err, exit );
+  config_delegate_log("Recv devReset request, login_id=%s", devResetData->loginId);
+
 exit:  
   return err;
 }
@@ -525,27 +513,16 @@ exit:
 OSStatus getMVDOTARequestData(const char *input, MVDOTARequestData_t *OTAData)
 {
   OSStatus err = kUnknownErr;
-  json_object *new_obj;
+  _MVDRequestFields_t fields;
   config_delegate_log_trace();
-  
-  new_obj = json_tokener_parse(input);
-  require_action(new_obj, exit, err = kUnknownErr);
-  
-  config_delegate_log("Recv OTA request object=%s", json_object_to_json_string(new_obj));
-  
-  json_object_object_foreach(new_obj, key, val) {
-    if(!strcmp(key, "login_id")){
-      strncpy(OTAData->loginId, json_object_get_string(val), MAX_SIZE_LOGIN_ID);
-    }
-    else if(!strcmp(key, "dev_passwd")){
-      strncpy(OTAData->devPasswd, json_object_get_string(val), MAX_SIZE_DEV_PASSWD);
-    }
-    else {
-    }
-  }
-  json_object_put(new_obj);
-  err = kNoErr;
-  
+
+  fields.loginId = OTAData->loginId;
+  fields.devPasswd = OTAData->devPasswd;
+  fields.userToken = NULL;
+  err = MICOConfigJsonParse( input, _MVDRequestValue, &fields );
+  require_noerr( err, exit );
+  config_delegate_log("Recv OTA request, login_id=%s", OTAData->loginId);
+
 exit:  
   return err;
 }
@@ -553,28 +530,16 @@ exit:
 OSStatus getMVDGetStateRequestData(const char *input, MVDGetStateRequestData_t *devGetStateData)
 {
   OSStatus err = kUnknownErr;
-  json_object *new_obj;
+  _MVDRequestFields_t fields;
   config_delegate_log_trace();
-  
-  new_obj = json_tokener_parse(input);
-  require_action(new_obj, exit, err = kUnknownErr);
-  
-  config_delegate_log("Recv activate object=%s", json_object_to_json_string(new_obj));
-  
-  json_object_object_foreach(new_obj, key, val) {
-    if(!strcmp(key, "login_id")){
-      strncpy(devGetStateData->loginId, json_object_get_string(val), MAX_SIZE_LOGIN_ID);
-    }
-    else if(!strcmp(key, "dev_passwd")){
-      strncpy(devGetStateData->devPasswd, json_object_get_string(val), MAX_SIZE_DEV_PASSWD);
-    }
-    else if(!strcmp(key, "user_token")){
-      strncpy(devGetStateData->user_token, json_object_get_string(val), MAX_SIZE_USER_TOKEN);
-    }
-  }
-  json_object_put(new_obj);
-  err = kNoErr;
-  
+
+  fields.loginId = devGetStateData->loginId;
+  fields.devPasswd = devGetStateData->devPasswd;
+  fields.userToken = devGetStateData->user_token;
+  err = MICOConfigJsonParse( input, _MVDRequestValue, &fields );
+  require_noerr( err, exit );
+  config_delegate_log("Recv getState request, login_id=%s", devGetStateData->loginId);
+
 exit:  
   return err;
 }
@@ -48,6 +48,8 @@
 #define kCONFIGURLWrite   "/config-write"
 #define kCONFIGURLOTA     "/OTA"
 
+#define kCONFIGBodyMaxLen 2048  /* Longest chunk copied into one buffer */
+
 //for temp config by WES at 20141123
 #define kCONFIGURLDevState             "/dev-state"
 #define kCONFIGURLDevActivate          "/dev-activate"
@@ -227,7 +229,9 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
   /* This is a demo code for http package has chunked data */
   char *tempStr;
   if(inHeader->chunkedData == true){
-    tempStr = calloc(inHeader->contentLength+1, sizeof(uint8_t));
+    require_action(inHeader->contentLength <= kCONFIGBodyMaxLen, exit, err = kSizeErr);
+    tempStr = calloc((size_t)inHeader->contentLength + 1, sizeof(uint8_t));
+    require_action(tempStr, exit, err = kNoMemoryErr);
     memcpy(tempStr, inHeader->extraDataPtr, inHeader->contentLength);
     config_log("Recv==>%s", tempStr);
     free(tempStr);
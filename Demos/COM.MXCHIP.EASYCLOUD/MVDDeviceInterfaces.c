@@ -68,19 +68,13 @@ size_t _uart_get_one_packet(uint8_t* inBuf, int inBufLen)
 {
   dev_if_log_trace();
 
-  int datalen;
+  uint32_t datalen;
   
+  /* A packet ends when the line goes idle, short commands are not held until a timeout */
   while(1) {
-    if( MicoUartRecv( UART_FOR_MCU, inBuf, inBufLen, UART_RECV_TIMEOUT) == kNoErr){
-      return inBufLen;
+    if( MicoUartRecvFrame( UART_FOR_MCU, inBuf, inBufLen, &datalen, UART_RECV_TIMEOUT) == kNoErr){
+      return datalen;
     }
-   else{
-     datalen = MicoUartGetLengthInBuffer( UART_FOR_MCU );
-     if(datalen){
-       MicoUartRecv(UART_FOR_MCU, inBuf, datalen, UART_RECV_TIMEOUT);
-       return datalen;
-     }
-   }  
   } 
 }
 
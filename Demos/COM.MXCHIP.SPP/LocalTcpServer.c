@@ -5,7 +5,7 @@
   * @version V1.0.0
   * @date    05-May-2014
   * @brief   This file create a TCP listener thread, accept every TCP client
-  *          connection and create thread for them.
+  *          connection and serve all of them in the same thread.
   ******************************************************************************
   * @attention
   *
@@ -30,21 +30,35 @@
 #define server_log(M, ...) custom_log("TCP SERVER", M, ##__VA_ARGS__)
 #define server_log_trace() custom_log_trace("TCP SERVER")
 
-static void localTcpClient_thread(void *inFd);
-static mico_Context_t *Context;
+typedef struct _local_client_t {
+  socket_reactor_handler_t  socketHandler;
+  socket_reactor_handler_t  eventHandler;   //! Readable when UART data is pushed to queue
+  mico_queue_t              queue;
+  socket_msg_t *            sendingMsg;     //! Popped from queue, waiting for the socket to be writable
+  int                       sentLen;
+  bool                      parked;         //! Not read while both UART transmit buffers are busy
+  uint8_t *                 rxBuffer;       //! UART transmit buffer taken for this client by _localTcpClientsResume
+} local_client_t;
+
+static OSStatus _localTcpListenerReadable( socket_reactor_handler_t *handler );
+static OSStatus _localTcpClientReadable( socket_reactor_handler_t *handler );
+static OSStatus _localTcpClientWritable( socket_reactor_handler_t *handler );
+static OSStatus _localTcpClientEventReadable( socket_reactor_handler_t *handler );
+static void _localTcpClientClose( socket_reactor_handler_t *handler, OSStatus reason );
+static OSStatus _localTcpClientsResume( socket_reactor_handler_t *handler );
 
-mico_thread_t   localTcpClient_thread_handler;
+static mico_Context_t *Context;
+static socket_reactor_t localTcpReactor;
+static socket_reactor_handler_t bufferHandler;  //! Readable when a UART transmit buffer is free, waited for only while clients are parked
+static int parkedClients = 0;
 
 void localTcpServer_thread(void *inContext)
 {
   server_log_trace();
   OSStatus err = kUnknownErr;
-  int j;
   Context = inContext;
   struct sockaddr_t addr;
-  int sockaddr_t_size;
-  fd_set readfds;
-  char ip_address[16];
+  socket_reactor_handler_t listenerHandler;
   
   int localTcpListener_fd = -1;
 
@@ -60,106 +74,207 @@ void localTcpServer_thread(void *inContext)
   require_noerr( err, exit );
 
   server_log("Server established at port: %d, fd: %d", Context->flashContentInRam.appConfig.localServerPort, localTcpListener_fd);
+
+  SocketReactorInit( &localTcpReactor );
+  memset( &listenerHandler, 0x0, sizeof(socket_reactor_handler_t) );
+  listenerHandler.fd = localTcpListener_fd;
+  listenerHandler.events = kSocketReactorReadable;
+  listenerHandler.onReadable = _localTcpListenerReadable;
+  err = SocketReactorAdd( &localTcpReactor, &listenerHandler );
+  require_noerr( err, exit );
+
+  /* Callbacks never block, a client that cannot hand its data to the UART is parked until a buffer is free */
+  memset( &bufferHandler, 0x0, sizeof(socket_reactor_handler_t) );
+  bufferHandler.onReadable = _localTcpClientsResume;
+  err = SocketReactorAddEvent( &localTcpReactor, &bufferHandler, sppWlanBufferEvent() );
+  require_noerr( err, exit );
+  bufferHandler.events = 0;
   
   while(1){
-    FD_ZERO(&readfds);
-    FD_SET(localTcpListener_fd, &readfds);  
-    select(1, &readfds, NULL, NULL, NULL);
-
-    /*Check tcp connection requests */
-    if(FD_ISSET(localTcpListener_fd, &readfds)){
-      sockaddr_t_size = sizeof(struct sockaddr_t);
-      j = accept(localTcpListener_fd, &addr, &sockaddr_t_size);
-      if (j > 0) {
-        inet_ntoa(ip_address, addr.s_ip );
-        server_log("Client %s:%d connected, fd: %d", ip_address, addr.s_port, j);
-        if(kNoErr != mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "Local Clients", localTcpClient_thread, STACK_SIZE_LOCAL_TCP_CLIENT_THREAD, &j) ) 
-          SocketClose(&j);
-      }
-    }
-   }
+    err = SocketReactorRunOnce( &localTcpReactor, NULL );
+    require_noerr( err, exit );
+  }
 
 exit:
     server_log("Exit: Local controller exit with err = %d", err);
+    SocketClose(&localTcpListener_fd);
     mico_rtos_delete_thread(NULL);
     return;
 }
 
-void localTcpClient_thread(void *inFd)
+/*Check tcp connection requests */
+static OSStatus _localTcpListenerReadable( socket_reactor_handler_t *handler )
 {
-  OSStatus err;
-  int clientFd = *(int *)inFd;
-  uint8_t *inDataBuffer = NULL;
-  int len;
-  fd_set readfds;
-  fd_set writeSet;
-  struct timeval_t t;
-  int eventFd = -1;
-  mico_queue_t queue;
-  socket_msg_t *msg;
-  int sent_len, errno;
-
-  inDataBuffer = malloc(wlanBufferLen);
-  require_action(inDataBuffer, exit, err = kNoMemoryErr);
-
-  err = socket_queue_create(Context, &queue);
+  OSStatus err = kNoErr;
+  struct sockaddr_t addr;
+  int sockaddr_t_size;
+  char ip_address[16];
+  int j;
+  int nonBlock = 1;
+  local_client_t *client = NULL;
+
+  sockaddr_t_size = sizeof(struct sockaddr_t);
+  j = accept(handler->fd, &addr, &sockaddr_t_size);
+  require_quiet(j > 0, exit);  // Listener is kept on accept errors
+  inet_ntoa(ip_address, addr.s_ip );
+  server_log("Client %s:%d connected, fd: %d", ip_address, addr.s_port, j);
+
+  /* The reactor thread serves every client, a stalled peer must not block it in write() */
+  err = setsockopt(j, SOL_SOCKET, SO_BLOCKMODE, &nonBlock, sizeof(nonBlock));
   require_noerr( err, exit );
-  eventFd = mico_create_event_fd(queue);
-  if (eventFd < 0) {
-    server_log("create event fd error");
-    goto exit_with_queue;
-  } 
-
-  t.tv_sec = 4;
-  t.tv_usec = 0;
-  
-  while(1){
 
-    FD_ZERO(&readfds);
-    FD_SET(clientFd, &readfds); 
-    FD_SET(eventFd, &readfds); 
-    FD_ZERO(&writeSet );
-    FD_SET(clientFd, &writeSet );
-
-    select(24, &readfds, &writeSet, NULL, &t);
-    /* send UART data */
-    if ((FD_ISSET( eventFd, &readfds )) && (FD_ISSET( clientFd, &writeSet ))) { // have data and can write
-        if(kNoErr == mico_rtos_pop_from_queue( &queue, &msg, 0)) {
-           sent_len = write(clientFd, msg->data, msg->len);
-           if (sent_len <= 0) {
-              len = sizeof(errno);
-              getsockopt(clientFd, SOL_SOCKET, SO_ERROR, &errno, &len);
-              socket_msg_free(msg);
-              server_log("write error, fd: %d, errno %d", clientFd, errno );
-              if (errno != ENOMEM) {
-                  goto exit_with_queue;
-              }
-           } else {
-                  socket_msg_free(msg);
-              }
-           }
-        }
-
-    /*Read data from tcp clients and process these data using HA protocol */ 
-    if (FD_ISSET(clientFd, &readfds)) {
-      len = recv(clientFd, inDataBuffer, wlanBufferLen, 0);
-      require_action_quiet(len>0, exit_with_queue, err = kConnectionErr);
-      sppWlanCommandProcess(inDataBuffer, &len, clientFd, Context);
-    }
+  client = calloc(1, sizeof(local_client_t));
+  require_action(client, exit, err = kNoMemoryErr);
+  client->socketHandler.fd = -1;
+  client->socketHandler.userContext = client;
+  client->eventHandler.fd = -1;
+
+  err = socket_queue_create(Context, &client->queue);
+  require_noerr_action( err, exit, free(client); client = NULL; err = kNoResourcesErr );
+
+  client->eventHandler.onReadable = _localTcpClientEventReadable;
+  client->eventHandler.onClose = _localTcpClientClose;
+  client->eventHandler.userContext = client;
+  err = SocketReactorAddEvent( &localTcpReactor, &client->eventHandler, client->queue );
+  require_noerr( err, exit );
+
+  client->socketHandler.fd = j;
+  j = -1;
+  client->socketHandler.events = kSocketReactorReadable;
+  client->socketHandler.onReadable = _localTcpClientReadable;
+  client->socketHandler.onWritable = _localTcpClientWritable;
+  client->socketHandler.onClose = _localTcpClientClose;
+  err = SocketReactorAdd( &localTcpReactor, &client->socketHandler );
+  require_noerr( err, exit );
+
+exit:
+  if( err != kNoErr ){
+    server_log("Client is not accepted, err = %d", err);
+    if(client) _localTcpClientClose( &client->socketHandler, err );
+    SocketClose(&j);
+  }
+  return kNoErr;
+}
+
+static int _localTcpSocketError( int fd )
+{
+  int socketErr = 0;
+  int len = sizeof(socketErr);
+
+  getsockopt(fd, SOL_SOCKET, SO_ERROR, &socketErr, &len);
+  return socketErr;
+}
+
+/*Read data from tcp clients straight into a UART transmit buffer */ 
+static OSStatus _localTcpClientReadable( socket_reactor_handler_t *handler )
+{
+  OSStatus err = kNoErr;
+  local_client_t *client = handler->userContext;
+  uint8_t *buffer = client->rxBuffer;
+  int len, socketErr;
+
+  client->rxBuffer = NULL;
+  if( buffer == NULL ) buffer = sppWlanBufferTake(0);
+  if( buffer == NULL ){
+    /* Both buffers are on the wire, leave the data in the TCP window until one is free */
+    client->parked = true;
+    client->socketHandler.events &= ~kSocketReactorReadable;
+    parkedClients++;
+    bufferHandler.events = kSocketReactorReadable;
+    goto exit;
   }
 
-exit_with_queue:
-    len = sizeof(errno);
-    getsockopt(clientFd, SOL_SOCKET, SO_ERROR, &errno, &len);
-    server_log("Exit: Client exit with err = %d, socket errno %d", err, errno);
-    if (eventFd >= 0) {
-        mico_delete_event_fd(eventFd);
-    }
-    socket_queue_delete(Context, &queue);
+  len = recv(handler->fd, buffer, wlanBufferLen, 0);
+  if( len < 0 ){
+    socketErr = _localTcpSocketError(handler->fd);
+    if( socketErr == EAGAIN || socketErr == EWOULDBLOCK ) len = 0;
+    else err = kConnectionErr;
+  }else if( len == 0 )
+    err = kConnectionErr;
+  sppWlanBufferSend(buffer, len);
+
 exit:
-    SocketClose(&clientFd);
-    if(inDataBuffer) free(inDataBuffer);
-    mico_rtos_delete_thread(NULL);
-    return;
+  return err;
+}
+
+/* A transmit buffer is free, hand the free buffers to parked clients in the order of the reactor's table */
+static OSStatus _localTcpClientsResume( socket_reactor_handler_t *handler )
+{
+  socket_reactor_handler_t *clientHandler;
+  local_client_t *client;
+  int i;
+  (void)handler;
+
+  for( i = 0; i < SocketReactor_Max_Handlers && parkedClients; i++ ){
+    clientHandler = localTcpReactor.handlers[i];
+    if( clientHandler == NULL || clientHandler->onReadable != _localTcpClientReadable ) continue;
+    client = clientHandler->userContext;
+    if( client->parked == false ) continue;
+    client->rxBuffer = sppWlanBufferTake(0);
+    if( client->rxBuffer == NULL ) break;
+    client->parked = false;
+    client->socketHandler.events |= kSocketReactorReadable;
+    parkedClients--;
+  }
+  if( parkedClients == 0 ) bufferHandler.events = 0;
+  return kNoErr;
+}
+
+/* UART data is taken one message at a time, the queue is not read again until the socket has taken it */
+static OSStatus _localTcpClientEventReadable( socket_reactor_handler_t *handler )
+{
+  local_client_t *client = handler->userContext;
+
+  if(kNoErr == mico_rtos_pop_from_queue( &client->queue, &client->sendingMsg, 0)) {
+    client->sentLen = 0;
+    client->eventHandler.events = 0;
+    client->socketHandler.events |= kSocketReactorWritable;
+  }
+  return kNoErr;
 }
 
+/* send UART data */
+static OSStatus _localTcpClientWritable( socket_reactor_handler_t *handler )
+{
+  OSStatus err = kNoErr;
+  local_client_t *client = handler->userContext;
+  socket_msg_t *msg = client->sendingMsg;
+  int sent_len, socketErr;
+
+  /* The socket is non-blocking, a short write keeps the rest for the next writable event */
+  sent_len = write(handler->fd, msg->data + client->sentLen, msg->len - client->sentLen);
+  if (sent_len <= 0) {
+    socketErr = _localTcpSocketError(handler->fd);
+    require_action_quiet(socketErr != EAGAIN && socketErr != EWOULDBLOCK, exit, err = kNoErr);
+    server_log("write error, fd: %d, errno %d", handler->fd, socketErr );
+    require_action(socketErr == ENOMEM, exit, err = kConnectionErr);
+    client->sentLen = msg->len; // Drop the message as before
+  } else {
+    client->sentLen += sent_len;
+  }
+
+  if (client->sentLen >= msg->len) {
+    socket_msg_free(msg);
+    client->sendingMsg = NULL;
+    client->socketHandler.events &= ~kSocketReactorWritable;
+    client->eventHandler.events = kSocketReactorReadable;
+  }
+
+exit:
+  return err;
+}
+
+static void _localTcpClientClose( socket_reactor_handler_t *handler, OSStatus reason )
+{
+  local_client_t *client = handler->userContext;
+
+  server_log("Exit: Client exit with err = %d", reason);
+  SocketReactorRemove( &localTcpReactor, &client->socketHandler );
+  SocketReactorRemove( &localTcpReactor, &client->eventHandler );
+  if(client->sendingMsg) socket_msg_free(client->sendingMsg);
+  if(client->rxBuffer) sppWlanBufferSend(client->rxBuffer, 0);
+  if(client->parked && --parkedClients == 0) bufferHandler.events = 0;
+  socket_queue_delete(Context, &client->queue);
+  SocketClose(&client->socketHandler.fd);
+  free(client);
+}
@@ -42,8 +42,9 @@
 
 /*User provided configurations*/
 #define CONFIGURATION_VERSION               0x00000002 // if default configuration is changed, update this number
-#define MAX_QUEUE_NUM                       6  // 1 remote client, 5 local server
+#define MAX_QUEUE_NUM                       9  // 1 remote client, 8 local server clients
 #define MAX_QUEUE_LENGTH                    8  // each queue max 8 msg
+#define SOCKET_MSG_POOL_NUM                 10 // UART packet blocks shared by all queues, more than one queue can hold
 #define LOCAL_PORT                          8080
 #define DEAFULT_REMOTE_SERVER               "192.168.2.254"
 #define DEFAULT_REMOTE_SERVER_PORT          8080
@@ -61,13 +62,11 @@
 /* Define thread stack size */
 #ifdef DEBUG
   #define STACK_SIZE_UART_RECV_THREAD           0x2A0
-  #define STACK_SIZE_LOCAL_TCP_SERVER_THREAD    0x300
-  #define STACK_SIZE_LOCAL_TCP_CLIENT_THREAD    0x350
+  #define STACK_SIZE_LOCAL_TCP_SERVER_THREAD    0x350
   #define STACK_SIZE_REMOTE_TCP_CLIENT_THREAD   0x500
 #else
   #define STACK_SIZE_UART_RECV_THREAD           0x150
-  #define STACK_SIZE_LOCAL_TCP_SERVER_THREAD    0x180
-  #define STACK_SIZE_LOCAL_TCP_CLIENT_THREAD    0x200
+  #define STACK_SIZE_LOCAL_TCP_SERVER_THREAD    0x200
   #define STACK_SIZE_REMOTE_TCP_CLIENT_THREAD   0x260
 #endif
 
@@ -88,9 +87,9 @@ typedef struct
 } application_config_t;
 
 typedef struct _socket_msg {
-  int ref;
+  volatile int ref;
   int len;
-  uint8_t data[1];
+  uint8_t data[UART_ONE_PACKAGE_LENGTH];
 } socket_msg_t;
 
 /*Running status*/
@@ -29,13 +29,25 @@
 #include "MICONotificationCenter.h"
 #include <stdio.h>
 
-#define MAX_SOCK_MSG_LEN (10*1024)
-int sockmsg_len = 0;
 #define spp_log(M, ...) custom_log("SPP", M, ##__VA_ARGS__)
 #define spp_log_trace() custom_log_trace("SPP")
 
-void socket_msg_take(socket_msg_t*msg);
-void socket_msg_free(socket_msg_t*msg);
+/* UART packets are received straight into blocks of this pool and the same block is queued to every client, free 
+   blocks wait in socket_msg_free_queue. No heap is used after sppProtocolInit. */
+static socket_msg_t socket_msg_pool[SOCKET_MSG_POOL_NUM];
+static mico_queue_t socket_msg_free_queue = NULL;
+
+/* WLAN data is received into one of two buffers and sent by UART DMA in background, free buffers wait in 
+   uart_tx_free_queue. A socket thread only waits when both buffers are still on the wire. */
+static uint8_t uart_tx_buffer[2][wlanBufferLen];
+static mico_queue_t uart_tx_free_queue = NULL;
+
+static void _uart_tx_done(void *arg, OSStatus result)
+{
+  uint8_t *data = arg;
+  (void)result;
+  mico_rtos_push_to_queue(&uart_tx_free_queue, &data, 0);
+}
 
 
 OSStatus sppProtocolInit(mico_Context_t * const inContext)
@@ -43,13 +55,33 @@ OSStatus sppProtocolInit(mico_Context_t * const inContext)
   int i;
   
   spp_log_trace();
-  (void)inContext;
+
+  OSStatus err = kNoErr;
+  socket_msg_t *msg;
+  uint8_t *data;
 
   for(i=0; i < MAX_QUEUE_NUM; i++) {
     inContext->appStatus.socket_out_queue[i] = NULL;
   }
   mico_rtos_init_mutex(&inContext->appStatus.queue_mtx);
-  return kNoErr;
+
+  err = mico_rtos_init_queue(&uart_tx_free_queue, "uart tx pool", sizeof(uint8_t *), 2);
+  require_noerr(err, exit);
+  for(i=0; i < 2; i++) {
+    data = uart_tx_buffer[i];
+    mico_rtos_push_to_queue(&uart_tx_free_queue, &data, 0);
+  }
+
+  err = mico_rtos_init_queue(&socket_msg_free_queue, "sockmsg pool", sizeof(socket_msg_t *), SOCKET_MSG_POOL_NUM);
+  require_noerr(err, exit);
+  for(i=0; i < SOCKET_MSG_POOL_NUM; i++) {
+    msg = &socket_msg_pool[i];
+    msg->ref = 0;
+    mico_rtos_push_to_queue(&socket_msg_free_queue, &msg, 0);
+  }
+
+exit:
+  return err;
 }
 
 OSStatus sppWlanCommandProcess(unsigned char *inBuf, int *inBufLen, int inSocketFd, mico_Context_t * const inContext)
@@ -57,61 +89,110 @@ OSStatus sppWlanCommandProcess(unsigned char *inBuf, int *inBufLen, int inSocket
   spp_log_trace();
   (void)inSocketFd;
   (void)inContext;
-  OSStatus err = kUnknownErr;
-
-  err = MicoUartSend(UART_FOR_APP, inBuf, *inBufLen);
+  OSStatus err = kNoErr;
+  uint8_t *data;
+  int len, sent = 0;
+
+  while(sent < *inBufLen) {
+    data = sppWlanBufferTake(MICO_WAIT_FOREVER);
+    len = MIN(*inBufLen - sent, wlanBufferLen);
+    memcpy(data, inBuf + sent, len);
+    err = sppWlanBufferSend(data, len);
+    if (err != kNoErr)
+      break;
+    sent += len;
+  }
 
   *inBufLen = 0;
   return err;
 }
 
-OSStatus sppUartCommandProcess(uint8_t *inBuf, int inLen, mico_Context_t * const inContext)
+/* Returns whichever transmit buffer of wlanBufferLen bytes gets free first, or NULL when none does within 
+   timeout_ms. A caller that must not block passes 0 and fills the buffer in place, so no copy is made. */
+uint8_t *sppWlanBufferTake(uint32_t timeout_ms)
+{
+  uint8_t *data = NULL;
+
+  if(kNoErr != mico_rtos_pop_from_queue(&uart_tx_free_queue, &data, timeout_ms))
+    return NULL;
+  return data;
+}
+
+/* Sends len bytes of a buffer from sppWlanBufferTake in background. The buffer is given back when the transfer is 
+   done, or at once if len is 0 or the transfer cannot be queued. */
+OSStatus sppWlanBufferSend(uint8_t *data, int len)
+{
+  OSStatus err = kNoErr;
+
+  if(len > 0)
+    err = MicoUartSendAsync(UART_FOR_APP, data, len, _uart_tx_done, data);
+  if(len <= 0 || err != kNoErr)
+    mico_rtos_push_to_queue(&uart_tx_free_queue, &data, 0);
+  return err;
+}
+
+/* Readable by an event fd while a transmit buffer is free, so a thread that must not block can wait for one in 
+   select() */
+mico_event sppWlanBufferEvent(void)
+{
+  return uart_tx_free_queue;
+}
+
+/* inMsg is taken from socket_msg_alloc and filled by the caller, the reference of the caller is released here. The 
+   block itself is queued to every client, so no copy is made. */
+OSStatus sppUartCommandProcess(socket_msg_t *inMsg, mico_Context_t * const inContext)
 {
   spp_log_trace();
   OSStatus err = kNoErr;
   int i;
   mico_queue_t* p_queue;
-  socket_msg_t *real_msg;
-
-  if (MAX_SOCK_MSG_LEN < sockmsg_len)
-    return kNoMemoryErr;
-  real_msg = (socket_msg_t*)malloc(sizeof(socket_msg_t) - 1 + inLen);
-
-  if (real_msg == NULL)
-    return kNoMemoryErr;
-  sockmsg_len += (sizeof(socket_msg_t) - 1 + inLen);
-  real_msg->len = inLen;
-  memcpy(real_msg->data, inBuf, inLen);
-  real_msg->ref = 0;
-  
+
   mico_rtos_lock_mutex(&inContext->appStatus.queue_mtx);
-  socket_msg_take(real_msg);
   for(i=0; i < MAX_QUEUE_NUM; i++) {
     p_queue = inContext->appStatus.socket_out_queue[i];
     if(p_queue  != NULL ){
-      socket_msg_take(real_msg);
-      if (kNoErr != mico_rtos_push_to_queue(p_queue, &real_msg, 0)) {
-        socket_msg_free(real_msg);
+      socket_msg_take(inMsg);
+      if (kNoErr != mico_rtos_push_to_queue(p_queue, &inMsg, 0)) {
+        socket_msg_free(inMsg);
+      }
     }
-  }
   }        
-  socket_msg_free(real_msg);
   mico_rtos_unlock_mutex(&inContext->appStatus.queue_mtx);
+  socket_msg_free(inMsg);
   return err;
 }
 
+/* Clients release their references from different threads, so the count is changed with exclusive access 
+   (LDREX/STREX) instead of a mutex */
+static int _socket_msg_ref_add(socket_msg_t*msg, int delta)
+{
+    int ref;
+    do {
+        ref = (int)__LDREXW((volatile uint32_t *)&msg->ref) + delta;
+    } while (__STREXW((uint32_t)ref, (volatile uint32_t *)&msg->ref));
+    return ref;
+}
+
+socket_msg_t* socket_msg_alloc(uint32_t timeout_ms)
+{
+    socket_msg_t *msg = NULL;
+
+    if (kNoErr != mico_rtos_pop_from_queue(&socket_msg_free_queue, &msg, timeout_ms))
+        return NULL;
+    msg->ref = 1;
+    msg->len = 0;
+    return msg;
+}
+
 void socket_msg_take(socket_msg_t*msg)
 {
-    msg->ref++;
+    _socket_msg_ref_add(msg, 1);
 }
 
 void socket_msg_free(socket_msg_t*msg)
 {
-    msg->ref--;
-    if (msg->ref == 0) {
-        sockmsg_len -= (sizeof(socket_msg_t) - 1 + msg->len);
-        free(msg);
-    
+    if (_socket_msg_ref_add(msg, -1) == 0) {
+        mico_rtos_push_to_queue(&socket_msg_free_queue, &msg, 0);
     }
 }
 
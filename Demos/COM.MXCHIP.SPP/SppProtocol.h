@@ -28,12 +28,16 @@
 OSStatus sppProtocolInit(mico_Context_t * const inContext);
 int is_network_state(int state);
 OSStatus sppWlanCommandProcess(unsigned char *inBuf, int *inBufLen, int inSocketFd, mico_Context_t * const inContext);
-OSStatus sppUartCommandProcess(uint8_t *inBuf, int inLen, mico_Context_t * const inContext);
+uint8_t *sppWlanBufferTake(uint32_t timeout_ms);
+OSStatus sppWlanBufferSend(uint8_t *data, int len);
+mico_event sppWlanBufferEvent(void);
+OSStatus sppUartCommandProcess(socket_msg_t *inMsg, mico_Context_t * const inContext);
 
 
 void set_network_state(int state, int on);
 int socket_queue_create(mico_Context_t * const inContext, mico_queue_t *queue);
 int socket_queue_delete(mico_Context_t * const inContext, mico_queue_t *queue);
+socket_msg_t* socket_msg_alloc(uint32_t timeout_ms);
 void socket_msg_free(socket_msg_t*msg);
 void socket_msg_take(socket_msg_t*msg);
 
@@ -36,20 +36,21 @@ void uartRecv_thread(void *inContext)
   uart_recv_log_trace();
   mico_Context_t *Context = inContext;
   int recvlen;
-  uint8_t *inDataBuffer;
-  
-  inDataBuffer = malloc(UART_ONE_PACKAGE_LENGTH);
-  require(inDataBuffer, exit);
+  socket_msg_t *msg = NULL;
   
   while(1) {
-    recvlen = _uart_get_one_packet(inDataBuffer, UART_ONE_PACKAGE_LENGTH);
+    /* Wait for a free block, UART data is kept in the driver's buffer meanwhile */
+    if (msg == NULL)
+      msg = socket_msg_alloc(MICO_WAIT_FOREVER);
+    if (msg == NULL)
+      continue;
+    recvlen = _uart_get_one_packet(msg->data, UART_ONE_PACKAGE_LENGTH);
     if (recvlen <= 0)
       continue; 
-    sppUartCommandProcess(inDataBuffer, recvlen, Context);
+    msg->len = recvlen;
+    sppUartCommandProcess(msg, Context);
+    msg = NULL;
   }
-  
-exit:
-  if(inDataBuffer) free(inDataBuffer);
 }
 
 /* Packet format: BB 00 CMD(2B) Status(2B) datalen(2B) data(x) checksum(2B)
@@ -59,22 +60,14 @@ size_t _uart_get_one_packet(uint8_t* inBuf, int inBufLen)
 {
   uart_recv_log_trace();
 
-  int datalen;
+  uint32_t datalen;
   
+  /* A packet ends when the line goes idle, short commands are not held until a timeout */
   while(1) {
-    if( MicoUartRecv( UART_FOR_APP, inBuf, inBufLen, UART_RECV_TIMEOUT) == kNoErr){
-      return inBufLen;
+    if( MicoUartRecvFrame( UART_FOR_APP, inBuf, inBufLen, &datalen, UART_RECV_TIMEOUT) == kNoErr){
+      return datalen;
     }
-   else{
-     datalen = MicoUartGetLengthInBuffer( UART_FOR_APP );
-     if(datalen){
-       MicoUartRecv(UART_FOR_APP, inBuf, datalen, UART_RECV_TIMEOUT);
-       return datalen;
-     }
-   }
-    
-  }
-  
+  } 
 }
 
 
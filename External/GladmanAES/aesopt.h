@@ -120,6 +120,14 @@ Issue Date: 20/12/2007
 
 /*  --- START OF USER CONFIGURED OPTIONS --- */
 
+/*  0. CODE SIZE VERSUS SPEED PROFILE
+
+    By default the rounds are fully unrolled and use four tables, the fastest
+    configuration in C.  Define AES_SMALL_CODE (e.g. on the compiler command
+    line) to build rolled rounds using one table each instead, which roughly
+    halves the size of the tables and code at a cost in speed.
+*/
+
 /*  1. BYTE ORDER WITHIN 32 BIT WORDS
 
     The fundamental data processing units in Rijndael are 8-bit bytes. The
@@ -257,7 +265,7 @@ Issue Date: 20/12/2007
     unrolling.  The following options allow partial or full loop unrolling
     to be set independently for encryption and decryption
 */
-#if 1
+#if !defined( AES_SMALL_CODE )
 #  define ENC_UNROLL  FULL
 #elif 0
 #  define ENC_UNROLL  PARTIAL
@@ -265,7 +273,7 @@ Issue Date: 20/12/2007
 #  define ENC_UNROLL  NONE
 #endif
 
-#if 1
+#if !defined( AES_SMALL_CODE )
 #  define DEC_UNROLL  FULL
 #elif 0
 #  define DEC_UNROLL  PARTIAL
@@ -365,33 +373,33 @@ Issue Date: 20/12/2007
     of tables used by this implementation.
 */
 
-#if 1   /* set tables for the normal encryption round */
+#if !defined( AES_SMALL_CODE )   /* set tables for the normal encryption round */
 #  define ENC_ROUND   FOUR_TABLES
-#elif 0
+#elif 1
 #  define ENC_ROUND   ONE_TABLE
 #else
 #  define ENC_ROUND   NO_TABLES
 #endif
 
-#if 1   /* set tables for the last encryption round */
+#if !defined( AES_SMALL_CODE )   /* set tables for the last encryption round */
 #  define LAST_ENC_ROUND  FOUR_TABLES
-#elif 0
+#elif 1
 #  define LAST_ENC_ROUND  ONE_TABLE
 #else
 #  define LAST_ENC_ROUND  NO_TABLES
 #endif
 
-#if 1   /* set tables for the normal decryption round */
+#if !defined( AES_SMALL_CODE )   /* set tables for the normal decryption round */
 #  define DEC_ROUND   FOUR_TABLES
-#elif 0
+#elif 1
 #  define DEC_ROUND   ONE_TABLE
 #else
 #  define DEC_ROUND   NO_TABLES
 #endif
 
-#if 1   /* set tables for the last decryption round */
+#if !defined( AES_SMALL_CODE )   /* set tables for the last decryption round */
 #  define LAST_DEC_ROUND  FOUR_TABLES
-#elif 0
+#elif 1
 #  define LAST_DEC_ROUND  ONE_TABLE
 #else
 #  define LAST_DEC_ROUND  NO_TABLES
@@ -401,9 +409,9 @@ Issue Date: 20/12/2007
     way that the round functions can.  Include or exclude the following
     defines to set this requirement.
 */
-#if 1
+#if !defined( AES_SMALL_CODE )
 #  define KEY_SCHED   FOUR_TABLES
-#elif 0
+#elif 1
 #  define KEY_SCHED   ONE_TABLE
 #else
 #  define KEY_SCHED   NO_TABLES
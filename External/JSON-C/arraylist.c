@@ -24,30 +24,37 @@
 #include "arraylist.h"
 
 struct array_list*
-array_list_new(array_list_free_fn *free_fn)
+array_list_new_arena(struct json_arena *arena, array_list_free_fn *free_fn)
 {
   struct array_list *arr;
 
-  arr = (struct array_list*)calloc(1, sizeof(struct array_list));
+  arr = (struct array_list*)json_arena_alloc(arena, sizeof(struct array_list));
   if(!arr) return NULL;
   arr->size = ARRAY_LIST_DEFAULT_SIZE;
   arr->length = 0;
   arr->free_fn = free_fn;
-  if(!(arr->array = (void**)calloc(sizeof(void*), arr->size))) {
-    free(arr);
+  arr->arena = arena;
+  if(!(arr->array = (void**)json_arena_alloc(arena, sizeof(void*) * arr->size))) {
+    json_arena_release(arena, arr);
     return NULL;
   }
   return arr;
 }
 
+struct array_list*
+array_list_new(array_list_free_fn *free_fn)
+{
+  return array_list_new_arena(NULL, free_fn);
+}
+
 extern void
 array_list_free(struct array_list *arr)
 {
   int i;
   for(i = 0; i < arr->length; i++)
     if(arr->array[i]) arr->free_fn(arr->array[i]);
-  free(arr->array);
-  free(arr);
+  json_arena_release(arr->arena, arr->array);
+  json_arena_release(arr->arena, arr);
 }
 
 void*
@@ -63,9 +70,10 @@ static int array_list_expand_internal(struct array_list *arr, int max)
   int new_size;
 
   if(max < arr->size) return 0;
-  //new_size = json_max(arr->size << 1, max);
-  new_size = json_max(arr->size + 1, max);
-  if(!(t = realloc(arr->array, new_size*sizeof(void*)))) return -1;
+  /* Arena memory is only reclaimed at once, so grow it geometrically */
+  if(arr->arena) new_size = json_max(arr->size << 1, max + 1);
+  else new_size = json_max(arr->size + 1, max);
+  if(!(t = json_arena_realloc(arr->arena, arr->array, arr->size*sizeof(void*), new_size*sizeof(void*)))) return -1;
   arr->array = (void**)t;
   (void)memset(arr->array + arr->size, 0, (new_size-arr->size)*sizeof(void*));
   arr->size = new_size;
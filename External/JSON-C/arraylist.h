@@ -12,6 +12,8 @@
 #ifndef _arraylist_h_
 #define _arraylist_h_
 
+#include "json_arena.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,11 +28,15 @@ struct array_list
   int length;
   int size;
   array_list_free_fn *free_fn;
+  struct json_arena *arena;
 };
 
 extern struct array_list*
 array_list_new(array_list_free_fn *free_fn);
 
+extern struct array_list*
+array_list_new_arena(struct json_arena *arena, array_list_free_fn *free_fn);
+
 extern void
 array_list_free(struct array_list *al);
 
@@ -20,6 +20,7 @@ extern "C" {
 #include "debug.h"
 #include "linkhash.h"
 #include "arraylist.h"
+#include "json_arena.h"
 #include "json_util.h"
 #include "json_object.h"
 #include "json_tokener.h"
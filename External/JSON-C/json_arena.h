@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2004, 2005 Metaparadigm Pte. Ltd.
+ * Michael Clark <michael@metaparadigm.com>
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See COPYING for details.
+ *
+ */
+
+#ifndef _json_arena_h_
+#define _json_arena_h_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_ARENA_DEF_BLOCK_SIZE 1024
+
+struct json_object;
+struct json_arena_block;
+
+/**
+ * Bump allocator for a whole json_object tree. Objects, their tables,
+ * arrays, keys and strings are carved from a few large blocks instead of
+ * one heap block each.
+ *
+ * The first object created in an arena is its root and owns it: when the
+ * root is released by json_object_put, the arena and every object in it
+ * are freed at once. Objects of an arena must not outlive its root.
+ */
+struct json_arena
+{
+  struct json_arena_block *blocks; /* current block first */
+  size_t block_size;
+  struct json_object *root;
+  int depth;                       /* json_object_put calls in progress */
+  int released;
+};
+
+/**
+ * Create an arena, blocks are at least block_size bytes
+ * @returns NULL if out of memory, constructors then fall back to the heap
+ */
+extern struct json_arena* json_arena_new(size_t block_size);
+
+/**
+ * Free an arena that never got a root object, use json_object_put otherwise
+ */
+extern void json_arena_free(struct json_arena *arena);
+
+/* Allocators used by json-c, a NULL arena means the heap. Memory is zeroed */
+extern void* json_arena_alloc(struct json_arena *arena, size_t size);
+extern void* json_arena_realloc(struct json_arena *arena, void *ptr,
+				size_t old_size, size_t new_size);
+extern void json_arena_release(struct json_arena *arena, void *ptr);
+extern char* json_arena_strdup(struct json_arena *arena, const char *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -16,6 +16,7 @@
 #include <stddef.h>
 #include <string.h>
 
+#include "bits.h"
 #include "debug.h"
 #include "printbuf.h"
 #include "linkhash.h"
@@ -37,7 +38,120 @@ const char *json_number_chars = "0123456789.+-eE";
 const char *json_hex_chars = "0123456789abcdef";
 
 static void json_object_generic_delete(struct json_object* jso);
-static struct json_object* json_object_new(enum json_type o_type);
+static struct json_object* json_object_new(struct json_arena *arena,
+					   enum json_type o_type);
+
+
+/* arena allocation */
+
+#define JSON_ARENA_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+struct json_arena_block
+{
+  struct json_arena_block *next;
+  size_t size;
+  size_t used;
+};
+
+#define JSON_ARENA_BLOCK_HDR JSON_ARENA_ALIGN(sizeof(struct json_arena_block))
+#define JSON_ARENA_HDR JSON_ARENA_ALIGN(sizeof(struct json_arena))
+#define JSON_ARENA_DATA(b) ((char*)(b) + JSON_ARENA_BLOCK_HDR)
+
+struct json_arena* json_arena_new(size_t block_size)
+{
+  struct json_arena *arena;
+  struct json_arena_block *block;
+
+  block_size = JSON_ARENA_ALIGN(block_size);
+  /* The first block shares the allocation with the arena itself */
+  arena = (struct json_arena*)malloc(JSON_ARENA_HDR + JSON_ARENA_BLOCK_HDR + block_size);
+  if(!arena) return NULL;
+  block = (struct json_arena_block*)((char*)arena + JSON_ARENA_HDR);
+  block->next = NULL;
+  block->size = block_size;
+  block->used = 0;
+  arena->blocks = block;
+  arena->block_size = block_size;
+  arena->root = NULL;
+  arena->depth = 0;
+  arena->released = 0;
+  return arena;
+}
+
+void json_arena_free(struct json_arena *arena)
+{
+  struct json_arena_block *block, *next;
+
+  if(!arena) return;
+  for(block = arena->blocks; block; block = next) {
+    next = block->next;
+    if((char*)block != (char*)arena + JSON_ARENA_HDR) free(block);
+  }
+  free(arena);
+}
+
+void* json_arena_alloc(struct json_arena *arena, size_t size)
+{
+  struct json_arena_block *block;
+  void *ptr;
+
+  if(!arena) return calloc(1, size);
+  size = JSON_ARENA_ALIGN(size);
+  block = arena->blocks;
+  if(block->size - block->used < size) {
+    block = (struct json_arena_block*)malloc(JSON_ARENA_BLOCK_HDR + json_max(arena->block_size, size));
+    if(!block) return NULL;
+    block->size = json_max(arena->block_size, size);
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+  ptr = JSON_ARENA_DATA(block) + block->used;
+  block->used += size;
+  memset(ptr, 0, size);
+  return ptr;
+}
+
+void* json_arena_realloc(struct json_arena *arena, void *ptr,
+			 size_t old_size, size_t new_size)
+{
+  struct json_arena_block *block;
+  void *t;
+
+  if(!arena) return realloc(ptr, new_size);
+  old_size = JSON_ARENA_ALIGN(old_size);
+  new_size = JSON_ARENA_ALIGN(new_size);
+  if(new_size <= old_size) return ptr;
+  /* Grow in place when ptr is the last allocation of the current block */
+  block = arena->blocks;
+  if((char*)ptr + old_size == JSON_ARENA_DATA(block) + block->used &&
+     block->size - block->used >= new_size - old_size) {
+    memset((char*)ptr + old_size, 0, new_size - old_size);
+    block->used += new_size - old_size;
+    return ptr;
+  }
+  if(!(t = json_arena_alloc(arena, new_size))) return NULL;
+  memcpy(t, ptr, old_size);
+  return t;
+}
+
+void json_arena_release(struct json_arena *arena, void *ptr)
+{
+  /* Arena memory goes away with the arena */
+  if(!arena) free(ptr);
+}
+
+char* json_arena_strdup(struct json_arena *arena, const char *str)
+{
+  size_t len;
+  char *s;
+
+  if(!arena) return strdup(str);
+  len = strlen(str);
+  if(!(s = (char*)json_arena_alloc(arena, len + 1))) return NULL;
+  memcpy(s, str, len);
+  return s;
+}
 
 
 /* ref count debugging */
@@ -71,47 +185,189 @@ static void json_object_fini(void) {
 #endif /* REFCOUNT_DEBUG */
 
 
-/* string escaping */
+/* serialization
+ *
+ * Objects are rendered through a json_writer, either into a caller buffer or
+ * staged and handed to a sink. Numbers and escapes are formatted into stack
+ * buffers, so rendering itself never touches the heap.
+ */
+
+struct json_writer
+{
+  char *buf;                  /* destination, or staging area for sink */
+  int size;
+  int pos;
+  json_object_sink_fn *sink;  /* NULL writes into buf only */
+  void *ctx;
+  int total;                  /* bytes rendered, including any that did not fit */
+  int err;
+};
+
+static void json_writer_flush(struct json_writer *w)
+{
+  if(w->sink && w->pos && !w->err && w->sink(w->ctx, w->buf, w->pos) < 0) w->err = 1;
+  w->pos = 0;
+}
+
+static void json_writer_put(struct json_writer *w, const char *data, int len)
+{
+  int n;
+
+  w->total += len;
+  if(w->err) return;
+  if(!w->sink) {
+    /* Keep one byte for the terminator, count what does not fit */
+    n = json_min(len, w->size - 1 - w->pos);
+    if(n > 0) {
+      memcpy(w->buf + w->pos, data, n);
+      w->pos += n;
+    }
+    return;
+  }
+  if(w->pos + len > w->size) {
+    json_writer_flush(w);
+    if(len > w->size) {
+      if(!w->err && w->sink(w->ctx, data, len) < 0) w->err = 1;
+      return;
+    }
+  }
+  memcpy(w->buf + w->pos, data, len);
+  w->pos += len;
+}
+
+#define json_writer_puts(w, s) json_writer_put(w, s, sizeof(s) - 1)
+
+static void json_writer_int(struct json_writer *w, int64_t i)
+{
+  char buf[21];
+  int pos = sizeof(buf);
+  uint64_t u = i < 0 ? (uint64_t)0 - (uint64_t)i : (uint64_t)i;
+
+  do {
+    buf[--pos] = '0' + (char)(u % 10);
+    u /= 10;
+  } while(u);
+  if(i < 0) buf[--pos] = '-';
+  json_writer_put(w, buf + pos, sizeof(buf) - pos);
+}
+
+static void json_writer_double(struct json_writer *w, double d)
+{
+  char buf[32];
+  int len;
+
+  len = snprintf(buf, sizeof(buf), "%g", d);
+  if(len > 0) json_writer_put(w, buf, json_min(len, (int)sizeof(buf) - 1));
+}
 
-static int json_escape_str(struct printbuf *pb, char *str, int len)
+static void json_writer_escape(struct json_writer *w, const char *str, int len)
 {
   int pos = 0, start_offset = 0;
   unsigned char c;
-  while (len--) {
+  char esc[6];
+
+  while(pos < len) {
     c = str[pos];
+    if(c >= ' ' && c != '"' && c != '\\' && c != '/') {
+      pos++;
+      continue;
+    }
+    if(pos - start_offset > 0)
+      json_writer_put(w, str + start_offset, pos - start_offset);
+    esc[0] = '\\';
     switch(c) {
-    case '\b':
-    case '\n':
-    case '\r':
-    case '\t':
+    case '\b': esc[1] = 'b'; break;
+    case '\n': esc[1] = 'n'; break;
+    case '\r': esc[1] = 'r'; break;
+    case '\t': esc[1] = 't'; break;
     case '"':
     case '\\':
-    case '/':
-      if(pos - start_offset > 0)
-	printbuf_memappend(pb, str + start_offset, pos - start_offset);
-      if(c == '\b') printbuf_memappend(pb, "\\b", 2);
-      else if(c == '\n') printbuf_memappend(pb, "\\n", 2);
-      else if(c == '\r') printbuf_memappend(pb, "\\r", 2);
-      else if(c == '\t') printbuf_memappend(pb, "\\t", 2);
-      else if(c == '"') printbuf_memappend(pb, "\\\"", 2);
-      else if(c == '\\') printbuf_memappend(pb, "\\\\", 2);
-      else if(c == '/') printbuf_memappend(pb, "\\/", 2);
-      start_offset = ++pos;
-      break;
+    case '/': esc[1] = c; break;
     default:
-      if(c < ' ') {
-	if(pos - start_offset > 0)
-	  printbuf_memappend(pb, str + start_offset, pos - start_offset);
-	sprintbuf(pb, "\\u00%c%c",
-		  json_hex_chars[c >> 4],
-		  json_hex_chars[c & 0xf]);
-	start_offset = ++pos;
-      } else pos++;
+      esc[1] = 'u'; esc[2] = '0'; esc[3] = '0';
+      esc[4] = json_hex_chars[c >> 4];
+      esc[5] = json_hex_chars[c & 0xf];
     }
+    json_writer_put(w, esc, esc[1] == 'u' ? 6 : 2);
+    start_offset = ++pos;
   }
   if(pos - start_offset > 0)
-    printbuf_memappend(pb, str + start_offset, pos - start_offset);
-  return 0;
+    json_writer_put(w, str + start_offset, pos - start_offset);
+}
+
+static void json_writer_object(struct json_writer *w, struct json_object *jso)
+{
+  struct json_object_iter iter;
+  int i;
+
+  if(!jso) {
+    json_writer_puts(w, "null");
+    return;
+  }
+  switch(jso->o_type) {
+  case json_type_boolean:
+    if(jso->o.c_boolean) json_writer_puts(w, "true");
+    else json_writer_puts(w, "false");
+    break;
+  case json_type_int:
+    json_writer_int(w, jso->o.c_int64);
+    break;
+  case json_type_double:
+    json_writer_double(w, jso->o.c_double);
+    break;
+  case json_type_string:
+    json_writer_puts(w, "\"");
+    json_writer_escape(w, jso->o.c_string.str, jso->o.c_string.len);
+    json_writer_puts(w, "\"");
+    break;
+  case json_type_object:
+    i = 0;
+    json_writer_puts(w, "{");
+    json_object_object_foreachC(jso, iter) {
+      if(i++) json_writer_puts(w, ",");
+      json_writer_puts(w, " \"");
+      json_writer_escape(w, iter.key, strlen(iter.key));
+      json_writer_puts(w, "\": ");
+      json_writer_object(w, iter.val);
+    }
+    json_writer_puts(w, " }");
+    break;
+  case json_type_array:
+    json_writer_puts(w, "[");
+    for(i = 0; i < json_object_array_length(jso); i++) {
+      if(i) json_writer_puts(w, ", ");
+      else json_writer_puts(w, " ");
+      json_writer_object(w, json_object_array_get_idx(jso, i));
+    }
+    json_writer_puts(w, " ]");
+    break;
+  default:
+    json_writer_puts(w, "null");
+  }
+}
+
+int json_object_to_json_buffer(struct json_object *jso, char *buf, int size)
+{
+  struct json_writer w = {buf, size, 0, NULL, NULL, 0, 0};
+
+  json_writer_object(&w, jso);
+  if(size > 0) buf[w.pos] = '\0';
+  return w.total;
+}
+
+int json_object_to_json_sink(struct json_object *jso, char *buf, int size,
+			     json_object_sink_fn *sink, void *ctx)
+{
+  struct json_writer w = {buf, size, 0, sink, ctx, 0, 0};
+
+  json_writer_object(&w, jso);
+  json_writer_flush(&w);
+  return w.err ? -1 : w.total;
+}
+
+static int json_object_printbuf_sink(void *ctx, const char *buf, int len)
+{
+  return printbuf_memappend((struct printbuf*)ctx, buf, len);
 }
 
 
@@ -127,9 +383,23 @@ extern struct json_object* json_object_get(struct json_object *jso)
 
 extern void json_object_put(struct json_object *jso)
 {
+  struct json_arena *arena;
+
   if(jso) {
     jso->_ref_count--;
-    if(!jso->_ref_count) jso->_delete(jso);
+    if(!jso->_ref_count) {
+      arena = jso->_arena;
+      if(!arena) {
+        jso->_delete(jso);
+        return;
+      }
+      /* The root may be released from inside another object's delete, so
+         the arena is only freed once the outermost put has finished */
+      arena->depth++;
+      if(jso == arena->root) arena->released = 1;
+      jso->_delete(jso);
+      if(--arena->depth == 0 && arena->released) json_arena_free(arena);
+    }
   }
 }
 
@@ -144,15 +414,18 @@ static void json_object_generic_delete(struct json_object* jso)
   lh_table_delete(json_object_table, jso);
 #endif /* REFCOUNT_DEBUG */
   printbuf_free(jso->_pb);
-  free(jso);
+  json_arena_release(jso->_arena, jso);
 }
 
-static struct json_object* json_object_new(enum json_type o_type)
+static struct json_object* json_object_new(struct json_arena *arena,
+					   enum json_type o_type)
 {
   struct json_object *jso;
 
-  jso = (struct json_object*)calloc(sizeof(struct json_object), 1);
+  jso = (struct json_object*)json_arena_alloc(arena, sizeof(struct json_object));
   if(!jso) return NULL;
+  if(arena && !arena->root) arena->root = jso;
+  jso->_arena = arena;
   jso->o_type = o_type;
   jso->_ref_count = 1;
   jso->_delete = &json_object_generic_delete;
@@ -176,59 +449,88 @@ enum json_type json_object_get_type(struct json_object *jso)
   return jso->o_type;
 }
 
+struct json_arena* json_object_get_arena(struct json_object *jso)
+{
+  if(!jso) return NULL;
+  return jso->_arena;
+}
+
 /* json_object_to_json_string */
 
+#define JSON_OBJECT_STAGE_SIZE 64
+
 const char* json_object_to_json_string(struct json_object *jso)
 {
+  char stage[JSON_OBJECT_STAGE_SIZE];
+
   if(!jso) return "null";
   if(!jso->_pb) {
     if(!(jso->_pb = printbuf_new())) return NULL;
   } else {
     printbuf_reset(jso->_pb);
   }
-  if(jso->_to_json_string(jso, jso->_pb) < 0) return NULL;
+  if(json_object_to_json_sink(jso, stage, sizeof(stage),
+			      json_object_printbuf_sink, jso->_pb) < 0) return NULL;
   return jso->_pb->buf;
 }
 
 struct printbuf * json_object_to_json_string_ex(struct json_object *jso)
 {
   struct printbuf *_pb;
+  char stage[JSON_OBJECT_STAGE_SIZE];
   if(!jso) return NULL;
 
   if(!(_pb = printbuf_new())) return NULL;
 
-  if(jso->_to_json_string(jso, _pb) < 0) return NULL;
+  if(json_object_to_json_sink(jso, stage, sizeof(stage),
+			      json_object_printbuf_sink, _pb) < 0) {
+    printbuf_free(_pb);
+    return NULL;
+  }
   return _pb;
 }
 
 
 /* json_object_object */
 
-static int json_object_object_to_json_string(struct json_object* jso,
-					     struct printbuf *pb)
-{
-  int i=0;
-  struct json_object_iter iter;
-  sprintbuf(pb, "{");
+#if JSON_OBJECT_INTERN_KEYS
+/* HomeKit (HAP) and config menu field names */
+static const char * const json_object_interned_keys[] = {
+  "aid", "iid", "value", "type", "characteristics", "status", "ev",
+  "perms", "format", "N", "C", "P", "S"
+};
+
+#define JSON_OBJECT_INTERNED_KEYS_NUM (sizeof(json_object_interned_keys) / sizeof(json_object_interned_keys[0]))
 
-  /* CAW: scope operator to make ANSI correctness */
-  /* CAW: switched to json_object_object_foreachC which uses an iterator struct */
-	json_object_object_foreachC(jso, iter) {
-			if(i) sprintbuf(pb, ",");
-			sprintbuf(pb, " \"");
-			json_escape_str(pb, iter.key, strlen(iter.key));
-			sprintbuf(pb, "\": ");
-			if(iter.val == NULL) sprintbuf(pb, "null");
-			else iter.val->_to_json_string(iter.val, pb);
-			i++;
-	}
+static const char* json_object_intern_key(const char *key)
+{
+  size_t i;
+  for(i = 0; i < JSON_OBJECT_INTERNED_KEYS_NUM; i++)
+    if(key[0] == json_object_interned_keys[i][0] &&
+       !strcmp(key, json_object_interned_keys[i])) return json_object_interned_keys[i];
+  return NULL;
+}
 
-  return sprintbuf(pb, " }");
+static int json_object_key_is_interned(const void *key)
+{
+  size_t i;
+  for(i = 0; i < JSON_OBJECT_INTERNED_KEYS_NUM; i++)
+    if(key == json_object_interned_keys[i]) return 1;
+  return 0;
 }
+#else
+#define json_object_intern_key(key)       NULL
+#define json_object_key_is_interned(key)  0
+#endif
 
 static void json_object_lh_entry_free(struct lh_entry *ent)
 {
-  free(ent->k);
+  if(!json_object_key_is_interned(ent->k)) free(ent->k);
+  json_object_put((struct json_object*)ent->v);
+}
+
+static void json_object_lh_arena_entry_free(struct lh_entry *ent)
+{
   json_object_put((struct json_object*)ent->v);
 }
 
@@ -238,17 +540,22 @@ static void json_object_object_delete(struct json_object* jso)
   json_object_generic_delete(jso);
 }
 
-struct json_object* json_object_new_object(void)
+struct json_object* json_arena_new_object(struct json_arena *arena)
 {
-  struct json_object *jso = json_object_new(json_type_object);
+  struct json_object *jso = json_object_new(arena, json_type_object);
   if(!jso) return NULL;
   jso->_delete = &json_object_object_delete;
-  jso->_to_json_string = &json_object_object_to_json_string;
-  jso->o.c_object = lh_kchar_table_new(JSON_OBJECT_DEF_HASH_ENTRIES,
-					NULL, &json_object_lh_entry_free);
+  jso->o.c_object = lh_kchar_table_new_arena(arena, JSON_OBJECT_DEF_HASH_ENTRIES, NULL,
+					     arena ? &json_object_lh_arena_entry_free
+						   : &json_object_lh_entry_free);
   return jso;
 }
 
+struct json_object* json_object_new_object(void)
+{
+  return json_arena_new_object(NULL);
+}
+
 struct lh_table* json_object_get_object(struct json_object *jso)
 {
   if(!jso) return NULL;
@@ -263,8 +570,15 @@ struct lh_table* json_object_get_object(struct json_object *jso)
 void json_object_object_add(struct json_object* jso, const char *key,
 			    struct json_object *val)
 {
+  const char *k = json_object_intern_key(key);
+
   lh_table_delete(jso->o.c_object, key);
-  lh_table_insert(jso->o.c_object, strdup(key), val);
+  if(!k) k = json_arena_strdup(jso->_arena, key);
+  if(lh_table_insert(jso->o.c_object, (void*)k, val) < 0) {
+    /* The table holds at most LH_MAX_SIZE entries */
+    if(!json_object_key_is_interned(k)) json_arena_release(jso->_arena, (void*)k);
+    json_object_put(val);
+  }
 }
 
 struct json_object* json_object_object_get(struct json_object* jso, const char *key)
@@ -281,20 +595,17 @@ void json_object_object_del(struct json_object* jso, const char *key)
 
 /* json_object_boolean */
 
-static int json_object_boolean_to_json_string(struct json_object* jso,
-					      struct printbuf *pb)
+struct json_object* json_arena_new_boolean(struct json_arena *arena, boolean b)
 {
-  if(jso->o.c_boolean) return sprintbuf(pb, "true");
-  else return sprintbuf(pb, "false");
+  struct json_object *jso = json_object_new(arena, json_type_boolean);
+  if(!jso) return NULL;
+  jso->o.c_boolean = b;
+  return jso;
 }
 
 struct json_object* json_object_new_boolean(boolean b)
 {
-  struct json_object *jso = json_object_new(json_type_boolean);
-  if(!jso) return NULL;
-  jso->_to_json_string = &json_object_boolean_to_json_string;
-  jso->o.c_boolean = b;
-  return jso;
+  return json_arena_new_boolean(NULL, b);
 }
 
 boolean json_object_get_boolean(struct json_object *jso)
@@ -317,19 +628,14 @@ boolean json_object_get_boolean(struct json_object *jso)
 
 /* json_object_int */
 
-static int json_object_int_to_json_string(struct json_object* jso,
-					  struct printbuf *pb)
+struct json_object* json_arena_new_int(struct json_arena *arena, int32_t i)
 {
-  return sprintbuf(pb, "%d", jso->o.c_int64);
+  return json_arena_new_int64(arena, i);
 }
 
 struct json_object* json_object_new_int(int32_t i)
 {
-  struct json_object *jso = json_object_new(json_type_int);
-  if(!jso) return NULL;
-  jso->_to_json_string = &json_object_int_to_json_string;
-  jso->o.c_int64 = i;
-  return jso;
+  return json_arena_new_int64(NULL, i);
 }
 
 int32_t json_object_get_int(struct json_object *jso)
@@ -368,15 +674,19 @@ int32_t json_object_get_int(struct json_object *jso)
   }
 }
 
-struct json_object* json_object_new_int64(int64_t i)
+struct json_object* json_arena_new_int64(struct json_arena *arena, int64_t i)
 {
-  struct json_object *jso = json_object_new(json_type_int);
+  struct json_object *jso = json_object_new(arena, json_type_int);
   if(!jso) return NULL;
-  jso->_to_json_string = &json_object_int_to_json_string;
   jso->o.c_int64 = i;
   return jso;
 }
 
+struct json_object* json_object_new_int64(int64_t i)
+{
+  return json_arena_new_int64(NULL, i);
+}
+
 int64_t json_object_get_int64(struct json_object *jso)
 {
    int64_t cint;
@@ -399,19 +709,17 @@ int64_t json_object_get_int64(struct json_object *jso)
 
 /* json_object_double */
 
-static int json_object_double_to_json_string(struct json_object* jso,
-					     struct printbuf *pb)
+struct json_object* json_arena_new_double(struct json_arena *arena, double d)
 {
-  return sprintbuf(pb, "%g", jso->o.c_double);
+  struct json_object *jso = json_object_new(arena, json_type_double);
+  if(!jso) return NULL;
+  jso->o.c_double = d;
+  return jso;
 }
 
 struct json_object* json_object_new_double(double d)
 {
-  struct json_object *jso = json_object_new(json_type_double);
-  if(!jso) return NULL;
-  jso->_to_json_string = &json_object_double_to_json_string;
-  jso->o.c_double = d;
-  return jso;
+  return json_arena_new_double(NULL, d);
 }
 
 double json_object_get_double(struct json_object *jso)
@@ -436,44 +744,49 @@ double json_object_get_double(struct json_object *jso)
 
 /* json_object_string */
 
-static int json_object_string_to_json_string(struct json_object* jso,
-					     struct printbuf *pb)
+static void json_object_string_delete(struct json_object* jso)
 {
-  sprintbuf(pb, "\"");
-  json_escape_str(pb, jso->o.c_string.str, jso->o.c_string.len);
-  sprintbuf(pb, "\"");
-  return 0;
+  json_arena_release(jso->_arena, jso->o.c_string.str);
+  json_object_generic_delete(jso);
 }
 
-static void json_object_string_delete(struct json_object* jso)
+struct json_object* json_arena_new_string(struct json_arena *arena, const char *s)
 {
-  free(jso->o.c_string.str);
-  json_object_generic_delete(jso);
+  return json_arena_new_string_len(arena, s, strlen(s));
 }
 
 struct json_object* json_object_new_string(const char *s)
 {
-  struct json_object *jso = json_object_new(json_type_string);
-  if(!jso) return NULL;
-  jso->_delete = &json_object_string_delete;
-  jso->_to_json_string = &json_object_string_to_json_string;
-  jso->o.c_string.str = strdup(s);
-  jso->o.c_string.len = strlen(s);
-  return jso;
+  return json_arena_new_string_len(NULL, s, strlen(s));
 }
 
-struct json_object* json_object_new_string_len(const char *s, int len)
+struct json_object* json_arena_new_string_len(struct json_arena *arena,
+					      const char *s, int len)
 {
-  struct json_object *jso = json_object_new(json_type_string);
-  if(!jso) return NULL;
+  struct json_object *jso;
+  char *str;
+
+  /* The copy comes first, so a failure never leaves a half built object
+     that may already be the root of the arena */
+  str = (char*)json_arena_alloc(arena, len + 1);
+  if(!str) return NULL;
+  jso = json_object_new(arena, json_type_string);
+  if(!jso) {
+    json_arena_release(arena, str);
+    return NULL;
+  }
   jso->_delete = &json_object_string_delete;
-  jso->_to_json_string = &json_object_string_to_json_string;
-  jso->o.c_string.str = malloc(len);
-  memcpy(jso->o.c_string.str, (void *)s, len);
+  memcpy(str, (void *)s, len);
+  jso->o.c_string.str = str;
   jso->o.c_string.len = len;
   return jso;
 }
 
+struct json_object* json_object_new_string_len(const char *s, int len)
+{
+  return json_arena_new_string_len(NULL, s, len);
+}
+
 const char* json_object_get_string(struct json_object *jso)
 {
   if(!jso) return NULL;
@@ -498,23 +811,6 @@ int json_object_get_string_len(struct json_object *jso)  {
 
 /* json_object_array */
 
-static int json_object_array_to_json_string(struct json_object* jso,
-					    struct printbuf *pb)
-{
-  int i;
-  sprintbuf(pb, "[");
-  for(i=0; i < json_object_array_length(jso); i++) {
-	  struct json_object *val;
-	  if(i) { sprintbuf(pb, ", "); }
-	  else { sprintbuf(pb, " "); }
-
-      val = json_object_array_get_idx(jso, i);
-	  if(val == NULL) { sprintbuf(pb, "null"); }
-	  else { val->_to_json_string(val, pb); }
-  }
-  return sprintbuf(pb, " ]");
-}
-
 static void json_object_array_entry_free(void *data)
 {
   json_object_put((struct json_object*)data);
@@ -526,16 +822,20 @@ static void json_object_array_delete(struct json_object* jso)
   json_object_generic_delete(jso);
 }
 
-struct json_object* json_object_new_array(void)
+struct json_object* json_arena_new_array(struct json_arena *arena)
 {
-  struct json_object *jso = json_object_new(json_type_array);
+  struct json_object *jso = json_object_new(arena, json_type_array);
   if(!jso) return NULL;
   jso->_delete = &json_object_array_delete;
-  jso->_to_json_string = &json_object_array_to_json_string;
-  jso->o.c_array = array_list_new(&json_object_array_entry_free);
+  jso->o.c_array = array_list_new_arena(arena, &json_object_array_entry_free);
   return jso;
 }
 
+struct json_object* json_object_new_array(void)
+{
+  return json_arena_new_array(NULL);
+}
+
 struct array_list* json_object_get_array(struct json_object *jso)
 {
   if(!jso) return NULL;
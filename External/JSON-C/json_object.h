@@ -13,6 +13,7 @@
 #define _json_object_h_
 
 #include "printbuf.h"
+#include "json_arena.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,7 +21,13 @@ extern "C" {
 
 
 
-#define JSON_OBJECT_DEF_HASH_ENTRIES 1 //default is 16
+#define JSON_OBJECT_DEF_HASH_ENTRIES 4 //default is 16, MICO objects rarely have more than 4 fields
+
+/* Well known field names ("aid", "iid", "value", "type", ...) share one constant
+   copy instead of a strdup per object, set to 0 to always copy keys */
+#ifndef JSON_OBJECT_INTERN_KEYS
+#define JSON_OBJECT_INTERN_KEYS 1
+#endif
 
 #undef FALSE
 #define FALSE ((boolean)0)
@@ -107,6 +114,30 @@ extern int json_object_is_type(struct json_object *obj, enum json_type type);
  */
 extern enum json_type json_object_get_type(struct json_object *obj);
 
+/**
+ * Get the arena a json_object was allocated from
+ * @param obj the json_object instance
+ * @returns the arena, or NULL for an object on the heap
+ */
+extern struct json_arena* json_object_get_arena(struct json_object *obj);
+
+/* arena construction */
+
+/*
+ * Same as the json_object_new_* constructors, but the object is carved from
+ * arena. The first object of an arena becomes its root, putting the root
+ * frees the whole tree. A NULL arena allocates from the heap.
+ */
+extern struct json_object* json_arena_new_object(struct json_arena *arena);
+extern struct json_object* json_arena_new_array(struct json_arena *arena);
+extern struct json_object* json_arena_new_boolean(struct json_arena *arena, boolean b);
+extern struct json_object* json_arena_new_int(struct json_arena *arena, int32_t i);
+extern struct json_object* json_arena_new_int64(struct json_arena *arena, int64_t i);
+extern struct json_object* json_arena_new_double(struct json_arena *arena, double d);
+extern struct json_object* json_arena_new_string(struct json_arena *arena, const char *s);
+extern struct json_object* json_arena_new_string_len(struct json_arena *arena,
+						     const char *s, int len);
+
 
 /** Stringify object to json format
  * @param obj the json_object instance
@@ -114,6 +145,31 @@ extern enum json_type json_object_get_type(struct json_object *obj);
  */
 extern const char* json_object_to_json_string(struct json_object *obj);
 
+/**
+ * Receives rendered json text from json_object_to_json_sink
+ * @returns a negative value to stop rendering
+ */
+typedef int (json_object_sink_fn)(void *ctx, const char *buf, int len);
+
+/** Render object to json format into a caller buffer, without heap allocations
+ * @param obj the json_object instance
+ * @param buf destination, always NUL terminated when size > 0
+ * @param size size of buf, 0 just measures the text
+ * @returns length of the complete text like snprintf, it did not fit if >= size
+ */
+extern int json_object_to_json_buffer(struct json_object *obj, char *buf, int size);
+
+/** Render object to json format and hand it to a sink, without heap allocations
+ * @param obj the json_object instance
+ * @param buf staging area, text reaches the sink in pieces of up to size bytes
+ * @param size size of buf, 0 hands every fragment to the sink directly
+ * @param sink called with the rendered text, in order
+ * @param ctx passed to sink
+ * @returns length of the text, or -1 if the sink failed
+ */
+extern int json_object_to_json_sink(struct json_object *obj, char *buf, int size,
+				    json_object_sink_fn *sink, void *ctx);
+
 
 /* object type methods */
 
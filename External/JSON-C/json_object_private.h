@@ -17,16 +17,14 @@ extern "C" {
 #endif
 
 typedef void (json_object_delete_fn)(struct json_object *o);
-typedef int (json_object_to_json_string_fn)(struct json_object *o,
-					    struct printbuf *pb);
 
 struct json_object
 {
   enum json_type o_type;
   json_object_delete_fn *_delete;
-  json_object_to_json_string_fn *_to_json_string;
   int _ref_count;
   struct printbuf *_pb;
+  struct json_arena *_arena;
   union data {
     boolean c_boolean;
     double c_double;
@@ -28,6 +28,7 @@
 #include "arraylist.h"
 #include "json_inttypes.h"
 #include "json_object.h"
+#include "json_object_private.h"
 #include "json_tokener.h"
 #include "json_util.h"
 
@@ -60,6 +61,7 @@ const char* json_tokener_errors[] = {
   "object value separator ',' expected",
   "invalid string sequence",
   "expected comment",
+  "parse aborted by callback",
 };
 
 /* Stuff for decoding unicode sequences */
@@ -80,10 +82,50 @@ struct json_tokener* json_tokener_new(void)
   return tok;
 }
 
+struct json_tokener* json_tokener_new_arena(size_t block_size)
+{
+  struct json_tokener *tok;
+
+  tok = json_tokener_new();
+  if (!tok) return NULL;
+  tok->arena_size = block_size;
+  return tok;
+}
+
+struct json_tokener* json_tokener_new_sax(const struct json_sax_callbacks *sax, void *ctx)
+{
+  struct json_tokener *tok;
+
+  if (!sax) return NULL;
+  tok = json_tokener_new();
+  if (!tok) return NULL;
+  /* Scalars are reported through one reusable object, retyped per value */
+  tok->sax_value = json_object_new_boolean(0);
+  if (!tok->sax_value) {
+    json_tokener_free(tok);
+    return NULL;
+  }
+  tok->sax = sax;
+  tok->sax_ctx = ctx;
+  return tok;
+}
+
+/* The arena is created with the first object of a document, and handed over
+   to that object once the document is complete */
+static struct json_arena* json_tokener_get_arena(struct json_tokener *tok)
+{
+  if(!tok->arena && tok->arena_size)
+    tok->arena = json_arena_new(tok->arena_size);
+  return tok->arena;
+}
+
 void json_tokener_free(struct json_tokener *tok)
 {
   json_tokener_reset(tok);
-  if(tok) printbuf_free(tok->pb);
+  if(tok) {
+    printbuf_free(tok->pb);
+    json_object_put(tok->sax_value);
+  }
   free(tok);
 }
 
@@ -99,10 +141,15 @@ static void json_tokener_reset_level(struct json_tokener *tok, int depth)
 
 void json_tokener_reset(struct json_tokener *tok)
 {
+  struct json_arena *arena;
   int i;
   if (!tok)
     return;
 
+  /* A partial document frees its arena when its root is put below */
+  arena = tok->arena;
+  tok->arena = NULL;
+  if(arena && !arena->root) json_arena_free(arena);
   for(i = tok->depth; i >= 0; i--)
     json_tokener_reset_level(tok, i);
   tok->depth = 0;
@@ -138,6 +185,71 @@ struct json_object* json_tokener_parse_verbose(const char *str, enum json_tokene
     return obj;
 }
 
+struct json_object* json_tokener_parse_arena(const char *str, size_t block_size)
+{
+  struct json_tokener* tok;
+  struct json_object* obj;
+
+  tok = json_tokener_new_arena(block_size);
+  if(!tok) return NULL;
+  obj = json_tokener_parse_ex(tok, str, -1);
+  if(tok->err != json_tokener_success)
+    obj = NULL;
+  json_tokener_free(tok);
+  return obj;
+}
+
+enum json_tokener_error json_tokener_parse_sax(const char *str,
+					       const struct json_sax_callbacks *sax, void *ctx)
+{
+  struct json_tokener* tok;
+  enum json_tokener_error err;
+
+  tok = json_tokener_new_sax(sax, ctx);
+  if(!tok) return json_tokener_error_parse_eof;
+  json_tokener_parse_ex(tok, str, -1);
+  err = tok->err;
+  json_tokener_free(tok);
+  return err;
+}
+
+int json_tokener_sax_match(struct json_tokener *tok, const char *path)
+{
+  const char *key;
+  size_t len;
+  int i;
+
+  for(i = 0; i < tok->depth; i++) {
+    if(*path == '\0') return 0;
+    len = strcspn(path, "/");
+    key = tok->stack[i].obj_field_name;
+    if(!(len == 1 && *path == '*') &&
+       (!key || strncmp(key, path, len) != 0 || key[len] != '\0'))
+      return 0;
+    path += len;
+    if(*path == '/') path++;
+  }
+  return *path == '\0';
+}
+
+/* The key of an event is the pending member name of the enclosing level */
+static int json_tokener_sax_event(struct json_tokener *tok, json_sax_event_fn *fn,
+				  struct json_object *val)
+{
+  const char *key = tok->depth ? tok->stack[tok->depth-1].obj_field_name : NULL;
+
+  if(!fn || !fn(tok->sax_ctx, tok, key, val)) return 0;
+  tok->err = json_tokener_error_sax_abort;
+  return -1;
+}
+
+static struct json_object* json_tokener_sax_scalar(struct json_tokener *tok,
+						   enum json_type type)
+{
+  tok->sax_value->o_type = type;
+  return tok->sax_value;
+}
+
 
 #if !HAVE_STRNDUP
 /* CAW: compliant version of strndup() */
@@ -241,12 +353,18 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       case '{':
 	state = json_tokener_state_eatws;
 	saved_state = json_tokener_state_object_field_start;
-	current = json_object_new_object();
+	if(tok->sax) {
+	  if(json_tokener_sax_event(tok, tok->sax->object_start, NULL)) goto out;
+	} else
+	current = json_arena_new_object(json_tokener_get_arena(tok));
 	break;
       case '[':
 	state = json_tokener_state_eatws;
 	saved_state = json_tokener_state_array;
-	current = json_object_new_array();
+	if(tok->sax) {
+	  if(json_tokener_sax_event(tok, tok->sax->array_start, NULL)) goto out;
+	} else
+	current = json_arena_new_array(json_tokener_get_arena(tok));
 	break;
       case 'N':
       case 'n':
@@ -306,6 +424,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 		     json_min(tok->st_pos+1, strlen(json_null_str))) == 0) {
 	if(tok->st_pos == strlen(json_null_str)) {
 	  current = NULL;
+	  if(tok->sax && json_tokener_sax_event(tok, tok->sax->value, NULL)) goto out;
 	  saved_state = json_tokener_state_finish;
 	  state = json_tokener_state_eatws;
 	  goto redo_char;
@@ -377,7 +496,13 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	while(1) {
 	  if(c == tok->quote_char) {
 	    printbuf_memappend_fast(tok->pb, case_start, str-case_start);
-	    current = json_object_new_string(tok->pb->buf);
+	    if(tok->sax) {
+	      struct json_object *val = json_tokener_sax_scalar(tok, json_type_string);
+	      val->o.c_string.str = tok->pb->buf;
+	      val->o.c_string.len = tok->pb->bpos;
+	      if(json_tokener_sax_event(tok, tok->sax->value, val)) goto out;
+	    } else
+	    current = json_arena_new_string(json_tokener_get_arena(tok), tok->pb->buf);
 	    saved_state = json_tokener_state_finish;
 	    state = json_tokener_state_eatws;
 	    break;
@@ -525,7 +650,11 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       if(strncasecmp(json_true_str, tok->pb->buf,
 		     json_min(tok->st_pos+1, strlen(json_true_str))) == 0) {
 	if(tok->st_pos == strlen(json_true_str)) {
-	  current = json_object_new_boolean(1);
+	  if(tok->sax) {
+	    json_tokener_sax_scalar(tok, json_type_boolean)->o.c_boolean = 1;
+	    if(json_tokener_sax_event(tok, tok->sax->value, tok->sax_value)) goto out;
+	  } else
+	  current = json_arena_new_boolean(json_tokener_get_arena(tok), 1);
 	  saved_state = json_tokener_state_finish;
 	  state = json_tokener_state_eatws;
 	  goto redo_char;
@@ -533,7 +662,11 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       } else if(strncasecmp(json_false_str, tok->pb->buf,
 			    json_min(tok->st_pos+1, strlen(json_false_str))) == 0) {
 	if(tok->st_pos == strlen(json_false_str)) {
-	  current = json_object_new_boolean(0);
+	  if(tok->sax) {
+	    json_tokener_sax_scalar(tok, json_type_boolean)->o.c_boolean = 0;
+	    if(json_tokener_sax_event(tok, tok->sax->value, tok->sax_value)) goto out;
+	  } else
+	  current = json_arena_new_boolean(json_tokener_get_arena(tok), 0);
 	  saved_state = json_tokener_state_finish;
 	  state = json_tokener_state_eatws;
 	  goto redo_char;
@@ -565,13 +698,21 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	int64_t num64;
 	double  numd;
 	if (!tok->is_double && json_parse_int64(tok->pb->buf, &num64) == 0) {
-		current = json_object_new_int64(num64);
+	  if(tok->sax)
+	    json_tokener_sax_scalar(tok, json_type_int)->o.c_int64 = num64;
+	  else
+		current = json_arena_new_int64(json_tokener_get_arena(tok), num64);
 	} else if(tok->is_double && sscanf(tok->pb->buf, "%lf", &numd) == 1) {
-          current = json_object_new_double(numd);
+	  if(tok->sax)
+	    json_tokener_sax_scalar(tok, json_type_double)->o.c_double = numd;
+	  else
+          current = json_arena_new_double(json_tokener_get_arena(tok), numd);
         } else {
           tok->err = json_tokener_error_parse_number;
           goto out;
         }
+        if(tok->sax && json_tokener_sax_event(tok, tok->sax->value, tok->sax_value))
+          goto out;
         saved_state = json_tokener_state_finish;
         state = json_tokener_state_eatws;
         goto redo_char;
@@ -579,6 +720,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 
     case json_tokener_state_array:
       if(c == ']') {
+	if(tok->sax && json_tokener_sax_event(tok, tok->sax->array_end, NULL)) goto out;
 	saved_state = json_tokener_state_finish;
 	state = json_tokener_state_eatws;
       } else {
@@ -594,13 +736,14 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       break;
 
     case json_tokener_state_array_add:
-      json_object_array_add(current, obj);
+      if(!tok->sax) json_object_array_add(current, obj);
       saved_state = json_tokener_state_array_sep;
       state = json_tokener_state_eatws;
       goto redo_char;
 
     case json_tokener_state_array_sep:
       if(c == ']') {
+	if(tok->sax && json_tokener_sax_event(tok, tok->sax->array_end, NULL)) goto out;
 	saved_state = json_tokener_state_finish;
 	state = json_tokener_state_eatws;
       } else if(c == ',') {
@@ -614,6 +757,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 
     case json_tokener_state_object_field_start:
       if(c == '}') {
+	if(tok->sax && json_tokener_sax_event(tok, tok->sax->object_end, NULL)) goto out;
 	saved_state = json_tokener_state_finish;
 	state = json_tokener_state_eatws;
       } else if (c == '"' || c == '\'') {
@@ -672,7 +816,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       goto redo_char;
 
     case json_tokener_state_object_value_add:
-      json_object_object_add(current, obj_field_name, obj);
+      if(!tok->sax) json_object_object_add(current, obj_field_name, obj);
       free(obj_field_name);
       obj_field_name = NULL;
       saved_state = json_tokener_state_object_sep;
@@ -681,6 +825,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 
     case json_tokener_state_object_sep:
       if(c == '}') {
+	if(tok->sax && json_tokener_sax_event(tok, tok->sax->object_end, NULL)) goto out;
 	saved_state = json_tokener_state_finish;
 	state = json_tokener_state_eatws;
       } else if(c == ',') {
@@ -704,7 +849,10 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       tok->err = json_tokener_error_parse_eof;
   }
 
-  if(tok->err == json_tokener_success) return json_object_get(current);
+  if(tok->err == json_tokener_success) {
+    tok->arena = NULL; /* now owned by the root object */
+    return json_object_get(current);
+  }
   MC_DEBUG("json_tokener_parse_ex: error %s at offset %d\n",
 	   json_tokener_errors[tok->err], tok->char_offset);
   return NULL;
@@ -33,7 +33,8 @@ enum json_tokener_error {
   json_tokener_error_parse_object_key_sep,
   json_tokener_error_parse_object_value_sep,
   json_tokener_error_parse_string,
-  json_tokener_error_parse_comment
+  json_tokener_error_parse_comment,
+  json_tokener_error_sax_abort
 };
 
 enum json_tokener_state {
@@ -71,6 +72,25 @@ struct json_tokener_srec
 
 #define JSON_TOKENER_MAX_DEPTH 32
 
+struct json_tokener;
+
+/* SAX mode: the document is reported as events instead of being built.
+   key is the member name of the value or container, NULL for array elements
+   and the root.  val is a scratch object that only lives for the call, it must
+   not be put or kept; a JSON null is reported as NULL.  Returning non-zero
+   stops the parse with json_tokener_error_sax_abort */
+typedef int (json_sax_event_fn)(void *ctx, struct json_tokener *tok,
+				const char *key, struct json_object *val);
+
+struct json_sax_callbacks
+{
+  json_sax_event_fn *object_start;
+  json_sax_event_fn *object_end;
+  json_sax_event_fn *array_start;
+  json_sax_event_fn *array_end;
+  json_sax_event_fn *value;   /* string, number, boolean and null */
+};
+
 struct json_tokener
 {
   char *str;
@@ -80,17 +100,34 @@ struct json_tokener
   unsigned int ucs_char;
   char quote_char;
   struct json_tokener_srec stack[JSON_TOKENER_MAX_DEPTH];
+  struct json_arena *arena;   /* arena of the document being parsed */
+  size_t arena_size;          /* arena block size, 0 parses onto the heap */
+  const struct json_sax_callbacks *sax; /* non-NULL in SAX mode */
+  void *sax_ctx;
+  struct json_object *sax_value;        /* scratch scalar handed to sax->value */
 };
 
 extern const char* json_tokener_errors[];
 
 extern struct json_tokener* json_tokener_new(void);
+/* Documents parsed by this tokener are built in an arena of block_size */
+extern struct json_tokener* json_tokener_new_arena(size_t block_size);
+/* Documents fed to this tokener are reported to sax and never built,
+   json_tokener_parse_ex returns NULL and tok->err tells the outcome */
+extern struct json_tokener* json_tokener_new_sax(const struct json_sax_callbacks *sax, void *ctx);
 extern void json_tokener_free(struct json_tokener *tok);
 extern void json_tokener_reset(struct json_tokener *tok);
 extern struct json_object* json_tokener_parse(const char *str);
 extern struct json_object* json_tokener_parse_verbose(const char *str, enum json_tokener_error *error);
+extern struct json_object* json_tokener_parse_arena(const char *str, size_t block_size);
 extern struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 						 const char *str, int len);
+extern enum json_tokener_error json_tokener_parse_sax(const char *str,
+						      const struct json_sax_callbacks *sax, void *ctx);
+/* From a SAX callback: 1 if the key path of the current event is path.
+   Components are separated by '/', "*" matches any member or array element,
+   and a path only matches at the depth of its component count, "" is the root */
+extern int json_tokener_sax_match(struct json_tokener *tok, const char *path);
 
 #ifdef __cplusplus
 }
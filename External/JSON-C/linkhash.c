@@ -16,6 +16,7 @@
 #include <stddef.h>
 #include <limits.h>
 
+#include "bits.h"
 #include "linkhash.h"
 
 void lh_abort(const char *msg, ...)
@@ -40,46 +41,75 @@ int lh_ptr_equal(const void *k1, const void *k2)
 
 unsigned long lh_char_hash(const void *k)
 {
-	unsigned int h = 0;
-	const char* data = (const char*)k;
- 
-	while( *data!=0 ) h = h*129 + (unsigned int)(*data++) + LH_PRIME;
+	/* FNV-1a, with a final mix so the low bits used by % size are spread */
+	unsigned int h = 2166136261U;
+	const unsigned char* data = (const unsigned char*)k;
+
+	while( *data!=0 ) h = (h ^ *data++) * 16777619U;
+	h ^= h >> 15;
 
 	return h;
 }
 
 int lh_char_equal(const void *k1, const void *k2)
 {
-	return (strcmp((const char*)k1, (const char*)k2) == 0);
+	/* Interned keys are compared by address first */
+	return (k1 == k2 || strcmp((const char*)k1, (const char*)k2) == 0);
 }
 
-struct lh_table* lh_table_new(int size, const char *name,
-			      lh_entry_free_fn *free_fn,
-			      lh_hash_fn *hash_fn,
-			      lh_equal_fn *equal_fn)
+static struct lh_entry* lh_table_new_entries(struct json_arena *arena, int size)
 {
 	int i;
+	struct lh_entry *table;
+
+	table = (struct lh_entry*)json_arena_alloc(arena, size * sizeof(struct lh_entry));
+	if(!table) return NULL;
+	for(i = 0; i < size; i++) table[i].k = LH_EMPTY;
+	return table;
+}
+
+static struct lh_table* lh_table_new_arena(struct json_arena *arena,
+					   int size, const char *name,
+					   lh_entry_free_fn *free_fn,
+					   lh_hash_fn *hash_fn,
+					   lh_equal_fn *equal_fn)
+{
 	struct lh_table *t;
 
-	t = (struct lh_table*)calloc(1, sizeof(struct lh_table));
+	t = (struct lh_table*)json_arena_alloc(arena, sizeof(struct lh_table));
 	if(!t) lh_abort("lh_table_new: calloc failed 1, size = %d\n", sizeof(struct lh_table));
 	t->count = 0;
 	t->size = size;
-	t->table = (struct lh_entry*)calloc(size, sizeof(struct lh_entry));
+	t->table = lh_table_new_entries(arena, size);
 	if(!t->table) lh_abort("lh_table_new: calloc failed 2, size = %d\n", sizeof(struct lh_table));
 	t->free_fn = free_fn;
 	t->hash_fn = hash_fn;
 	t->equal_fn = equal_fn;
-	for(i = 0; i < size; i++) t->table[i].k = LH_EMPTY;
+	t->arena = arena;
 	return t;
 }
 
+struct lh_table* lh_table_new(int size, const char *name,
+			      lh_entry_free_fn *free_fn,
+			      lh_hash_fn *hash_fn,
+			      lh_equal_fn *equal_fn)
+{
+	return lh_table_new_arena(NULL, size, name, free_fn, hash_fn, equal_fn);
+}
+
 struct lh_table* lh_kchar_table_new(int size, const char *name,
 				    lh_entry_free_fn *free_fn)
 {
 	return lh_table_new(size, name, free_fn, lh_char_hash, lh_char_equal);
 }
 
+struct lh_table* lh_kchar_table_new_arena(struct json_arena *arena,
+					  int size, const char *name,
+					  lh_entry_free_fn *free_fn)
+{
+	return lh_table_new_arena(arena, size, name, free_fn, lh_char_hash, lh_char_equal);
+}
+
 struct lh_table* lh_kptr_table_new(int size, const char *name,
 				   lh_entry_free_fn *free_fn)
 {
@@ -88,21 +118,21 @@ struct lh_table* lh_kptr_table_new(int size, const char *name,
 
 void lh_table_resize(struct lh_table *t, int new_size)
 {
-	struct lh_table *new_t;
-	struct lh_entry *ent;
+	struct lh_entry *old_table, *ent;
 
-	new_t = lh_table_new(new_size, NULL, NULL, t->hash_fn, t->equal_fn);
+	old_table = t->table;
 	ent = t->head;
+	t->table = lh_table_new_entries(t->arena, new_size);
+	if(!t->table) lh_abort("lh_table_resize: calloc failed, size = %d\n", new_size);
+	t->size = new_size;
+	t->count = 0;
+	t->head = t->tail = NULL;
+	/* The old entries stay readable until every one is moved, in list order */
 	while(ent) {
-		lh_table_insert(new_t, ent->k, ent->v);
+		lh_table_insert(t, ent->k, ent->v);
 		ent = ent->next;
 	}
-	free(t->table);
-	t->table = new_t->table;
-	t->size = new_size;
-	t->head = new_t->head;
-	t->tail = new_t->tail;
-	free(new_t);
+	json_arena_release(t->arena, old_table);
 }
 
 void lh_table_free(struct lh_table *t)
@@ -113,20 +143,23 @@ void lh_table_free(struct lh_table *t)
 			t->free_fn(c);
 		}
 	}
-	free(t->table);
-	free(t);
+	json_arena_release(t->arena, t->table);
+	json_arena_release(t->arena, t);
 }
 
 
 int lh_table_insert(struct lh_table *t, void *k, const void *v)
 {
-	unsigned long h, n;
+	unsigned long n;
 
-	//if(t->count > t->size * 0.66) lh_table_resize(t, t->size * 2); 
-	if(t->count >= t->size) lh_table_resize(t, t->size + 1); 
+	/* Small tables fill up before they grow, hashed ones stay 3/4 full at most */
+	if(t->size <= LH_SMALL_SIZE ? t->count >= t->size : t->count >= t->size - (t->size >> 2)) {
+		if(t->size < LH_MAX_SIZE) lh_table_resize(t, json_min(t->size * 2, LH_MAX_SIZE));
+		if(t->count >= t->size) return -1;
+	}
 
-	h = t->hash_fn(k);
-	n = h % t->size;
+	/* Small tables take the first free slot, so used slots always precede the empty ones */
+	n = t->size <= LH_SMALL_SIZE ? 0 : t->hash_fn(k) % t->size;
 
 	while( 1 ) {
 		if(t->table[n].k == LH_EMPTY || t->table[n].k == LH_FREED) break;
@@ -153,8 +186,7 @@ int lh_table_insert(struct lh_table *t, void *k, const void *v)
 
 struct lh_entry* lh_table_lookup_entry(struct lh_table *t, const void *k)
 {
-	unsigned long h = t->hash_fn(k);
-	unsigned long n = h % t->size;
+	unsigned long n = t->size <= LH_SMALL_SIZE ? 0 : t->hash_fn(k) % t->size;
 	int count = 0;
 
 	while( count < t->size ) {
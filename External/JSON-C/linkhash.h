@@ -12,6 +12,8 @@
 #ifndef _linkhash_h_
 #define _linkhash_h_
 
+#include "json_arena.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,6 +33,16 @@ extern "C" {
  */
 #define LH_FREED (void*)-2
 
+/**
+ * tables up to this size are scanned linearly instead of hashed
+ */
+#define LH_SMALL_SIZE 8
+
+/**
+ * largest table size, see lh_table.size
+ */
+#define LH_MAX_SIZE 255
+
 struct lh_entry;
 
 /**
@@ -100,6 +112,11 @@ struct lh_table {
 	lh_entry_free_fn *free_fn;
 	lh_hash_fn *hash_fn;
 	lh_equal_fn *equal_fn;
+
+	/**
+	 * Arena the table and its entries live in, NULL for the heap.
+	 */
+	struct json_arena *arena;
 };
 
 
@@ -130,7 +147,9 @@ for(entry = table->head; entry && ((tmp = entry->next) || 1); entry = tmp)
 /**
  * Create a new linkhash table.
  * @param size initial table size. The table is automatically resized
- * although this incurs a performance penalty.
+ * although this incurs a performance penalty. Tables of up to
+ * LH_SMALL_SIZE entries keep their keys in insertion order and are
+ * searched linearly, larger ones are hashed.
  * @param name the table name.
  * @param free_fn callback function used to free memory for entries
  * when lh_table_free or lh_table_delete is called.
@@ -160,6 +179,18 @@ extern struct lh_table* lh_table_new(int size, const char *name,
 extern struct lh_table* lh_kchar_table_new(int size, const char *name,
 					   lh_entry_free_fn *free_fn);
 
+/**
+ * Create a new linkhash table with char keys inside an arena.
+ * @param arena the arena, NULL for the heap.
+ * @param size initial table size.
+ * @param name table name.
+ * @param free_fn callback function used to free memory for entries.
+ * @return a pointer onto the linkhash table.
+ */
+extern struct lh_table* lh_kchar_table_new_arena(struct json_arena *arena,
+						 int size, const char *name,
+						 lh_entry_free_fn *free_fn);
+
 
 /**
  * Convenience function to create a new linkhash
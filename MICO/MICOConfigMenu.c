@@ -34,15 +34,37 @@
 #include "JSON-C/json.h"
 #include "MICOConfigMenu.h"
 
+typedef struct {
+  MICOConfigJsonHandler handler;
+  void *context;
+  OSStatus err;
+} _ConfigJsonStream_t;
+
+static int _ConfigJsonValue(void *ctx, struct json_tokener *tok, const char *key, json_object *val)
+{
+  _ConfigJsonStream_t *stream = ctx;
+
+  /* Only members of the root object, nested values are skipped */
+  if(key == NULL || !json_tokener_sax_match(tok, "*"))
+    return 0;
+  stream->err = stream->handler(key, val, stream->context);
+  return stream->err != kNoErr;
+}
+
+static const struct json_sax_callbacks _ConfigJsonCallbacks = {
+  NULL, NULL, NULL, NULL, _ConfigJsonValue
+};
+
 OSStatus MICOAddSector(json_object* sectors, char* const name,  json_object *menus)
 {
   OSStatus err;
   json_object *object;
+  struct json_arena *arena = json_object_get_arena(sectors);
   err = kNoErr;
 
-  object = json_object_new_object();
+  object = json_arena_new_object(arena);
   require_action(object, exit, err = kNoMemoryErr);
-  json_object_object_add(object, "N", json_object_new_string(name));      
+  json_object_object_add(object, "N", json_arena_new_string(arena, name));      
   json_object_object_add(object, "C", menus);
   json_object_array_add(sectors, object);
 
@@ -54,13 +76,14 @@ OSStatus MICOAddStringCellToSector(json_object* menus, char* const name,  char*
 {
   OSStatus err;
   json_object *object;
+  struct json_arena *arena = json_object_get_arena(menus);
   err = kNoErr;
 
-  object = json_object_new_object();
+  object = json_arena_new_object(arena);
   require_action(object, exit, err = kNoMemoryErr);
-  json_object_object_add(object, "N", json_object_new_string(name));      
-  json_object_object_add(object, "C", json_object_new_string(content));
-  json_object_object_add(object, "P", json_object_new_string(privilege)); 
+  json_object_object_add(object, "N", json_arena_new_string(arena, name));      
+  json_object_object_add(object, "C", json_arena_new_string(arena, content));
+  json_object_object_add(object, "P", json_arena_new_string(arena, privilege)); 
 
   if(secectionArray)
     json_object_object_add(object, "S", secectionArray); 
@@ -76,14 +99,15 @@ OSStatus MICOAddNumberCellToSector(json_object* menus, char* const name,  int co
 {
   OSStatus err;
   json_object *object;
+  struct json_arena *arena = json_object_get_arena(menus);
   err = kNoErr;
 
-  object = json_object_new_object();
+  object = json_arena_new_object(arena);
   require_action(object, exit, err = kNoMemoryErr);
-  json_object_object_add(object, "N", json_object_new_string(name));      
+  json_object_object_add(object, "N", json_arena_new_string(arena, name));      
 
-  json_object_object_add(object, "C", json_object_new_int(content));
-  json_object_object_add(object, "P", json_object_new_string(privilege)); 
+  json_object_object_add(object, "C", json_arena_new_int(arena, content));
+  json_object_object_add(object, "P", json_arena_new_string(arena, privilege)); 
 
   if(secectionArray)
     json_object_object_add(object, "S", secectionArray); 
@@ -98,14 +122,15 @@ OSStatus MICOAddFloatCellToSector(json_object* menus, char* const name,  float c
 {
   OSStatus err;
   json_object *object;
+  struct json_arena *arena = json_object_get_arena(menus);
   err = kNoErr;
 
-  object = json_object_new_object();
+  object = json_arena_new_object(arena);
   require_action(object, exit, err = kNoMemoryErr);
-  json_object_object_add(object, "N", json_object_new_string(name));      
+  json_object_object_add(object, "N", json_arena_new_string(arena, name));      
 
-  json_object_object_add(object, "C", json_object_new_double(content));
-  json_object_object_add(object, "P", json_object_new_string(privilege)); 
+  json_object_object_add(object, "C", json_arena_new_double(arena, content));
+  json_object_object_add(object, "P", json_arena_new_string(arena, privilege)); 
 
   if(secectionArray)
     json_object_object_add(object, "S", secectionArray); 
@@ -121,13 +146,14 @@ OSStatus MICOAddSwitchCellToSector(json_object* menus, char* const name,  boolea
 {
   OSStatus err;
   json_object *object;
+  struct json_arena *arena = json_object_get_arena(menus);
   err = kNoErr;
 
-  object = json_object_new_object();
+  object = json_arena_new_object(arena);
   require_action(object, exit, err = kNoMemoryErr);
-  json_object_object_add(object, "N", json_object_new_string(name));      
-  json_object_object_add(object, "C", json_object_new_boolean(switcher));
-  json_object_object_add(object, "P", json_object_new_string(privilege)); 
+  json_object_object_add(object, "N", json_arena_new_string(arena, name));      
+  json_object_object_add(object, "C", json_arena_new_boolean(arena, switcher));
+  json_object_object_add(object, "P", json_arena_new_string(arena, privilege)); 
   json_object_array_add(menus, object);
 
 exit:
@@ -138,11 +164,12 @@ OSStatus MICOAddMenuCellToSector(json_object* menus, char* const name, json_obje
 {
   OSStatus err;
   json_object *object;
+  struct json_arena *arena = json_object_get_arena(menus);
   err = kNoErr;
 
-  object = json_object_new_object();
+  object = json_arena_new_object(arena);
   require_action(object, exit, err = kNoMemoryErr);
-  json_object_object_add(object, "N", json_object_new_string(name));
+  json_object_object_add(object, "N", json_arena_new_string(arena, name));
   json_object_object_add(object, "C", lowerSectors);
   json_object_array_add(menus, object);
 
@@ -154,25 +181,117 @@ OSStatus MICOAddTopMenu(json_object **outTopMenu, char* const inName, json_objec
 {
   OSStatus err;
   json_object *object;
+  struct json_arena *arena = json_object_get_arena(sectors);
   err = kNoErr;
   require_action(inVersions.protocol, exit, err = kParamErr);
   require_action(inVersions.hdVersion, exit, err = kParamErr);
   require_action(inVersions.fwVersion, exit, err = kParamErr);
 
-  object = json_object_new_object();
+  object = json_arena_new_object(arena);
   require_action(object, exit, err = kNoMemoryErr);
-  json_object_object_add(object, "T", json_object_new_string("Current Configuration"));
-  json_object_object_add(object, "N", json_object_new_string(inName));
+  json_object_object_add(object, "T", json_arena_new_string(arena, "Current Configuration"));
+  json_object_object_add(object, "N", json_arena_new_string(arena, inName));
   json_object_object_add(object, "C", sectors);
 
-  json_object_object_add(object, "PO", json_object_new_string(inVersions.protocol));
-  json_object_object_add(object, "HD", json_object_new_string(inVersions.hdVersion));
-  json_object_object_add(object, "FW", json_object_new_string(inVersions.fwVersion));
+  json_object_object_add(object, "PO", json_arena_new_string(arena, inVersions.protocol));
+  json_object_object_add(object, "HD", json_arena_new_string(arena, inVersions.hdVersion));
+  json_object_object_add(object, "FW", json_arena_new_string(arena, inVersions.fwVersion));
   if(inVersions.rfVersion)
-    json_object_object_add(object, "RF", json_object_new_string(inVersions.rfVersion));
+    json_object_object_add(object, "RF", json_arena_new_string(arena, inVersions.rfVersion));
  
   *outTopMenu = object;
 exit:
   return err;
 }
 
+
+struct json_tokener* MICOConfigJsonStreamNew(MICOConfigJsonHandler handler, void *inContext)
+{
+  _ConfigJsonStream_t *stream;
+  struct json_tokener *tok = NULL;
+
+  stream = calloc(1, sizeof(_ConfigJsonStream_t));
+  require(stream, exit);
+  stream->handler = handler;
+  stream->context = inContext;
+  tok = json_tokener_new_sax(&_ConfigJsonCallbacks, stream);
+  require_action(tok, exit, free(stream));
+
+exit:
+  return tok;
+}
+
+OSStatus MICOConfigJsonStreamFeed(struct json_tokener* stream, const char *data, int len)
+{
+  json_tokener_parse_ex(stream, data, len);
+  switch(stream->err){
+    case json_tokener_success:
+      return kNoErr;
+    case json_tokener_continue:
+      return kInProgressErr;
+    case json_tokener_error_sax_abort:
+      return ((_ConfigJsonStream_t *)stream->sax_ctx)->err;
+    default:
+      return kMalformedErr;
+  }
+}
+
+void MICOConfigJsonStreamFree(struct json_tokener* stream)
+{
+  if(stream == NULL) return;
+  free(stream->sax_ctx);
+  json_tokener_free(stream);
+}
+
+OSStatus MICOConfigJsonParse(const char *input, MICOConfigJsonHandler handler, void *inContext)
+{
+  OSStatus err;
+  struct json_tokener *stream;
+
+  stream = MICOConfigJsonStreamNew(handler, inContext);
+  require_action(stream, exit, err = kNoMemoryErr);
+  err = MICOConfigJsonStreamFeed(stream, input, -1);
+  if(err == kInProgressErr) err = kMalformedErr;
+  MICOConfigJsonStreamFree(stream);
+
+exit:
+  return err;
+}
+
+flash_content_t* MICOConfigStageNew(mico_Context_t * const inContext)
+{
+  flash_content_t *staged;
+
+  staged = malloc(sizeof(flash_content_t));
+  require(staged, exit);
+  mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
+  memcpy(staged, &inContext->flashContentInRam, sizeof(flash_content_t));
+  mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
+
+exit:
+  return staged;
+}
+
+void MICOConfigStageCommit(flash_content_t *staged, mico_Context_t * const inContext)
+{
+  /* Handlers never touch the boot table, which OTA may update meanwhile */
+  mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
+  memcpy(&inContext->flashContentInRam.micoSystemConfig, &staged->micoSystemConfig, sizeof(mico_sys_config_t));
+  memcpy(&inContext->flashContentInRam.appConfig, &staged->appConfig, sizeof(application_config_t));
+  mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
+}
+
+OSStatus MICOConfigJsonApply(const char *input, MICOConfigJsonHandler handler, mico_Context_t * const inContext)
+{
+  OSStatus err;
+  flash_content_t *staged;
+
+  staged = MICOConfigStageNew(inContext);
+  require_action(staged, exit, err = kNoMemoryErr);
+  err = MICOConfigJsonParse(input, handler, staged);
+  if(err == kNoErr) MICOConfigStageCommit(staged, inContext);
+  free(staged);
+
+exit:
+  return err;
+}
@@ -35,6 +35,7 @@
 
 #include "Common.h"
 #include "JSON-C/json.h"
+#include "MICODefine.h"
 
 typedef struct {
   char*  protocol;
@@ -43,6 +44,8 @@ typedef struct {
   char*  rfVersion;
 } OTA_Versions_t;
 
+/* Cells are allocated from the arena of the sector they are added to, so a
+   menu whose sectors come from json_arena_new_array() is built in one arena */
 
 OSStatus MICOAddSector(json_object* sectors, char* const name,  json_object *menus);
 
@@ -58,4 +61,27 @@ OSStatus MICOAddMenuCellToSector(json_object* menus, char* const name, json_obje
 
 OSStatus MICOAddTopMenu(json_object **deviceInfo, char* const name, json_object* sectors, OTA_Versions_t versions);
 
+/* Incomming config objects are applied member by member while they are parsed,
+   no DOM is built. The handler gets every top-level member, val only lives for
+   the call, and an error from it stops the parse and is returned */
+typedef OSStatus (*MICOConfigJsonHandler)(const char *key, json_object *val, void *inContext);
+
+struct json_tokener* MICOConfigJsonStreamNew(MICOConfigJsonHandler handler, void *inContext);
+
+/* kInProgressErr until the object is complete, can be fed chunk by chunk */
+OSStatus MICOConfigJsonStreamFeed(struct json_tokener* stream, const char *data, int len);
+
+void MICOConfigJsonStreamFree(struct json_tokener* stream);
+
+OSStatus MICOConfigJsonParse(const char *input, MICOConfigJsonHandler handler, void *inContext);
+
+/* Config handlers write into a staged copy of the flash content, which they get
+   as inContext. The copy is committed under flashContentInRam_mutex only after
+   the whole object has parsed, so a bad or truncated request changes nothing */
+flash_content_t* MICOConfigStageNew(mico_Context_t * const inContext);
+
+void MICOConfigStageCommit(flash_content_t *staged, mico_Context_t * const inContext);
+
+OSStatus MICOConfigJsonApply(const char *input, MICOConfigJsonHandler handler, mico_Context_t * const inContext);
+
 #endif
@@ -37,6 +37,7 @@
 #include "HTTPUtils.h"
 #include "MICONotificationCenter.h"
 #include "StringUtils.h"
+#include "MICOConfigMenu.h"
 
 #define config_log(M, ...) custom_log("CONFIG SERVER", M, ##__VA_ARGS__)
 #define config_log_trace() custom_log_trace("CONFIG SERVER")
@@ -48,13 +49,11 @@
 
 #define kMIMEType_MXCHIP_OTA    "application/ota-stream"
 
-typedef struct _configContext_t{
-  uint32_t flashStorageAddress;
-  bool     isFlashLocked;
-} configContext_t;
+#define kCONFIGIdleTimeout      60  /* Seconds, a persistent connection without any request is closed */
+#define kCONFIGJsonStageSize    512 /* Report is rendered and sent in pieces of this size */
 
-extern OSStatus     ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext );
-extern OSStatus     ConfigIncommingJsonMessageUAP( const char *input, mico_Context_t * const inContext );
+extern OSStatus     ConfigIncommingJsonValue( const char *key, json_object *val, void *inContext );
+extern OSStatus     ConfigIncommingJsonValueUAP( const char *key, json_object *val, void *inContext );
 extern json_object* ConfigCreateReportJsonMessage( mico_Context_t * const inContext );
 
 static void localConfiglistener_thread(void *inContext);
@@ -62,8 +61,10 @@ static void localConfig_thread(void *inFd);
 static mico_Context_t *Context;
 static OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext);
 static void _easylinkConnectWiFi( mico_Context_t * const inContext);
-static OSStatus onReceivedData(struct _HTTPHeader_t * httpHeader, uint32_t pos, uint8_t * data, size_t len, void * userContext );
-static void onClearHTTPHeader(struct _HTTPHeader_t * httpHeader, void * userContext );
+static OSStatus _LocalConfigReadJsonBody( int fd, HTTPHeader_t* inHeader, json_object **outJson );
+#ifdef MICO_FLASH_FOR_UPDATE
+static OSStatus _LocalConfigReadOTABody( int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext, uint32_t *outLen );
+#endif
 
 OSStatus MICOStartConfigServer ( mico_Context_t * const inContext )
 {
@@ -124,18 +125,24 @@ void localConfig_thread(void *inFd)
   OSStatus err;
   int clientFd = *(int *)inFd;
   int clientFdIsSet;
+  int selectResult;
+  int readTimeout = kCONFIGIdleTimeout*1000;
   fd_set readfds;
   struct timeval_t t;
+  char *headerEnd;
   HTTPHeader_t *httpHeader = NULL;
-  configContext_t httpContext = {0, false};
 
   config_log_trace();
-  httpHeader = HTTPHeaderCreateWithCallback(onReceivedData, onClearHTTPHeader, &httpContext);
+
+  /* A header that comes in part by part is read with blocking reads, none of them waits longer than an idle client */
+  err = setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &readTimeout, sizeof(readTimeout));
+  require_noerr(err, exit);
+
+  httpHeader = HTTPHeaderCreate();
   require_action( httpHeader, exit, err = kNoMemoryErr );
+  httpHeader->streamBody = true;
   HTTPHeaderClear( httpHeader );
 
-  t.tv_sec = 60;
-  t.tv_usec = 0;
   config_log("Free memory %d bytes", MicoGetMemoryInfo()->free_memory) ; 
 
   while(1){
@@ -143,8 +150,18 @@ void localConfig_thread(void *inFd)
     FD_SET(clientFd, &readfds);
     clientFdIsSet = 0;
 
-    if(httpHeader->len == 0){
-      require(select(1, &readfds, NULL, NULL, &t) >= 0, exit);
+    /* Pipelined requests left in httpHeader by HTTPHeaderClear are served before waiting on the socket, the rest 
+       of a partial one is waited for like a new request */
+    if(findHeader(httpHeader, &headerEnd) == false){
+      t.tv_sec = kCONFIGIdleTimeout;
+      t.tv_usec = 0;
+      selectResult = select(clientFd + 1, &readfds, NULL, NULL, &t);
+      require_action(selectResult >= 0, exit, err = kConnectionErr);
+      if(selectResult == 0){
+        config_log("Connection idle for %d seconds.", kCONFIGIdleTimeout);
+        err = kTimeoutErr;
+        goto exit;
+      }
       clientFdIsSet = FD_ISSET(clientFd, &readfds);
     }
   
@@ -154,34 +171,15 @@ void localConfig_thread(void *inFd)
       switch ( err )
       {
         case kNoErr:
-          // Read the rest of the HTTP body if necessary
-          //do{
-          err = SocketReadHTTPBody( clientFd, httpHeader );
-          
-          if(httpHeader->dataEndedbyClose == true){
-            err = _LocalConfigRespondInComingMessage( clientFd, httpHeader, Context );
-            require_noerr(err, exit);
-            err = kConnectionErr;
-            goto exit;
-          }else{
-            require_noerr(err, exit);
-            err = _LocalConfigRespondInComingMessage( clientFd, httpHeader, Context );
-            require_noerr(err, exit);
-          }
-          
-
-
-          //  if(httpHeader->contentLength == 0)
-          //    break;
-          //} while( httpHeader->chunkedData == true || httpHeader->dataEndedbyClose == true);
-
-          // Call the HTTPServer owner back with the acquired HTTP header
-          //err = _LocalConfigRespondInComingMessage( clientFd, httpHeader, Context );
-          //
-          //Exit if connection is closed
-          //require_noerr(err, exit); 
-      
-          // Reuse HTTPHeader
+          // The body is pulled by the handler through a fixed window, never buffered as a whole
+          err = _LocalConfigRespondInComingMessage( clientFd, httpHeader, Context );
+          require_noerr(err, exit);
+
+          // Drop whatever part of the body the handler did not consume
+          err = SocketSkipHTTPBody( clientFd, httpHeader );
+          require_noerr(err, exit);
+
+          // Reuse HTTPHeader, bytes of the next request received with this one are kept
           HTTPHeaderClear( httpHeader );
         break;
 
@@ -216,99 +214,135 @@ exit:
   return;
 }
 
-static OSStatus onReceivedData(struct _HTTPHeader_t * inHeader, uint32_t inPos, uint8_t * inData, size_t inLen, void * inUserContext )
+static OSStatus _LocalConfigApplyJsonBody( int fd, HTTPHeader_t* inHeader, MICOConfigJsonHandler handler, mico_Context_t * const inContext )
 {
-  OSStatus err = kUnknownErr;
-  const char *    value;
-  size_t          valueSize;
-  configContext_t *context = (configContext_t *)inUserContext;
-
-  err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
-  if(err == kNoErr && strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0){
-    config_log("OTA data %d, %d to: %x", inPos, inLen, context->flashStorageAddress);
-#ifdef MICO_FLASH_FOR_UPDATE  
-    if(inPos == 0){
-      context->flashStorageAddress = UPDATE_START_ADDRESS;
-      mico_rtos_lock_mutex(&Context->flashContentInRam_mutex); //We are write the Flash content, no other write is possiable
-      context->isFlashLocked = true;
-      err = MicoFlashInitialize( MICO_FLASH_FOR_UPDATE );
-      require_noerr(err, flashErrExit);
-      err = MicoFlashErase(MICO_FLASH_FOR_UPDATE, UPDATE_START_ADDRESS, UPDATE_END_ADDRESS);
-      require_noerr(err, flashErrExit);
-      err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &context->flashStorageAddress, (uint8_t *)inData, inLen);
-      require_noerr(err, flashErrExit);
-    }else{
-      err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &context->flashStorageAddress, (uint8_t *)inData, inLen);
-      require_noerr(err, flashErrExit);
-    }
-#else
-    config_log("OTA storage is not exist");
-    return kUnsupportedErr;
-#endif
-  }
-  else if(inHeader->chunkedData == true){
-    config_log("ChunkedData: %d, %d:", inPos, inLen);
-    for(uint32_t i = 0; i<inLen; i++)
-      printf("%c", inData[i]);
-    printf("\r\n");
-  }
-  else{
-    return kUnsupportedErr;
-  }
+  OSStatus err = kNoMemoryErr;
+  struct json_tokener *stream = NULL;
+  flash_content_t *staged = NULL;
+  uint8_t *window = NULL;
+  size_t readLen;
+
+  staged = MICOConfigStageNew( inContext );
+  require( staged, exit );
+  stream = MICOConfigJsonStreamNew( handler, staged );
+  require( stream, exit );
+  window = malloc( HTTP_Body_Window_Length );
+  require( window, exit );
+
+  /* Each window is parsed into the staged copy as it arrives, neither the body
+     nor a DOM is kept. The copy is committed once the object is complete */
+  do{
+    err = SocketReadHTTPBodyWindow( fd, inHeader, window, HTTP_Body_Window_Length, &readLen );
+    require_noerr( err, exit );
+    require_action( readLen, exit, err = kMalformedErr );
+    err = MICOConfigJsonStreamFeed( stream, (const char *)window, readLen );
+  }while( err == kInProgressErr );
+  require_noerr( err, exit );
+  MICOConfigStageCommit( staged, inContext );
 
-  if(err!=kNoErr)  config_log("onReceivedData");
+exit:
+  if(window)  free(window);
+  if(staged)  free(staged);
+  MICOConfigJsonStreamFree(stream);
   return err;
+}
+
+#ifdef MICO_FLASH_FOR_UPDATE
+static OSStatus _LocalConfigReadOTABody( int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext, uint32_t *outLen )
+{
+  OSStatus err = kNoMemoryErr;
+  uint32_t flashStorageAddress = UPDATE_START_ADDRESS;
+  uint8_t *window = NULL;
+  size_t readLen;
+
+  window = malloc( OTA_Data_Length_per_read );
+  require( window, exit );
+
+  mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex); //We are write the Flash content, no other write is possiable
+  err = MicoFlashInitialize( MICO_FLASH_FOR_UPDATE );
+  require_noerr(err, flashErrExit);
+  err = MicoFlashErase(MICO_FLASH_FOR_UPDATE, UPDATE_START_ADDRESS, UPDATE_END_ADDRESS);
+  require_noerr(err, flashErrExit);
+
+  while(1){
+    err = SocketReadHTTPBodyWindow( fd, inHeader, window, OTA_Data_Length_per_read, &readLen );
+    require_noerr(err, flashErrExit);
+    if(readLen == 0) break;
+    config_log("OTA data %d to: %x", readLen, flashStorageAddress);
+    err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &flashStorageAddress, window, readLen);
+    require_noerr(err, flashErrExit);
+  }
+  *outLen = flashStorageAddress - UPDATE_START_ADDRESS;
 
-#ifdef MICO_FLASH_FOR_UPDATE  
 flashErrExit:
   MicoFlashFinalize(MICO_FLASH_FOR_UPDATE);
-  mico_rtos_unlock_mutex(&Context->flashContentInRam_mutex);
+  mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
+exit:
+  if(window)  free(window);
   return err;
-#endif
 }
+#endif
 
-static void onClearHTTPHeader(struct _HTTPHeader_t * inHeader, void * inUserContext )
-{
-  UNUSED_PARAMETER(inHeader);
-  configContext_t *context = (configContext_t *)inUserContext;
-
-  if(context->isFlashLocked == true){
-    mico_rtos_unlock_mutex(&Context->flashContentInRam_mutex);
-    context->isFlashLocked = false;
-  }
- }
 
+typedef struct {
+  int             fd;
+  const uint8_t   *header;    //! Sent together with the first piece of the body
+  size_t          headerLen;
+} _LocalConfigJsonSink_t;
 
+static int _LocalConfigJsonSink( void *inContext, const char *inBuf, int inLen )
+{
+  _LocalConfigJsonSink_t *sink = inContext;
+  socket_iovec_t iov[2];
+  int iovCount = 0;
+
+  if(sink->headerLen){
+    iov[iovCount].iov_base = sink->header;
+    iov[iovCount++].iov_len = sink->headerLen;
+    sink->headerLen = 0;
+  }
+  iov[iovCount].iov_base = (const uint8_t *)inBuf;
+  iov[iovCount++].iov_len = inLen;
+  return SocketSendv( sink->fd, iov, iovCount ) == kNoErr ? inLen : -1;
+}
 
 OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext)
 {
   OSStatus err = kUnknownErr;
-  const char *  json_str;
+  int jsonLen;
+  char *jsonStage = NULL;
+  _LocalConfigJsonSink_t sink;
   uint8_t *httpResponse = NULL;
   size_t httpResponseLen = 0;
   json_object* report = NULL;
+#ifdef MICO_FLASH_FOR_UPDATE
+  uint32_t otaLength = 0;
+#endif
   config_log_trace();
 
   if(HTTPHeaderMatchURL( inHeader, kCONFIGURLRead ) == kNoErr){    
     report = ConfigCreateReportJsonMessage( inContext );
     require( report, exit );
-    json_str = json_object_to_json_string(report);
-    require_action( json_str, exit, err = kNoMemoryErr );
-    config_log("Send config object=%s", json_str);
-    err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_JSON, strlen(json_str), &httpResponse, &httpResponseLen );
+    /* Measure first for Content-Length, then render straight to the socket */
+    jsonLen = json_object_to_json_buffer(report, NULL, 0);
+    config_log("Send config object, %d bytes", jsonLen);
+    err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_JSON, jsonLen, &httpResponse, &httpResponseLen );
     require_noerr( err, exit );
     require( httpResponse, exit );
-    err = SocketSend( fd, httpResponse, httpResponseLen );
-    require_noerr( err, exit );
-    err = SocketSend( fd, (uint8_t *)json_str, strlen(json_str) );
-    require_noerr( err, exit );
+    jsonStage = malloc( kCONFIGJsonStageSize );
+    require_action( jsonStage, exit, err = kNoMemoryErr );
+    sink.fd = fd;
+    sink.header = httpResponse;
+    sink.headerLen = httpResponseLen;
+    require_action( json_object_to_json_sink(report, jsonStage, kCONFIGJsonStageSize, _LocalConfigJsonSink, &sink) == jsonLen,
+                    exit, err = kWriteErr );
     config_log("Current configuration sent");
     goto exit;
   }
   else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLWrite ) == kNoErr){
-    if(inHeader->contentLength > 0){
+    if(inHeader->contentLength > 0 || inHeader->chunkedData == true){
       config_log("Recv new configuration, apply and reset");
-      err = ConfigIncommingJsonMessage( inHeader->extraDataPtr, inContext);
+      err = _LocalConfigApplyJsonBody( fd, inHeader, ConfigIncommingJsonValue, inContext );
       require_noerr( err, exit );
       inContext->flashContentInRam.micoSystemConfig.configured = allConfigured;
       MICOUpdateConfiguration(inContext);
@@ -326,9 +360,9 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico
     goto exit;
   }
 else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLWriteByUAP ) == kNoErr){
-    if(inHeader->contentLength > 0){
+    if(inHeader->contentLength > 0 || inHeader->chunkedData == true){
       config_log("Recv new configuration from uAP, apply and connect to AP");
-      err = ConfigIncommingJsonMessageUAP( inHeader->extraDataPtr, inContext);
+      err = _LocalConfigApplyJsonBody( fd, inHeader, ConfigIncommingJsonValueUAP, inContext );
       require_noerr( err, exit );
       MICOUpdateConfiguration(inContext);
 
@@ -349,10 +383,12 @@ else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLWriteByUAP ) == kNoErr){
   }
 #ifdef MICO_FLASH_FOR_UPDATE
   else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLOTA ) == kNoErr){
-    if(inHeader->contentLength > 0){
+    if(inHeader->contentLength > 0 || inHeader->chunkedData == true){
       config_log("Receive OTA data!");
+      err = _LocalConfigReadOTABody( fd, inHeader, inContext, &otaLength );
+      require_noerr( err, exit );
       memset(&inContext->flashContentInRam.bootTable, 0, sizeof(boot_table_t));
-      inContext->flashContentInRam.bootTable.length = inHeader->contentLength;
+      inContext->flashContentInRam.bootTable.length = otaLength;
       inContext->flashContentInRam.bootTable.start_address = UPDATE_START_ADDRESS;
       inContext->flashContentInRam.bootTable.type = 'A';
       inContext->flashContentInRam.bootTable.upgrade_type = 'U';
@@ -369,13 +405,20 @@ else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLWriteByUAP ) == kNoErr){
   }
 #endif
   else{
-    return kNotFoundErr;
+    /* Answer unknown URLs so that a persistent connection can continue with the next request */
+    config_log("URL not found");
+    err = CreateHTTPRespondMessageNoCopy( kStatusNotFound, kMIMEType_JSON, 0, &httpResponse, &httpResponseLen );
+    require_noerr( err, exit );
+    err = SocketSend( fd, httpResponse, httpResponseLen );
+    require_noerr( err, exit );
+    goto exit;
   };
 
  exit:
   if(inHeader->persistent == false)  //Return an err to close socket and exit the current thread
     err = kConnectionErr;
   if(httpResponse)  free(httpResponse);
+  if(jsonStage)     free(jsonStage);
   if(report)        json_object_put(report);
 
   return err;
@@ -35,21 +35,246 @@
 #include "platform_config.h"
 #include "MicoPlatform.h"
 
+/* Parameter journal
+ *
+ * The complete flash_content_t image is kept at PARA_START_ADDRESS, where the
+ * bootloader expects the boot table. The rest of the PARA area holds a journal
+ * of records, each patching a byte range of that image. MICOUpdateConfiguration
+ * appends one record per changed range instead of erasing the sector, so the
+ * area is only erased when the journal is full, the boot table changes or a
+ * damaged record header has been found (compaction).
+ *
+ * A record's data is programmed before its header, so a record becomes visible
+ * only once it is complete. Records with a bad CRC are skipped on replay.
+ */
+#define PARA_JOURNAL_MAGIC          (0x4A52)
+#define PARA_JOURNAL_START          (PARA_START_ADDRESS + ((sizeof(flash_content_t) + 3) & ~3))
+#define PARA_JOURNAL_END            (PARA_END_ADDRESS + 1)
+#define PARA_JOURNAL_MERGE_GAP      (sizeof(para_record_t))
+#define PARA_VERIFY_CHUNK           (32)
+
+typedef struct _para_record_t {
+  uint16_t magic;
+  uint16_t offset;   /* Offset in flash_content_t */
+  uint16_t length;   /* Data bytes following this header, padded to 4 bytes in flash */
+  uint16_t crc;      /* CRC16 over offset, length and data */
+} para_record_t;
+
+#define PARA_RECORD_SIZE(len)       (sizeof(para_record_t) + (((len) + 3) & ~3))
+
 /* Update seed number every time*/
 static int32_t seedNum = 0;
 
+/* Next free address in journal, and a copy of the content last committed to flash */
+static uint32_t journalTail = 0;
+static bool journalDirty = true;
+static flash_content_t *committedContent = NULL;
+
 __weak void appRestoreDefault_callback(mico_Context_t *inContext)
 {
 
 }
 
+static uint16_t _paraCRC16(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+  uint8_t i;
+
+  while(len--){
+    crc ^= (uint16_t)(*data++) << 8;
+    for(i = 0; i < 8; i++)
+      crc = (crc & 0x8000)? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static uint16_t _paraRecordCRC(const para_record_t *record, const uint8_t *data)
+{
+  uint16_t crc = 0xFFFF;
+  crc = _paraCRC16(crc, (const uint8_t *)&record->offset, sizeof(record->offset));
+  crc = _paraCRC16(crc, (const uint8_t *)&record->length, sizeof(record->length));
+  return _paraCRC16(crc, data, record->length);
+}
+
+static void _paraSyncCommitted(mico_Context_t *inContext)
+{
+  if(committedContent == NULL)
+    committedContent = malloc(sizeof(flash_content_t));
+  if(committedContent != NULL)
+    memcpy(committedContent, &inContext->flashContentInRam, sizeof(flash_content_t));
+}
+
+/* Erase PARA area and write the complete image, leaving an empty journal */
+static OSStatus _paraCompact(mico_Context_t *inContext)
+{
+  OSStatus err = kNoErr;
+  uint32_t paraStartAddress = PARA_START_ADDRESS;
+
+  err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
+  require_noerr(err, exit);
+  err = MicoFlashErase(MICO_FLASH_FOR_PARA, PARA_START_ADDRESS, PARA_END_ADDRESS);
+  require_noerr(err, exit);
+  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t));
+  require_noerr(err, exit);
+  err = MicoFlashFinalize(MICO_FLASH_FOR_PARA);
+  require_noerr(err, exit);
+
+  journalTail = PARA_JOURNAL_START;
+  journalDirty = false;
+  _paraSyncCommitted(inContext);
+
+exit:
+  return err;
+}
+
+static OSStatus _paraVerify(uint32_t address, const uint8_t *data, uint32_t len)
+{
+  OSStatus err = kNoErr;
+  uint8_t readBack[PARA_VERIFY_CHUNK];
+  uint32_t chunk;
+
+  while(len){
+    chunk = MIN(len, PARA_VERIFY_CHUNK);
+    err = MicoFlashRead(MICO_FLASH_FOR_PARA, &address, readBack, chunk);
+    require_noerr(err, exit);
+    require_action(memcmp(readBack, data, chunk) == 0, exit, err = kWriteErr);
+    data += chunk;
+    len -= chunk;
+  }
+
+exit:
+  return err;
+}
+
+/* Append one record patching flash_content_t[offset, offset+length) */
+static OSStatus _paraJournalAppend(const uint8_t *content, uint16_t offset, uint16_t length)
+{
+  OSStatus err = kNoErr;
+  para_record_t record;
+  uint32_t address;
+
+  require_action_quiet(journalTail + PARA_RECORD_SIZE(length) <= PARA_JOURNAL_END, exit, err = kNoSpaceErr);
+
+  record.magic = PARA_JOURNAL_MAGIC;
+  record.offset = offset;
+  record.length = length;
+  record.crc = _paraRecordCRC(&record, content + offset);
+
+  /* Data first, header last: the record only exists once the header is programmed */
+  address = journalTail + sizeof(para_record_t);
+  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &address, (uint8_t *)content + offset, length);
+  require_noerr(err, exit);
+  address = journalTail;
+  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &address, (uint8_t *)&record, sizeof(para_record_t));
+  require_noerr(err, exit);
+
+  err = _paraVerify(journalTail, (uint8_t *)&record, sizeof(para_record_t));
+  require_noerr(err, exit);
+  err = _paraVerify(journalTail + sizeof(para_record_t), content + offset, length);
+  require_noerr(err, exit);
+
+exit:
+  /* Skip whatever was programmed, even a failed record */
+  if(err != kNoSpaceErr)
+    journalTail += PARA_RECORD_SIZE(length);
+  return err;
+}
+
+/* Apply every valid record in journal to flashContentInRam */
+static OSStatus _paraJournalReplay(mico_Context_t *inContext)
+{
+  OSStatus err = kNoErr;
+  para_record_t record;
+  uint32_t address = PARA_JOURNAL_START;
+  uint8_t *content = (uint8_t *)&inContext->flashContentInRam;
+  uint8_t *data = NULL;
+
+  journalDirty = false;
+
+  while(address + sizeof(para_record_t) <= PARA_JOURNAL_END){
+    journalTail = address;
+    err = MicoFlashRead(MICO_FLASH_FOR_PARA, &address, (uint8_t *)&record, sizeof(para_record_t));
+    require_noerr(err, exit);
+
+    if(record.magic == 0xFFFF && record.offset == 0xFFFF && record.length == 0xFFFF && record.crc == 0xFFFF)
+      goto exit; /* End of journal */
+
+    if(record.magic != PARA_JOURNAL_MAGIC || record.length == 0
+       || (uint32_t)record.offset + record.length > sizeof(flash_content_t)
+       || journalTail + PARA_RECORD_SIZE(record.length) > PARA_JOURNAL_END){
+      /* Header is damaged, the end of this record is unknown */
+      journalDirty = true;
+      goto exit;
+    }
+
+    data = malloc(record.length);
+    require_action(data, exit, err = kNoMemoryErr);
+    err = MicoFlashRead(MICO_FLASH_FOR_PARA, &address, data, record.length);
+    require_noerr(err, exit);
+
+    /* A bad CRC is left by an interrupted append, the record is simply skipped */
+    if(_paraRecordCRC(&record, data) == record.crc)
+      memcpy(content + record.offset, data, record.length);
+
+    free(data);
+    data = NULL;
+    address = journalTail + PARA_RECORD_SIZE(record.length);
+  }
+  journalTail = PARA_JOURNAL_END;
+
+exit:
+  if(data) free(data);
+  return err;
+}
+
+/* Write every range that differs from the committed content as a journal record */
+static OSStatus _paraJournalUpdate(mico_Context_t *inContext)
+{
+  OSStatus err = kNoErr;
+  const uint8_t *content = (const uint8_t *)&inContext->flashContentInRam;
+  const uint8_t *committed = (const uint8_t *)committedContent;
+  uint32_t start, end, idx;
+
+  require_action_quiet(committedContent && !journalDirty, exit, err = kNotPreparedErr);
+  /* Bootloader reads boot table from image directly */
+  require_action_quiet(memcmp(&committedContent->bootTable, &inContext->flashContentInRam.bootTable, sizeof(boot_table_t)) == 0, exit, err = kNotPreparedErr);
+
+  err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
+  require_noerr(err, exit);
+
+  for(idx = 0; idx < sizeof(flash_content_t); ){
+    if(content[idx] == committed[idx]){
+      idx++;
+      continue;
+    }
+
+    /* Merge ranges that are separated by less than a record header */
+    start = idx;
+    end = ++idx;
+    while(idx < sizeof(flash_content_t) && idx - end < PARA_JOURNAL_MERGE_GAP){
+      if(content[idx] != committed[idx])
+        end = idx + 1;
+      idx++;
+    }
+    idx = end;
+
+    /* Area behind journal tail may be partly programmed by an interrupted append, retry once */
+    err = _paraJournalAppend(content, start, end - start);
+    if(err == kWriteErr)
+      err = _paraJournalAppend(content, start, end - start);
+    require_noerr_quiet(err, exit);
+    memcpy((uint8_t *)committedContent + start, content + start, end - start);
+  }
+
+  err = MicoFlashFinalize(MICO_FLASH_FOR_PARA);
+  require_noerr(err, exit);
+
+exit:
+  return err;
+}
+
 OSStatus MICORestoreDefault(mico_Context_t *inContext)
 { 
   OSStatus err = kNoErr;
-  uint32_t paraStartAddress, paraEndAddress;
- 
-  paraStartAddress = PARA_START_ADDRESS;
-  paraEndAddress = PARA_END_ADDRESS;
 
   /*wlan configration is not need to change to a default state, use easylink to do that*/
   memset(&inContext->flashContentInRam, 0x0, sizeof(inContext->flashContentInRam));
@@ -65,13 +290,7 @@ OSStatus MICORestoreDefault(mico_Context_t *inContext)
   /*Application's default configuration*/
   appRestoreDefault_callback(inContext);
 
-  err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
-  require_noerr(err, exit);
-  err = MicoFlashErase(MICO_FLASH_FOR_PARA, paraStartAddress, paraEndAddress);
-  require_noerr(err, exit);
-  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, (void *)inContext, sizeof(flash_content_t));
-  require_noerr(err, exit);
-  err = MicoFlashFinalize(MICO_FLASH_FOR_PARA);
+  err = _paraCompact(inContext);
   require_noerr(err, exit);
 
 exit:
@@ -82,10 +301,6 @@ exit:
 OSStatus MICORestoreMFG(mico_Context_t *inContext)
 { 
   OSStatus err = kNoErr;
-  uint32_t paraStartAddress, paraEndAddress;
- 
-  paraStartAddress = PARA_START_ADDRESS;
-  paraEndAddress = PARA_END_ADDRESS;
 
   /*wlan configration is not need to change to a default state, use easylink to do that*/
   sprintf(inContext->flashContentInRam.micoSystemConfig.name, DEFAULT_NAME);
@@ -94,13 +309,7 @@ OSStatus MICORestoreMFG(mico_Context_t *inContext)
   /*Application's default configuration*/
   appRestoreDefault_callback(inContext);
 
-  err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
-  require_noerr(err, exit);
-  err = MicoFlashErase(MICO_FLASH_FOR_PARA, paraStartAddress, paraEndAddress);
-  require_noerr(err, exit);
-  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, (void *)inContext, sizeof(flash_content_t));
-  require_noerr(err, exit);
-  err = MicoFlashFinalize(MICO_FLASH_FOR_PARA);
+  err = _paraCompact(inContext);
   require_noerr(err, exit);
 
 exit:
@@ -118,6 +327,11 @@ OSStatus MICOReadConfiguration(mico_Context_t *inContext)
   err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
   require_noerr(err, exit);
   err = MicoFlashRead(MICO_FLASH_FOR_PARA, &configInFlash, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t));
+  require_noerr(err, exit);
+  err = _paraJournalReplay(inContext);
+  require_noerr(err, exit);
+  _paraSyncCommitted(inContext);
+
   seedNum = inContext->flashContentInRam.micoSystemConfig.seed;
   if(seedNum == -1) seedNum = 0;
 
@@ -146,23 +360,16 @@ exit:
 OSStatus MICOUpdateConfiguration(mico_Context_t *inContext)
 {
   OSStatus err = kNoErr;
-  uint32_t paraStartAddress, paraEndAddress;
- 
-  paraStartAddress = PARA_START_ADDRESS;
-  paraEndAddress = PARA_END_ADDRESS;
 
   inContext->flashContentInRam.micoSystemConfig.seed = ++seedNum;
-  err = MicoFlashInitialize(MICO_FLASH_FOR_PARA);
-  require_noerr(err, exit);
-  err = MicoFlashErase(MICO_FLASH_FOR_PARA, paraStartAddress, paraEndAddress);
-  require_noerr(err, exit);
-  err = MicoFlashWrite(MICO_FLASH_FOR_PARA, &paraStartAddress, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t));
-  require_noerr(err, exit);
-  err = MicoFlashFinalize(MICO_FLASH_FOR_PARA);
-  require_noerr(err, exit);
+
+  err = _paraJournalUpdate(inContext);
+  if(err != kNoErr){
+    /* Journal is full or unusable, rewrite the whole area */
+    err = _paraCompact(inContext);
+    require_noerr(err, exit);
+  }
 
 exit:
   return err;
 }
-
-
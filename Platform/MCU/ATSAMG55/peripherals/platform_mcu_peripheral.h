@@ -100,6 +100,9 @@ extern "C"
 /* Invalid UART port number */
 #define INVALID_UART_PORT_NUMBER  (0xff)
 
+/* Transfers queued on a UART port, including the one in progress */
+#define UART_TX_QUEUE_LENGTH      (4)
+
  /* SPI1 to SPI3 */
 #define NUMBER_OF_SPI_PORTS       (3)
 
@@ -180,6 +183,14 @@ typedef struct {
 } platform_uart_t;
 
 
+typedef struct
+{
+    const uint8_t*             data;
+    uint32_t                   size;
+    void                     (*callback)( void* arg, OSStatus result );
+    void*                      arg;
+} platform_uart_tx_desc_t;
+
 typedef struct
 {
     platform_uart_t*           peripheral;
@@ -189,6 +200,11 @@ typedef struct
     mico_semaphore_t           tx_complete;
     mico_mutex_t               tx_mutex;
     mico_semaphore_t           sem_wakeup;
+    mico_semaphore_t           tx_slots;           /* Free descriptors in tx_queue */
+    platform_uart_tx_desc_t    tx_queue[UART_TX_QUEUE_LENGTH];
+    volatile uint8_t           tx_queue_head;      /* Descriptor being sent by PDC */
+    volatile uint8_t           tx_queue_count;
+    volatile OSStatus          tx_sync_result;     /* Result of the transfer platform_uart_transmit_bytes waits for */
 #else
     volatile bool              rx_complete;
     volatile bool              tx_complete;
@@ -87,6 +87,12 @@ static Flexcom  *flexcom_base[] =
 *        Static Function Declarations
 ******************************************************/
 
+static void start_transmit( platform_uart_driver_t* driver, const uint8_t* data, uint32_t size );
+#ifndef NO_MICO_RTOS
+static void queue_transmit( platform_uart_driver_t* driver, const uint8_t* data, uint32_t size, platform_uart_tx_callback_t callback, void* arg );
+static void transmit_complete( void* arg, OSStatus result );
+#endif
+
 /******************************************************
 *               Function Definitions
 ******************************************************/
@@ -97,6 +103,9 @@ OSStatus platform_uart_init( platform_uart_driver_t* driver, const platform_uart
   OSStatus          err = kNoErr;
   sam_usart_opt_t   settings;
   bool              hardware_shaking = false;
+#ifndef NO_MICO_RTOS
+  int               i;
+#endif
 
   platform_mcu_powersave_disable();
   
@@ -114,6 +123,13 @@ OSStatus platform_uart_init( platform_uart_driver_t* driver, const platform_uart
   mico_rtos_init_semaphore( &driver->rx_complete, 1 );
   mico_rtos_init_semaphore( &driver->sem_wakeup,  1 );
   mico_rtos_init_mutex    ( &driver->tx_mutex );
+  mico_rtos_init_semaphore( &driver->tx_slots, UART_TX_QUEUE_LENGTH );
+  for ( i = 0; i < UART_TX_QUEUE_LENGTH; i++ )
+  {
+    mico_rtos_set_semaphore( &driver->tx_slots );
+  }
+  driver->tx_queue_head        = 0;
+  driver->tx_queue_count       = 0;
 #else
   driver->tx_complete = false;
   driver->rx_complete = false;
@@ -254,6 +270,7 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver )
 #ifndef NO_MICO_RTOS
   mico_rtos_deinit_semaphore(&driver->rx_complete);
   mico_rtos_deinit_semaphore(&driver->tx_complete);
+  mico_rtos_deinit_semaphore(&driver->tx_slots);
 #endif
 
   driver->peripheral = NULL;
@@ -264,33 +281,74 @@ exit:
   return err;
 }
 
-OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size )
+static void start_transmit( platform_uart_driver_t* driver, const uint8_t* data, uint32_t size )
 {
-  OSStatus      err = kNoErr;
   pdc_packet_t  pdc_uart_packet;
 
-  platform_mcu_powersave_disable();
-  
-#ifndef NO_MICO_RTOS
-  mico_rtos_lock_mutex( &driver->tx_mutex );
-#endif
-  
-  require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
-  
   /* reset DMA transmission result. the result is assigned in interrupt handler */
   driver->last_transmit_result                    = kGeneralErr;
   driver->tx_size                                 = size;
   
-  pdc_uart_packet.ul_addr = (uint32_t) data_out;
+  pdc_uart_packet.ul_addr = (uint32_t) data;
   pdc_uart_packet.ul_size = size;
   pdc_tx_init( usart_get_pdc_base( driver->peripheral->port ), &pdc_uart_packet, NULL);
 
   /* Enable Tx DMA transmission */
   pdc_enable_transfer( usart_get_pdc_base( driver->peripheral->port ), PERIPH_PTCR_TXTEN );
+}
+
+#ifndef NO_MICO_RTOS
+/* Caller owns a tx_slots count, the ENDTX interrupt starts queued transfers one after another */
+static void queue_transmit( platform_uart_driver_t* driver, const uint8_t* data, uint32_t size, platform_uart_tx_callback_t callback, void* arg )
+{
+  platform_uart_tx_desc_t* desc;
+
+  /* Released by platform_uart_irq when the transfer is done */
+  platform_mcu_powersave_disable();
+
+  DISABLE_INTERRUPTS;
+  desc = &driver->tx_queue[ ( driver->tx_queue_head + driver->tx_queue_count ) % UART_TX_QUEUE_LENGTH ];
+  desc->data     = data;
+  desc->size     = size;
+  desc->callback = callback;
+  desc->arg      = arg;
+  driver->tx_queue_count++;
+  if ( driver->tx_queue_count == 1 )
+  {
+    start_transmit( driver, data, size );
+  }
+  ENABLE_INTERRUPTS;
+}
+
+static void transmit_complete( void* arg, OSStatus result )
+{
+  platform_uart_driver_t* driver = arg;
+
+  driver->tx_sync_result = result;
+  mico_rtos_set_semaphore( &driver->tx_complete );
+}
+#endif
+
+OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size )
+{
+  OSStatus      err = kNoErr;
+
+  platform_mcu_powersave_disable();
   
 #ifndef NO_MICO_RTOS
+  mico_rtos_lock_mutex( &driver->tx_mutex );
+#endif
+  
+  require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
+  
+#ifndef NO_MICO_RTOS
+  /* Queued behind the asynchronous transfers, transmit_complete wakes us up */
+  mico_rtos_get_semaphore( &driver->tx_slots, MICO_NEVER_TIMEOUT );
+  queue_transmit( driver, data_out, size, transmit_complete, driver );
   mico_rtos_get_semaphore( &driver->tx_complete, MICO_NEVER_TIMEOUT );
+  err = driver->tx_sync_result;
 #else 
+  start_transmit( driver, data_out, size );
   while( driver->tx_complete == false);
   driver->tx_complete = false;
 #endif
@@ -351,17 +409,10 @@ OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* d
     // Grab data from the buffer
     do
     {
-      uint8_t* available_data;
-      uint32_t bytes_available;
-
-      ring_buffer_get_data( driver->rx_ring_buffer, &available_data, &bytes_available );
-      bytes_available = MIN( bytes_available, transfer_size );
-      memcpy( data_in, available_data, bytes_available );
-      transfer_size -= bytes_available;
-      data_in = ( (uint8_t*)data_in + bytes_available );
-      ring_buffer_consume( driver->rx_ring_buffer, bytes_available );
-    }
-    while ( transfer_size != 0 );
+      uint32_t bytes_read = ring_buffer_read( driver->rx_ring_buffer, (uint8_t*)data_in, transfer_size );
+      transfer_size -= bytes_read;
+      data_in = ( (uint8_t*)data_in + bytes_read );
+    } while ( transfer_size != 0 );
   }
 
   require_action( expected_data_size == 0, exit, err = kReadErr);
@@ -376,6 +427,45 @@ OSStatus platform_uart_get_length_in_buffer( platform_uart_driver_t* driver )
   return ring_buffer_used_space( driver->rx_ring_buffer );
 }
 
+OSStatus platform_uart_transmit_bytes_async( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size, platform_uart_tx_callback_t callback, void* arg )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
+
+#ifndef NO_MICO_RTOS
+  require_action_quiet( mico_rtos_get_semaphore( &driver->tx_slots, MICO_NO_WAIT ) == kNoErr, exit, err = kNoResourcesErr);
+  queue_transmit( driver, data_out, size, callback, arg );
+#else
+  err = platform_uart_transmit_bytes( driver, data_out, size );
+  if ( err == kNoErr && callback != NULL )
+    callback( arg, err );
+#endif
+
+exit:
+  return err;
+}
+
+/* No frame boundary detection on this MCU, MicoUartRecvFrame falls back to an inter-byte gap */
+OSStatus platform_uart_set_framing( platform_uart_driver_t* driver, int32_t delimiter, platform_uart_frame_callback_t callback, void* arg )
+{
+  UNUSED_PARAMETER( driver );
+  UNUSED_PARAMETER( delimiter );
+  UNUSED_PARAMETER( callback );
+  UNUSED_PARAMETER( arg );
+  return kUnsupportedErr;
+}
+
+OSStatus platform_uart_receive_frame( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t max_size, uint32_t* frame_size, uint32_t timeout_ms )
+{
+  UNUSED_PARAMETER( driver );
+  UNUSED_PARAMETER( data_in );
+  UNUSED_PARAMETER( max_size );
+  UNUSED_PARAMETER( frame_size );
+  UNUSED_PARAMETER( timeout_ms );
+  return kUnsupportedErr;
+}
+
 /******************************************************
 *            Interrupt Service Routines
 ******************************************************/
@@ -402,9 +492,37 @@ void platform_uart_irq( platform_uart_driver_t* driver )
 
     pdc_tx_init( usart_get_pdc_base( driver->peripheral->port ), &dma_packet, NULL );
 
-    /* Notifies waiting thread that Tx DMA transfer is complete */
+    /* PDC has no error status, a transfer that ends has completed */
+    driver->last_transmit_result = kNoErr;
+
 #ifndef NO_MICO_RTOS
-    mico_rtos_set_semaphore( &driver->tx_complete );
+    if ( driver->tx_queue_count > 0 )
+    {
+      platform_uart_tx_desc_t* desc = &driver->tx_queue[ driver->tx_queue_head ];
+      platform_uart_tx_callback_t callback = desc->callback;
+      void* arg = desc->arg;
+
+      driver->tx_queue_head = ( driver->tx_queue_head + 1 ) % UART_TX_QUEUE_LENGTH;
+      driver->tx_queue_count--;
+
+      /* Arm the next transfer before anything else, so the line does not go idle between them */
+      if ( driver->tx_queue_count > 0 )
+      {
+        desc = &driver->tx_queue[ driver->tx_queue_head ];
+        start_transmit( driver, desc->data, desc->size );
+      }
+      else
+      {
+        driver->tx_size = 0;
+      }
+
+      if ( callback != NULL )
+      {
+        callback( arg, kNoErr );
+      }
+      mico_rtos_set_semaphore( &driver->tx_slots );
+      platform_mcu_powersave_enable();
+    }
 #else
     driver->tx_complete = true;
 #endif
@@ -428,7 +546,7 @@ void platform_uart_irq( platform_uart_driver_t* driver )
    */
   if ( ( mask & US_IMR_RXRDY )  )
   {
-    driver->rx_ring_buffer->tail = driver->rx_ring_buffer->size - pdc_register->PERIPH_RCR;
+    ring_buffer_commit( driver->rx_ring_buffer, ( 2 * driver->rx_ring_buffer->size - pdc_register->PERIPH_RCR - driver->rx_ring_buffer->tail ) % driver->rx_ring_buffer->size );
 
     // Notify thread if sufficient data are available
     if ( ( driver->rx_size > 0 ) && ( ring_buffer_used_space( driver->rx_ring_buffer ) >= driver->rx_size ) )
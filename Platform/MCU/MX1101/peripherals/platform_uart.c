@@ -244,15 +244,9 @@ static OSStatus FUartRecv( platform_uart_driver_t* driver, void* data, uint32_t
       // Grab data from the buffer
       do
       {
-        uint8_t* available_data;
-        uint32_t bytes_available;
-        
-        ring_buffer_get_data( driver->rx_buffer, &available_data, &bytes_available );
-        bytes_available = MIN( bytes_available, transfer_size );
-        memcpy( data, available_data, bytes_available );
-        transfer_size -= bytes_available;
-        data = ( (uint8_t*) data + bytes_available );
-        ring_buffer_consume( driver->rx_buffer, bytes_available );
+        uint32_t bytes_read = ring_buffer_read( driver->rx_buffer, (uint8_t*)data, transfer_size );
+        transfer_size -= bytes_read;
+        data = ( (uint8_t*)data + bytes_read );
       } while ( transfer_size != 0 );
     }
     
@@ -367,6 +361,37 @@ OSStatus platform_uart_get_length_in_buffer( platform_uart_driver_t* driver )
   return 0;
 }
 
+/* FuartSend and BuartSend in the vendor library own the transfer and give no
+   way to chain another one, so transmit stays synchronous on this MCU and the
+   callback is called before returning */
+OSStatus platform_uart_transmit_bytes_async( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size, platform_uart_tx_callback_t callback, void* arg )
+{
+  OSStatus err = platform_uart_transmit_bytes( driver, data_out, size );
+  if ( err == kNoErr && callback != NULL )
+    callback( arg, err );
+  return err;
+}
+
+/* No frame boundary detection on this MCU, MicoUartRecvFrame falls back to an inter-byte gap */
+OSStatus platform_uart_set_framing( platform_uart_driver_t* driver, int32_t delimiter, platform_uart_frame_callback_t callback, void* arg )
+{
+  UNUSED_PARAMETER( driver );
+  UNUSED_PARAMETER( delimiter );
+  UNUSED_PARAMETER( callback );
+  UNUSED_PARAMETER( arg );
+  return kUnsupportedErr;
+}
+
+OSStatus platform_uart_receive_frame( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t max_size, uint32_t* frame_size, uint32_t timeout_ms )
+{
+  UNUSED_PARAMETER( driver );
+  UNUSED_PARAMETER( data_in );
+  UNUSED_PARAMETER( max_size );
+  UNUSED_PARAMETER( frame_size );
+  UNUSED_PARAMETER( timeout_ms );
+  return kUnsupportedErr;
+}
+
 /******************************************************
 *            Interrupt Service Routines
 ******************************************************/
@@ -70,6 +70,9 @@ extern "C"
 /* Invalid UART port number */
 #define INVALID_UART_PORT_NUMBER  (0xff)
 
+/* Transfers queued on a UART port, including the one in progress */
+#define UART_TX_QUEUE_LENGTH      (4)
+
  /* SPI1 to SPI3 */
 #define NUMBER_OF_SPI_PORTS       (3)
 
@@ -192,6 +195,14 @@ typedef struct
 
 typedef void (* wakeup_irq_handler_t)(void *arg);
 
+typedef struct
+{
+    const uint8_t*             data;
+    uint32_t                   size;
+    void                     (*callback)( void* arg, OSStatus result );
+    void*                      arg;
+} platform_uart_tx_desc_t;
+
 typedef struct
 {
     platform_uart_port_t*  port;
@@ -220,6 +231,18 @@ typedef struct
     volatile uint32_t          rx_size;
     volatile OSStatus          last_receive_result;
     volatile OSStatus          last_transmit_result;
+#ifndef NO_MICO_RTOS
+    mico_semaphore_t           tx_slots;           /* Free descriptors in tx_queue */
+    platform_uart_tx_desc_t    tx_queue[UART_TX_QUEUE_LENGTH];
+    volatile uint8_t           tx_queue_head;      /* Descriptor being sent by DMA */
+    volatile uint8_t           tx_queue_count;
+    volatile OSStatus          tx_sync_result;     /* Result of the transfer platform_uart_transmit_bytes waits for */
+#endif
+    volatile uint32_t          rx_frame_tail;      /* Ring buffer tail at the latest frame boundary */
+    volatile bool              rx_frame_wait;      /* A thread waits in platform_uart_receive_frame */
+    int16_t                    rx_delimiter;       /* Byte that ends a frame, -1 if frames end on an idle line */
+    void                     (*rx_frame_callback)( void* arg, uint32_t frame_size );
+    void*                      rx_frame_arg;
 } platform_uart_driver_t;
 
 typedef struct
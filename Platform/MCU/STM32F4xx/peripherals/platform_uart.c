@@ -118,6 +118,12 @@ static const IRQn_Type uart_irq_vectors[NUMBER_OF_UART_PORTS] =
 *        Static Function Declarations
 ******************************************************/
 static OSStatus receive_bytes       ( platform_uart_driver_t* driver, void* data, uint32_t size, uint32_t timeout );
+static uint32_t get_frame_size      ( platform_uart_driver_t* driver, uint32_t limit );
+static void     start_transmit      ( platform_uart_driver_t* driver, const uint8_t* data, uint32_t size );
+#ifndef NO_MICO_RTOS
+static void     queue_transmit      ( platform_uart_driver_t* driver, const uint8_t* data, uint32_t size, platform_uart_tx_callback_t callback, void* arg );
+static void     transmit_complete   ( void* arg, OSStatus result );
+#endif
 static uint32_t get_dma_irq_status  ( DMA_Stream_TypeDef* stream );
 static void     clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags );
 
@@ -136,6 +142,7 @@ OSStatus platform_uart_init( platform_uart_driver_t* driver, const platform_uart
   DMA_InitTypeDef   dma_init_structure;
   USART_InitTypeDef uart_init_structure;
   uint32_t          uart_number;
+  uint32_t          i;
   OSStatus          err = kNoErr;
 
   platform_mcu_powersave_disable();
@@ -150,11 +157,23 @@ OSStatus platform_uart_init( platform_uart_driver_t* driver, const platform_uart
   driver->last_transmit_result = kNoErr;
   driver->last_receive_result  = kNoErr;
   driver->peripheral           = (platform_uart_t*)peripheral;
+  driver->rx_frame_tail        = 0;
+  driver->rx_frame_wait        = false;
+  driver->rx_delimiter         = -1;
+  driver->rx_frame_callback    = NULL;
+  driver->rx_frame_arg         = NULL;
 #ifndef NO_MICO_RTOS
   mico_rtos_init_semaphore( &driver->tx_complete, 1 );
   mico_rtos_init_semaphore( &driver->rx_complete, 1 );
   mico_rtos_init_semaphore( &driver->sem_wakeup,  1 );
   mico_rtos_init_mutex    ( &driver->tx_mutex );
+  mico_rtos_init_semaphore( &driver->tx_slots, UART_TX_QUEUE_LENGTH );
+  for ( i = 0; i < UART_TX_QUEUE_LENGTH; i++ )
+  {
+    mico_rtos_set_semaphore( &driver->tx_slots );
+  }
+  driver->tx_queue_head        = 0;
+  driver->tx_queue_count       = 0;
 #else
   driver->tx_complete = false;
   driver->rx_complete = false;
@@ -372,6 +391,7 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver )
    **************************************************************************/
 
   USART_ITConfig( driver->peripheral->port, USART_IT_RXNE, DISABLE );
+  USART_ITConfig( driver->peripheral->port, USART_IT_IDLE, DISABLE );
 
   /* Disable UART interrupt vector on Cortex-M3 */
   NVIC_DisableIRQ( driver->peripheral->rx_dma_config.irq_vector );
@@ -382,6 +402,7 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver )
 #ifndef NO_MICO_RTOS
   mico_rtos_deinit_semaphore( &driver->rx_complete );
   mico_rtos_deinit_semaphore( &driver->tx_complete );
+  mico_rtos_deinit_semaphore( &driver->tx_slots );
   mico_rtos_deinit_mutex( &driver->tx_mutex );
 #else
   driver->rx_complete = false;
@@ -409,27 +430,23 @@ OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uin
 
   require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
 
-  /* Clear interrupt status before enabling DMA otherwise error occurs immediately */
-  clear_dma_interrupts( driver->peripheral->tx_dma_config.stream, driver->peripheral->tx_dma_config.complete_flags | driver->peripheral->tx_dma_config.error_flags );
-
-  /* Init DMA parameters and variables */
-  driver->last_transmit_result                    = kGeneralErr;
-  driver->tx_size                                 = size;
-  driver->peripheral->tx_dma_config.stream->CR   &= ~(uint32_t) DMA_SxCR_CIRC;
-  driver->peripheral->tx_dma_config.stream->NDTR  = size;
-  driver->peripheral->tx_dma_config.stream->M0AR  = (uint32_t)data_out;
-  
-  USART_DMACmd( driver->peripheral->port, USART_DMAReq_Tx, ENABLE );
-  USART_ClearFlag( driver->peripheral->port, USART_FLAG_TC );
-  driver->peripheral->tx_dma_config.stream->CR   |= DMA_SxCR_EN;
-  
-/* Wait for transmission complete */
 #ifndef NO_MICO_RTOS
+  /* Queued behind the asynchronous transfers, transmit_complete wakes us up */
+  mico_rtos_get_semaphore( &driver->tx_slots, MICO_NEVER_TIMEOUT );
+  queue_transmit( driver, data_out, size, transmit_complete, driver );
   mico_rtos_get_semaphore( &driver->tx_complete, MICO_NEVER_TIMEOUT );
+  err = driver->tx_sync_result;
+
+  /* Wait for the last byte on the wire, unless another transfer has started already */
+  while ( ( driver->tx_queue_count == 0 ) && ( ( driver->peripheral->port->SR & USART_SR_TC ) == 0 ) )
+  {
+  }
 #else 
+  start_transmit( driver, data_out, size );
+
+  /* Wait for transmission complete */
   while( driver->tx_complete == false );
   driver->tx_complete = false;
-#endif
 
   while ( ( driver->peripheral->port->SR & USART_SR_TC ) == 0 )
   {
@@ -439,6 +456,7 @@ OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uin
   USART_DMACmd( driver->peripheral->port, USART_DMAReq_Tx, DISABLE );
   driver->tx_size = 0;
   err = driver->last_transmit_result;
+#endif
 
 exit:  
 #ifndef NO_MICO_RTOS  
@@ -448,6 +466,74 @@ exit:
   return err;
 }
 
+OSStatus platform_uart_transmit_bytes_async( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size, platform_uart_tx_callback_t callback, void* arg )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
+
+#ifndef NO_MICO_RTOS
+  require_action_quiet( mico_rtos_get_semaphore( &driver->tx_slots, MICO_NO_WAIT ) == kNoErr, exit, err = kNoResourcesErr);
+  queue_transmit( driver, data_out, size, callback, arg );
+#else
+  err = platform_uart_transmit_bytes( driver, data_out, size );
+  if ( err == kNoErr && callback != NULL )
+    callback( arg, err );
+#endif
+
+exit:
+  return err;
+}
+
+static void start_transmit( platform_uart_driver_t* driver, const uint8_t* data, uint32_t size )
+{
+  /* Clear interrupt status before enabling DMA otherwise error occurs immediately */
+  clear_dma_interrupts( driver->peripheral->tx_dma_config.stream, driver->peripheral->tx_dma_config.complete_flags | driver->peripheral->tx_dma_config.error_flags );
+
+  /* Init DMA parameters and variables */
+  driver->last_transmit_result                    = kGeneralErr;
+  driver->tx_size                                 = size;
+  driver->peripheral->tx_dma_config.stream->CR   &= ~(uint32_t) DMA_SxCR_CIRC;
+  driver->peripheral->tx_dma_config.stream->NDTR  = size;
+  driver->peripheral->tx_dma_config.stream->M0AR  = (uint32_t)data;
+  
+  USART_DMACmd( driver->peripheral->port, USART_DMAReq_Tx, ENABLE );
+  USART_ClearFlag( driver->peripheral->port, USART_FLAG_TC );
+  driver->peripheral->tx_dma_config.stream->CR   |= DMA_SxCR_EN;
+}
+
+#ifndef NO_MICO_RTOS
+/* Caller owns a tx_slots count, the DMA interrupt starts queued transfers one after another */
+static void queue_transmit( platform_uart_driver_t* driver, const uint8_t* data, uint32_t size, platform_uart_tx_callback_t callback, void* arg )
+{
+  platform_uart_tx_desc_t* desc;
+
+  /* Released by platform_uart_tx_dma_irq when the transfer is done */
+  platform_mcu_powersave_disable();
+
+  DISABLE_INTERRUPTS;
+  desc = &driver->tx_queue[ ( driver->tx_queue_head + driver->tx_queue_count ) % UART_TX_QUEUE_LENGTH ];
+  desc->data     = data;
+  desc->size     = size;
+  desc->callback = callback;
+  desc->arg      = arg;
+  driver->tx_queue_count++;
+  if ( driver->tx_queue_count == 1 )
+  {
+    start_transmit( driver, data, size );
+  }
+  ENABLE_INTERRUPTS;
+}
+
+static void transmit_complete( void* arg, OSStatus result )
+{
+  platform_uart_driver_t* driver = arg;
+
+  driver->tx_sync_result = result;
+  mico_rtos_set_semaphore( &driver->tx_complete );
+}
+#endif
+
 OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t expected_data_size, uint32_t timeout_ms )
 {
   OSStatus err = kNoErr;
@@ -496,15 +582,9 @@ OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* d
       // Grab data from the buffer
       do
       {
-        uint8_t* available_data;
-        uint32_t bytes_available;
-        
-        ring_buffer_get_data( driver->rx_buffer, &available_data, &bytes_available );
-        bytes_available = MIN( bytes_available, transfer_size );
-        memcpy( data_in, available_data, bytes_available );
-        transfer_size -= bytes_available;
-        data_in = ( (uint8_t*) data_in + bytes_available );
-        ring_buffer_consume( driver->rx_buffer, bytes_available );
+        uint32_t bytes_read = ring_buffer_read( driver->rx_buffer, (uint8_t*)data_in, transfer_size );
+        transfer_size -= bytes_read;
+        data_in = ( (uint8_t*)data_in + bytes_read );
       } while ( transfer_size != 0 );
     }
   }
@@ -528,6 +608,9 @@ static OSStatus receive_bytes( platform_uart_driver_t* driver, void* data, uint3
     // Enabled individual byte interrupts so progress can be updated
     USART_ClearITPendingBit( driver->peripheral->port, USART_IT_RXNE );
     USART_ITConfig( driver->peripheral->port, USART_IT_RXNE, ENABLE );
+
+    // Idle line interrupt marks the end of a burst for platform_uart_receive_frame
+    USART_ITConfig( driver->peripheral->port, USART_IT_IDLE, ENABLE );
   }
   else
   {
@@ -566,6 +649,114 @@ OSStatus platform_uart_get_length_in_buffer( platform_uart_driver_t* driver )
   return ring_buffer_used_space( driver->rx_buffer );
 }
 
+OSStatus platform_uart_set_framing( platform_uart_driver_t* driver, int32_t delimiter, platform_uart_frame_callback_t callback, void* arg )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( driver != NULL, exit, err = kParamErr);
+
+  driver->rx_frame_callback = NULL;
+  driver->rx_delimiter      = ( delimiter < 0 ) ? -1 : (int16_t)( delimiter & 0xFF );
+  driver->rx_frame_arg      = arg;
+  driver->rx_frame_callback = callback;
+
+exit:
+  return err;
+}
+
+OSStatus platform_uart_receive_frame( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t max_size, uint32_t* frame_size, uint32_t timeout_ms )
+{
+  OSStatus err = kNoErr;
+  uint32_t limit;
+  uint32_t available;
+  uint32_t elapsed;
+#ifndef NO_MICO_RTOS
+  uint32_t start_time = mico_get_time();
+#else
+  uint32_t start_time = mico_get_time_no_os();
+#endif
+
+  require_action_quiet( ( driver != NULL ) && ( data_in != NULL ) && ( max_size != 0 ) && ( frame_size != NULL ), exit, err = kParamErr);
+  require_action_quiet( driver->rx_buffer != NULL, exit, err = kUnsupportedErr);
+
+  *frame_size = 0;
+  limit = MIN( driver->rx_buffer->size / 2, max_size );
+
+  /* The interrupt wakes us up on a frame boundary, or when limit bytes are received without one */
+  driver->rx_frame_wait = true;
+  driver->rx_size       = limit;
+
+  while ( ( available = get_frame_size( driver, limit ) ) == 0 )
+  {
+#ifndef NO_MICO_RTOS
+    elapsed = mico_get_time() - start_time;
+#else
+    elapsed = mico_get_time_no_os() - start_time;
+#endif
+    if ( timeout_ms != MICO_NEVER_TIMEOUT && elapsed >= timeout_ms )
+    {
+      err = kTimeoutErr;
+      break;
+    }
+
+#ifndef NO_MICO_RTOS
+    err = mico_rtos_get_semaphore( &driver->rx_complete, ( timeout_ms == MICO_NEVER_TIMEOUT ) ? MICO_NEVER_TIMEOUT : timeout_ms - elapsed );
+    if ( err != kNoErr )
+      break;
+#else
+    driver->rx_complete = false;
+    while( driver->rx_complete == false && get_frame_size( driver, limit ) == 0 ){
+      if( timeout_ms != MICO_NEVER_TIMEOUT && mico_get_time_no_os() - start_time >= timeout_ms )
+        break;
+    }
+#endif
+    driver->rx_size = limit;
+  }
+
+  /* Reset rx_size to prevent semaphore being set while nothing waits for the data */
+  driver->rx_size       = 0;
+  driver->rx_frame_wait = false;
+  require_noerr_quiet( err, exit );
+
+  // The frame is already in the buffer
+  *frame_size = ring_buffer_read( driver->rx_buffer, data_in, available );
+
+exit:
+  return err;
+}
+
+/* Size of the frame at the head of ring buffer, 0 if no boundary is received and less than limit bytes are available */
+static uint32_t get_frame_size( platform_uart_driver_t* driver, uint32_t limit )
+{
+  ring_buffer_t* ring = driver->rx_buffer;
+  uint32_t head = ring->head;
+  uint32_t used = ring_buffer_used_space( ring );
+  uint32_t size = ( driver->rx_frame_tail + ring->size - head ) % ring->size;
+  uint32_t i;
+
+  /* Boundary is already consumed by a plain receive, or by a frame that reached limit */
+  if ( size > used )
+    size = 0;
+
+  /* Deliver delimited frames one by one, several may be received before the thread runs */
+  if ( driver->rx_delimiter >= 0 )
+  {
+    for ( i = 0; i < size; i++ )
+    {
+      if ( ring->buffer[ ( head + i ) % ring->size ] == (uint8_t) driver->rx_delimiter )
+      {
+        size = i + 1;
+        break;
+      }
+    }
+  }
+
+  if ( size == 0 && used >= limit )
+    size = limit;
+
+  return MIN( size, limit );
+}
+
 static void clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags )
 {
     if ( stream <= DMA1_Stream3 )
@@ -690,15 +881,53 @@ void RX_PIN_WAKEUP_handler(void *arg)
 void platform_uart_irq( platform_uart_driver_t* driver )
 {
   platform_uart_port_t* uart = (platform_uart_port_t*) driver->peripheral->port;
+  ring_buffer_t* ring = driver->rx_buffer;
+  uint32_t tail;
+  uint32_t boundary = driver->rx_frame_tail;
+  bool     idle = false;
+  bool     new_frame = false;
+
+  // Idle line flag is cleared by reading SR then DR, received data is already moved by DMA
+  if ( ( uart->SR & USART_SR_IDLE ) != 0 )
+  {
+      idle = true;
+      (void) uart->DR;
+  }
 
-  // Clear all interrupts. It's safe to do so because only RXNE interrupt is enabled
+  // Clear all interrupts. It's safe to do so because only RXNE and IDLE interrupts are enabled
   uart->SR = (uint16_t) ( uart->SR | 0xffff );
 
-  // Update tail
-  driver->rx_buffer->tail = driver->rx_buffer->size - driver->peripheral->rx_dma_config.stream->NDTR;
+  // Update tail, a frame ends on an idle line or after the last delimiter received
+  tail = ring->size - driver->peripheral->rx_dma_config.stream->NDTR;
+  if ( driver->rx_delimiter >= 0 )
+  {
+      uint32_t i;
+      for ( i = ring->tail; i != tail; i = ( i + 1 ) % ring->size )
+      {
+          if ( ring->buffer[i] == (uint8_t) driver->rx_delimiter )
+          {
+              boundary = ( i + 1 ) % ring->size;
+          }
+      }
+  }
+  else if ( idle == true )
+  {
+      boundary = tail;
+  }
+  ring_buffer_commit( ring, ( tail + ring->size - ring->tail ) % ring->size );
+
+  if ( boundary != driver->rx_frame_tail )
+  {
+      new_frame = true;
+      driver->rx_frame_tail = boundary;
+      if ( driver->rx_frame_callback != NULL )
+      {
+          driver->rx_frame_callback( driver->rx_frame_arg, ( boundary + ring->size - ring->head ) % ring->size );
+      }
+  }
 
-  // Notify thread if sufficient data are available
-  if ( ( driver->rx_size > 0 ) && ( ring_buffer_used_space( driver->rx_buffer ) >= driver->rx_size ) )
+  // Notify thread if sufficient data are available, or a frame is received while it waits for one
+  if ( ( driver->rx_size > 0 ) && ( ( ring_buffer_used_space( ring ) >= driver->rx_size ) || ( driver->rx_frame_wait == true && new_frame == true ) ) )
   {
       #ifndef NO_MICO_RTOS
       mico_rtos_set_semaphore( &driver->rx_complete );
@@ -715,27 +944,101 @@ void platform_uart_irq( platform_uart_driver_t* driver )
 
 void platform_uart_tx_dma_irq( platform_uart_driver_t* driver )
 {
-    if ( ( get_dma_irq_status( driver->peripheral->tx_dma_config.stream ) & driver->peripheral->tx_dma_config.complete_flags ) != 0 )
+    DMA_Stream_TypeDef* stream = driver->peripheral->tx_dma_config.stream;
+    uint32_t status = get_dma_irq_status( stream );
+    /* TEIF sits two bits below TCIF in the flag group of every stream */
+    uint32_t transfer_error_flag = driver->peripheral->tx_dma_config.complete_flags >> 2;
+    OSStatus result;
+
+    if ( ( status & driver->peripheral->tx_dma_config.error_flags ) != 0 )
+    {
+        clear_dma_interrupts( stream, driver->peripheral->tx_dma_config.error_flags );
+    }
+
+    if ( ( status & driver->peripheral->tx_dma_config.complete_flags ) != 0 )
+    {
+        clear_dma_interrupts( stream, driver->peripheral->tx_dma_config.complete_flags );
+        result = kNoErr;
+    }
+    else if ( ( status & transfer_error_flag ) != 0 )
+    {
+        /* The stream is disabled by hardware, the transfer will not complete */
+        result = kGeneralErr;
+    }
+    else
     {
-        clear_dma_interrupts( driver->peripheral->tx_dma_config.stream, driver->peripheral->tx_dma_config.complete_flags );
-        driver->last_transmit_result = kNoErr;
+        /* FIFO and direct mode errors do not stop the stream, TC still follows */
+        return;
     }
+    driver->last_transmit_result = result;
 
-    if ( ( get_dma_irq_status( driver->peripheral->tx_dma_config.stream ) & driver->peripheral->tx_dma_config.error_flags ) != 0 )
+#ifndef NO_MICO_RTOS
+    if ( driver->tx_queue_count == 0 )
     {
-        clear_dma_interrupts( driver->peripheral->tx_dma_config.stream, driver->peripheral->tx_dma_config.error_flags );
-        driver->last_transmit_result = kGeneralErr;
+        return;
     }
 
+    if ( result == kNoErr )
+    {
+        platform_uart_tx_desc_t* desc = &driver->tx_queue[ driver->tx_queue_head ];
+        platform_uart_tx_callback_t callback = desc->callback;
+        void* arg = desc->arg;
+
+        driver->tx_queue_head = ( driver->tx_queue_head + 1 ) % UART_TX_QUEUE_LENGTH;
+        driver->tx_queue_count--;
+
+        /* Arm the next transfer before anything else, so the line does not go idle between them */
+        if ( driver->tx_queue_count > 0 )
+        {
+            desc = &driver->tx_queue[ driver->tx_queue_head ];
+            start_transmit( driver, desc->data, desc->size );
+        }
+        else
+        {
+            USART_DMACmd( driver->peripheral->port, USART_DMAReq_Tx, DISABLE );
+            driver->tx_size = 0;
+        }
+
+        if ( callback != NULL )
+        {
+            callback( arg, result );
+        }
+        mico_rtos_set_semaphore( &driver->tx_slots );
+        platform_mcu_powersave_enable();
+    }
+    else
+    {
+        /* Abort the queue, data queued behind a lost transfer would arrive out of order.
+         * Descriptors are taken off first, so callbacks may queue new transfers. */
+        platform_uart_tx_desc_t failed[ UART_TX_QUEUE_LENGTH ];
+        uint8_t count = driver->tx_queue_count;
+        uint8_t i;
+
+        for ( i = 0; i < count; i++ )
+        {
+            failed[ i ] = driver->tx_queue[ ( driver->tx_queue_head + i ) % UART_TX_QUEUE_LENGTH ];
+        }
+        driver->tx_queue_head = ( driver->tx_queue_head + count ) % UART_TX_QUEUE_LENGTH;
+        driver->tx_queue_count = 0;
+        USART_DMACmd( driver->peripheral->port, USART_DMAReq_Tx, DISABLE );
+        driver->tx_size = 0;
+
+        for ( i = 0; i < count; i++ )
+        {
+            if ( failed[ i ].callback != NULL )
+            {
+                failed[ i ].callback( failed[ i ].arg, result );
+            }
+            mico_rtos_set_semaphore( &driver->tx_slots );
+            platform_mcu_powersave_enable();
+        }
+    }
+#else
     if ( driver->tx_size > 0 )
     {
-        #ifndef NO_MICO_RTOS
-        /* Set semaphore regardless of result to prevent waiting thread from locking up */
-        mico_rtos_set_semaphore( &driver->tx_complete );
-        #else
         driver->tx_complete = true;
-        #endif
     }
+#endif
 }
 
 void platform_uart_rx_dma_irq( platform_uart_driver_t* driver )
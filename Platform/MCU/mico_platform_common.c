@@ -63,6 +63,9 @@
 
 extern OSStatus mico_platform_init      ( void );
 
+static OSStatus uart_recv_length_prefixed_frame( platform_uart_driver_t* driver, const mico_uart_framing_t* framing, uint8_t* data, uint32_t size, uint32_t* frame_size, uint32_t timeout );
+static OSStatus uart_recv_frame_by_gap         ( platform_uart_driver_t* driver, uint32_t gap, uint8_t* data, uint32_t size, uint32_t* frame_size, uint32_t timeout );
+
 /******************************************************
 *               Variable Definitions
 ******************************************************/
@@ -80,6 +83,9 @@ extern WEAK platform_spi_slave_driver_t platform_spi_slave_drivers[];
 extern const platform_flash_t      platform_flash_peripherals[];
 extern platform_flash_driver_t     platform_flash_drivers[];
 
+/* Zero initialised, UART ports end frames on an idle line until MicoUartSetFraming is called */
+static mico_uart_framing_t         uart_framing[MICO_UART_NONE];
+
 const char* flash_name[] =
 { 
 #ifdef USE_MICO_SPI_FLASH
@@ -457,6 +463,14 @@ OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size )
   return (OSStatus) platform_uart_transmit_bytes( &platform_uart_drivers[uart], (const uint8_t*) data, size );
 }
 
+OSStatus MicoUartSendAsync( mico_uart_t uart, const void* data, uint32_t size, mico_uart_tx_callback_t callback, void* arg )
+{
+  if ( uart >= MICO_UART_NONE )
+    return kUnsupportedErr;
+
+  return (OSStatus) platform_uart_transmit_bytes_async( &platform_uart_drivers[uart], (const uint8_t*) data, size, callback, arg );
+}
+
 OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t timeout )
 {
   if ( uart >= MICO_UART_NONE )
@@ -473,6 +487,136 @@ uint32_t MicoUartGetLengthInBuffer( mico_uart_t uart )
   return (OSStatus) platform_uart_get_length_in_buffer( &platform_uart_drivers[uart] );
 }
 
+OSStatus MicoUartSetFraming( mico_uart_t uart, const mico_uart_framing_t* framing )
+{
+  OSStatus err;
+  int32_t delimiter = -1;
+  mico_uart_frame_callback_t callback;
+
+  if ( uart >= MICO_UART_NONE )
+    return kUnsupportedErr;
+
+  if ( framing == NULL )
+    return kParamErr;
+
+  callback = framing->callback;
+  if ( framing->mode == UART_FRAME_LENGTH_PREFIX && ( framing->length_size == 0 || framing->length_size > 2 ) )
+    return kParamErr;
+
+  uart_framing[uart] = *framing;
+
+  /* Length prefixed frames are cut by the reader, the driver only finds boundaries for the other modes */
+  if ( framing->mode == UART_FRAME_DELIMITER )
+    delimiter = framing->delimiter;
+  else if ( framing->mode == UART_FRAME_LENGTH_PREFIX )
+    callback = NULL;
+
+  err = platform_uart_set_framing( &platform_uart_drivers[uart], delimiter, callback, framing->arg );
+
+  /* Idle line falls back to an inter-byte gap, but delimiters and callbacks need the driver */
+  if ( err == kUnsupportedErr && framing->mode != UART_FRAME_DELIMITER && callback == NULL )
+    err = kNoErr;
+
+  return err;
+}
+
+OSStatus MicoUartRecvFrame( mico_uart_t uart, void* data, uint32_t size, uint32_t* frame_size, uint32_t timeout )
+{
+  OSStatus err;
+  const mico_uart_framing_t* framing;
+
+  if ( uart >= MICO_UART_NONE )
+    return kUnsupportedErr;
+
+  framing = &uart_framing[uart];
+
+  if ( framing->mode == UART_FRAME_LENGTH_PREFIX )
+    return uart_recv_length_prefixed_frame( &platform_uart_drivers[uart], framing, (uint8_t*)data, size, frame_size, timeout );
+
+  err = platform_uart_receive_frame( &platform_uart_drivers[uart], (uint8_t*)data, size, frame_size, timeout );
+  if ( err == kUnsupportedErr && framing->mode == UART_FRAME_IDLE_LINE )
+    err = uart_recv_frame_by_gap( &platform_uart_drivers[uart], framing->idle_gap ? framing->idle_gap : UART_FRAME_DEFAULT_IDLE_GAP, (uint8_t*)data, size, frame_size, timeout );
+
+  return err;
+}
+
+static OSStatus uart_recv_length_prefixed_frame( platform_uart_driver_t* driver, const mico_uart_framing_t* framing, uint8_t* data, uint32_t size, uint32_t* frame_size, uint32_t timeout )
+{
+  OSStatus err = kNoErr;
+  uint32_t header = framing->length_offset + framing->length_size;
+  uint32_t length, chunk;
+
+  *frame_size = 0;
+  require_action_quiet( header <= size, exit, err = kSizeErr );
+
+  err = platform_uart_receive_bytes( driver, data, header, timeout );
+  require_noerr_quiet( err, exit );
+
+  length = data[framing->length_offset];
+  if ( framing->length_size == 2 )
+    length += (uint32_t)data[framing->length_offset + 1] << 8;
+  length += framing->length_extra;
+
+  if ( header + length > size )
+  {
+    /* Drop the frame that does not fit to stay in step with the sender */
+    while ( length > 0 )
+    {
+      chunk = MIN( length, size );
+      err = platform_uart_receive_bytes( driver, data, chunk, timeout );
+      require_noerr_quiet( err, exit );
+      length -= chunk;
+    }
+    err = kSizeErr;
+    goto exit;
+  }
+
+  if ( length > 0 )
+  {
+    err = platform_uart_receive_bytes( driver, data + header, length, timeout );
+    require_noerr_quiet( err, exit );
+  }
+  *frame_size = header + length;
+
+exit:
+  return err;
+}
+
+/* For MCUs without idle line detection, a frame ends when nothing is received for gap milliseconds. Waiting is left 
+   to platform_uart_receive_bytes, which blocks on the driver's receive semaphore (or its own loop in NO_MICO_RTOS 
+   builds), so nothing is polled here. */
+static OSStatus uart_recv_frame_by_gap( platform_uart_driver_t* driver, uint32_t gap, uint8_t* data, uint32_t size, uint32_t* frame_size, uint32_t timeout )
+{
+  OSStatus err = kNoErr;
+  uint32_t length, chunk;
+
+  *frame_size = 0;
+
+  /* The first byte may take up to timeout, every following byte at most gap */
+  err = platform_uart_receive_bytes( driver, data, 1, timeout );
+  require_noerr_quiet( err, exit );
+  length = 1;
+
+  while ( length < size )
+  {
+    chunk = MIN( platform_uart_get_length_in_buffer( driver ), size - length );
+    if ( chunk == 0 )
+      chunk = 1;
+    err = platform_uart_receive_bytes( driver, data + length, chunk, gap );
+    if ( err == kTimeoutErr )
+    {
+      err = kNoErr;
+      break;
+    }
+    require_noerr_quiet( err, exit );
+    length += chunk;
+  }
+  *frame_size = length;
+
+exit:
+  return err;
+}
+
 OSStatus MicoRandomNumberRead( void *inBuffer, int inByteCount )
 {
   return (OSStatus) platform_random_number_read( inBuffer, inByteCount );
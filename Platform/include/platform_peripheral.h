@@ -190,6 +190,16 @@ typedef enum
  */
 typedef void (*platform_gpio_irq_callback_t)( void* arg );
 
+/**
+ * UART frame boundary callback handler, called from the UART interrupt
+ */
+typedef void (*platform_uart_frame_callback_t)( void* arg, uint32_t frame_size );
+
+/**
+ * UART transmit complete callback handler, may be called from the UART interrupt
+ */
+typedef void (*platform_uart_tx_callback_t)( void* arg, OSStatus result );
+
 /******************************************************
  *                    Structures
  ******************************************************/
@@ -469,6 +479,16 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver );
 OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size );
 
 
+/**
+ * Queue data for transmit over the specified UART port and return at once.
+ * data_out must stay valid until callback is called with the result, callback
+ * is only called if kNoErr is returned.
+ *
+ * @return @ref OSStatus, kNoResourcesErr if the transmit queue is full
+ */
+OSStatus platform_uart_transmit_bytes_async( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size, platform_uart_tx_callback_t callback, void* arg );
+
+
 /**
  * Receive data over the specified UART port
  *
@@ -484,6 +504,26 @@ OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* d
  */
 OSStatus platform_uart_get_length_in_buffer( platform_uart_driver_t* driver );
 
+
+/**
+ * Select how received data is split into frames on the specified UART port
+ *
+ * @param[in] delimiter : byte that ends a frame, or -1 to end a frame when the line goes idle
+ * @param[in] callback  : optional, called from the UART interrupt when a frame boundary is received
+ *
+ * @return @ref OSStatus, kUnsupportedErr if the MCU can not detect frame boundaries
+ */
+OSStatus platform_uart_set_framing( platform_uart_driver_t* driver, int32_t delimiter, platform_uart_frame_callback_t callback, void* arg );
+
+
+/**
+ * Receive one frame over the specified UART port, returns as soon as a frame boundary
+ * is received or max_size bytes are available. Requires a receive ring buffer.
+ *
+ * @return @ref OSStatus, kUnsupportedErr if the MCU can not detect frame boundaries
+ */
+OSStatus platform_uart_receive_frame( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t max_size, uint32_t* frame_size, uint32_t timeout_ms );
+
 /**
  * Initialise the specified SPI interface
  *
@@ -91,6 +91,54 @@ static inline void AES_CTR_Increment( uint8_t *inCounter )
     }
 }
 
+//===========================================================================================================================
+//  AES_CTR_Keystream
+//===========================================================================================================================
+
+// Generates inCount blocks of keystream and advances the counter past them.
+
+static OSStatus AES_CTR_Keystream( AES_CTR_Context *inContext, uint8_t *outKeystream, size_t inCount )
+{
+    OSStatus            err;
+    size_t              i;
+    
+#if( AES_UTILS_USE_COMMON_CRYPTO || AES_UTILS_USE_GLADMAN_AES )
+    // Lay out the counter blocks and encrypt them in place with one call.
+    
+    for( i = 0; i < inCount; ++i )
+    {
+        memcpy( &outKeystream[ i * kAES_CTR_Size ], inContext->ctr, kAES_CTR_Size );
+        AES_CTR_Increment( inContext->ctr );
+    }
+    #if( AES_UTILS_USE_COMMON_CRYPTO )
+        err = CCCryptorUpdate( inContext->cryptor, outKeystream, inCount * kAES_CTR_Size, outKeystream, 
+            inCount * kAES_CTR_Size, &i );
+        require_noerr( err, exit );
+        require_action( i == ( inCount * kAES_CTR_Size ), exit, err = kSizeErr );
+    #else
+        aes_ecb_encrypt( outKeystream, outKeystream, (int)( inCount * kAES_CTR_Size ), &inContext->ctx );
+    #endif
+#else
+    for( i = 0; i < inCount; ++i )
+    {
+        #if( AES_UTILS_USE_MICO_AES )
+            AesEncryptDirect( &inContext->ctx, &outKeystream[ i * kAES_CTR_Size ], inContext->ctr );
+        #elif( AES_UTILS_USE_USSL )
+            aes_crypt_ecb( &inContext->ctx, AES_ENCRYPT, inContext->ctr, &outKeystream[ i * kAES_CTR_Size ] );
+        #else
+            AES_encrypt( inContext->ctr, &outKeystream[ i * kAES_CTR_Size ], &inContext->key );
+        #endif
+        AES_CTR_Increment( inContext->ctr );
+    }
+#endif
+    err = kNoErr;
+    
+#if( AES_UTILS_USE_COMMON_CRYPTO )
+exit:
+#endif
+    return( err );
+}
+
 //===========================================================================================================================
 //  AES_CTR_Update
 //===========================================================================================================================
@@ -103,6 +151,8 @@ OSStatus    AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_
     uint8_t *           buf;
     size_t              used;
     size_t              i;
+    size_t              n;
+    uint32_t            keystream[ ( AES_UTILS_CTR_BATCH_BLOCKS * kAES_CTR_Size ) / 4 ];
     
     // inSrc and inDst may be the same, but otherwise, the buffers must not overlap.
     
@@ -125,52 +175,41 @@ OSStatus    AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_
     }
     inContext->used = used;
     
-    // Process whole blocks.
+    // Process whole blocks, a batch of keystream at a time. Word aligned buffers are XOR'd 32 bits at a time.
     
     while( inLen >= kAES_CTR_Size )
     {
-        #if( AES_UTILS_USE_COMMON_CRYPTO )
-            err = CCCryptorUpdate( inContext->cryptor, inContext->ctr, kAES_CTR_Size, buf, kAES_CTR_Size, &i );
-            require_noerr( err, exit );
-            require_action( i == kAES_CTR_Size, exit, err = kSizeErr );
-        #elif( AES_UTILS_USE_GLADMAN_AES )
-            aes_ecb_encrypt( inContext->ctr, buf, kAES_CTR_Size, &inContext->ctx );
-        #elif( AES_UTILS_USE_MICO_AES )
-            AesEncryptDirect( &inContext->ctx, buf, inContext->ctr );
-        #elif( AES_UTILS_USE_USSL )
-            aes_crypt_ecb( &inContext->ctx, AES_ENCRYPT, inContext->ctr, buf );
-        #else
-            AES_encrypt( inContext->ctr, buf, &inContext->key );
-        #endif
-        AES_CTR_Increment( inContext->ctr );
+        n = inLen / kAES_CTR_Size;
+        if( n > AES_UTILS_CTR_BATCH_BLOCKS ) n = AES_UTILS_CTR_BATCH_BLOCKS;
+        err = AES_CTR_Keystream( inContext, (uint8_t *) keystream, n );
+        require_noerr( err, exit );
+        n *= kAES_CTR_Size;
         
-        for( i = 0; i < kAES_CTR_Size; ++i )
+        if( ( ( (uintptr_t) src | (uintptr_t) dst ) & 3 ) == 0 )
+        {
+            for( i = 0; i < ( n / 4 ); ++i )
+            {
+                ( (uint32_t *) dst )[ i ] = ( (const uint32_t *) src )[ i ] ^ keystream[ i ];
+            }
+        }
+        else
         {
-            dst[ i ] = src[ i ] ^ buf[ i ];
+            for( i = 0; i < n; ++i )
+            {
+                dst[ i ] = src[ i ] ^ ( (const uint8_t *) keystream )[ i ];
+            }
         }
-        src   += kAES_CTR_Size;
-        dst   += kAES_CTR_Size;
-        inLen -= kAES_CTR_Size;
+        src   += n;
+        dst   += n;
+        inLen -= n;
     }
     
     // Process any trailing sub-block bytes. Extra key material is buffered for next time.
     
     if( inLen > 0 )
     {
-        #if( AES_UTILS_USE_COMMON_CRYPTO )
-            err = CCCryptorUpdate( inContext->cryptor, inContext->ctr, kAES_CTR_Size, buf, kAES_CTR_Size, &i );
-            require_noerr( err, exit );
-            require_action( i == kAES_CTR_Size, exit, err = kSizeErr );
-        #elif( AES_UTILS_USE_GLADMAN_AES )
-            aes_ecb_encrypt( inContext->ctr, buf, kAES_CTR_Size, &inContext->ctx );
-        #elif( AES_UTILS_USE_MICO_AES )
-            AesEncryptDirect( &inContext->ctx, buf, inContext->ctr );
-        #elif( AES_UTILS_USE_USSL )
-            aes_crypt_ecb( &inContext->ctx, AES_ENCRYPT, inContext->ctr, buf );
-        #else
-            AES_encrypt( inContext->ctr, buf, &inContext->key );
-        #endif
-        AES_CTR_Increment( inContext->ctr );
+        err = AES_CTR_Keystream( inContext, buf, 1 );
+        require_noerr( err, exit );
         
         for( i = 0; i < inLen; ++i )
         {
@@ -186,9 +225,7 @@ OSStatus    AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_
     }
     err = kNoErr;
     
-#if( AES_UTILS_USE_COMMON_CRYPTO )
 exit:
-#endif
     return( err );
 }
 
@@ -579,18 +616,25 @@ OSStatus    AES_ECB_Update( AES_ECB_Context *inContext, const void *inSrc, size_
     
     src = (const uint8_t *) inSrc;
     dst = (uint8_t *) inDst;
-    for( n = inLen / kAES_ECB_Size; n > 0; --n )
+    n   = inLen / kAES_ECB_Size;
+    
+    // Libraries with a multi-block ECB call get the whole run of blocks at once.
+    
+#if( AES_UTILS_USE_COMMON_CRYPTO )
     {
-        #if( AES_UTILS_USE_COMMON_CRYPTO )
-            size_t      len;
-            
-            err = CCCryptorUpdate( inContext->cryptor, src, kAES_ECB_Size, dst, kAES_ECB_Size, &len );
-            require_noerr( err, exit );
-            check( len == kAES_ECB_Size );
-        #elif( AES_UTILS_USE_GLADMAN_AES )
-            if( inContext->encrypt )    aes_ecb_encrypt( src, dst, kAES_ECB_Size, &inContext->ctx.encrypt );
-            else                        aes_ecb_decrypt( src, dst, kAES_ECB_Size, &inContext->ctx.decrypt );
-        #elif( AES_UTILS_USE_MICO_AES )
+        size_t      len;
+        
+        err = CCCryptorUpdate( inContext->cryptor, src, n * kAES_ECB_Size, dst, n * kAES_ECB_Size, &len );
+        require_noerr( err, exit );
+        check( len == ( n * kAES_ECB_Size ) );
+    }
+#elif( AES_UTILS_USE_GLADMAN_AES )
+    if( inContext->encrypt )    aes_ecb_encrypt( src, dst, (int)( n * kAES_ECB_Size ), &inContext->ctx.encrypt );
+    else                        aes_ecb_decrypt( src, dst, (int)( n * kAES_ECB_Size ), &inContext->ctx.decrypt );
+#else
+    for( ; n > 0; --n )
+    {
+        #if( AES_UTILS_USE_MICO_AES )
             AesEncryptDirect( &inContext->ctx, dst, src );
         #elif( AES_UTILS_USE_USSL )
             aes_crypt_ecb( &inContext->ctx, inContext->mode, (unsigned char *) src, dst );
@@ -600,6 +644,7 @@ OSStatus    AES_ECB_Update( AES_ECB_Context *inContext, const void *inSrc, size_
         src += kAES_ECB_Size;
         dst += kAES_ECB_Size;
     }
+#endif
     err = kNoErr;
     
 #if( AES_UTILS_USE_COMMON_CRYPTO )
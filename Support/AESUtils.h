@@ -124,6 +124,11 @@
 
 #define kAES_CTR_Size       16
 
+// Counter blocks encrypted per batch by AES_CTR_Update, the keystream batch lives on the stack.
+#if( !defined( AES_UTILS_CTR_BATCH_BLOCKS ) )
+    #define AES_UTILS_CTR_BATCH_BLOCKS      4
+#endif
+
 typedef struct
 {
 #if( AES_UTILS_USE_COMMON_CRYPTO )
@@ -58,11 +58,13 @@ int SocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader )
   
   buf = inHeader->buf;
   dst = buf + inHeader->len;
-  lim = buf + sizeof( inHeader->buf );
+  lim = buf + kHTTPHeaderMaxLen;
   for( ;; )
   {
-    if(findHeader( inHeader,  &end ))
-      break ;
+    err = HTTPHeaderParseIncremental( inHeader, &end );
+    if( err == kNoErr ) break;
+    require( err == kInProgressErr, exit );
+    require_action( dst < lim, exit, err = kNoSpaceErr );
     n = read( inSock, dst, (size_t)( lim - dst ) );
     if(      n  > 0 ) len = (size_t) n;
     else  { err = kConnectionErr; goto exit; }
@@ -71,57 +73,47 @@ int SocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader )
   }
   
   inHeader->len = (size_t)( end - buf );
-  err = HTTPHeaderParse( inHeader );
-  require_noerr( err, exit );
-  inHeader->extraDataLen = (size_t)( dst - end );
   if(inHeader->extraDataPtr) {
     free((uint8_t *)inHeader->extraDataPtr);
     inHeader->extraDataPtr = 0;
   }
+  inHeader->extraDataLen = 0;
 
-  /* For chunked extra data without content length */
-  if(inHeader->chunkedData == true){
-    inHeader->chunkedDataBufferLen = (inHeader->extraDataLen > READ_LENGTH)? inHeader->extraDataLen:READ_LENGTH;
-    inHeader->chunkedDataBufferPtr = calloc(inHeader->chunkedDataBufferLen, sizeof(uint8_t)); //Make extra data buffer larger than chunk length
-    require_action(inHeader->chunkedDataBufferPtr, exit, err = kNoMemoryErr);
-    memcpy((uint8_t *)inHeader->chunkedDataBufferPtr, end, inHeader->extraDataLen);
-    inHeader->extraDataPtr = inHeader->chunkedDataBufferPtr;
+  /* Application pulls the body with SocketReadHTTPBodyWindow */
+  if( inHeader->streamBody == true || HTTPHeaderBodyComplete( inHeader ) )
     return kNoErr;
-  }
-
-  /* Extra data with content length */
 
-  if (inHeader->contentLength != 0){ //Content length >0, create a memory buffer (Content length) and store extra data
-    size_t copyDataLen = (inHeader->contentLength >= inHeader->extraDataLen)? inHeader->extraDataLen : inHeader->contentLength;
-    if(inHeader->onReceivedDataCallback && (inHeader->onReceivedDataCallback)(inHeader, 0, (uint8_t *)end, copyDataLen, inHeader->userContext)==kNoErr){
+  /* Chunked data is always delivered to onReceivedDataCallback, other data only if the callback accepts the first 
+     bytes received with the header. */
+  if( inHeader->chunkedData == true ){
+    inHeader->isCallbackSupported = true;
+  }else{
+    len = ( inHeader->contentLength >= inHeader->stageLen )? inHeader->stageLen : (size_t)inHeader->contentLength;
+    if(inHeader->onReceivedDataCallback && (inHeader->onReceivedDataCallback)(inHeader, 0, (uint8_t *)buf + inHeader->stagePos, len, inHeader->userContext)==kNoErr){
       inHeader->isCallbackSupported = true;
-      inHeader->extraDataPtr = calloc(READ_LENGTH, sizeof(uint8_t));
-      require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
+      inHeader->stagePos += len;
+      inHeader->stageLen -= len;
+      inHeader->bodyReadLen = len;
     }else{
       inHeader->isCallbackSupported = false;
-      inHeader->extraDataPtr = calloc(inHeader->contentLength , sizeof(uint8_t));
-      require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
-      memcpy((uint8_t *)inHeader->extraDataPtr, end, copyDataLen);
     }
-    err = kNoErr;
-  } /* Extra data without content length, data is ended by conntection close */
-  // else if(inHeader->extraDataLen != 0){ //Content length =0, but extra data length >0, create a memory buffer (1500)and store extra data
-  //   inHeader->dataEndedbyClose = true;
-  //   inHeader->extraDataPtr = calloc(1500, sizeof(uint8_t));
-  //   require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
-  //   memcpy((uint8_t *)inHeader->extraDataPtr, end, inHeader->extraDataLen);
-  //   (inHeader->onReceivedDataCallback)(inHeader, 0, (uint8_t *)inHeader->extraDataPtr, inHeader->extraDataLen, inHeader->userContext);
-
-  //   err = kNoErr;
-  // }
-  else
-    return kNoErr;
+  }
+
+  if(inHeader->isCallbackSupported == true){
+    inHeader->extraDataPtr = calloc(READ_LENGTH, sizeof(uint8_t));
+    require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
+  }else{
+    /* Whole body in one buffer, NUL terminated for string consumers */
+    require_action(inHeader->contentLength <= kHTTPBodyMaxLen, exit, err = kSizeErr);
+    inHeader->extraDataPtr = calloc((size_t)inHeader->contentLength + 1, sizeof(uint8_t));
+    require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
+  }
+  err = kNoErr;
   
 exit:
   return err;
 }
 
-
 bool findHeader ( HTTPHeader_t *inHeader,  char **  outHeaderEnd)
 {
   char *dst = inHeader->buf + inHeader->len;
@@ -164,200 +156,226 @@ bool findHeader ( HTTPHeader_t *inHeader,  char **  outHeaderEnd)
   return false;
 }
 
-OSStatus SocketReadHTTPBody( int inSock, HTTPHeader_t *inHeader )
+static int _SocketReadWithTimeout( void *inContext, int inSock, void *inBuf, size_t inLen )
 {
-  OSStatus err = kParamErr;
-  ssize_t readResult;
-  int selectResult;
   fd_set readSet;
-  size_t    lastChunkLen, chunckheaderLen; 
-  char *nextPackagePtr;
   struct timeval_t t;
-  size_t          readLength;
-  uint32_t pos = 0;
+  UNUSED_PARAMETER(inContext);
+
   t.tv_sec = 5;
   t.tv_usec = 0;
-  
-  require( inHeader, exit );
-  err = kNotReadableErr;
-  
   FD_ZERO( &readSet );
   FD_SET( inSock, &readSet );
+  if( select( inSock + 1, &readSet, NULL, NULL, &t ) < 1 )
+    return -1;
+  return read( inSock, inBuf, inLen );
+}
 
-  /* Chunked data without content length */
-  if( inHeader->chunkedData == true ){
-    do{
-      /* Find Chunk data length */
-      while ( findChunkedDataLength( inHeader->chunkedDataBufferPtr, inHeader->extraDataLen, &inHeader->extraDataPtr ,"%llu", &inHeader->contentLength ) == false){
-        require_action(inHeader->extraDataLen < inHeader->chunkedDataBufferLen, exit, err=kMalformedErr );
+/* Take up to inLen raw bytes, bytes already received with the header first, then from the connection */
+static OSStatus _HTTPReadRaw( int inSock, HTTPHeader_t *inHeader, HTTPReadFunc inReadFunc, void *inReadContext, 
+                              uint8_t *inBuf, size_t inLen, size_t *outLen )
+{
+  OSStatus err = kNoErr;
+  int readResult;
+
+  if( inHeader->stageLen ){
+    *outLen = ( inHeader->stageLen < inLen )? inHeader->stageLen : inLen;
+    memcpy( inBuf, inHeader->buf + inHeader->stagePos, *outLen );
+    inHeader->stagePos += *outLen;
+    inHeader->stageLen -= *outLen;
+  }else{
+    readResult = inReadFunc( inReadContext, inSock, inBuf, inLen );
+    require_action( readResult > 0, exit, err = kConnectionErr );
+    *outLen = (size_t)readResult;
+  }
+
+exit:
+  return err;
+}
 
-        selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-        require_action( selectResult >= 1, exit, err = kNotReadableErr );
+/* Chunk framing (size lines, CRLFs and trailers) is received into the free space of buf behind the header. Bytes 
+   beyond the end of the body stay there and become the start of the next message in HTTPHeaderClear. A header is 
+   at most kHTTPHeaderMaxLen bytes, so at least kHTTPHeaderStageReserve bytes are always free here. */
+static OSStatus _HTTPFillStage( int inSock, HTTPHeader_t *inHeader, HTTPReadFunc inReadFunc, void *inReadContext )
+{
+  OSStatus err = kNoErr;
+  int readResult;
 
-        readResult = read( inSock, inHeader->chunkedDataBufferPtr + inHeader->extraDataLen, (size_t)( inHeader->chunkedDataBufferLen - inHeader->extraDataLen ) );
+  inHeader->stagePos = inHeader->len;
+  require_action( inHeader->stagePos < sizeof( inHeader->buf ), exit, err = kNoSpaceErr );
+  readResult = inReadFunc( inReadContext, inSock, inHeader->buf + inHeader->stagePos, sizeof( inHeader->buf ) - inHeader->stagePos );
+  require_action( readResult > 0, exit, err = kConnectionErr );
+  inHeader->stageLen = (size_t)readResult;
 
-        if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-        else { err = kConnectionErr; goto exit; }
-      }
+exit:
+  return err;
+}
+
+/* Run the chunk framing state machine over the staged bytes until chunk data is due, the body ends or the stage is empty */
+static OSStatus _HTTPDecodeChunkFraming( HTTPHeader_t *inHeader )
+{
+  OSStatus err = kNoErr;
+  char c;
+
+  while( inHeader->stageLen && inHeader->chunkState != kHTTPChunkState_Data && inHeader->chunkState != kHTTPChunkState_Done ){
+    c = inHeader->buf[ inHeader->stagePos++ ];
+    inHeader->stageLen--;
+
+    switch( inHeader->chunkState ){
+      case kHTTPChunkState_Size:
+        if( c >= '0' && c <= '9' )      c = c - '0';
+        else if( c >= 'a' && c <= 'f' ) c = c - 'a' + 10;
+        else if( c >= 'A' && c <= 'F' ) c = c - 'A' + 10;
+        else if( c == ';' || c == ' ' || c == '\t' || c == '\r' ){
+          inHeader->chunkState = kHTTPChunkState_Extension;
+          break;
+        }
+        else if( c == '\n' ){
+          inHeader->chunkState = ( inHeader->chunkRemaining )? kHTTPChunkState_Data : kHTTPChunkState_Trailer;
+          break;
+        }
+        else{
+          err = kMalformedErr;
+          goto exit;
+        }
+        require_action( inHeader->chunkRemaining < ( (uint64_t)1 << 56 ), exit, err = kMalformedErr );
+        inHeader->chunkRemaining = ( inHeader->chunkRemaining << 4 ) | (uint64_t)c;
+        break;
+
+      case kHTTPChunkState_Extension:
+        if( c == '\n' )
+          inHeader->chunkState = ( inHeader->chunkRemaining )? kHTTPChunkState_Data : kHTTPChunkState_Trailer;
+        break;
+
+      case kHTTPChunkState_DataEnd:
+        if( c == '\n' ){
+          inHeader->chunkState = kHTTPChunkState_Size;
+          inHeader->chunkRemaining = 0;
+        }else
+          require_action( c == '\r', exit, err = kMalformedErr );
+        break;
+
+      case kHTTPChunkState_Trailer: //chunkRemaining counts the length of the current trailer line
+        if( c == '\n' ){
+          if( inHeader->chunkRemaining == 0 ) inHeader->chunkState = kHTTPChunkState_Done;
+          inHeader->chunkRemaining = 0;
+        }else if( c != '\r' )
+          inHeader->chunkRemaining++;
+        break;
+
+      default:
+        break;
+    }
+  }
 
-      chunckheaderLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr;
+exit:
+  return err;
+}
 
-      /* Check the last chunk */
-      if(inHeader->contentLength == 0){ 
-        while( findCRLF( inHeader->extraDataPtr, inHeader->extraDataLen - chunckheaderLen, &nextPackagePtr ) == false){ //find CRLF
-          selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-          require_action( selectResult >= 1, exit, err = kNotReadableErr );
+OSStatus HTTPReadBodyWindow( int inSock, HTTPHeader_t *inHeader, HTTPReadFunc inReadFunc, void *inReadContext, 
+                             uint8_t *inWindow, size_t inWindowLen, size_t *outLen )
+{
+  OSStatus err = kParamErr;
+  uint64_t remaining;
 
-          readResult = read( inSock,
-                            (uint8_t *)( inHeader->extraDataPtr + inHeader->extraDataLen - chunckheaderLen ),
-                            256 - inHeader->extraDataLen ); //Assume chunk trailer length is less than 256 (256 is the min chunk buffer, maybe dangerous
+  require( inHeader && inWindow && inWindowLen && outLen, exit );
+  *outLen = 0;
+  if( inReadFunc == NULL ) inReadFunc = _SocketReadWithTimeout;
 
-          if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-          else { err = kConnectionErr; goto exit; }
-          (inHeader->onReceivedDataCallback)(inHeader, inHeader->extraDataLen - readResult, (uint8_t *)inHeader->extraDataPtr, readResult, inHeader->userContext);
-        }
+  if( inHeader->chunkedData == false ){
+    remaining = inHeader->contentLength - inHeader->bodyReadLen;
+    if( remaining == 0 ){
+      err = kNoErr;
+      goto exit;
+    }
+    err = _HTTPReadRaw( inSock, inHeader, inReadFunc, inReadContext, inWindow, 
+                        ( remaining < inWindowLen )? (size_t)remaining : inWindowLen, outLen );
+    require_noerr( err, exit );
+  }else{
+    for( ;; ){
+      err = _HTTPDecodeChunkFraming( inHeader );
+      require_noerr( err, exit );
 
-        err = kNoErr;
+      if( inHeader->chunkState == kHTTPChunkState_Done )
         goto exit;
-      } 
-      else{ // Read chunk data
-        /* Chunk package already exist, callback, move to buffer's head */
-        if( inHeader->extraDataLen >= inHeader->contentLength + chunckheaderLen + 2 ){
-          require_action( *(inHeader->extraDataPtr + inHeader->contentLength ) == '\r' &&
-                          *(inHeader->extraDataPtr + inHeader->contentLength + 1 ) == '\n', 
-                          exit, err = kMalformedErr);
-
-          (inHeader->onReceivedDataCallback)(inHeader,  pos, 
-                                                        (uint8_t *)inHeader->extraDataPtr, 
-                                                        inHeader->contentLength, 
-                                                        inHeader->userContext);
-          pos+=inHeader->contentLength;
-
-          /* Move next chunk to chunked data buffer header point */
-          lastChunkLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr + inHeader->contentLength;
-          if(inHeader->contentLength) lastChunkLen += 2;  //Last chunck data has a CRLF tail
-          memmove( inHeader->chunkedDataBufferPtr, inHeader->chunkedDataBufferPtr + lastChunkLen, inHeader->chunkedDataBufferLen - lastChunkLen  );
-          inHeader->extraDataLen -= lastChunkLen;
-        }
-        /* Chunck exist without the last LF, generate callback abd recv LF */
-        /* Callback , read LF */
-        else if(inHeader->extraDataLen == inHeader->contentLength + chunckheaderLen +1){ //recv CR 
 
-          require_action( *(inHeader->chunkedDataBufferPtr + inHeader->extraDataLen - 1) == '\r' ,
-                          exit, err = kMalformedErr);
+      if( inHeader->chunkState == kHTTPChunkState_Data ){
+        remaining = inHeader->chunkRemaining;
+        err = _HTTPReadRaw( inSock, inHeader, inReadFunc, inReadContext, inWindow, 
+                            ( remaining < inWindowLen )? (size_t)remaining : inWindowLen, outLen );
+        require_noerr( err, exit );
+        inHeader->chunkRemaining -= *outLen;
+        if( inHeader->chunkRemaining == 0 ) inHeader->chunkState = kHTTPChunkState_DataEnd;
+        break;
+      }
 
-          (inHeader->onReceivedDataCallback)(inHeader,  pos, 
-                                                        (uint8_t *)inHeader->extraDataPtr, 
-                                                        inHeader->extraDataLen - chunckheaderLen-1, 
-                                                        inHeader->userContext);
-          pos+=inHeader->extraDataLen - chunckheaderLen-1;
-          selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-          require_action( selectResult >= 1, exit, err = kNotReadableErr );
+      err = _HTTPFillStage( inSock, inHeader, inReadFunc, inReadContext );
+      require_noerr( err, exit );
+    }
+  }
+  inHeader->bodyReadLen += *outLen;
 
-          readResult = read( inSock, (uint8_t *)inHeader->extraDataPtr, 1);
+exit:
+  return err;
+}
 
-          if( readResult  > 0 ) {}
-          else { err = kConnectionErr; goto exit; }
+OSStatus SocketReadHTTPBodyWindow( int inSock, HTTPHeader_t *inHeader, uint8_t *inWindow, size_t inWindowLen, size_t *outLen )
+{
+  return HTTPReadBodyWindow( inSock, inHeader, NULL, NULL, inWindow, inWindowLen, outLen );
+}
 
-          require_action( *(inHeader->extraDataPtr) == '\n', exit, err = kMalformedErr);
-          inHeader->extraDataLen = 0;
-        }
-        else{
-          /* Callback , read , callback , read CRLF */
-          (inHeader->onReceivedDataCallback)(inHeader, pos, 
-                                                       (uint8_t *)inHeader->extraDataPtr, 
-                                                       inHeader->extraDataLen - chunckheaderLen, 
-                                                       inHeader->userContext);
-          pos += inHeader->extraDataLen - chunckheaderLen;
-
-          while ( inHeader->extraDataLen < inHeader->contentLength + chunckheaderLen  ){
-            selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-            require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-            if( inHeader->contentLength - (inHeader->extraDataLen - chunckheaderLen) > inHeader->chunkedDataBufferLen - chunckheaderLen)
-              //Data needed is greater than valid buffer size
-              readLength = inHeader->chunkedDataBufferLen - chunckheaderLen; 
-            else
-              //Data needed is less than valid buffer size
-              readLength = inHeader->contentLength - (inHeader->extraDataLen - chunckheaderLen) ; 
-
-            readResult = read( inSock, (uint8_t *)inHeader->extraDataPtr, readLength);
-            
-            if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-            else { err = kConnectionErr; goto exit; }
-
-            (inHeader->onReceivedDataCallback)(inHeader, pos, 
-                                                         (uint8_t *)inHeader->extraDataPtr, 
-                                                         readResult, 
-                                                         inHeader->userContext);
-            pos += readResult;
-          } 
-
-          selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-          require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-          readResult = read( inSock, (uint8_t *)inHeader->extraDataPtr, 2);
-
-          if( readResult  > 0 ) {}
-          else { err = kConnectionErr; goto exit; }
-
-
-          require_action( *(inHeader->extraDataPtr) == '\r' &&
-                          *(inHeader->extraDataPtr+1 ) == '\n', 
-                          exit, err = kMalformedErr);
-
-          inHeader->extraDataLen = 0;
-        }
-      }
-    }while(inHeader->contentLength != 0);
+OSStatus SocketSkipHTTPBody( int inSock, HTTPHeader_t *inHeader )
+{
+  OSStatus err = kNoErr;
+  uint8_t  drop[ 32 ];
+  size_t   readLen;
+
+  while( HTTPHeaderBodyComplete( inHeader ) == false ){
+    err = SocketReadHTTPBodyWindow( inSock, inHeader, drop, sizeof( drop ), &readLen );
+    require_noerr( err, exit );
   }
 
-  /* We has extra data but total length is not clear, store them to 1500 bytes buffer 
-     return when connection is disconnected by remote server */
-  // if( inHeader->dataEndedbyClose == true){ 
-  //   if(inHeader->contentLength == 0) { //First read body, return using data received by SocketReadHTTPHeader
-  //     inHeader->contentLength = inHeader->extraDataLen;
-  //   }else{
-  //     selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-  //     require_action( selectResult >= 1, exit, err = kNotReadableErr );
-      
-  //     readResult = read( inSock,
-  //                       (uint8_t*)( inHeader->extraDataPtr ),
-  //                       1500 );
-  //     if( readResult  > 0 ) inHeader->contentLength = readResult;
-  //     else { err = kConnectionErr; goto exit; }
-  //   }
-  //   err = kNoErr;
-  //   goto exit;
-  // }
-  
-
-  while ( inHeader->extraDataLen < inHeader->contentLength )
-  {
-    selectResult = select( inSock + 1, &readSet, NULL, NULL, &t );
-    require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-    if(inHeader->isCallbackSupported == true){
-      /* We has extra data, and we give these data to application by onReceivedDataCallback function */
-      readLength = inHeader->contentLength - inHeader->extraDataLen > READ_LENGTH? READ_LENGTH:inHeader->contentLength - inHeader->extraDataLen;
-      readResult = read( inSock,
-                        (uint8_t*)( inHeader->extraDataPtr),
-                        readLength );
-      
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else { err = kConnectionErr; goto exit; }      
-      (inHeader->onReceivedDataCallback)(inHeader, inHeader->extraDataLen - readResult, (uint8_t *)inHeader->extraDataPtr, readResult, inHeader->userContext);
-    }else{
-      /* We has extra data and we has a predefined buffer to store the total extra data return when all data has received*/
-      readResult = read( inSock,
-                        (uint8_t*)( inHeader->extraDataPtr + inHeader->extraDataLen ),
-                        ( inHeader->contentLength - inHeader->extraDataLen ) );
-      
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else { err = kConnectionErr; goto exit; }
+exit:
+  return err;
+}
+
+bool HTTPHeaderBodyComplete( HTTPHeader_t *inHeader )
+{
+  if( inHeader->chunkedData == true )
+    return ( inHeader->chunkState == kHTTPChunkState_Done );
+  return ( inHeader->bodyReadLen >= inHeader->contentLength );
+}
+
+OSStatus SocketReadHTTPBody( int inSock, HTTPHeader_t *inHeader )
+{
+  OSStatus err = kParamErr;
+  size_t   readLen;
+  
+  require( inHeader, exit );
+  err = kNoErr;
+
+  if( inHeader->streamBody == true || inHeader->extraDataPtr == NULL )
+    goto exit;
+
+  if( inHeader->isCallbackSupported == true ){
+    /* Give the body to the application by onReceivedDataCallback function, one READ_LENGTH window at a time */
+    for( ;; ){
+      err = SocketReadHTTPBodyWindow( inSock, inHeader, (uint8_t *)inHeader->extraDataPtr, READ_LENGTH, &readLen );
+      require_noerr( err, exit );
+      if( readLen == 0 ) break;
+      inHeader->extraDataLen += readLen;
+      (inHeader->onReceivedDataCallback)(inHeader, (uint32_t)(inHeader->bodyReadLen - readLen), 
+                                         (uint8_t *)inHeader->extraDataPtr, readLen, inHeader->userContext);
     }
+  }else{
+    /* We has a predefined buffer to store the total body */
+    while( inHeader->bodyReadLen < inHeader->contentLength ){
+      err = SocketReadHTTPBodyWindow( inSock, inHeader, (uint8_t *)inHeader->extraDataPtr + inHeader->bodyReadLen, 
+                                      (size_t)( inHeader->contentLength - inHeader->bodyReadLen ), &readLen );
+      require_noerr( err, exit );
+    }
+    inHeader->extraDataLen = (size_t)inHeader->bodyReadLen;
   }
-  err = kNoErr;
   
 exit:
   if(err != kNoErr) inHeader->len = 0;
@@ -373,52 +391,29 @@ exit:
 OSStatus HTTPHeaderParse( HTTPHeader_t *ioHeader )
 {
   OSStatus            err;
-  const char *        src;
-  const char *        end;
-  const char *        ptr;
-  char                c;
-  const char *        value;
-  size_t              valueSize;
-  int                 x;
+  char *              end;
   
   require_action( ioHeader->len < sizeof( ioHeader->buf ), exit, err = kParamErr );
   
-  // Reset fields up-front to good defaults to simplify handling of unused fields later.
-  
-  ioHeader->methodPtr         = "";
-  ioHeader->methodLen         = 0;
-  ioHeader->urlPtr            = "";
-  ioHeader->urlLen            = 0;
-  memset( &ioHeader->url, 0, sizeof( ioHeader->url ) );
-  ioHeader->protocolPtr       = "";
-  ioHeader->protocolLen       = 0;
-  ioHeader->statusCode        = -1;
-  ioHeader->reasonPhrasePtr   = "";
-  ioHeader->reasonPhraseLen   = 0;
-  ioHeader->channelID         = 0;
-  ioHeader->contentLength     = 0;
-  ioHeader->persistent        = false;
-  
-  // Check for a 4-byte interleaved binary data header (see RFC 2326 section 10.12). It has the following format:
-  //
-  //      '$' <1:channelID> <2:dataSize in network byte order> ... followed by dataSize bytes of binary data.
-  src = ioHeader->buf;
-  if( ( ioHeader->len == 4 ) && ( src[ 0 ] == '$' ) )
-  {
-    const uint8_t *     usrc;
-    
-    usrc = (const uint8_t *) src;
-    ioHeader->channelID     =   usrc[ 1 ];
-    ioHeader->contentLength = ( usrc[ 2 ] << 8 ) | usrc[ 3 ];
-    
-    ioHeader->methodPtr = src;
-    ioHeader->methodLen = 1;
-    
-    err = kNoErr;
-    goto exit;
-  }
+  ioHeader->parseState      = kHTTPParseState_StartLine;
+  ioHeader->parsePos        = 0;
+  ioHeader->parseScanPos    = 0;
+  ioHeader->parseFieldEnd   = 0;
+  
+  err = HTTPHeaderParseIncremental( ioHeader, &end );
+  if( err == kInProgressErr ) err = kMalformedErr;
+  
+exit:
+  return err;
+}
+
+static OSStatus _HTTPHeaderParseStartLine( HTTPHeader_t *ioHeader, const char *src, const char *end )
+{
+  OSStatus            err;
+  const char *        ptr;
+  char                c;
+  int                 x;
   
-  // Parse the start line. This will also determine if it's a request or response.
   // Requests are in the format <method> <url> <protocol>/<majorVersion>.<minorVersion>, for example:
   //
   //      GET /abc/xyz.html HTTP/1.1
@@ -429,7 +424,6 @@ OSStatus HTTPHeaderParse( HTTPHeader_t *ioHeader )
   //
   //      HTTP/1.1 404 Not Found
   ptr = src;
-  end = src + ioHeader->len;
   for( c = 0; ( ptr < end ) && ( ( c = *ptr ) != ' ' ) && ( c != '/' ); ++ptr ) {}
   require_action( ptr < end, exit, err = kMalformedErr );
   
@@ -451,10 +445,17 @@ OSStatus HTTPHeaderParse( HTTPHeader_t *ioHeader )
     
     // Parse the protocol and version.
     ioHeader->protocolPtr = ptr;
-    while( ( ptr < end ) && ( ( c = *ptr ) != '\r' ) && ( c != '\n' ) ) ++ptr;
-    ioHeader->protocolLen = (size_t)( ptr - ioHeader->protocolPtr );
-    require_action( ptr < end, exit, err = kMalformedErr );
-    ++ptr;
+    ioHeader->protocolLen = (size_t)( end - ptr );
+    
+    if( ioHeader->onParsedElementCallback )
+    {
+      err = (ioHeader->onParsedElementCallback)( ioHeader, kHTTPParsedElement_Method, NULL, 0, 
+                                                 ioHeader->methodPtr, ioHeader->methodLen, ioHeader->userContext );
+      require_noerr( err, exit );
+      err = (ioHeader->onParsedElementCallback)( ioHeader, kHTTPParsedElement_URL, NULL, 0, 
+                                                 ioHeader->urlPtr, ioHeader->urlLen, ioHeader->userContext );
+      require_noerr( err, exit );
+    }
   }
   else // Response
   {
@@ -473,28 +474,194 @@ OSStatus HTTPHeaderParse( HTTPHeader_t *ioHeader )
     
     // Parse the reason phrase.
     ioHeader->reasonPhrasePtr = ptr;
-    while( ( ptr < end ) && ( ( c = *ptr ) != '\r' ) && ( c != '\n' ) ) ++ptr;
-    ioHeader->reasonPhraseLen = (size_t)( ptr - ioHeader->reasonPhrasePtr );
-    require_action( ptr < end, exit, err = kMalformedErr );
-    ++ptr;
+    ioHeader->reasonPhraseLen = (size_t)( end - ptr );
   }
   
-  // There should at least be a blank line after the start line so make sure there's more data.
-  require_action( ptr < end, exit, err = kMalformedErr );
+  // Determine persistence. Note: HTTP 1.0 defaults to non-persistent, it may be overridden by a Connection header field.
+  ioHeader->persistent = (Boolean)( strnicmpx( ioHeader->protocolPtr, ioHeader->protocolLen, "HTTP/1.0" ) != 0 );
+  err = kNoErr;
   
-  // Determine persistence. Note: HTTP 1.0 defaults to non-persistent if a Connection header field is not present.
-  err = HTTPGetHeaderField( ioHeader->buf, ioHeader->len, "Connection", NULL, NULL, &value, &valueSize, NULL );
-  if( err )   ioHeader->persistent = (Boolean)( strnicmpx( ioHeader->protocolPtr, ioHeader->protocolLen, "HTTP/1.0" ) != 0 );
-  else        ioHeader->persistent = (Boolean)( strnicmpx( value, valueSize, "close" ) != 0 );
+exit:
+  return err;
+}
 
-  err = HTTPGetHeaderField( ioHeader->buf, ioHeader->len, "Transfer-Encoding", NULL, NULL, &value, &valueSize, NULL );
-  if( err )   ioHeader->chunkedData = false;
-  else        ioHeader->chunkedData = (Boolean)( strnicmpx( value, valueSize, kTransferrEncodingType_CHUNKED ) == 0 );
+static OSStatus _HTTPHeaderParseField( HTTPHeader_t *ioHeader, const char *src, const char *end )
+{
+  OSStatus            err = kNoErr;
+  const char *        nameEnd;
+  const char *        valuePtr;
+  const char *        ptr;
+  size_t              nameLen;
+  size_t              valueLen;
+  char                c;
+  
+  nameEnd = src;
+  while( ( nameEnd < end ) && ( *nameEnd != ':' ) ) ++nameEnd;
+  require_quiet( nameEnd < end, exit ); // Not a "name: value" line, ignore it like HTTPGetHeaderField does.
+  nameLen = (size_t)( nameEnd - src );
+  
+  valuePtr = nameEnd + 1;
+  while( ( valuePtr < end ) && ( ( ( c = *valuePtr ) == ' ' ) || ( c == '\t' ) ) ) ++valuePtr;
+  valueLen = (size_t)( end - valuePtr );
+  
+  // Pick up the fields used by the socket read functions here, so no extra pass over the header is needed.
+  if( strnicmpx( src, nameLen, "Content-Length" ) == 0 )
+  {
+    ioHeader->contentLength = 0;
+    for( ptr = valuePtr; ( ptr < end ) && ( ( c = *ptr ) >= '0' ) && ( c <= '9' ); ++ptr )
+      ioHeader->contentLength = ( ioHeader->contentLength * 10 ) + (uint64_t)( c - '0' );
+  }
+  else if( strnicmpx( src, nameLen, "Connection" ) == 0 )
+    ioHeader->persistent = (Boolean)( strnicmpx( valuePtr, valueLen, "close" ) != 0 );
+  else if( strnicmpx( src, nameLen, "Transfer-Encoding" ) == 0 )
+    ioHeader->chunkedData = (Boolean)( strnicmpx( valuePtr, valueLen, kTransferrEncodingType_CHUNKED ) == 0 );
   
-  // Content-Length is such a common field that we get it here during general parsing.
-  HTTPScanFHeaderValue( ioHeader->buf, ioHeader->len, "Content-Length", "%llu", &ioHeader->contentLength );
+  if( ioHeader->onParsedElementCallback )
+    err = (ioHeader->onParsedElementCallback)( ioHeader, kHTTPParsedElement_Field, src, nameLen, 
+                                               valuePtr, valueLen, ioHeader->userContext );
+  
+exit:
+  return err;
+}
 
-  err = kNoErr;
+// Bytes received beyond the header are the start of the body, they are consumed in place by HTTPReadBodyWindow.
+static void _HTTPHeaderPrepareBody( HTTPHeader_t *ioHeader, char *inHeaderEnd, char *inDataEnd )
+{
+  ioHeader->stagePos        = (size_t)( inHeaderEnd - ioHeader->buf );
+  ioHeader->stageLen        = (size_t)( inDataEnd - inHeaderEnd );
+  ioHeader->bodyReadLen     = 0;
+  ioHeader->chunkState      = kHTTPChunkState_Size;
+  ioHeader->chunkRemaining  = 0;
+}
+
+//===========================================================================================================================
+//  HTTPHeaderParseIncremental
+//
+//  Parses the bytes appended to "buf" since the previous call, "len" is the number of valid bytes in "buf". The parser 
+//  resumes the search for the end of the line it stopped in where the previous call left off, so every byte is only 
+//  scanned once no matter how fragmented the header arrives.
+//===========================================================================================================================
+
+OSStatus HTTPHeaderParseIncremental( HTTPHeader_t *ioHeader, char **outHeaderEnd )
+{
+  OSStatus            err;
+  char *              buf = ioHeader->buf;
+  char *              lim = ioHeader->buf + ioHeader->len;
+  char *              lineStart;
+  char *              lineEnd;
+  char *              src;
+  
+  require_action( ioHeader->len <= sizeof( ioHeader->buf ), exit, err = kParamErr );
+  
+  if( ioHeader->parseState == kHTTPParseState_Done )
+  {
+    *outHeaderEnd = buf + ioHeader->parsePos;
+    err = kNoErr;
+    goto exit;
+  }
+  
+  if( ( ioHeader->parseState == kHTTPParseState_StartLine ) && ( ioHeader->parsePos == 0 ) )
+  {
+    // Reset fields up-front to good defaults to simplify handling of unused fields later.
+    ioHeader->methodPtr         = "";
+    ioHeader->methodLen         = 0;
+    ioHeader->urlPtr            = "";
+    ioHeader->urlLen            = 0;
+    memset( &ioHeader->url, 0, sizeof( ioHeader->url ) );
+    ioHeader->protocolPtr       = "";
+    ioHeader->protocolLen       = 0;
+    ioHeader->statusCode        = -1;
+    ioHeader->reasonPhrasePtr   = "";
+    ioHeader->reasonPhraseLen   = 0;
+    ioHeader->channelID         = 0;
+    ioHeader->contentLength     = 0;
+    ioHeader->persistent        = false;
+    ioHeader->chunkedData       = false;
+    ioHeader->parseFieldEnd     = 0;
+    
+    // Check for a 4-byte interleaved binary data header (see RFC 2326 section 10.12). It has the following format:
+    //
+    //      '$' <1:channelID> <2:dataSize in network byte order> ... followed by dataSize bytes of binary data.
+    if( ( lim > buf ) && ( buf[ 0 ] == '$' ) )
+    {
+      const uint8_t *     usrc = (const uint8_t *) buf;
+      
+      require_action_quiet( ( lim - buf ) >= 4, exit, err = kInProgressErr );
+      ioHeader->channelID     =   usrc[ 1 ];
+      ioHeader->contentLength = ( usrc[ 2 ] << 8 ) | usrc[ 3 ];
+      ioHeader->methodPtr     = buf;
+      ioHeader->methodLen     = 1;
+      ioHeader->parsePos      = 4;
+      ioHeader->parseState    = kHTTPParseState_Done;
+      *outHeaderEnd = buf + 4;
+      _HTTPHeaderPrepareBody( ioHeader, buf + 4, lim );
+      err = kNoErr;
+      goto exit;
+    }
+  }
+  
+  // The line in progress always starts at parsePos. The bytes of a partial line up to parseScanPos are known to hold 
+  // no LF, so the search picks up after them.
+  lineStart = buf + ioHeader->parsePos;
+  src = lineStart;
+  if( ioHeader->parseScanPos > ioHeader->parsePos ) src = buf + ioHeader->parseScanPos;
+  for( ;; )
+  {
+    while( ( src < lim ) && ( *src != '\n' ) ) ++src;
+    if( src >= lim )
+    {
+      ioHeader->parseScanPos = (size_t)( lim - buf );
+      err = kInProgressErr;
+      goto exit;
+    }
+    
+    // The HTTP spec defines line endings as CRLF, but some use a bare LF so this handles both.
+    lineEnd = src;
+    if( ( lineEnd > lineStart ) && ( lineEnd[ -1 ] == '\r' ) ) --lineEnd;
+    ++src;
+    
+    if( ioHeader->parseState == kHTTPParseState_StartLine )
+    {
+      // Empty lines before the start line should be ignored (RFC 7230 section 3.5).
+      if( lineEnd > lineStart )
+      {
+        err = _HTTPHeaderParseStartLine( ioHeader, lineStart, lineEnd );
+        require_noerr( err, exit );
+        ioHeader->parseState = kHTTPParseState_Fields;
+      }
+    }
+    else if( ( lineEnd > lineStart ) && ( ( *lineStart == ' ' ) || ( *lineStart == '\t' ) ) && ioHeader->parseFieldEnd )
+    {
+      // A continuation line extends the value of the previous field.
+      ioHeader->parseFieldEnd = (size_t)( lineEnd - buf );
+    }
+    else
+    {
+      // A field is only complete once we know the next line is not a continuation of it.
+      if( ioHeader->parseFieldEnd )
+      {
+        err = _HTTPHeaderParseField( ioHeader, buf + ioHeader->parseFieldStart, buf + ioHeader->parseFieldEnd );
+        require_noerr( err, exit );
+        ioHeader->parseFieldEnd = 0;
+      }
+      
+      if( lineEnd == lineStart ) // Empty line, end of the header.
+      {
+        ioHeader->parseState = kHTTPParseState_Done;
+        ioHeader->parsePos = (size_t)( src - buf );
+        *outHeaderEnd = src;
+        _HTTPHeaderPrepareBody( ioHeader, src, lim );
+        err = kNoErr;
+        goto exit;
+      }
+      
+      ioHeader->parseFieldStart = (size_t)( lineStart - buf );
+      ioHeader->parseFieldEnd   = (size_t)( lineEnd - buf );
+    }
+    
+    lineStart = src;
+    ioHeader->parsePos = (size_t)( src - buf );
+  }
   
 exit:
   return err;
@@ -703,50 +870,33 @@ HTTPHeader_t * HTTPHeaderCreateWithCallback( onReceivedDataCallback inRecvFunc,
 
 void HTTPHeaderClear( HTTPHeader_t *inHeader )
 {
-  char *nextPackagePtr;
-  size_t chunckheaderLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr;
-
   if(inHeader->onClearCallback)
     (inHeader->onClearCallback)(inHeader, inHeader->userContext);
 
-  if(inHeader->chunkedData && (uint32_t *)inHeader->chunkedDataBufferPtr){ //chunk data
-    /* Possible to read the header of the next http package */
-    if(findCRLF( inHeader->extraDataPtr, inHeader->extraDataLen - chunckheaderLen, &nextPackagePtr ) ){
-      if( nextPackagePtr <= inHeader->chunkedDataBufferPtr + inHeader->extraDataLen ){ //We get some data belongs to next http package
-        inHeader->len = inHeader->extraDataLen - (nextPackagePtr - inHeader->chunkedDataBufferPtr);
-        if(inHeader->len > 512)
-          inHeader->len = 0;
-        else
-          memcpy(inHeader->buf, nextPackagePtr, inHeader->len);
-      } else
-        inHeader->len = 0;
-    }
-
-    inHeader->extraDataLen = 0;
-    free((uint32_t *)inHeader->chunkedDataBufferPtr);
-    inHeader->chunkedDataBufferPtr = NULL;   
-    inHeader->extraDataPtr = NULL;   
-    inHeader->chunkedData = false;
-  }else{
-
-    /* We get some data belongs to next http package, this only could happen two or more
-      packages are received by SocketReadHTTPHeader */ 
-    if( inHeader->extraDataLen > inHeader->contentLength ){ 
-      inHeader->len = inHeader->extraDataLen - inHeader->contentLength;
-      memcpy(inHeader->buf, inHeader->extraDataPtr + inHeader->contentLength, inHeader->len);
-    } else
-      inHeader->len = 0;
-
-    inHeader->extraDataLen = 0;
-    if((uint32_t *)inHeader->extraDataPtr) {
-      free((uint32_t *)inHeader->extraDataPtr);
-      inHeader->extraDataPtr = NULL;
-    } 
-    inHeader->dataEndedbyClose = false;
-  }
-
+  /* We get some data belongs to next http package, this only could happen two or more
+     packages are received in one read. It is only valid if the current body was read completely. */
+  if( inHeader->stageLen && HTTPHeaderBodyComplete( inHeader ) ){
+    memmove(inHeader->buf, inHeader->buf + inHeader->stagePos, inHeader->stageLen);
+    inHeader->len = inHeader->stageLen;
+  } else
+    inHeader->len = 0;
+
+  inHeader->stagePos = 0;
+  inHeader->stageLen = 0;
+  inHeader->extraDataLen = 0;
+  if((uint32_t *)inHeader->extraDataPtr) {
+    free((uint32_t *)inHeader->extraDataPtr);
+    inHeader->extraDataPtr = NULL;
+  } 
+  inHeader->dataEndedbyClose = false;
+  inHeader->chunkedData = false;
+  inHeader->contentLength = 0;
+  inHeader->bodyReadLen = 0;
   inHeader->isCallbackSupported = false;
-
+  inHeader->parseState = kHTTPParseState_StartLine;
+  inHeader->parsePos = 0;
+  inHeader->parseScanPos = 0;
+  inHeader->parseFieldEnd = 0;
 }
 
 OSStatus CreateSimpleHTTPOKMessage( uint8_t **outMessage, size_t *outMessageSize )
@@ -756,8 +906,9 @@ OSStatus CreateSimpleHTTPOKMessage( uint8_t **outMessage, size_t *outMessageSize
   require( *outMessage, exit );
   
   sprintf( (char*)*outMessage,
-          "%s %s %s%s",
-          "HTTP/1.1", "200", "OK", kCRLFLineEnding );
+          "%s %s %s%s%s %d%s",
+          "HTTP/1.1", "200", "OK", kCRLFNewLine,
+          "Content-Length:", 0, kCRLFLineEnding );
   *outMessageSize = strlen( (char*)*outMessage );
   
   err = kNoErr;
@@ -851,30 +1002,49 @@ char * getStatusString(int status)
     return "OK";
 }
 
-OSStatus CreateHTTPRespondMessageNoCopy( int status, const char *contentType, size_t inDataLen, uint8_t **outMessage, size_t *outMessageSize )
+OSStatus CreateHTTPRespondHeader( int status, const char *contentType, size_t inDataLen, char *outHeader, size_t inHeaderSize, size_t *outHeaderSize )
 {
-  OSStatus err = kParamErr;
+  OSStatus err = kNoErr;
   char *statusString = getStatusString(status);
-    
-  err = kNoMemoryErr;
-  *outMessage = malloc( 200 );
-  require( *outMessage, exit );
+  int len;
   
   // Create HTTP Response
   if(inDataLen)
-    snprintf( (char*)*outMessage, 200, 
+    len = snprintf( outHeader, inHeaderSize, 
             "%s %d %s%s%s %s%s%s %d%s",
             "HTTP/1.1", status, statusString, kCRLFNewLine, 
             "Content-Type:", contentType, kCRLFNewLine,
             "Content-Length:", (int)inDataLen, kCRLFLineEnding );
-  else
-    snprintf( (char*)*outMessage, 200, 
+  else if(status == kStatusNoConetnt)
+    len = snprintf( outHeader, inHeaderSize, 
         "%s %d %s%s",
         "HTTP/1.1", status, statusString, kCRLFLineEnding);
+  else  // Without a body length the client could only find the end of the message by a connection close
+    len = snprintf( outHeader, inHeaderSize, 
+        "%s %d %s%s%s %d%s",
+        "HTTP/1.1", status, statusString, kCRLFNewLine,
+        "Content-Length:", 0, kCRLFLineEnding);
+  require_action( len > 0 && (size_t)len < inHeaderSize, exit, err = kSizeErr );
+  
+  *outHeaderSize = (size_t)len;
+  
+exit:
+  return err;
+}
+
+OSStatus CreateHTTPRespondMessageNoCopy( int status, const char *contentType, size_t inDataLen, uint8_t **outMessage, size_t *outMessageSize )
+{
+  OSStatus err = kNoMemoryErr;
+    
+  *outMessage = malloc( 200 );
+  require( *outMessage, exit );
   
   // outMessageSize will be the length of the HTTP Header plus the data length
-  *outMessageSize = strlen( (char*)*outMessage );
-  err = kNoErr;
+  err = CreateHTTPRespondHeader( status, contentType, inDataLen, (char*)*outMessage, 200, outMessageSize );
+  if( err != kNoErr ){
+    free( *outMessage );
+    *outMessage = NULL;
+  }
   
 exit:
   return err;
@@ -31,6 +31,10 @@
 
 #define kHTTPPostMethod     "POST"
 
+#define kHTTPHeaderMaxLen           512     //! Longest header, start line and terminating empty line included.
+#define kHTTPHeaderStageReserve     16      //! Bytes of buf kept behind a full header to receive chunk framing.
+#define kHTTPBodyMaxLen             2048    //! Longest body read into one buffer, longer ones are refused with kSizeErr.
+
       // Status-Code    =
       //       "100"  ; Section 10.1.1: Continue
       //     | "101"  ; Section 10.1.2: Switching Protocols
@@ -84,11 +88,33 @@
 #define kTransferrEncodingType_CHUNKED  "chunked"
 
 #define OTA_Data_Length_per_read        1024
+#define HTTP_Body_Window_Length         256
+
+typedef enum {
+    kHTTPParseState_StartLine = 0,  //! Waiting for the request/status line.
+    kHTTPParseState_Fields,         //! Waiting for header fields or the empty line ending the header.
+    kHTTPParseState_Done,           //! Header is complete, body (if any) follows at buf + len.
+} HTTPParseState_t;
+
+typedef enum {
+    kHTTPParsedElement_Method = 0,  //! valuePtr/valueLen is the request method.
+    kHTTPParsedElement_URL,         //! valuePtr/valueLen is the request URL.
+    kHTTPParsedElement_Field,       //! namePtr/nameLen and valuePtr/valueLen is one header field.
+} HTTPParsedElement_t;
+
+typedef enum {
+    kHTTPChunkState_Size = 0,       //! Reading the hex chunk size.
+    kHTTPChunkState_Extension,      //! Skipping chunk extensions up to the end of the size line.
+    kHTTPChunkState_Data,           //! Delivering chunk data, chunkRemaining bytes left.
+    kHTTPChunkState_DataEnd,        //! Expecting the CRLF that follows chunk data.
+    kHTTPChunkState_Trailer,        //! Skipping trailer fields after the last chunk.
+    kHTTPChunkState_Done,           //! The whole chunked body has been delivered.
+} HTTPChunkState_t;
 
 
 typedef struct _HTTPHeader_t
 {
-    char                buf[ 512 ];        //! Buffer holding the start line and all headers.
+    char                buf[ kHTTPHeaderMaxLen + kHTTPHeaderStageReserve ]; //! Buffer holding the start line and all headers.
     size_t              len;                //! Number of bytes in the header.
     char *              extraDataPtr;       //! Ptr for any extra data beyond the header, it is alloced when http header is received.
     char *              otaDataPtr;         //! Ptr for any OTA data beyond the header, it is alloced when one OTA package is received.
@@ -112,14 +138,26 @@ typedef struct _HTTPHeader_t
     int                 firstErr;           //! First error that occurred or kNoErr.
 
     bool                dataEndedbyClose;
-    bool                chunkedData;        //! true=Application should read the next chunked data.
-    char *              chunkedDataBufferPtr;     //! Ptr for any extra data beyond the header, it is alloced when http header is received.
-    size_t              chunkedDataBufferLen; //! Total buffer length that stores the chunkedData, private use only
+    bool                chunkedData;        //! true=Body is sent with chunked transfer encoding.
+    bool                streamBody;         //! true=Body is pulled by the application with SocketReadHTTPBodyWindow, never buffered as a whole.
+    uint64_t            bodyReadLen;        //! Number of (de-chunked) body bytes delivered so far.
+    HTTPChunkState_t    chunkState;         //! Chunked decoder state, private use only
+    uint64_t            chunkRemaining;     //! Bytes left in the current chunk or trailer line, private use only
+    size_t              stagePos;           //! Offset in buf of raw bytes received beyond the header, private use only
+    size_t              stageLen;           //! Number of raw bytes at stagePos not consumed yet, private use only
+
+    HTTPParseState_t    parseState;         //! Incremental parser state, private use only
+    size_t              parsePos;           //! Offset in buf where the incremental parser resumes, private use only
+    size_t              parseScanPos;       //! Offset in buf up to which the line at parsePos was searched for LF, private use only
+    size_t              parseFieldStart;    //! Offset in buf of a header field that may still be continued, private use only
+    size_t              parseFieldEnd;      //! End offset of that header field, 0 if no field is pending, private use only
 
     void *              userContext;
     bool                isCallbackSupported;
     OSStatus            (*onReceivedDataCallback) ( struct _HTTPHeader_t * , uint32_t, uint8_t *, size_t, void * ); 
     void                (*onClearCallback) ( struct _HTTPHeader_t * httpHeader, void * userContext );
+    OSStatus            (*onParsedElementCallback) ( struct _HTTPHeader_t * httpHeader, HTTPParsedElement_t element, 
+                                                     const char *namePtr, size_t nameLen, const char *valuePtr, size_t valueLen, void * userContext );
 
 
 
@@ -129,6 +167,12 @@ typedef OSStatus (*onReceivedDataCallback) ( struct _HTTPHeader_t * httpHeader,
 
 typedef void (*onClearCallback) ( struct _HTTPHeader_t * httpHeader, void * userContext );
 
+/* Called by the incremental parser as soon as each element of the header is complete. namePtr and valuePtr
+   point into httpHeader->buf and are valid until HTTPHeaderClear is called. A return value other than kNoErr 
+   aborts the parse with that error. */
+typedef OSStatus (*onParsedElementCallback) ( struct _HTTPHeader_t * httpHeader, HTTPParsedElement_t element, 
+                                              const char *namePtr, size_t nameLen, const char *valuePtr, size_t valueLen, void * userContext );
+
 void PrintHTTPHeader( HTTPHeader_t *inHeader );
 
 bool findHeader ( HTTPHeader_t *inHeader,  char **  outHeaderEnd);
@@ -143,8 +187,29 @@ int SocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader );
 
 int SocketReadHTTPBody( int inSock, HTTPHeader_t *inHeader );
 
+/* Reads data from a connection, returns the number of bytes read, 0 or negative if the connection is closed or broken. */
+typedef int (*HTTPReadFunc)( void *inContext, int inSock, void *inBuf, size_t inLen );
+
+/* Pulls the next piece of the body into inWindow, decoding chunked transfer encoding on the fly. Only the bytes the 
+   caller has room for are read from the connection, so peak memory is the window whatever the body size and a slow 
+   consumer throttles the peer through the TCP window. *outLen is 0 once the whole body has been delivered. 
+   inReadFunc may be NULL to read from the socket with a timeout. */
+int HTTPReadBodyWindow( int inSock, HTTPHeader_t *inHeader, HTTPReadFunc inReadFunc, void *inReadContext, 
+                        uint8_t *inWindow, size_t inWindowLen, size_t *outLen );
+
+int SocketReadHTTPBodyWindow( int inSock, HTTPHeader_t *inHeader, uint8_t *inWindow, size_t inWindowLen, size_t *outLen );
+
+/* Reads and drops whatever is left of the body so the connection is ready for the next message. */
+int SocketSkipHTTPBody( int inSock, HTTPHeader_t *inHeader );
+
+bool HTTPHeaderBodyComplete( HTTPHeader_t *inHeader );
+
 int HTTPHeaderParse( HTTPHeader_t *ioHeader );
 
+/* Resumable parser: only scans the bytes appended to buf since the last call. Returns kInProgressErr while 
+   the header is incomplete, kNoErr with outHeaderEnd set once the empty line is found. */
+int HTTPHeaderParseIncremental( HTTPHeader_t *ioHeader, char **outHeaderEnd );
+
 int HTTPHeaderMatchMethod( HTTPHeader_t *inHeader, const char *method );
 
 int HTTPHeaderMatchURL( HTTPHeader_t *inHeader, const char *url );
@@ -174,6 +239,9 @@ OSStatus CreateSimpleHTTPMessageNoCopy( const char *contentType, size_t inDataLe
 
 OSStatus CreateHTTPRespondMessageNoCopy( int status, const char *contentType, size_t inDataLen, uint8_t **outMessage, size_t *outMessageSize );
 
+/* Same header written into a caller's buffer, kSizeErr when it does not fit */
+OSStatus CreateHTTPRespondHeader( int status, const char *contentType, size_t inDataLen, char *outHeader, size_t inHeaderSize, size_t *outHeaderSize );
+
 
 OSStatus CreateHTTPMessage( const char *methold, const char *url, const char *contentType, uint8_t *inData, size_t inDataLen, uint8_t **outMessage, size_t *outMessageSize );
 
@@ -66,21 +66,43 @@ static int _bonjour_announce = 0;
 static dns_sd_service_record_t*   available_services	= NULL;
 static uint8_t	available_service_count;
 
+/* Responses are serialized once with compressed names and sent from static buffers, they are 
+   rebuilt only when the TXT record or the IP address changes */
+#define MDNS_RESPONSE_LENGTH               512
+#define MDNS_SHORT_RESPONSE_LENGTH         128
+#define MDNS_NAME_TABLE_SIZE               16
+#define MDNS_IP_CHECK_INTERVAL             1000  // ms between two IP address checks
+
+typedef struct
+{
+  uint16_t offsets[MDNS_NAME_TABLE_SIZE]; // Labels already written to the packet
+  uint8_t  count;
+} dns_name_table_t;
+
+static uint8_t  mdns_services_packet[MDNS_SHORT_RESPONSE_LENGTH];
+static uint8_t  mdns_service_packet[MDNS_RESPONSE_LENGTH];
+static uint8_t  mdns_host_packet[MDNS_SHORT_RESPONSE_LENGTH];
+static dns_message_iterator_t mdns_services_response;  // PTR of "_services._dns-sd._udp.local."
+static dns_message_iterator_t mdns_service_response;   // PTR, TXT, SRV and A of our service
+static dns_message_iterator_t mdns_host_response;      // A of our host name
+static bool     mdns_responses_valid = false;
+static uint32_t mdns_ip = 0;
+static uint32_t mdns_ip_check_time = 0;
+
 static int dns_get_next_question( dns_message_iterator_t* iter, dns_question_t* q, dns_name_t* name );
 static int dns_compare_name_to_string( dns_name_t* name, const char* string, const char* fun, const int line );
-static int dns_create_message( dns_message_iterator_t* message, uint16_t size );
 static void dns_write_header( dns_message_iterator_t* iter, uint16_t id, uint16_t flags, uint16_t question_count, uint16_t answer_count, uint16_t authorative_count );
-static void dns_write_record( dns_message_iterator_t* iter, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata );
+static void dns_write_record( dns_message_iterator_t* iter, dns_name_table_t* names, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata );
 static void mdns_send_message(int fd, dns_message_iterator_t* message );
-static void dns_free_message( dns_message_iterator_t* message );
 static void mdns_process_query(int fd, dns_name_t* name, dns_question_t* question, dns_message_iterator_t* source );
-static void dns_write_record( dns_message_iterator_t* iter, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata );
 static void dns_write_uint16( dns_message_iterator_t* iter, uint16_t data );
 static void dns_write_uint32( dns_message_iterator_t* iter, uint32_t data );
 static void dns_write_bytes( dns_message_iterator_t* iter, uint8_t* data, uint16_t length );
 static uint16_t dns_read_uint16( dns_message_iterator_t* iter );
 static void dns_skip_name( dns_message_iterator_t* iter );
-static void dns_write_name( dns_message_iterator_t* iter, const char* src );
+static void dns_write_name( dns_message_iterator_t* iter, dns_name_table_t* names, const char* src );
+static int mdns_responses_ready( void );
+static void mdns_send_response( int fd, dns_message_iterator_t* response, uint16_t id );
 
 static mico_mutex_t bonjour_mutex = NULL;
 static mico_thread_t mfi_bonjour_thread_handler;
@@ -108,21 +130,14 @@ void process_dns_questions(int fd, dns_message_iterator_t* iter )
 {
   dns_name_t name;
   dns_question_t question;
-  dns_message_iterator_t response;
-  IPStatusTypedef para;
   int a = 0;
   int question_processed;
-  uint32_t myip;
   
-  micoWlanGetIPStatus(&para, _interface);
-  myip = htonl(inet_addr(para.ip));
-  if(myip == 0) {
+  if ( !mdns_responses_ready() ) {
     _debug_out("UDP multicast test: IP error.\r\n");
     return;
   }
   
-  memset( &response, 0, sizeof(dns_message_iterator_t) );
-  
   for ( a = 0; a < htons(iter->header->question_count); ++a )
   {
     if (iter->iter > iter->end)
@@ -132,45 +147,16 @@ void process_dns_questions(int fd, dns_message_iterator_t* iter )
     question_processed = 0;
     switch ( question.question_type ){
     case RR_TYPE_PTR:
-      if ( available_services != NULL ){
-        // Check if its a query for all available services  
-        if ( dns_compare_name_to_string( &name, MFi_SERVICE_QUERY_NAME, __FUNCTION__, __LINE__ ) ){
-          int b = 0;
-          _debug_out("UDP multicast test: Recv a SERVICE QUERY request.\r\n");
-          if(dns_create_message( &response, 512 )) {
-            dns_write_header(&response, iter->header->id, 0x8400, 0, available_service_count, 0 );          
-            for ( b = 0; b < available_service_count; ++b ){
-              dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].service_name );
-            }
-            mdns_send_message(fd, &response );
-            dns_free_message( &response );
-            question_processed = 1;
-          }
-        }
-        // else check if its one of our records
-        else {
-          int b = 0;
-          for ( b = 0; b < available_service_count; ++b ){
-            //printf("UDP multicast test: Recv a SERVICE Detail request: %s.\r\n", name);
-            if ( dns_compare_name_to_string( &name, available_services[b].service_name, __FUNCTION__, __LINE__ )){
-              // Send the PTR, TXT, SRV and A records
-              if(dns_create_message( &response, 512 )){
-                dns_write_header( &response, iter->header->id, 0x8400, 0, 4, 0 );
-                //dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (u8*) available_services[b].service_name );
-                dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].instance_name );
-                dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, 1500, (uint8_t*) available_services[b].txt_att );
-                dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, 1500, (uint8_t*) &available_services[b]);
-                dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, 1500, (uint8_t*) &myip);
-                mdns_send_message(fd, &response );
-                dns_free_message( &response );
-                question_processed = 1;
-              }
-              else{
-                _debug_out("UDP multicast test: Send error.\r\n");
-              }
-            }
-          }
-        }
+      // Check if its a query for all available services  
+      if ( dns_compare_name_to_string( &name, MFi_SERVICE_QUERY_NAME, __FUNCTION__, __LINE__ ) ){
+        _debug_out("UDP multicast test: Recv a SERVICE QUERY request.\r\n");
+        mdns_send_response(fd, &mdns_services_response, iter->header->id );
+        question_processed = 1;
+      }
+      // else check if its our record, send the PTR, TXT, SRV and A records
+      else if ( dns_compare_name_to_string( &name, available_services->service_name, __FUNCTION__, __LINE__ )){
+        mdns_send_response(fd, &mdns_service_response, iter->header->id );
+        question_processed = 1;
       }
       break;
     }
@@ -184,28 +170,14 @@ void process_dns_questions(int fd, dns_message_iterator_t* iter )
 static void mdns_process_query(int fd, dns_name_t* name, 
                                dns_question_t* question, dns_message_iterator_t* source )
 {
-  dns_message_iterator_t response;
-  IPStatusTypedef para;
-  uint32_t myip;
-  
-  micoWlanGetIPStatus(&para, _interface);
-  myip = htonl(inet_addr(para.ip));
-  
-  memset( &response, 0, sizeof(dns_message_iterator_t) );
-  
   switch ( question->question_type )
   {
   case RR_QTYPE_ANY:
   case RR_TYPE_A:
     if ( dns_compare_name_to_string( name, available_services->hostname, __FUNCTION__, __LINE__) ){				
       _debug_out("UDP multicast test: Recv RR_TYPE_A.\r\n");
-      if(dns_create_message( &response, 256 )){
-        dns_write_header( &response, source->header->id, 0x8400, 0, 1, 0 );
-        dns_write_record( &response, available_services->hostname, RR_CLASS_IN | RR_CACHE_FLUSH, RR_TYPE_A, 300, (uint8_t *)&myip);
-        mdns_send_message(fd, &response );
-        dns_free_message( &response );
-        return;
-      }
+      mdns_send_response(fd, &mdns_host_response, source->header->id );
+      return;
     }    
   default:
     _debug_out("UDP multicast test: Request not support type: %d.---------------------\r\n", question->question_type);
@@ -235,7 +207,6 @@ static int dns_compare_name_to_string( dns_name_t* name, const char* string, con
   int result   = 1;
   uint8_t* buffer 	  = name->start_of_name;
   _debug_out("UDP multicast test: CMP called by %s@%d.\r\n", fun, line );
-  char *temp;
   
   while ( !finished )
   {
@@ -251,11 +222,6 @@ static int dns_compare_name_to_string( dns_name_t* name, const char* string, con
     
     // Compare section
     section_length = *( buffer++ );
-    temp = malloc(section_length+1);
-    temp[section_length] = 0;
-    memcpy(temp, buffer, section_length );
-    _debug_out("UDP multicast test: Recv a name: %s.\r\n", temp);
-    free(temp);
     if ( strncmp( (char*) buffer, string, section_length ) )
     {
       result	 = 0;
@@ -279,24 +245,6 @@ static int dns_compare_name_to_string( dns_name_t* name, const char* string, con
   return result;
 }
 
-static int dns_create_message( dns_message_iterator_t* message, uint16_t size )
-{
-  message->header = (dns_message_header_t*) malloc( size );
-  if ( message->header == NULL )
-  {
-    return 0;
-  }
-  
-  message->iter = (uint8_t *) message->header + sizeof(dns_message_header_t);
-  return 1;
-}
-
-static void dns_free_message( dns_message_iterator_t* message )
-{
-  free(message->header);
-  message->header = NULL;
-}
-
 static void dns_write_string( dns_message_iterator_t* iter, const char* src )
 {
   uint8_t* segment_length_pointer;
@@ -350,13 +298,13 @@ static void dns_write_header( dns_message_iterator_t* iter, uint16_t id, uint16_
 }
 
 
-static void dns_write_record( dns_message_iterator_t* iter, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata )
+static void dns_write_record( dns_message_iterator_t* iter, dns_name_table_t* names, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata )
 {
   uint8_t* rd_length;
   uint8_t* temp_ptr;
   
   /* Write the name, type, class, TTL*/
-  dns_write_name	( iter, name );
+  dns_write_name	( iter, names, name );
   dns_write_uint16( iter, record_type );
   dns_write_uint16( iter, record_class );
   dns_write_uint32( iter, ttl );
@@ -373,8 +321,11 @@ static void dns_write_record( dns_message_iterator_t* iter, const char* name, ui
     break;
     
   case RR_TYPE_PTR:
+    dns_write_name( iter, names, (const char*) rdata );
+    break;
+
   case RR_TYPE_TXT:
-    dns_write_name( iter, (const char*) rdata );
+    dns_write_string( iter, (const char*) rdata );
     break;
     
   case RR_TYPE_SRV:
@@ -386,7 +337,7 @@ static void dns_write_record( dns_message_iterator_t* iter, const char* name, ui
     dns_write_uint16( iter, ( (dns_sd_service_record_t*) rdata )->port );
     
     /* Write the hostname*/
-    dns_write_string( iter, ( (dns_sd_service_record_t*) rdata )->hostname );
+    dns_write_name( iter, names, ( (dns_sd_service_record_t*) rdata )->hostname );
     break;
   default:
     break;
@@ -467,9 +418,154 @@ static void dns_skip_name( dns_message_iterator_t* iter )
   ++iter->iter;
 }
 
-static void dns_write_name( dns_message_iterator_t* iter, const char* src )
+/* Compare labels in the packet, following pointers, with uncompressed labels */
+static int dns_compare_labels( uint8_t* packet, uint8_t* stored, uint8_t* label )
+{
+  int a;
+  
+  while ( 1 )
+  {
+    while ( ( *stored & 0xC0 ) == 0xC0 )
+      stored = packet + ( ( ( stored[0] << 8 ) | stored[1] ) & 0x3FFF );
+
+    if ( *stored != *label )
+      return 0;
+    if ( *stored == 0 )
+      return 1;
+    for ( a = 1; a <= *label; ++a )
+    {
+      if ( tolower( stored[a] ) != tolower( label[a] ) )
+        return 0;
+    }
+
+    stored += *stored + 1;
+    label  += *label + 1;
+  }
+}
+
+/* Write a name, the longest suffix already in the packet is replaced by a pointer to it. 
+   Names are written uncompressed when names is NULL */
+static void dns_write_name( dns_message_iterator_t* iter, dns_name_table_t* names, const char* src )
 {
+  uint8_t* packet = (uint8_t*) iter->header;
+  uint8_t* name   = iter->iter;
+  uint8_t* label;
+  uint16_t offset = 0;
+  int a;
+  
   dns_write_string( iter, src );
+  if ( names == NULL )
+    return;
+  
+  for ( label = name; *label != 0 && ( *label & 0xC0 ) == 0 && offset == 0; label += *label + 1 )
+  {
+    for ( a = 0; a < names->count; ++a )
+    {
+      if ( dns_compare_labels( packet, packet + names->offsets[a], label ) )
+      {
+        offset = names->offsets[a];
+        break;
+      }
+    }
+    if ( offset != 0 )
+    {
+      label[0] = 0xC0 | ( offset >> 8 );
+      label[1] = offset & 0xFF;
+      iter->iter = label + 2;
+      break;
+    }
+  }
+  
+  /* Remember the labels written out in full for the following names */
+  for ( ; name < label && names->count < MDNS_NAME_TABLE_SIZE; name += *name + 1 )
+    names->offsets[names->count++] = name - packet;
+}
+
+static void mdns_start_response( dns_message_iterator_t* response, uint8_t* packet, uint16_t size, dns_name_table_t* names )
+{
+  response->header = (dns_message_header_t*) packet;
+  response->iter   = packet + sizeof(dns_message_header_t);
+  response->end    = packet + size;
+  names->count     = 0;
+}
+
+/* Serialize the responses of our service. Every name written uncompressed would take
+   strlen + 2 bytes, so the size is checked with that before anything is written */
+static int mdns_build_responses( uint32_t ip, uint32_t ttl )
+{
+  dns_sd_service_record_t* service = available_services;
+  dns_name_table_t names;
+  size_t service_len, instance_len, host_len, txt_len;
+
+  if ( service == NULL || service->service_name == NULL || service->hostname == NULL || service->instance_name == NULL )
+    return 0;
+
+  service_len  = strlen( service->service_name ) + 2;
+  instance_len = strlen( service->instance_name ) + 2;
+  host_len     = strlen( service->hostname ) + 2;
+  txt_len      = service->txt_att ? strlen( service->txt_att ) + 2 : 1;
+
+  if ( sizeof(dns_message_header_t) + 10 + sizeof(MFi_SERVICE_QUERY_NAME) + 1 + service_len > MDNS_SHORT_RESPONSE_LENGTH ||
+       sizeof(dns_message_header_t) + 14 + 2 * host_len > MDNS_SHORT_RESPONSE_LENGTH ||
+       sizeof(dns_message_header_t) + 50 + service_len + 3 * instance_len + txt_len + 2 * host_len > MDNS_RESPONSE_LENGTH )
+  {
+    mdns_utils_log("ERROR: Bonjour records do not fit in a response.");
+    return 0;
+  }
+
+  mdns_start_response( &mdns_services_response, mdns_services_packet, sizeof(mdns_services_packet), &names );
+  dns_write_header( &mdns_services_response, 0x0, 0x8400, 0, 1, 0 );
+  dns_write_record( &mdns_services_response, &names, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, ttl, (uint8_t*) service->service_name );
+
+  mdns_start_response( &mdns_service_response, mdns_service_packet, sizeof(mdns_service_packet), &names );
+  dns_write_header( &mdns_service_response, 0x0, 0x8400, 0, 4, 0 );
+  dns_write_record( &mdns_service_response, &names, service->service_name, RR_CLASS_IN, RR_TYPE_PTR, ttl, (uint8_t*) service->instance_name );
+  dns_write_record( &mdns_service_response, &names, service->instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, ttl, (uint8_t*) ( service->txt_att ? service->txt_att : "" ) );
+  dns_write_record( &mdns_service_response, &names, service->instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, ttl, (uint8_t*) service );
+  dns_write_record( &mdns_service_response, &names, service->hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, ttl, (uint8_t*) &ip );
+
+  mdns_start_response( &mdns_host_response, mdns_host_packet, sizeof(mdns_host_packet), &names );
+  dns_write_header( &mdns_host_response, 0x0, 0x8400, 0, 1, 0 );
+  dns_write_record( &mdns_host_response, &names, service->hostname, RR_CLASS_IN | RR_CACHE_FLUSH, RR_TYPE_A, ttl ? 300 : 0, (uint8_t *) &ip );
+
+  return 1;
+}
+
+/* Read the IP address at most once every MDNS_IP_CHECK_INTERVAL once we have one, responses are
+   rebuilt when it changes */
+static uint32_t mdns_current_ip( bool force )
+{
+  IPStatusTypedef para;
+  uint32_t ip;
+
+  if ( force || mdns_ip == 0 || mico_get_time() - mdns_ip_check_time >= MDNS_IP_CHECK_INTERVAL )
+  {
+    micoWlanGetIPStatus(&para, _interface);
+    ip = htonl(inet_addr(para.ip));
+    mdns_ip_check_time = mico_get_time();
+    if ( ip != mdns_ip )
+    {
+      mdns_ip = ip;
+      mdns_responses_valid = false;
+    }
+  }
+  return mdns_ip;
+}
+
+static int mdns_responses_ready( void )
+{
+  if ( mdns_current_ip( false ) == 0 )
+    return 0;
+
+  if ( mdns_responses_valid == false )
+    mdns_responses_valid = mdns_build_responses( mdns_ip, 1500 );
+  return mdns_responses_valid;
+}
+
+static void mdns_send_response( int fd, dns_message_iterator_t* response, uint16_t id )
+{
+  response->header->id = id;  // Already in network byte order
+  mdns_send_message( fd, response );
 }
 
 
@@ -504,16 +600,16 @@ void bonjour_service_init(bonjour_init_t init)
 
   available_services->hostname = (char*)__strdup(init.host_name);
 
-  len = strlen(init.instance_name);
-  available_services->instance_name = (char*)malloc(len+3);//// 0xc00c+\0
-  memcpy(available_services->instance_name, init.instance_name, len);
-  available_services->instance_name[len]= 0xc0;
-  available_services->instance_name[len+1]= 0x0c;
-  available_services->instance_name[len+2]= 0;
+  /* instance.service.local., the service part is compressed when written */
+  len = strlen(init.instance_name) + strlen(init.service_name) + 2;
+  available_services->instance_name = (char*)malloc(len);
+  if(available_services->instance_name)
+    snprintf(available_services->instance_name, len, "%s.%s", init.instance_name, init.service_name);
   
   available_services->txt_att = (char*)__strdup(init.txt_record);
 
   available_services->port = init.service_port;
+  mdns_responses_valid = false;
   mico_rtos_unlock_mutex( &bonjour_mutex );
 }
 
@@ -524,6 +620,7 @@ void bonjour_update_txt_record(char *txt_record)
   if(available_services->txt_att)  free(available_services->txt_att);
   
   available_services->txt_att = (char*)__strdup(txt_record);
+  mdns_responses_valid = false;
 
   _bonjour_announce = 1;
   mico_rtos_unlock_mutex( &bonjour_mutex );
@@ -551,59 +648,22 @@ void mfi_mdns_handler(int fd, uint8_t* pkt, int pkt_len)
 
 void mfi_bonjour_send(int fd)
 {
-  dns_message_iterator_t response;
-  uint32_t myip;
-  IPStatusTypedef para;
-  micoWlanGetIPStatus(&para, _interface);
-  myip = htonl(inet_addr(para.ip));
-  if(myip == 0) return;
-  int b = 0;
-    
-  if(dns_create_message( &response, 512 )) {
-    dns_write_header(&response, 0x0, 0x8400, 0, available_service_count, 0 );          
-    for ( b = 0; b < available_service_count; ++b ){
-      dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].service_name );
-    }
-    mdns_send_message(fd, &response );
-    dns_free_message( &response );
-  }
+  if ( !mdns_responses_ready() ) return;
 
-  for ( b = 0; b < available_service_count; ++b ){
-      if(dns_create_message( &response, 512 )){
-        dns_write_header( &response, 0x0, 0x8400, 0, 4, 0 );
-        dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].instance_name );
-        dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, 1500, (uint8_t*) available_services[b].txt_att );
-        dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, 1500, (uint8_t*) &available_services[b]);
-        dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, 1500, (uint8_t*) &myip);
-        mdns_send_message(fd, &response );
-        dns_free_message( &response );
-      }
-  }
+  mdns_send_response(fd, &mdns_services_response, 0x0 );
+  mdns_send_response(fd, &mdns_service_response, 0x0 );
 }
 
 
 void mfi_bonjour_remove_record(int fd)
 {
-  dns_message_iterator_t response;
-  uint32_t myip;
-  IPStatusTypedef para;
-  micoWlanGetIPStatus(&para, _interface);
-  myip = htonl(inet_addr(para.ip));
-  int b = 0;
-
-  for ( b = 0; b < available_service_count; ++b ){
-    if(dns_create_message( &response, 512 )){
-      dns_write_header( &response, 0x0, 0x8400, 0, 4, 0 );
-      dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, 0, (uint8_t*) available_services[b].instance_name );
-      dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, 0, (uint8_t*) available_services[b].txt_att );
-      dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, 0, (uint8_t*) &available_services[b]);
-      dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, 0, (uint8_t*) &myip);
-      mdns_send_message(fd, &response );
-      mico_thread_msleep(20);
-      mdns_send_message(fd, &response );
-      dns_free_message( &response );
-    }
+  /* Goodbye packets carry the same records with TTL 0 */
+  if ( mdns_build_responses( mdns_current_ip( true ), 0 ) ){
+    mdns_send_response(fd, &mdns_service_response, 0x0 );
+    mico_thread_msleep(20);
+    mdns_send_message(fd, &mdns_service_response );
   }
+  mdns_responses_valid = false;
 }
 
 int start_bonjour_service(void)
@@ -619,6 +679,7 @@ void suspend_bonjour_service(bool state)
     mfi_bonjour_remove_record(mDNS_fd);
   }
   else{
+    mdns_current_ip( true );
     _bonjour_announce = 1;
     _bonjour_announce_time = 0;
   }
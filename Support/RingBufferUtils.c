@@ -26,12 +26,32 @@
 #define ring_buffer_utils_log(M, ...) custom_log("RingBufferUtils", M, ##__VA_ARGS__)
 #define ring_buffer_utils_log_trace() custom_log_trace("RingBufferUtils")
 
+/* Data must be in memory before the index that publishes it, and read after the index that announces it */
+#if defined ( __GNUC__ ) && defined ( __arm__ )
+#define ring_buffer_barrier()         __asm volatile ( "dmb" ::: "memory" )
+#elif defined ( __GNUC__ )
+#define ring_buffer_barrier()         __sync_synchronize()
+#elif defined ( __IAR_SYSTEMS_ICC__ )
+#include <intrinsics.h>
+#define ring_buffer_barrier()         __DMB()
+#elif defined ( __CC_ARM )
+#define ring_buffer_barrier()         __dmb( 0xF )
+#else
+#error "ring_buffer_barrier() is not defined for this compiler"
+#endif
+
+/* index + count with count <= size, avoids a division on every access */
+#define ring_buffer_advance(rb, index, count)  ( ( (index) + (count) >= (rb)->size ) ? ( (index) + (count) - (rb)->size ) : ( (index) + (count) ) )
+
 OSStatus ring_buffer_init( ring_buffer_t* ring_buffer, uint8_t* buffer, uint32_t size )
 {
     ring_buffer->buffer     = (uint8_t*)buffer;
     ring_buffer->size       = size;
     ring_buffer->head       = 0;
     ring_buffer->tail       = 0;
+    ring_buffer->watermark  = 0;
+    ring_buffer->watermark_callback = NULL;
+    ring_buffer->watermark_arg      = NULL;
     return kNoErr;
 }
 
@@ -43,41 +63,46 @@ OSStatus ring_buffer_deinit( ring_buffer_t* ring_buffer )
 
 uint32_t ring_buffer_free_space( ring_buffer_t* ring_buffer )
 {
-  uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
-  return ((tail_to_end + ring_buffer->head) % ring_buffer->size);
+  return ring_buffer->size - 1 - ring_buffer_used_space( ring_buffer );
 }
 
 uint32_t ring_buffer_used_space( ring_buffer_t* ring_buffer )
 {
-  uint32_t head_to_end = ring_buffer->size - ring_buffer->head;
-  return ((head_to_end + ring_buffer->tail) % ring_buffer->size);
+  uint32_t head = ring_buffer->head;
+  uint32_t tail = ring_buffer->tail;
+  return ( tail >= head ) ? ( tail - head ) : ( ring_buffer->size - head + tail );
 }
 
 uint8_t ring_buffer_get_data( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t* contiguous_bytes )
 {
-  uint32_t head_to_end = ring_buffer->size - ring_buffer->head;
-  
-  *data = &(ring_buffer->buffer[ring_buffer->head]);
+  uint32_t head = ring_buffer->head;
+  uint32_t tail = ring_buffer->tail;
   
-  *contiguous_bytes = MIN(head_to_end, (head_to_end + ring_buffer->tail) % ring_buffer->size);
+  ring_buffer_barrier();
+  *data = &(ring_buffer->buffer[head]);
+  *contiguous_bytes = ( tail >= head ) ? ( tail - head ) : ( ring_buffer->size - head );
   return 0;
 }
 
 uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed )
 {
-  ring_buffer->head = (ring_buffer->head + bytes_consumed) % ring_buffer->size;
+  /* Finish reading the data before the producer may overwrite it */
+  ring_buffer_barrier();
+  ring_buffer->head = ring_buffer_advance( ring_buffer, ring_buffer->head, bytes_consumed );
   return 0;
 }
 
 uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length )
 {
-  uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
+  uint32_t tail = ring_buffer->tail;
+  uint32_t tail_to_end = ring_buffer->size - tail;
+  uint32_t free_space = ring_buffer_free_space( ring_buffer );
   
   /* Calculate the maximum amount we can copy */
-  uint32_t amount_to_copy = MIN(data_length, (ring_buffer->tail == ring_buffer->head) ? ring_buffer->size : (tail_to_end + ring_buffer->head) % ring_buffer->size);
+  uint32_t amount_to_copy = MIN(data_length, free_space);
   
   /* Copy as much as we can until we fall off the end of the buffer */
-  memcpy(&ring_buffer->buffer[ring_buffer->tail], data, MIN(amount_to_copy, tail_to_end));
+  memcpy(&ring_buffer->buffer[tail], data, MIN(amount_to_copy, tail_to_end));
   
   /* Check if we have more to copy to the front of the buffer */
   if (tail_to_end < amount_to_copy)
@@ -86,7 +111,82 @@ uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uin
   }
   
   /* Update the tail */
-  ring_buffer->tail = (ring_buffer->tail + amount_to_copy) % ring_buffer->size;
+  ring_buffer_commit( ring_buffer, amount_to_copy );
   
   return amount_to_copy;
 }
+
+uint32_t ring_buffer_peek( ring_buffer_t* ring_buffer, uint32_t offset, uint8_t* data, uint32_t data_length )
+{
+  uint32_t used = ring_buffer_used_space( ring_buffer );
+  uint32_t start, start_to_end, amount_to_copy;
+
+  if ( offset >= used )
+    return 0;
+
+  ring_buffer_barrier();
+  start = ring_buffer_advance( ring_buffer, ring_buffer->head, offset );
+  start_to_end = ring_buffer->size - start;
+  amount_to_copy = MIN( data_length, used - offset );
+
+  memcpy( data, &ring_buffer->buffer[start], MIN( amount_to_copy, start_to_end ) );
+  if ( start_to_end < amount_to_copy )
+  {
+    memcpy( data + start_to_end, ring_buffer->buffer, amount_to_copy - start_to_end );
+  }
+
+  return amount_to_copy;
+}
+
+uint32_t ring_buffer_read( ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length )
+{
+  uint32_t amount_to_copy = ring_buffer_peek( ring_buffer, 0, data, data_length );
+
+  if ( amount_to_copy > 0 )
+  {
+    ring_buffer_consume( ring_buffer, amount_to_copy );
+  }
+  return amount_to_copy;
+}
+
+uint8_t ring_buffer_reserve( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t* contiguous_bytes )
+{
+  uint32_t tail = ring_buffer->tail;
+  uint32_t tail_to_end = ring_buffer->size - tail;
+  uint32_t free_space = ring_buffer_free_space( ring_buffer );
+
+  *data = &(ring_buffer->buffer[tail]);
+  *contiguous_bytes = MIN( tail_to_end, free_space );
+  return 0;
+}
+
+uint8_t ring_buffer_commit( ring_buffer_t* ring_buffer, uint32_t bytes_written )
+{
+  uint32_t used;
+
+  /* Data written by the CPU or DMA must be visible before the new tail */
+  ring_buffer_barrier();
+  ring_buffer->tail = ring_buffer_advance( ring_buffer, ring_buffer->tail, bytes_written );
+
+  if ( ring_buffer->watermark_callback != NULL && bytes_written > 0 )
+  {
+    used = ring_buffer_used_space( ring_buffer );
+    if ( used >= ring_buffer->watermark )
+    {
+      ring_buffer->watermark_callback( ring_buffer->watermark_arg, used );
+    }
+  }
+  return 0;
+}
+
+OSStatus ring_buffer_set_watermark( ring_buffer_t* ring_buffer, uint32_t level, ring_buffer_watermark_callback_t callback, void* arg )
+{
+  if ( level >= ring_buffer->size )
+    return kParamErr;
+
+  ring_buffer->watermark_callback = NULL;
+  ring_buffer->watermark     = level;
+  ring_buffer->watermark_arg = arg;
+  ring_buffer->watermark_callback = ( level > 0 ) ? callback : NULL;
+  return kNoErr;
+}
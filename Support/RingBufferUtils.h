@@ -25,12 +25,24 @@
 
 #include "Common.h"
 
+/* Called from ring_buffer_commit or ring_buffer_write, in the producer's context. For the UART 
+   receive buffers that is the DMA or UART interrupt, so the callback must not block, take a mutex 
+   or allocate: signal a semaphore or push to a queue with no wait and let a thread do the work */
+typedef void (*ring_buffer_watermark_callback_t)( void* arg, uint32_t used_space );
+
+/* Safe for one producer and one consumer without locking: only the producer moves 
+   tail and only the consumer moves head. A DMA engine may be the producer, the 
+   driver publishes its position with ring_buffer_commit. One byte is kept free 
+   to tell a full buffer from an empty one. */
 typedef struct
 {
-  uint32_t  size;
-  uint32_t  head;
-  uint32_t  tail;
-  uint8_t*  buffer;
+  uint32_t           size;
+  volatile uint32_t  head;
+  volatile uint32_t  tail;
+  uint8_t*           buffer;
+  uint32_t           watermark;
+  ring_buffer_watermark_callback_t watermark_callback;
+  void*              watermark_arg;
 } ring_buffer_t;
 
 #ifndef MIN
@@ -51,6 +63,20 @@ uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed
 
 uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length );
 
+/* Copy up to data_length bytes out of the buffer and consume them, returns the bytes copied */
+uint32_t ring_buffer_read( ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length );
+
+/* Copy up to data_length bytes starting offset bytes after head without consuming them */
+uint32_t ring_buffer_peek( ring_buffer_t* ring_buffer, uint32_t offset, uint8_t* data, uint32_t data_length );
+
+/* Producer side zero copy: fill the contiguous free space returned by reserve, then commit it */
+uint8_t ring_buffer_reserve( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t* contiguous_bytes );
+
+uint8_t ring_buffer_commit( ring_buffer_t* ring_buffer, uint32_t bytes_written );
+
+/* Call callback each time a commit or write leaves at least level bytes in the buffer, level 0 disables it */
+OSStatus ring_buffer_set_watermark( ring_buffer_t* ring_buffer, uint32_t level, ring_buffer_watermark_callback_t callback, void* arg );
+
 #endif // __RingBufferUtils_h__
 
 
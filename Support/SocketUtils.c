@@ -72,6 +72,83 @@ exit:
     return err;
 }
 
+/* The socket layer has no vectored write, so small pieces are coalesced into one segment sized buffer to avoid a
+   small TCP segment per piece. Pieces of one segment or more are written directly from the caller's memory. The 
+   buffer is only allocated when two or more pieces can share a segment, and only as long as the longest such run.
+   Without it every piece is written on its own, which costs segments but not correctness. */
+OSStatus SocketSendv( int fd, const socket_iovec_t *inIov, int inIovCount )
+{
+    socket_utils_log_trace();
+    OSStatus err = kParamErr;
+    uint8_t *stage = NULL;
+    size_t stageLen = 0;
+    size_t runLen = 0, stageSize = 0;
+    int runCount = 0;
+    int i;
+
+    require( fd>=0, exit );
+    require( inIov, exit );
+    require( inIovCount > 0, exit );
+
+    if( inIovCount == 1 )
+        return SocketSend( fd, inIov[0].iov_base, inIov[0].iov_len );
+
+    /* Walk the pieces the same way as below to size the buffer */
+    for( i = 0; i < inIovCount; i++ )
+    {
+        if( inIov[i].iov_len == 0 ) continue;
+
+        if( runLen + inIov[i].iov_len > SocketSendv_Coalesce_Length || inIov[i].iov_len >= SocketSendv_Coalesce_Length )
+        {
+            if( runCount > 1 && runLen > stageSize ) stageSize = runLen;
+            runLen = 0;
+            runCount = 0;
+        }
+        if( inIov[i].iov_len < SocketSendv_Coalesce_Length )
+        {
+            runLen += inIov[i].iov_len;
+            runCount++;
+        }
+    }
+    if( runCount > 1 && runLen > stageSize ) stageSize = runLen;
+
+    if( stageSize )
+        stage = malloc( stageSize );
+    if( stage == NULL )
+        stageSize = 0;
+
+    for( i = 0; i < inIovCount; i++ )
+    {
+        if( inIov[i].iov_len == 0 ) continue;
+
+        if( stageLen + inIov[i].iov_len > stageSize && stageLen )
+        {
+            err = SocketSend( fd, stage, stageLen );
+            require_noerr( err, exit );
+            stageLen = 0;
+        }
+
+        if( stageLen + inIov[i].iov_len > stageSize )
+        {
+            err = SocketSend( fd, inIov[i].iov_base, inIov[i].iov_len );
+            require_noerr( err, exit );
+        }
+        else
+        {
+            memcpy( stage + stageLen, inIov[i].iov_base, inIov[i].iov_len );
+            stageLen += inIov[i].iov_len;
+        }
+    }
+
+    err = kNoErr;
+    if( stageLen )
+        err = SocketSend( fd, stage, stageLen );
+
+exit:
+    if( stage ) free( stage );
+    return err;
+}
+
 void SocketClose(int* fd)
 {
     int tempFd = *fd;
@@ -111,3 +188,126 @@ void SocketAccept(int *plocalTcpClientsPool, int maxClientsNum, int newFd)
     plocalTcpClientsPool[minFdIndex] = newFd;  
 }
 
+void SocketReactorInit( socket_reactor_t *reactor )
+{
+    memset( reactor, 0x0, sizeof(socket_reactor_t) );
+}
+
+OSStatus SocketReactorAdd( socket_reactor_t *reactor, socket_reactor_handler_t *handler )
+{
+    OSStatus err = kParamErr;
+    int i;
+
+    require( reactor && handler, exit );
+    require( handler->fd >= 0 && handler->fd < FD_SETSIZE, exit );
+
+    err = kNoResourcesErr;
+    for( i = 0; i < SocketReactor_Max_Handlers; i++ )
+    {
+        if( reactor->handlers[i] == NULL )
+        {
+            reactor->handlers[i] = handler;
+            err = kNoErr;
+            break;
+        }
+    }
+
+exit:
+    return err;
+}
+
+OSStatus SocketReactorAddEvent( socket_reactor_t *reactor, socket_reactor_handler_t *handler, mico_event event )
+{
+    OSStatus err = kNoResourcesErr;
+
+    handler->fd = mico_create_event_fd( event );
+    require( handler->fd >= 0, exit );
+    handler->isEventFd = true;
+    handler->events = kSocketReactorReadable;
+
+    err = SocketReactorAdd( reactor, handler );
+    if( err != kNoErr )
+    {
+        SocketCloseForOSEvent( &handler->fd );
+        handler->isEventFd = false;
+    }
+
+exit:
+    return err;
+}
+
+/* Safe to call from inside a callback, the handler is not touched by the reactor afterwards */
+void SocketReactorRemove( socket_reactor_t *reactor, socket_reactor_handler_t *handler )
+{
+    int i;
+
+    for( i = 0; i < SocketReactor_Max_Handlers; i++ )
+    {
+        if( reactor->handlers[i] == handler )
+            reactor->handlers[i] = NULL;
+    }
+
+    if( handler->isEventFd == true )
+    {
+        SocketCloseForOSEvent( &handler->fd );
+        handler->isEventFd = false;
+    }
+}
+
+static void _SocketReactorDispatch( socket_reactor_t *reactor, int index, SocketReactorCallback callback )
+{
+    socket_reactor_handler_t *handler = reactor->handlers[index];
+    OSStatus err;
+
+    if( handler == NULL || callback == NULL )
+        return;
+
+    err = callback( handler );
+    if( err != kNoErr && reactor->handlers[index] == handler )
+    {
+        SocketReactorRemove( reactor, handler );
+        if( handler->onClose ) handler->onClose( handler, err );
+    }
+}
+
+OSStatus SocketReactorRunOnce( socket_reactor_t *reactor, struct timeval_t *timeout )
+{
+    OSStatus err = kNoErr;
+    socket_reactor_handler_t *handler;
+    socket_reactor_handler_t *selected[SocketReactor_Max_Handlers];
+    fd_set readSet;
+    fd_set writeSet;
+    int maxFd = -1;
+    int selectResult;
+    int i;
+
+    FD_ZERO( &readSet );
+    FD_ZERO( &writeSet );
+    for( i = 0; i < SocketReactor_Max_Handlers; i++ )
+    {
+        handler = selected[i] = reactor->handlers[i];
+        if( handler == NULL ) continue;
+        if( handler->events & kSocketReactorReadable ) FD_SET( handler->fd, &readSet );
+        if( handler->events & kSocketReactorWritable ) FD_SET( handler->fd, &writeSet );
+        if( handler->events && handler->fd > maxFd ) maxFd = handler->fd;
+    }
+
+    selectResult = select( maxFd + 1, &readSet, &writeSet, NULL, timeout );
+    require_action( selectResult >= 0, exit, err = kConnectionErr );
+    if( selectResult == 0 ) goto exit;
+
+    /* A callback may remove other handlers or add new ones, only handlers that were selected on are served */
+    for( i = 0; i < SocketReactor_Max_Handlers; i++ )
+    {
+        handler = selected[i];
+        if( handler && reactor->handlers[i] == handler && ( handler->events & kSocketReactorWritable ) && FD_ISSET( handler->fd, &writeSet ) )
+            _SocketReactorDispatch( reactor, i, handler->onWritable );
+
+        if( handler && reactor->handlers[i] == handler && ( handler->events & kSocketReactorReadable ) && FD_ISSET( handler->fd, &readSet ) )
+            _SocketReactorDispatch( reactor, i, handler->onReadable );
+    }
+
+exit:
+    return err;
+}
+
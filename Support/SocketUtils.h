@@ -23,15 +23,63 @@
 #define __SocketUtils_h__
 
 #include "Common.h"
+#include "MICO.h"
+
+#define SocketSendv_Coalesce_Length     1460  //! Pieces smaller than one TCP segment are copied together before written
+
+typedef struct _socket_iovec_t {
+  const uint8_t *     iov_base;
+  size_t              iov_len;
+} socket_iovec_t;
 
 OSStatus SocketSend( int fd, const uint8_t *inBuf, size_t inBufLen );
 
+OSStatus SocketSendv( int fd, const socket_iovec_t *inIov, int inIovCount );
+
 void SocketClose(int* fd);
 
 void SocketCloseForOSEvent(int* fd);
 
 void SocketAccept(int *plocalTcpClientsPool, int maxClientsNum, int newFd);
 
+/* Socket reactor: one thread serves many connections. Every registered fd has a handler that is called back from 
+   SocketReactorRunOnce when the fd is readable or writable. An event fd made from a queue is readable while the queue 
+   has messages, so other threads wake the reactor by pushing to the queue. */
+
+#define SocketReactor_Max_Handlers      FD_SETSIZE
+
+#define kSocketReactorReadable          0x01
+#define kSocketReactorWritable          0x02
+
+typedef struct _socket_reactor_handler_t socket_reactor_handler_t;
+
+typedef OSStatus (*SocketReactorCallback)( socket_reactor_handler_t *handler );
+typedef void (*SocketReactorCloseCallback)( socket_reactor_handler_t *handler, OSStatus reason );
+
+struct _socket_reactor_handler_t {
+  int                           fd;
+  uint8_t                       events;         //! Events waited for, kSocketReactorReadable and/or kSocketReactorWritable
+  bool                          isEventFd;      //! true=fd is created by SocketReactorAddEvent and deleted on removal
+  SocketReactorCallback         onReadable;     //! Data or a connection is pending, or the event fd's queue is not empty
+  SocketReactorCallback         onWritable;     //! More data can be written
+  SocketReactorCloseCallback    onClose;        //! Handler is removed because a callback returned an error, may free it
+  void *                        userContext;
+};
+
+typedef struct _socket_reactor_t {
+  socket_reactor_handler_t *    handlers[SocketReactor_Max_Handlers];
+} socket_reactor_t;
+
+void SocketReactorInit( socket_reactor_t *reactor );
+
+OSStatus SocketReactorAdd( socket_reactor_t *reactor, socket_reactor_handler_t *handler );
+
+OSStatus SocketReactorAddEvent( socket_reactor_t *reactor, socket_reactor_handler_t *handler, mico_event event );
+
+void SocketReactorRemove( socket_reactor_t *reactor, socket_reactor_handler_t *handler );
+
+OSStatus SocketReactorRunOnce( socket_reactor_t *reactor, struct timeval_t *timeout );
+
 #endif // __SocketUtils_h__
 
 
@@ -81,6 +81,15 @@
 #define UART_WAKEUP_DISABLE    (0 << UART_WAKEUP_MASK_POSN) /**< UART can not wakeup MCU from stop mode */
 #define UART_WAKEUP_ENABLE     (1 << UART_WAKEUP_MASK_POSN) /**< UART can wake up MCU from stop mode */
 
+#define UART_FRAME_DEFAULT_IDLE_GAP  5   /**< Silence in ms that ends a frame when the MCU can not detect an idle line */
+
+typedef enum
+{
+    UART_FRAME_IDLE_LINE,       /**< A frame ends when the line goes idle, this is the default */
+    UART_FRAME_DELIMITER,       /**< A frame ends with a delimiter byte */
+    UART_FRAME_LENGTH_PREFIX,   /**< A frame carries the length of its data in a header field */
+} mico_uart_frame_mode_t;
+
 
 /******************************************************
  *                    Structures
@@ -101,6 +110,22 @@
  ******************************************************/
  typedef platform_uart_config_t                  mico_uart_config_t;
 
+ typedef platform_uart_frame_callback_t          mico_uart_frame_callback_t;
+
+ typedef platform_uart_tx_callback_t             mico_uart_tx_callback_t;
+
+typedef struct
+{
+    mico_uart_frame_mode_t      mode;
+    uint8_t                     delimiter;      /**< UART_FRAME_DELIMITER: byte that ends a frame */
+    uint8_t                     length_offset;  /**< UART_FRAME_LENGTH_PREFIX: offset of the length field */
+    uint8_t                     length_size;    /**< UART_FRAME_LENGTH_PREFIX: size of the length field, 1 or 2 bytes, little endian */
+    uint8_t                     length_extra;   /**< UART_FRAME_LENGTH_PREFIX: bytes after the counted data, e.g. a checksum */
+    uint32_t                    idle_gap;       /**< UART_FRAME_IDLE_LINE: silence in ms that ends a frame if the MCU can not detect an idle line, 0 for default */
+    mico_uart_frame_callback_t  callback;       /**< Optional, called from the UART interrupt when a frame boundary is received */
+    void*                       arg;            /**< Argument passed to callback */
+} mico_uart_framing_t;
+
 /******************************************************
  *                 Function Declarations
  ******************************************************/
@@ -160,6 +185,25 @@ OSStatus MicoUartFinalize( mico_uart_t uart );
 OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size );
 
 
+/** Queue data for transmit on a UART interface and return without waiting
+ *
+ * Transfers are sent in order, the next one is started by the DMA interrupt
+ * as soon as the previous one completes. On MCUs without a transmit queue the
+ * data is sent before returning and callback is called from the caller.
+ *
+ * @param  uart     : the UART interface
+ * @param  data     : pointer to the start of data, must stay valid until callback is called
+ * @param  size     : number of bytes to transmit
+ * @param  callback : optional, called with the result when the transfer is done, may run in interrupt context.
+ *                     Not called if an error is returned.
+ * @param  arg      : argument passed to callback
+ *
+ * @return    kNoErr          : on success.
+ * @return    kNoResourcesErr : if the transmit queue is full
+ */
+OSStatus MicoUartSendAsync( mico_uart_t uart, const void* data, uint32_t size, mico_uart_tx_callback_t callback, void* arg );
+
+
 /** Receive data on a UART interface
  *
  * @param  uart     : the UART interface
@@ -180,6 +224,33 @@ OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t tim
  */
 uint32_t MicoUartGetLengthInBuffer( mico_uart_t uart ); 
 
+/** Select how received data is split into frames by MicoUartRecvFrame
+ *
+ * @param  uart     : the UART interface
+ * @param  framing  : framing configuration
+ *
+ * @return    kNoErr          : on success.
+ * @return    kUnsupportedErr : if delimiters or callbacks are not supported by the MCU
+ */
+OSStatus MicoUartSetFraming( mico_uart_t uart, const mico_uart_framing_t* framing );
+
+/** Receive one frame on a UART interface, a UART interface with a receive ring buffer is required
+ *
+ * Returns as soon as a complete frame is received instead of waiting for the timeout,
+ * a frame longer than size is returned in several parts except for length prefixed frames.
+ *
+ * @param  uart       : the UART interface
+ * @param  data       : pointer to the buffer which will store the frame
+ * @param  size       : size of the buffer
+ * @param  frame_size : length of the received frame
+ * @param  timeout    : timeout in milisecond
+ *
+ * @return    kNoErr        : on success.
+ * @return    kTimeoutErr   : if no frame is received in time
+ * @return    kSizeErr      : if a length prefixed frame is larger than size, the frame is dropped
+ */
+OSStatus MicoUartRecvFrame( mico_uart_t uart, void* data, uint32_t size, uint32_t* frame_size, uint32_t timeout );
+
 /** @} */
 /** @} */
 